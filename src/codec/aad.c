@@ -11,6 +11,7 @@
 
 #include "aad.h"
 #include "../oscore/options.h"
+#include "../util/scratch.h"
 
 OscoreError aad_length(struct coap_option* options, u16_t opt_num, enum aead_algorithm aead_alg, array kid, array piv,
                        size_t* out) {
@@ -32,14 +33,17 @@ OscoreError aad_length(struct coap_option* options, u16_t opt_num, enum aead_alg
     try_cbor_oom(cbor_encode_byte_string(&array_enc, piv.ptr, piv.len));
     // options
     u32_t encoded_opt_i_len = encoded_option_len(options, opt_num, CLASS_I);
-    u8_t encoded_opt_i_bytes[encoded_opt_i_len];
+    size_t mark = scratch_mark();
     array opts_i = {
         .len = encoded_opt_i_len,
-        .ptr = encoded_opt_i_bytes,
+        .ptr = scratch_alloc(encoded_opt_i_len),
     };
+    ensure(opts_i.ptr != NULL, OscoreScratchExhausted);
     u32_t size = encode_options(options, opt_num, CLASS_I, &opts_i.ptr[0]);
     assert_eq(size, encoded_opt_i_len);
-    try_cbor_oom(cbor_encode_byte_string(&array_enc, opts_i.ptr, opts_i.len));
+    CborError encoded = cbor_encode_byte_string(&array_enc, opts_i.ptr, opts_i.len);
+    scratch_release(mark);
+    try_cbor_oom(encoded);
     // finish up
     try_cbor_oom(cbor_encoder_close_container(&enc, &array_enc));
     *out = cbor_encoder_get_extra_bytes_needed(&enc);
@@ -66,14 +70,17 @@ OscoreError create_aad(struct coap_option* options, u16_t opt_num, enum aead_alg
     try_cbor(cbor_encode_byte_string(&array_enc, piv.ptr, piv.len));
     // options
     u32_t encoded_opt_i_len = encoded_option_len(options, opt_num, CLASS_I);
-    u8_t encoded_opt_i_bytes[encoded_opt_i_len];
+    size_t mark = scratch_mark();
     array opts_i = {
         .len = encoded_opt_i_len,
-        .ptr = encoded_opt_i_bytes,
+        .ptr = scratch_alloc(encoded_opt_i_len),
     };
+    ensure(opts_i.ptr != NULL, OscoreScratchExhausted);
     u32_t size = encode_options(options, opt_num, CLASS_I, &opts_i.ptr[0]);
     assert_eq(size, encoded_opt_i_len);
-    try_cbor(cbor_encode_byte_string(&array_enc, opts_i.ptr, opts_i.len));
+    CborError encoded = cbor_encode_byte_string(&array_enc, opts_i.ptr, opts_i.len);
+    scratch_release(mark);
+    try_cbor(encoded);
     // finish up
     try_cbor(cbor_encoder_close_container(&enc, &array_enc));
     return OscoreNoError;
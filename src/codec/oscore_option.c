@@ -25,11 +25,19 @@
 // h: kid context flag (if kid context is contained)
 
 OscoreError from_oscore_option(array option_value, struct unprotected* unprotected) {
-    ensure(option_value.len != 0, OscoreInvalidOptionLength);
+    // "If the OSCORE flag bits are all zero (0x00), the option value SHALL be empty"
+    if (option_value.len == 0) {
+        unprotected->partial_iv.len = 0;
+        unprotected->kid.len = 0;
+        unprotected->kid_context.len = 0;
+        return OscoreNoError;
+    }
     // oscore octet: 0b000hknnn
     u8_t h = (u8_t)(option_value.ptr[0] & 0b00010000) >> 4;
     u8_t k = (u8_t)(option_value.ptr[0] & 0b00001000) >> 3;
     u8_t n = (u8_t)(option_value.ptr[0] & 0b00000111);
+    // `s` follows the Partial IV
+    ensure(option_value.len >= 1 + n + h, OscoreInvalidOptionLength);
     u8_t s = h != 0 ? (u8_t)(option_value.ptr[1 + n]) : (u8_t)0;
 
     // verify option length
@@ -81,6 +89,10 @@ OscoreError to_oscore_option(struct unprotected unprotected, array option_value)
     u8_t k = (u8_t)(unprotected.kid.ptr != NULL) << 3;
     ensure(unprotected.partial_iv.len < 8, OscoreInvalidPartialIvLength);
     u8_t n = (u8_t)unprotected.partial_iv.len;
+    if ((h | k | n) == 0) {
+        // empty option value, e.g. for a response reusing the request's nonce
+        return OscoreNoError;
+    }
     option_value.ptr[0] = h | k | n;
     int index = 1;
     // partial IV
@@ -108,6 +120,9 @@ OscoreError to_oscore_option(struct unprotected unprotected, array option_value)
 
 size_t option_value_length(struct unprotected unprotected) {
     // flag-byte + piv + [kidcontext-len + kidcontext] + kid
+    if (unprotected.partial_iv.len == 0 && unprotected.kid.ptr == NULL && unprotected.kid_context.ptr == NULL) {
+        return 0;
+    }
     size_t kid_context_len = (unprotected.kid_context.ptr == NULL ? 0 : 1 + unprotected.kid_context.len);
     return 1 + unprotected.partial_iv.len + kid_context_len + unprotected.kid.len;
 }
@@ -10,24 +10,178 @@
  */
 
 #include <tinycrypt/ccm_mode.h>
+#include <string.h>
 #include "aes.h"
 
-OscoreError aes_ccm_encrypt(u8_t* key, u8_t* nonce, array plaintext, array ad, array ciphertext) {
+OscoreError aes_expand_key(const u8_t* key, struct tc_aes_key_sched_struct* out) {
+    try_tc(tc_aes128_set_encrypt_key(out, key));
+    return OscoreNoError;
+}
+
+/**
+ * Configures TinyCrypt's CCM mode, which keeps non-const pointers to the key schedule and nonce.
+ * @param sched key schedule, copied into @a sched_copy
+ * @param nonce 13-byte nonce, copied into @a nonce_copy
+ * @param sched_copy copy of the key schedule which has to outlive @a ccm_mode
+ * @param nonce_copy 13-byte copy of the nonce which has to outlive @a ccm_mode
+ * @param ccm_mode out-pointer to the CCM mode to configure
+ * @return OscoreError
+ */
+static OscoreError ccm_config(const struct tc_aes_key_sched_struct* sched, const u8_t* nonce,
+                              struct tc_aes_key_sched_struct* sched_copy, u8_t* nonce_copy,
+                              struct tc_ccm_mode_struct* ccm_mode) {
+    *sched_copy = *sched;
+    memcpy(nonce_copy, nonce, 13);
+    try_tc(tc_ccm_config(ccm_mode, sched_copy, nonce_copy, 13, 8));
+    return OscoreNoError;
+}
+
+OscoreError aes_ccm_encrypt(const struct tc_aes_key_sched_struct* sched, const u8_t* nonce, array plaintext,
+                            array ad, array ciphertext) {
     ensure_eq(ciphertext.len, plaintext.len + 8, OscoreInvalidOutLength);
-    struct tc_aes_key_sched_struct s;
-    try_tc(tc_aes128_set_encrypt_key(&s, key));
+    struct tc_aes_key_sched_struct sched_copy;
+    u8_t nonce_copy[13];
     struct tc_ccm_mode_struct ccm_mode;
-    try_tc(tc_ccm_config(&ccm_mode, &s, nonce, 13, 8));
+    try(ccm_config(sched, nonce, &sched_copy, nonce_copy, &ccm_mode));
     try_tc(tc_ccm_generation_encryption(ciphertext.ptr, ciphertext.len, ad.ptr, ad.len, plaintext.ptr, plaintext.len, &ccm_mode));
     return OscoreNoError;
 }
 
-OscoreError aes_ccm_decrypt(u8_t* key, u8_t* nonce, array ciphertext, array ad, array plaintext) {
+OscoreError aes_ccm_decrypt(const struct tc_aes_key_sched_struct* sched, const u8_t* nonce, array ciphertext,
+                            array ad, array plaintext) {
     ensure_eq(plaintext.len, ciphertext.len - 8, OscoreInvalidOutLength);
-    struct tc_aes_key_sched_struct s;
-    try_tc(tc_aes128_set_encrypt_key(&s, key));
+    struct tc_aes_key_sched_struct sched_copy;
+    u8_t nonce_copy[13];
     struct tc_ccm_mode_struct ccm_mode;
-    try_tc(tc_ccm_config(&ccm_mode, &s, nonce, 13, 8));
+    try(ccm_config(sched, nonce, &sched_copy, nonce_copy, &ccm_mode));
     try_tc(tc_ccm_decryption_verification(plaintext.ptr, plaintext.len, ad.ptr, ad.len, ciphertext.ptr, ciphertext.len, &ccm_mode));
     return OscoreNoError;
 }
+
+/// CCM length field size: the nonce is 13 bytes, leaving 2 bytes for the message length
+#define CCM_L 2
+
+/**
+ * XORs a byte into the CBC-MAC state, encrypting the state whenever a block is complete.
+ * @param stream Stream state
+ * @param byte byte to authenticate
+ * @param pos position within the current block
+ * @return OscoreError
+ */
+static OscoreError mac_byte(struct aes_ccm_stream* stream, u8_t byte, u8_t* pos) {
+    stream->mac[(*pos)++] ^= byte;
+    if (*pos == 16) {
+        try_tc(tc_aes_encrypt(stream->mac, stream->mac, &stream->sched));
+        *pos = 0;
+    }
+    return OscoreNoError;
+}
+
+OscoreError aes_ccm_stream_init(struct aes_ccm_stream* stream, const struct tc_aes_key_sched_struct* sched,
+                                const u8_t* nonce, array ad, size_t len) {
+    ensure(len <= 0xffff, OscoreOutTooLong);
+    // ad lengths of 0xff00 and above would need a longer length encoding
+    ensure(ad.len < 0xff00, OscoreOutTooLong);
+    stream->sched = *sched;
+
+    // B_0 = Flags || Nonce || l(m)
+    stream->mac[0] = (u8_t)((ad.len > 0 ? 0x40 : 0) | (((AES_CCM_TAG_LEN - 2) / 2) << 3) | (CCM_L - 1));
+    memcpy(&stream->mac[1], nonce, 13);
+    stream->mac[14] = (u8_t)(len >> 8);
+    stream->mac[15] = (u8_t)len;
+    try_tc(tc_aes_encrypt(stream->mac, stream->mac, &stream->sched));
+
+    // l(a) || a, padded with zeroes
+    if (ad.len > 0) {
+        u8_t pos = 0;
+        try(mac_byte(stream, (u8_t)(ad.len >> 8), &pos));
+        try(mac_byte(stream, (u8_t)ad.len, &pos));
+        for (size_t i = 0; i < ad.len; i++) {
+            try(mac_byte(stream, ad.ptr[i], &pos));
+        }
+        if (pos > 0) {
+            try_tc(tc_aes_encrypt(stream->mac, stream->mac, &stream->sched));
+        }
+    }
+
+    // A_i = Flags || Nonce || i, starting with A_1 for the message
+    stream->ctr[0] = CCM_L - 1;
+    memcpy(&stream->ctr[1], nonce, 13);
+    stream->ctr[14] = 0;
+    stream->ctr[15] = 0;
+    stream->pos = 0;
+    stream->remaining = len;
+    return OscoreNoError;
+}
+
+/**
+ * En- or decrypts the next chunk, authenticating the plaintext.
+ * @param stream Stream state
+ * @param in next chunk of the input
+ * @param out out-parameter, may be the same buffer as @a in
+ * @param encrypt whether @a in is the plaintext
+ * @return OscoreError
+ */
+static OscoreError ccm_stream_process(struct aes_ccm_stream* stream, array in, array out, bool encrypt) {
+    ensure_eq(in.len, out.len, OscoreInvalidOutLength);
+    ensure(in.len <= stream->remaining, OscoreOutTooLong);
+    for (size_t i = 0; i < in.len; i++) {
+        if (stream->pos == 0) {
+            if (++stream->ctr[15] == 0) {
+                stream->ctr[14]++;
+            }
+            try_tc(tc_aes_encrypt(stream->keystream, stream->ctr, &stream->sched));
+        }
+        u8_t plain = encrypt ? in.ptr[i] : (u8_t)(in.ptr[i] ^ stream->keystream[stream->pos]);
+        out.ptr[i] = in.ptr[i] ^ stream->keystream[stream->pos];
+        try(mac_byte(stream, plain, &stream->pos));
+    }
+    stream->remaining -= in.len;
+    return OscoreNoError;
+}
+
+OscoreError aes_ccm_stream_encrypt(struct aes_ccm_stream* stream, array plaintext, array ciphertext) {
+    return ccm_stream_process(stream, plaintext, ciphertext, true);
+}
+
+OscoreError aes_ccm_stream_decrypt(struct aes_ccm_stream* stream, array ciphertext, array plaintext) {
+    return ccm_stream_process(stream, ciphertext, plaintext, false);
+}
+
+OscoreError aes_ccm_stream_tag(struct aes_ccm_stream* stream, array tag) {
+    ensure_eq(tag.len, AES_CCM_TAG_LEN, OscoreInvalidOutLength);
+    ensure_eq(stream->remaining, 0, OscoreInvalidOutLength);
+    // the last block is padded with zeroes, which doesn't change the state
+    if (stream->pos > 0) {
+        try_tc(tc_aes_encrypt(stream->mac, stream->mac, &stream->sched));
+        stream->pos = 0;
+    }
+    // U = T XOR first-M-bytes(S_0)
+    stream->ctr[14] = 0;
+    stream->ctr[15] = 0;
+    try_tc(tc_aes_encrypt(stream->keystream, stream->ctr, &stream->sched));
+    for (size_t i = 0; i < AES_CCM_TAG_LEN; i++) {
+        tag.ptr[i] = stream->mac[i] ^ stream->keystream[i];
+    }
+    memset(stream->keystream, 0, sizeof(stream->keystream));
+    return OscoreNoError;
+}
+
+OscoreError aes_ccm_stream_verify(struct aes_ccm_stream* stream, array tag) {
+    ensure_eq(tag.len, AES_CCM_TAG_LEN, OscoreInvalidOutLength);
+    u8_t expected_bytes[AES_CCM_TAG_LEN];
+    array expected = {
+        .len = sizeof(expected_bytes),
+        .ptr = expected_bytes,
+    };
+    try(aes_ccm_stream_tag(stream, expected));
+    // constant time comparison
+    u8_t diff = 0;
+    for (size_t i = 0; i < AES_CCM_TAG_LEN; i++) {
+        diff |= expected_bytes[i] ^ tag.ptr[i];
+    }
+    if (diff != 0) {
+        return OscoreTinyCryptError;
+    }
+    return OscoreNoError;
+}
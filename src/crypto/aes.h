@@ -12,29 +12,112 @@
 #ifndef NONE_AES_H
 #define NONE_AES_H
 
+#include <tinycrypt/aes.h>
 #include "../util/array.h"
 #include "../util/error.h"
 
 /**
- * AES-CCM-16-64-128 Encryption
+ * Expands a 16-byte AES key into its key schedule, which the AES-CCM functions take instead of the key.
  * @param key 16-byte key
+ * @param out out-pointer to write the key schedule into
+ * @return OscoreError
+ */
+OscoreError aes_expand_key(const u8_t* key, struct tc_aes_key_sched_struct* out);
+
+/**
+ * AES-CCM-16-64-128 Encryption
+ * @param sched key schedule of the 16-byte key, see `aes_expand_key`
  * @param nonce 13-byte nonce
  * @param plaintext plaintext to encrypt
  * @param ad additional data to include in MAC calculation
  * @param ciphertext out-parameter to write ciphertext into, must have a length equal to the length of the plaintext + 8 bytes
  * @return OscoreError
  */
-OscoreError aes_ccm_encrypt(u8_t* key, u8_t* nonce, array plaintext, array ad, array ciphertext);
+OscoreError aes_ccm_encrypt(const struct tc_aes_key_sched_struct* sched, const u8_t* nonce, array plaintext, array ad,
+                            array ciphertext);
 
 /**
  * AES-CCM-16-64-128 Decryption
- * @param key 16-byte key
+ * @param sched key schedule of the 16-byte key, see `aes_expand_key`
  * @param nonce 13-byte nonce
  * @param ciphertext ciphertext to decrypt
  * @param ad additional data to include in MAC verification
  * @param plaintext out-parameter to write plaintext into, must have a length equal to the length of the ciphertext - 8 bytes
  * @return OscoreError
  */
-OscoreError aes_ccm_decrypt(u8_t* key, u8_t* nonce, array ciphertext, array ad, array plaintext);
+OscoreError aes_ccm_decrypt(const struct tc_aes_key_sched_struct* sched, const u8_t* nonce, array ciphertext, array ad,
+                            array plaintext);
+
+/// Length of the AES-CCM-16-64-128 authentication tag
+#define AES_CCM_TAG_LEN 8
+
+/**
+ * State of an incremental AES-CCM-16-64-128 en- / decryption.
+ *
+ * CCM needs the total message length in its first block B0, thus it has to be known up front.
+ * Afterwards the message can be passed in chunks of arbitrary length, so it never has to be held in memory at once.
+ */
+struct aes_ccm_stream {
+    struct tc_aes_key_sched_struct sched;
+    /// counter block A_i of the current key stream block
+    u8_t ctr[16];
+    /// CBC-MAC state X_i
+    u8_t mac[16];
+    /// key stream block S_i
+    u8_t keystream[16];
+    /// number of bytes of the current block which were already processed
+    u8_t pos;
+    /// number of message bytes which still need to be processed
+    size_t remaining;
+};
+
+/**
+ * Starts an incremental AES-CCM-16-64-128 en- or decryption and authenticates the additional data.
+ * @param stream Stream state to initialize
+ * @param sched key schedule of the 16-byte key, see `aes_expand_key`. It's copied into @a stream.
+ * @param nonce 13-byte nonce
+ * @param ad additional data to include in MAC calculation
+ * @param len total length of the plaintext, at most 65535 bytes
+ * @return OscoreError
+ */
+OscoreError aes_ccm_stream_init(struct aes_ccm_stream* stream, const struct tc_aes_key_sched_struct* sched,
+                                const u8_t* nonce, array ad, size_t len);
+
+/**
+ * Encrypts the next chunk of the plaintext.
+ * @param stream Initialized stream state
+ * @param plaintext next chunk of the plaintext
+ * @param ciphertext out-parameter to write the ciphertext into, must have the same length as @a plaintext.
+ *          May be the same buffer as @a plaintext.
+ * @return OscoreError
+ */
+OscoreError aes_ccm_stream_encrypt(struct aes_ccm_stream* stream, array plaintext, array ciphertext);
+
+/**
+ * Decrypts the next chunk of the ciphertext (without tag).
+ * The plaintext MUST NOT be used before `aes_ccm_stream_verify` succeeded.
+ * @param stream Initialized stream state
+ * @param ciphertext next chunk of the ciphertext
+ * @param plaintext out-parameter to write the plaintext into, must have the same length as @a ciphertext.
+ *          May be the same buffer as @a ciphertext.
+ * @return OscoreError
+ */
+OscoreError aes_ccm_stream_decrypt(struct aes_ccm_stream* stream, array ciphertext, array plaintext);
+
+/**
+ * Finishes an incremental encryption, after the whole plaintext was passed.
+ * @param stream Stream state
+ * @param tag out-parameter to write the AES_CCM_TAG_LEN-byte tag into
+ * @return OscoreError
+ */
+OscoreError aes_ccm_stream_tag(struct aes_ccm_stream* stream, array tag);
+
+/**
+ * Finishes an incremental decryption, after the whole ciphertext was passed.
+ * @param stream Stream state
+ * @param tag AES_CCM_TAG_LEN-byte tag which was received after the ciphertext
+ * @return OscoreError, OscoreTinyCryptError if the tag is invalid
+ */
+OscoreError aes_ccm_stream_verify(struct aes_ccm_stream* stream, array tag);
 
 #endif //NONE_AES_H
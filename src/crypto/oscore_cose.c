@@ -11,6 +11,7 @@
 
 #include "oscore_cose.h"
 #include "aes.h"
+#include "../util/scratch.h"
 
 // COSE Object:
 // protected: empty
@@ -50,42 +51,73 @@ static OscoreError enc_structure_length(array external_aad, size_t* out) {
     return OscoreNoError;
 }
 
-OscoreError from_oscore_cose_encrypt0(u8_t* key, u8_t* nonce, array ciphertext, array aad, array plaintext) {
+OscoreError from_oscore_cose_encrypt0(const struct tc_aes_key_sched_struct* key, const u8_t* nonce, array ciphertext,
+                                      array aad, array plaintext) {
     ensure_eq(plaintext.len, ciphertext.len - 8, OscoreInvalidOutLength);
 
     // get enc_structure
     size_t enc_structure_len;
     try(enc_structure_length(aad, &enc_structure_len));
 
-    u8_t enc_structure_bytes[enc_structure_len];
+    size_t mark = scratch_mark();
     array enc_structure = {
             .len = enc_structure_len,
-            .ptr = enc_structure_bytes,
+            .ptr = scratch_alloc(enc_structure_len),
     };
-    try(create_enc_structure(aad, enc_structure));
+    ensure(enc_structure.ptr != NULL, OscoreScratchExhausted);
+    OscoreError res = create_enc_structure(aad, enc_structure);
 
     // decrypt
-    try(aes_ccm_decrypt(&key[0], &nonce[0], ciphertext, enc_structure, plaintext));
-    return OscoreNoError;
+    if (res == OscoreNoError) {
+        res = aes_ccm_decrypt(key, &nonce[0], ciphertext, enc_structure, plaintext);
+    }
+    scratch_release(mark);
+    return res;
 }
 
-OscoreError to_oscore_cose_encrypt0(u8_t* key, u8_t* nonce, array plaintext, array aad, array payload) {
+OscoreError cose_encrypt0_stream_init(struct aes_ccm_stream* stream, const struct tc_aes_key_sched_struct* key,
+                                      const u8_t* nonce, array aad, size_t plaintext_len) {
+    size_t enc_structure_len;
+    try(enc_structure_length(aad, &enc_structure_len));
+
+    size_t mark = scratch_mark();
+    array enc_structure = {
+        .len = enc_structure_len,
+        .ptr = scratch_alloc(enc_structure_len),
+    };
+    ensure(enc_structure.ptr != NULL, OscoreScratchExhausted);
+    OscoreError res = create_enc_structure(aad, enc_structure);
+
+    // the Enc_structure is completely absorbed into the MAC state, so it can be dropped afterwards
+    if (res == OscoreNoError) {
+        res = aes_ccm_stream_init(stream, key, &nonce[0], enc_structure, plaintext_len);
+    }
+    scratch_release(mark);
+    return res;
+}
+
+OscoreError to_oscore_cose_encrypt0(const struct tc_aes_key_sched_struct* key, const u8_t* nonce, array plaintext,
+                                    array aad, array payload) {
     ensure_eq(payload.len, plaintext.len + 8, OscoreInvalidOutLength);
 
     // get enc_structure
     size_t enc_structure_len;
     try(enc_structure_length(aad, &enc_structure_len));
 
-    u8_t enc_structure_bytes[enc_structure_len];
+    size_t mark = scratch_mark();
     array enc_structure = {
         .len = enc_structure_len,
-        .ptr = enc_structure_bytes,
+        .ptr = scratch_alloc(enc_structure_len),
     };
-    try(create_enc_structure(aad, enc_structure));
+    ensure(enc_structure.ptr != NULL, OscoreScratchExhausted);
+    OscoreError res = create_enc_structure(aad, enc_structure);
 
     // encrypt
-    try(aes_ccm_encrypt(&key[0], &nonce[0], plaintext, enc_structure, payload));
-    return OscoreNoError;
+    if (res == OscoreNoError) {
+        res = aes_ccm_encrypt(key, &nonce[0], plaintext, enc_structure, payload);
+    }
+    scratch_release(mark);
+    return res;
 
     // This would have been the actual COSE_Encrypt0 encoding.
     // Due to the OSCORE Header Compression this isn't needed.
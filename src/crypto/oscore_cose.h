@@ -14,27 +14,42 @@
 
 #include "../util/array.h"
 #include "../util/error.h"
+#include "aes.h"
 
 /**
  * Encrypts the plaintext and encodes it as COSE_Encrypt0 structure
- * @param key 16-byte key
+ * @param key key schedule of the 16-byte key, see `aes_expand_key`
  * @param nonce 13-byte nonce
  * @param ciphertext AEAD'd ciphertext
  * @param aad additional data to include in MAC verification
  * @param plaintext out-parameter to write payload into, MUST be exactly ciphertext.len - 8 bytes long
  * @return OscoreError
  */
-OscoreError from_oscore_cose_encrypt0(u8_t* key, u8_t* nonce, array ciphertext, array aad, array plaintext);
+OscoreError from_oscore_cose_encrypt0(const struct tc_aes_key_sched_struct* key, const u8_t* nonce, array ciphertext,
+                                      array aad, array plaintext);
 
 /**
  * Encrypts the plaintext and encodes it as COSE_Encrypt0 structure
- * @param key 16-byte key
+ * @param key key schedule of the 16-byte key, see `aes_expand_key`
  * @param nonce 13-byte nonce
  * @param plaintext plaintext to encrypt
  * @param aad additional data to include in MAC calculation
  * @param payload out-parameter to write payload into, MUST be exactly plaintext.len + 8 bytes long
  * @return OscoreError
  */
-OscoreError to_oscore_cose_encrypt0(u8_t* key, u8_t* nonce, array plaintext, array aad, array payload);
+OscoreError to_oscore_cose_encrypt0(const struct tc_aes_key_sched_struct* key, const u8_t* nonce, array plaintext,
+                                    array aad, array payload);
+
+/**
+ * Starts an incremental en- or decryption of a COSE_Encrypt0 structure, whose plaintext is passed in chunks.
+ * @param stream Stream state to initialize
+ * @param key key schedule of the 16-byte key, see `aes_expand_key`
+ * @param nonce 13-byte nonce
+ * @param aad additional data to include in MAC calculation
+ * @param plaintext_len total length of the plaintext
+ * @return OscoreError
+ */
+OscoreError cose_encrypt0_stream_init(struct aes_ccm_stream* stream, const struct tc_aes_key_sched_struct* key,
+                                      const u8_t* nonce, array aad, size_t plaintext_len);
 
 #endif //NONE_OSCORE_COSE_H
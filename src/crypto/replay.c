@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include "replay.h"
+
+static u64_t sequence_number(array partial_iv) {
+    u64_t seq = 0;
+    for (size_t i = 0; i < partial_iv.len; i++) {
+        seq = (seq << 8) | partial_iv.ptr[i];
+    }
+    return seq;
+}
+
+bool replay_check(const struct replay_state* state, array partial_iv) {
+    if (!state->initialized) {
+        return true;
+    }
+    u64_t seq = sequence_number(partial_iv);
+    if (seq > state->highest) {
+        return true;
+    }
+    u64_t age = state->highest - seq;
+    return age < REPLAY_WINDOW_SIZE && (state->received & ((u32_t)1 << age)) == 0;
+}
+
+void replay_update(struct replay_state* state, array partial_iv) {
+    u64_t seq = sequence_number(partial_iv);
+    if (!state->initialized) {
+        state->highest = seq;
+        state->received = 1;
+        state->initialized = true;
+    } else if (seq > state->highest) {
+        u64_t shift = seq - state->highest;
+        state->received = shift < REPLAY_WINDOW_SIZE ? state->received << shift : 0;
+        state->received |= 1;
+        state->highest = seq;
+    } else if (state->highest - seq < REPLAY_WINDOW_SIZE) {
+        state->received |= (u32_t)1 << (state->highest - seq);
+    }
+}
+
+void replay_restart(struct replay_state* state, array partial_iv) {
+    state->highest = sequence_number(partial_iv);
+    // older Partial IVs in the window count as received, the ones below it are too old anyway
+    state->received = ~(u32_t)0;
+    state->initialized = true;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_REPLAY_H
+#define NONE_REPLAY_H
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include "../util/array.h"
+
+/// Number of sequence numbers below the highest received one which are still accepted (RFC6347 4.1.2.6)
+#define REPLAY_WINDOW_SIZE 32
+
+/// Sliding window of the Partial IVs received from a sender, the bit i of `received` stands for `highest - i`
+struct replay_state {
+    u64_t highest;
+    u32_t received;
+    /// false until the first message was verified, every Partial IV is accepted before
+    bool initialized;
+};
+
+/**
+ * Checks whether a Partial IV may be accepted, without changing the window.
+ * This is cheap enough to drop replays before anything is decrypted.
+ * @param state Replay window of the recipient context
+ * @param partial_iv Partial IV of the received message, at most 5 bytes
+ * @return true if the Partial IV wasn't received yet and isn't too old
+ */
+bool replay_check(const struct replay_state* state, array partial_iv);
+
+/**
+ * Marks a Partial IV as received. Must only be called after the message was verified, otherwise forged messages
+ * could move the window.
+ * @param state Replay window of the recipient context
+ * @param partial_iv Partial IV of the verified message, at most 5 bytes
+ */
+void replay_update(struct replay_state* state, array partial_iv);
+
+/**
+ * Restarts the window at the Partial IV of a verified message which is known to be fresh, e.g. after a reboot lost the
+ * window. Every lower Partial IV is rejected afterwards, as it may have been received before.
+ * @param state Replay window of the recipient context
+ * @param partial_iv Partial IV of the fresh message, at most 5 bytes
+ */
+void replay_restart(struct replay_state* state, array partial_iv);
+
+#endif //NONE_REPLAY_H
@@ -9,8 +9,10 @@
  * except according to those terms.
  */
 
+#include <string.h>
 #include "security_context.h"
 #include "hkdf.h"
+#include "aes.h"
 #include "../codec/hkdf_info.h"
 
 static enum aead_algorithm get_aead_alg(struct pre_established pre) {
@@ -29,11 +31,6 @@ static enum hkdf get_kdf(struct pre_established pre) {
     return pre.opt != NULL ? pre.opt->kdf : SHA_256;
 }
 
-static replay_window get_replay_window(struct pre_established pre) {
-    // TODO: correct default replay window
-    return pre.opt != NULL ? pre.opt->replay_window : NULL;
-}
-
 /**
  * Common derive procedure used to derive the Common IV and Sender / Recipient Keys
  * @param pre pre-established data
@@ -102,7 +99,6 @@ OscoreError derive_sender_context(struct pre_established pre, u8_t* sender_key_p
 }
 
 OscoreError derive_recipient_context(struct pre_established pre, u8_t* recipient_key_ptr, struct recipient_context* out) {
-    replay_window replay_window = get_replay_window(pre);
     array recipient_key = {
             .len = 16,
             .ptr = recipient_key_ptr,
@@ -111,9 +107,31 @@ OscoreError derive_recipient_context(struct pre_established pre, u8_t* recipient
     struct recipient_context ret = {
             .recipient_id = pre.recipient_id,
             .recipient_key = recipient_key,
-            .replay_window = replay_window,
     };
     *out = ret;
     return OscoreNoError;
 }
 
+OscoreError derive_security_context(struct pre_established pre, struct security_context* out) {
+    ensure(pre.sender_id.len <= OSCORE_MAX_ID_LEN, OscoreInvalidKidLength);
+    ensure(pre.recipient_id.len <= OSCORE_MAX_ID_LEN, OscoreInvalidKidLength);
+    struct common_context common;
+    struct sender_context sender;
+    struct recipient_context recipient;
+    u8_t sender_key[16];
+    u8_t recipient_key[16];
+    memset(out, 0, sizeof(*out));
+    try(derive_common_context(pre, &out->common_iv[0], &common));
+    try(derive_sender_context(pre, &sender_key[0], &sender));
+    try(derive_recipient_context(pre, &recipient_key[0], &recipient));
+
+    out->aead_alg = (u8_t) common.aead_alg;
+    out->sender_id_len = (u8_t) sender.sender_id.len;
+    memcpy(out->sender_id, sender.sender_id.ptr, sender.sender_id.len);
+    out->recipient_id_len = (u8_t) recipient.recipient_id.len;
+    memcpy(out->recipient_id, recipient.recipient_id.ptr, recipient.recipient_id.len);
+    // only the key schedules are kept
+    try(aes_expand_key(sender_key, &out->sender_sched));
+    try(aes_expand_key(recipient_key, &out->recipient_sched));
+    return OscoreNoError;
+}
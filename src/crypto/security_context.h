@@ -12,8 +12,10 @@
 #ifndef NONE_SECURITY_CONTEXT_H
 #define NONE_SECURITY_CONTEXT_H
 
+#include <tinycrypt/aes.h>
 #include "../util/array.h"
 #include "../util/error.h"
+#include "replay.h"
 
 // TODO: support multiple algorithms (with all of their different parameter sizes)
 // TODO: allow algorithms to be encoded as strings
@@ -92,10 +94,60 @@ struct sender_context {
 struct recipient_context {
     array recipient_id;
     array recipient_key;
-    // TODO: actually implement
-    replay_window replay_window;
+    /// Partial IVs of verified requests, zeroed on derivation
+    struct replay_state replay;
 };
 
+/// Maximum length of a Sender / Recipient ID: the AEAD nonce length of AES-CCM-16-64-128 minus 6 (RFC8613 5.2)
+#define OSCORE_MAX_ID_LEN 7
+/// Maximum length of a Master Secret or Master Salt kept for the derivation of a security context
+#define OSCORE_MAX_SECRET_LEN 32
+/// Maximum length of an ID Context kept for the derivation of a security context
+#define OSCORE_MAX_ID_CONTEXT_LEN 16
+
+#ifndef OSCORE_CACHE_LINE
+/// Alignment of `struct security_context`, so a context never shares a cache line with another one
+#define OSCORE_CACHE_LINE 64
+#endif
+
+/**
+ * Derived Common, Sender and Recipient Context of one peer as a fixed-size record without pointers.
+ *
+ * Everything needed to look up, prefilter and build the nonce of a message lies in the first cache line, followed by
+ * the expanded keys, so no key expansion is done per message. The Master Secret, Master Salt and ID Context are only
+ * needed for the derivation and aren't referenced. 448 bytes (7 cache lines).
+ */
+struct security_context {
+    /// Partial IVs of verified requests, zeroed on derivation
+    struct replay_state replay;
+    u8_t common_iv[13];
+    u8_t sender_seq_num[5];
+    u8_t sender_id_len;
+    u8_t recipient_id_len;
+    u8_t sender_id[OSCORE_MAX_ID_LEN];
+    u8_t recipient_id[OSCORE_MAX_ID_LEN];
+    /// `enum aead_algorithm`
+    u8_t aead_alg;
+    /// key schedules of the Sender and Recipient Key
+    struct tc_aes_key_sched_struct sender_sched;
+    struct tc_aes_key_sched_struct recipient_sched;
+} __attribute__((aligned(OSCORE_CACHE_LINE)));
+
+/// Sender ID of @a ctx, pointing into it
+static inline array context_sender_id(struct security_context* ctx) {
+    return (array) { .len = ctx->sender_id_len, .ptr = ctx->sender_id };
+}
+
+/// Recipient ID of @a ctx, pointing into it
+static inline array context_recipient_id(struct security_context* ctx) {
+    return (array) { .len = ctx->recipient_id_len, .ptr = ctx->recipient_id };
+}
+
+/// Common IV of @a ctx, pointing into it
+static inline array context_common_iv(struct security_context* ctx) {
+    return (array) { .len = sizeof(ctx->common_iv), .ptr = ctx->common_iv };
+}
+
 /**
  *
  * @param pre pre-established data
@@ -120,5 +172,12 @@ OscoreError derive_sender_context(struct pre_established pre, u8_t* sender_key_p
  * @return OscoreError
  */
 OscoreError derive_recipient_context(struct pre_established pre, u8_t* recipient_key_ptr, struct recipient_context* out);
+/**
+ * Derives the Common, Sender and Recipient Context of a peer. Nothing of @a pre is referenced afterwards.
+ * @param pre pre-established data
+ * @param out out-pointer (can be uninitialized)
+ * @return OscoreError, OscoreInvalidKidLength if an ID is longer than OSCORE_MAX_ID_LEN
+ */
+OscoreError derive_security_context(struct pre_established pre, struct security_context* out);
 
 #endif //NONE_SECURITY_CONTEXT_H
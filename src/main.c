@@ -20,6 +20,7 @@
 #include "main.h"
 #include "tests.h"
 #include "server/coap-server.h"
+#include "server/context_store.h"
 #include "server/ipsp.h"
 #include "oscore/oscore.h"
 #include "util/macros.h"
@@ -35,7 +36,9 @@ void main(void) {
     test_derive_recipient_key();
     test_derive_common_iv();
 
-    assert_eq(oscore_init(PRE_ESTABLISHED), OscoreNoError);
+    // restores the contexts of the last boot instead of deriving them, the unit tests run on the host, see
+    // port/posix/test_main.c
+    assert_no_error(context_store_load(&PRE_ESTABLISHED, 1));
     coap_server_init();
     ipsp_init();
 }
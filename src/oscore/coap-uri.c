@@ -19,7 +19,7 @@
  * @param s2 second string represented as array
  * @return true if the strings are equal ignoring their case, false otherwise
  */
-static bool strcasecmp(array s1, array s2) {
+static bool equals_ignore_case(array s1, array s2) {
     if (s1.len != s2.len) {
         return false;
     }
@@ -56,7 +56,7 @@ OscoreError coap_parse_uri(struct coap_option option, struct sockaddr_in6 to, st
     };
     array coap = { .len = 4, .ptr = (u8_t*)"coap" };
     array coaps = { .len = 5, .ptr = (u8_t*)"coaps" };
-    ensure(strcasecmp(opt_value, coap) || strcasecmp(opt_value, coaps), OscoreUriInvalidProtocol);
+    ensure(equals_ignore_case(opt_value, coap) || equals_ignore_case(opt_value, coaps), OscoreUriInvalidProtocol);
 
     // "4.  If |url| has a <fragment> component, then fail this algorithm."
     ensure(url.field_data[UF_FRAGMENT].len == 0, OscoreUriInvalidFragment);
@@ -11,6 +11,19 @@
 
 #include <net/udp.h>
 #include "coap_helper.h"
+#include "pkt_pool.h"
+
+void get_from_ip_addr(struct coap_packet* cpkt, struct sockaddr_in6* from) {
+    struct net_udp_hdr hdr;
+    struct net_udp_hdr* udp_hdr = net_udp_get_hdr(cpkt->pkt, &hdr);
+    if (!udp_hdr) {
+        return;
+    }
+
+    net_ipaddr_copy(&from->sin6_addr, &NET_IPV6_HDR(cpkt->pkt)->src);
+    from->sin6_port = udp_hdr->src_port;
+    from->sin6_family = AF_INET6;
+}
 
 OscoreError get_options(struct coap_packet* pkt, struct coap_option* options, u8_t* opt_num) {
     // we need to distinguish between actually parsed options and untouched ones to find out the actual opt_num
@@ -60,3 +73,77 @@ OscoreError read_payload(struct payload_info info, array payload) {
     ensure(!(ret == NULL && new_pos == 0xFFFF), OscoreNetPacketReadError);
     return OscoreNoError;
 }
+
+u16_t coap_message_len(struct coap_packet* packet) {
+    return (u16_t)(net_pkt_get_len(packet->pkt) - packet->offset);
+}
+
+OscoreError read_coap_message(struct coap_packet* packet, array out) {
+    ensure_eq(out.len, coap_message_len(packet), OscoreInvalidOutLength);
+    u16_t new_pos;
+    struct net_buf* ret = net_frag_read(packet->frag, packet->offset, &new_pos, (u16_t)out.len, &out.ptr[0]);
+    ensure(!(ret == NULL && new_pos == 0xFFFF), OscoreNetPacketReadError);
+    return OscoreNoError;
+}
+
+OscoreError coap_message_to_pkt(array message, s32_t timeout, struct net_pkt** out) {
+    struct net_pkt* pkt;
+    try(pkt_pool_get(false, timeout, &pkt));
+    if (!net_pkt_append_all(pkt, (u16_t)message.len, message.ptr, timeout)) {
+        net_pkt_unref(pkt);
+        return OscoreNetPacketAppendError;
+    }
+    *out = pkt;
+    return OscoreNoError;
+}
+
+OscoreError init_received_packet(struct coap_packet* request, u8_t coap_code, struct coap_packet* out) {
+    u8_t version = coap_header_get_version(request);
+    u8_t type = coap_header_get_type(request);
+    u8_t token[8];
+    u8_t tkl = coap_header_get_token(request, token);
+    u16_t id = coap_header_get_id(request);
+
+    struct net_pkt* pkt;
+    try(pkt_pool_get(true, OSCORE_PKT_TIMEOUT_MS, &pkt));
+
+    // We can't use coap_packet_init here, because we need to also add the original IPv6 and UDP header to the packet,
+    // which coap_packet_init doesn't allow. Thus we need to do the relevant work here.
+//    ensure_eq(coap_packet_init(out, pkt, version, type, tkl, (u8_t *)token, coap_code, id), 0, OscoreCoapPacketInitError);
+    u16_t ip_udp_header_len = request->offset;
+    out->pkt = pkt;
+    out->frag = pkt->frags;
+    out->offset = ip_udp_header_len;
+    out->hdr_len = 0;
+    // set opt_len and last_delta to zero, as they'll be set when we write the options with `coap_append_option`
+    out->opt_len = 0;
+    out->last_delta = 0;
+
+    // Restore IP and UDP header from request to newly built request
+    // The checksum and length field of the UDP header will be wrong, but those checks should already have happened anyways.
+    // TODO: calculate and set correct checksum and length
+    u8_t ip_udp_header[ip_udp_header_len];
+    u16_t pos;
+    struct net_buf* frag = net_frag_read(request->frag, 0, &pos, ip_udp_header_len, ip_udp_header);
+    ensure(!(frag == NULL && pos == 0xffff), OscorePktError);
+    ensure(net_pkt_append_all(pkt, ip_udp_header_len, ip_udp_header, K_SECONDS(1)), OscoreNetPacketAppendError);
+    net_pkt_set_ip_hdr_len(out->pkt, net_pkt_ip_hdr_len(request->pkt));
+    net_pkt_set_ipv6_ext_len(out->pkt, net_pkt_ipv6_ext_len(request->pkt));
+    net_pkt_set_family(out->pkt, net_pkt_family(request->pkt));
+    net_pkt_set_iface(out->pkt, net_pkt_iface(request->pkt));
+
+    ensure(version < 4, OscoreInvalidVersion);
+    ensure(type < 4, OscoreInvalidType);
+    ensure(tkl < 16, OscoreInvalidTokenLength);
+    u8_t info_byte = version << 6;
+    info_byte += type << 4;
+    info_byte += tkl;
+
+    ensure_eq(net_pkt_append_u8(pkt, info_byte), true, OscoreNetPacketAppendError);
+    ensure_eq(net_pkt_append_u8(pkt, coap_code), true, OscoreNetPacketAppendError);
+    ensure_eq(net_pkt_append_be16(pkt, id), true, OscoreNetPacketAppendError);
+    out->hdr_len += 4;
+    ensure_eq(net_pkt_append_all(pkt, tkl, token, K_SECONDS(1)), true, OscoreNetPacketAppendError);
+    out->hdr_len += tkl;
+    return OscoreNoError;
+}
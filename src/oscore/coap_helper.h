@@ -13,9 +13,17 @@
 #define NONE_COAP_HELPER_H
 
 #include <net/coap.h>
+#include <net/net_ip.h>
 #include "../util/error.h"
 #include "../util/array.h"
 
+/**
+ * Reads the source address and port of a received packet. @a from is left untouched if the packet has no UDP header.
+ * @param cpkt Received packet
+ * @param from out-pointer to write the address into
+ */
+void get_from_ip_addr(struct coap_packet* cpkt, struct sockaddr_in6* from);
+
 /**
  * Parses CoAP Options from given packet.
  * @param pkt Packet to parse CoAP Options from.
@@ -47,4 +55,38 @@ OscoreError get_payload_info(struct coap_packet* pkt, struct payload_info* info)
  */
 OscoreError read_payload(struct payload_info info, array payload);
 
+/**
+ * Returns the length of the CoAP message (header, options and payload) of a locally built packet.
+ * @param packet Packet initialized with `coap_packet_init`
+ * @return length in bytes
+ */
+u16_t coap_message_len(struct coap_packet* packet);
+
+/**
+ * Copies the CoAP message (header, options and payload) of a locally built packet into @a out.
+ * @param packet Packet initialized with `coap_packet_init`
+ * @param out Array with a length of `coap_message_len(packet)`
+ * @return OscoreError
+ */
+OscoreError read_coap_message(struct coap_packet* packet, array out);
+
+/**
+ * Allocates a new packet containing the given serialized CoAP message, e.g. to send it again.
+ * @param message Serialized CoAP message as read by `read_coap_message`
+ * @param timeout Timeout for the allocation of the packet and its fragments
+ * @param out out-pointer which will contain the new packet
+ * @return OscoreError
+ */
+OscoreError coap_message_to_pkt(array message, s32_t timeout, struct net_pkt** out);
+
+/**
+ * Initialize the packet at @a out, copy the request's UDP/IP and CoAP header with given @a coap_code.
+ * Options and payload need to be appended afterwards, e.g. to rebuild a received packet after decryption.
+ * @param request Request to copy UDP/IP and CoAP header (except CoAP Code) from
+ * @param coap_code CoAP Code to write to out-packet
+ * @param out packet to copy headers into
+ * @return OscoreError
+ */
+OscoreError init_received_packet(struct coap_packet* request, u8_t coap_code, struct coap_packet* out);
+
 #endif //NONE_COAP_HELPER_H
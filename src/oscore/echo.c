@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <string.h>
+#include <kernel.h>
+#include "echo.h"
+
+struct echo {
+    /// index + 1 of the challenged peer, 0 if unused
+    u16_t peer;
+    u8_t value[OSCORE_ECHO_LEN];
+    /// value of `issued` when the challenge was created, the lowest one is replaced first
+    u32_t age;
+};
+
+static struct echo echoes[OSCORE_ECHO_CHALLENGES];
+/// number of challenges created so far
+static u32_t issued;
+static struct k_mutex lock;
+
+static struct echo* find(u16_t peer) {
+    for (int i = 0; i < OSCORE_ECHO_CHALLENGES; i++) {
+        if (echoes[i].peer == peer + 1) {
+            return &echoes[i];
+        }
+    }
+    return NULL;
+}
+
+void echo_init(void) {
+    k_mutex_init(&lock);
+    memset(echoes, 0, sizeof(echoes));
+    issued = 0;
+}
+
+void echo_challenge(u16_t peer, u8_t* out) {
+    k_mutex_lock(&lock, K_FOREVER);
+    struct echo* echo = find(peer);
+    if (echo == NULL) {
+        // a free entry is taken before the oldest challenge is replaced
+        echo = &echoes[0];
+        for (int i = 1; i < OSCORE_ECHO_CHALLENGES && echo->peer != 0; i++) {
+            if (echoes[i].peer == 0 || echoes[i].age < echo->age) {
+                echo = &echoes[i];
+            }
+        }
+        // a value of an earlier boot must never match, so it's random instead of a counter
+        for (size_t i = 0; i < sizeof(echo->value); i += sizeof(u32_t)) {
+            u32_t random = sys_rand32_get();
+            memcpy(&echo->value[i], &random, sizeof(random));
+        }
+        echo->peer = (u16_t) (peer + 1);
+        echo->age = ++issued;
+    }
+    memcpy(out, echo->value, sizeof(echo->value));
+    k_mutex_unlock(&lock);
+}
+
+bool echo_verify(u16_t peer, array value) {
+    k_mutex_lock(&lock, K_FOREVER);
+    struct echo* echo = find(peer);
+    bool valid = echo != NULL && value.len == sizeof(echo->value) && memcmp(echo->value, value.ptr, value.len) == 0;
+    if (valid) {
+        echo->peer = 0;
+    }
+    k_mutex_unlock(&lock);
+    return valid;
+}
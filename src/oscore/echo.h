@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_ECHO_H
+#define NONE_ECHO_H
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include "../util/array.h"
+
+#ifndef OSCORE_ECHO_CHALLENGES
+/// Maximum number of peers challenged with an Echo Option at the same time, the oldest challenge is replaced
+#define OSCORE_ECHO_CHALLENGES 4
+#endif
+/// Length of an Echo value
+#define OSCORE_ECHO_LEN 8
+
+/**
+ * Forgets all outstanding challenges.
+ * Must be called once before any other echo function.
+ */
+void echo_init(void);
+
+/**
+ * Returns the Echo value a peer has to repeat in its next request. A peer which was challenged already gets the
+ * same value again, so every outstanding request can be answered with it.
+ * @param peer Index of the peer's security context
+ * @param out Buffer of OSCORE_ECHO_LEN bytes to write the Echo value into
+ */
+void echo_challenge(u16_t peer, u8_t* out);
+
+/**
+ * Checks the Echo value of a verified request and forgets the challenge if it matches.
+ * @param peer Index of the security context the request was verified with
+ * @param value Value of the request's Echo Option, NULL_ARRAY if it has none
+ * @return true if @a value is the outstanding challenge of @a peer
+ */
+bool echo_verify(u16_t peer, array value);
+
+#endif //NONE_ECHO_H
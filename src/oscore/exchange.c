@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <string.h>
+#include <kernel.h>
+#include "exchange.h"
+
+/// Number of hash buckets used to find an exchange by its token, must be a power of two
+#define NUM_TOKEN_BUCKETS 8
+
+struct exchange {
+    /// node in the age list, the oldest exchange is expired first
+    sys_dnode_t age_node;
+    /// node in the token bucket, unlinked while the exchange is unused
+    sys_dnode_t token_node;
+    u8_t token[8];
+    u8_t tkl;
+    bool observe;
+    u32_t expiry_ms;
+    struct oscore_request request;
+};
+
+static struct exchange exchanges[NUM_OSCORE_EXCHANGES];
+/// unused exchanges
+static sys_dlist_t free_list;
+/// outstanding requests, oldest first; Observe registrations don't expire and are kept at the front
+static sys_dlist_t age_list;
+static sys_dlist_t token_buckets[NUM_TOKEN_BUCKETS];
+static struct k_mutex lock;
+
+/// FNV-1a over the token, folded to the bucket count
+static sys_dlist_t* token_bucket(const u8_t* token, u8_t tkl) {
+    u32_t hash = 2166136261u;
+    for (int i = 0; i < tkl; i++) {
+        hash = (hash ^ token[i]) * 16777619u;
+    }
+    return &token_buckets[(hash ^ (hash >> 16)) & (NUM_TOKEN_BUCKETS - 1)];
+}
+
+static struct exchange* find(const u8_t* token, u8_t tkl) {
+    struct exchange* exchange;
+    SYS_DLIST_FOR_EACH_CONTAINER(token_bucket(token, tkl), exchange, token_node) {
+        if (exchange->tkl == tkl && memcmp(exchange->token, token, tkl) == 0) {
+            return exchange;
+        }
+    }
+    return NULL;
+}
+
+static void release(struct exchange* exchange) {
+    sys_dlist_remove(&exchange->token_node);
+    sys_dlist_remove(&exchange->age_node);
+    sys_dlist_append(&free_list, &exchange->age_node);
+}
+
+/// frees all requests which didn't get a response within EXCHANGE_LIFETIME
+static void expire(u32_t now) {
+    struct exchange* exchange;
+    struct exchange* next;
+    SYS_DLIST_FOR_EACH_CONTAINER_SAFE(&age_list, exchange, next, age_node) {
+        if (exchange->observe) {
+            continue;
+        }
+        if ((s32_t)(now - exchange->expiry_ms) < 0) {
+            break;
+        }
+        release(exchange);
+    }
+}
+
+void exchange_init(void) {
+    k_mutex_init(&lock);
+    sys_dlist_init(&free_list);
+    sys_dlist_init(&age_list);
+    for (int i = 0; i < NUM_TOKEN_BUCKETS; i++) {
+        sys_dlist_init(&token_buckets[i]);
+    }
+    for (int i = 0; i < NUM_OSCORE_EXCHANGES; i++) {
+        sys_dlist_append(&free_list, &exchanges[i].age_node);
+    }
+}
+
+OscoreError exchange_add(const u8_t* token, u8_t tkl, struct oscore_request* request, bool observe) {
+    ensure(tkl <= sizeof(((struct exchange*)0)->token), OscoreInvalidTokenLength);
+
+    k_mutex_lock(&lock, K_FOREVER);
+    expire(k_uptime_get_32());
+    if (find(token, tkl) != NULL) {
+        k_mutex_unlock(&lock);
+        return OscoreTokenInUse;
+    }
+    // outstanding requests are never replaced, their responses couldn't be verified anymore
+    sys_dnode_t* node = sys_dlist_get(&free_list);
+    if (node == NULL) {
+        k_mutex_unlock(&lock);
+        return OscoreTooManyExchanges;
+    }
+    struct exchange* exchange = CONTAINER_OF(node, struct exchange, age_node);
+    memcpy(exchange->token, token, tkl);
+    exchange->tkl = tkl;
+    exchange->observe = observe;
+    exchange->expiry_ms = k_uptime_get_32() + OSCORE_EXCHANGE_LIFETIME_MS;
+    exchange->request = *request;
+    if (observe) {
+        sys_dlist_prepend(&age_list, &exchange->age_node);
+    } else {
+        sys_dlist_append(&age_list, &exchange->age_node);
+    }
+    sys_dlist_append(token_bucket(token, tkl), &exchange->token_node);
+    k_mutex_unlock(&lock);
+    return OscoreNoError;
+}
+
+OscoreError exchange_find(const u8_t* token, u8_t tkl, struct oscore_request* out) {
+    k_mutex_lock(&lock, K_FOREVER);
+    expire(k_uptime_get_32());
+    struct exchange* exchange = find(token, tkl);
+    if (exchange == NULL) {
+        k_mutex_unlock(&lock);
+        return OscoreUnknownExchange;
+    }
+    *out = exchange->request;
+    k_mutex_unlock(&lock);
+    return OscoreNoError;
+}
+
+void exchange_complete(const u8_t* token, u8_t tkl) {
+    k_mutex_lock(&lock, K_FOREVER);
+    struct exchange* exchange = find(token, tkl);
+    if (exchange != NULL && !exchange->observe) {
+        release(exchange);
+    }
+    k_mutex_unlock(&lock);
+}
+
+void exchange_remove(const u8_t* token, u8_t tkl) {
+    k_mutex_lock(&lock, K_FOREVER);
+    struct exchange* exchange = find(token, tkl);
+    if (exchange != NULL) {
+        release(exchange);
+    }
+    k_mutex_unlock(&lock);
+}
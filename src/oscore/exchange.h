@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_EXCHANGE_H
+#define NONE_EXCHANGE_H
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include "oscore.h"
+
+/// Maximum number of protected requests awaiting a response at the same time (NSTART)
+#define NUM_OSCORE_EXCHANGES 8
+/// Time in milliseconds after which a request without response is forgotten (CoAP EXCHANGE_LIFETIME, RFC7252 4.8.2)
+#define OSCORE_EXCHANGE_LIFETIME_MS 247000
+
+/**
+ * Initializes the table of outstanding client requests.
+ * Must be called once before any other exchange function.
+ */
+void exchange_init(void);
+
+/**
+ * Remembers the request_kid and request_piv of a protected request until its response arrives.
+ * @param token Token of the request, it MUST be unique among all outstanding requests
+ * @param tkl Length of @a token
+ * @param request request_kid and request_piv of the request
+ * @param observe Whether the request registers an Observe relation. Such an exchange is kept for all notifications
+ *          until it is removed with `exchange_remove`.
+ * @return OscoreError, OscoreTooManyExchanges if NUM_OSCORE_EXCHANGES requests are outstanding
+ */
+OscoreError exchange_add(const u8_t* token, u8_t tkl, struct oscore_request* request, bool observe);
+
+/**
+ * Finds the outstanding request matching the token of a response.
+ * The exchange is kept, as the response still needs to be verified, see `exchange_complete`.
+ * @param token Token of the response
+ * @param tkl Length of @a token
+ * @param out out-pointer to write request_kid and request_piv of the request into
+ * @return OscoreError, OscoreUnknownExchange if no request with this token is outstanding
+ */
+OscoreError exchange_find(const u8_t* token, u8_t tkl, struct oscore_request* out);
+
+/**
+ * Marks the request as answered after its response was verified.
+ * The exchange is removed, unless it belongs to an Observe registration.
+ * @param token Token of the response
+ * @param tkl Length of @a token
+ */
+void exchange_complete(const u8_t* token, u8_t tkl);
+
+/**
+ * Forgets an outstanding request, e.g. if it was canceled or couldn't be sent. Unknown tokens are ignored.
+ * @param token Token of the request
+ * @param tkl Length of @a token
+ */
+void exchange_remove(const u8_t* token, u8_t tkl);
+
+#endif //NONE_EXCHANGE_H
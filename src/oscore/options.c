@@ -178,15 +178,17 @@ OscoreError decode_options(array options, struct coap_option* out, u16_t* offset
 u32_t encoded_option_len(struct coap_option* options, u16_t opt_num, enum option_class class) {
     bool (*condition)(u16_t) = class_to_condition(class);
     u32_t len = 0;
-    u16_t total_delta = 0;
+    u16_t code = 0;
+    u16_t last_code = 0;
     for (int i = 0; i < opt_num; i++) {
-        total_delta += options[i].delta;
-        u16_t code = total_delta;
+        code += options[i].delta;
         if (!condition(code)) {
             continue;
         }
 
-        len += 1 + option_field_len(options[i].delta) + option_field_len(options[i].len) + options[i].len;
+        // the delta is encoded relative to the last option of the requested class
+        len += 1 + option_field_len(code - last_code) + option_field_len(options[i].len) + options[i].len;
+        last_code = code;
     }
     return len;
 }
@@ -195,15 +197,16 @@ u32_t encode_options(struct coap_option* options, u16_t opt_num, enum option_cla
     bool (*condition)(u16_t) = class_to_condition(class);
 
     u32_t index = 0;
-    u16_t skipped_delta = 0;
+    u16_t code = 0;
+    u16_t last_code = 0;
     for (int i = 0; i < opt_num; i++) {
         // skip options which aren't of requested class
-        u16_t delta = options[i].delta + skipped_delta;
-        if (!condition(delta)) {
-            skipped_delta += options[i].delta;
+        code += options[i].delta;
+        if (!condition(code)) {
             continue;
         }
-        skipped_delta = 0;
+        u16_t delta = code - last_code;
+        last_code = code;
 
         struct coap_option option = options[i];
 
@@ -22,7 +22,6 @@
 #include <net/http_parser_url.h>
 #include <net/coap.h>
 #include "cbor.h"
-#include "../server/coap-server.h"
 #include "../crypto/aes.h"
 #include "../util/macros.h"
 #include "oscore.h"
@@ -33,7 +32,14 @@
 #include "../codec/aad.h"
 #include "../codec/oscore_option.h"
 #include "../codec/nonce.h"
+#include "exchange.h"
+#include "echo.h"
+#include "snapshot.h"
+#include "pkt_pool.h"
 #include "coap_helper.h"
+#include "../util/scratch.h"
+#include "../util/trace.h"
+#include "../util/profile.h"
 
 u8_t MASTER_SECRET[16] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
 u8_t SENDER_ID[1] = { 1 };
@@ -72,85 +78,460 @@ struct pre_established PRE_ESTABLISHED = {
     .opt = &OPT,
 };
 
-static u8_t common_iv[13];
-static u8_t sender_key[16];
-static u8_t recipient_key[16];
-static struct common_context cctx;
-static struct sender_context sctx;
-static struct recipient_context rctx;
+#if (OSCORE_CONTEXT_BUCKETS & (OSCORE_CONTEXT_BUCKETS - 1)) != 0
+#error "OSCORE_CONTEXT_BUCKETS must be a power of two"
+#endif
+#if defined(OSCORE_LAZY_CONTEXTS) && ((OSCORE_CONTEXT_SETS & (OSCORE_CONTEXT_SETS - 1)) != 0 || \
+    OSCORE_CONTEXT_SETS * OSCORE_CONTEXT_WAYS != OSCORE_DERIVED_CONTEXTS)
+#error "OSCORE_DERIVED_CONTEXTS must be a power of two multiple of OSCORE_CONTEXT_WAYS"
+#endif
 
-OscoreError oscore_init(struct pre_established pre_established) {
-    try(derive_common_context(pre_established, &common_iv[0], &cctx));
-    try(derive_sender_context(pre_established, &sender_key[0], &sctx));
-    try(derive_recipient_context(pre_established, &recipient_key[0], &rctx));
+/// Pre-established material of a peer besides its Recipient ID, copied so the caller's buffers may go away
+struct peer_material {
+    u8_t master_secret[OSCORE_MAX_SECRET_LEN];
+    u8_t master_salt[OSCORE_MAX_SECRET_LEN];
+    u8_t id_context[OSCORE_MAX_ID_CONTEXT_LEN];
+    u8_t sender_id[OSCORE_MAX_ID_LEN];
+    u8_t master_secret_len;
+    u8_t master_salt_len;
+    u8_t id_context_len;
+    u8_t sender_id_len;
+    /// an empty ID Context is derived differently from none
+    bool has_id_context;
+    /// `enum aead_algorithm`
+    u8_t aead_alg;
+};
+
+/// Pre-established material of a peer, the first one is used to protect requests
+struct peer {
+    /// Recipient ID, which requests are looked up by
+    u8_t kid[OSCORE_MAX_ID_LEN];
+    u8_t kid_len;
+    /// index + 1 of the peer's context in `derived`, 0 if it isn't derived
+    u16_t derived;
+    /// Sender Sequence Number and replay window while the peer's context isn't derived
+    u8_t sender_seq_num[5];
+    /// whether the replay window is unknown until a request echoes a challenge, see `oscore_require_echo`
+    bool echo_required;
+    struct replay_state replay;
+    /// Sender Sequence Number reserved by the last snapshot, 0 if there is none, see `oscore_snapshot_due`
+    u64_t seq_limit;
+    /// only needed to derive the context
+    struct peer_material material;
+};
+
+static struct peer peers[OSCORE_MAX_CONTEXTS];
+static size_t num_peers;
+/// index + 1 of the first peer of every bucket, 0 if it's empty
+static u16_t buckets[OSCORE_CONTEXT_BUCKETS];
+/// index + 1 of the next peer in the same bucket, 0 at the end
+static u16_t next_in_bucket[OSCORE_MAX_CONTEXTS];
+
+/// Derived security contexts, the ones of set i are at i * OSCORE_CONTEXT_WAYS
+static struct security_context derived[OSCORE_DERIVED_CONTEXTS];
+#ifdef OSCORE_LAZY_CONTEXTS
+/// index + 1 of the peer a derived context belongs to, 0 if it's unused
+static u16_t derived_peer[OSCORE_DERIVED_CONTEXTS];
+/// value of the set's clock when a derived context was used last
+static u32_t last_use[OSCORE_DERIVED_CONTEXTS];
+static u32_t set_clock[OSCORE_CONTEXT_SETS];
+#endif
+static struct oscore_context_stats context_stats;
+
+u32_t oscore_kid_hash(array kid) {
+    // FNV-1a
+    u32_t hash = 2166136261u;
+    for (size_t i = 0; i < kid.len; i++) {
+        hash = (hash ^ kid.ptr[i]) * 16777619u;
+    }
+    return hash;
+}
+
+u32_t oscore_kid_partition(array kid, u32_t partitions) {
+#ifdef OSCORE_LAZY_CONTEXTS
+    // all contexts of a set belong to the same partition, so a set is only ever changed by one thread
+    return (oscore_kid_hash(kid) & (OSCORE_CONTEXT_SETS - 1)) % partitions;
+#else
+    return oscore_kid_hash(kid) % partitions;
+#endif
+}
+
+/// Returns the index of the peer whose Recipient ID is @a kid, -1 if there is none
+static int find_recipient_peer(array kid) {
+    u16_t entry = buckets[oscore_kid_hash(kid) & (OSCORE_CONTEXT_BUCKETS - 1)];
+    while (entry != 0) {
+        const struct peer* peer = &peers[entry - 1];
+        if (peer->kid_len == kid.len && memcmp(peer->kid, kid.ptr, kid.len) == 0) {
+            return entry - 1;
+        }
+        entry = next_in_bucket[entry - 1];
+    }
+    return -1;
+}
+
+/// Recipient ID of @a peer, pointing into it
+static array peer_kid(struct peer* peer) {
+    array kid = {
+        .len = peer->kid_len,
+        .ptr = peer->kid,
+    };
+    return kid;
+}
+
+/// Sender ID of @a peer, pointing into it
+static array peer_sender_id(struct peer* peer) {
+    array sender_id = {
+        .len = peer->material.sender_id_len,
+        .ptr = peer->material.sender_id,
+    };
+    return sender_id;
+}
+
+/// Optional pre-established material of @a peer, pointing into it
+static struct pre_established_opt peer_opt(struct peer* peer) {
+    struct pre_established_opt opt = {
+        .aead_alg = (enum aead_algorithm) peer->material.aead_alg,
+        .master_salt = {
+            .len = peer->material.master_salt_len,
+            .ptr = peer->material.master_salt,
+        },
+        .kdf = SHA_256,
+        .replay_window = NULL,
+    };
+    return opt;
+}
+
+/// Pre-established material of @a peer, pointing into it and @a opt, see `peer_opt`
+static struct pre_established peer_pre_established(struct peer* peer, const struct pre_established_opt* opt) {
+    struct pre_established pre = {
+        .master_secret = {
+            .len = peer->material.master_secret_len,
+            .ptr = peer->material.master_secret,
+        },
+        .sender_id = peer_sender_id(peer),
+        .recipient_id = peer_kid(peer),
+        .common_id_context = {
+            .len = peer->material.id_context_len,
+            .ptr = peer->material.has_id_context ? peer->material.id_context : NULL,
+        },
+        .opt = opt,
+    };
+    return pre;
+}
+
+/// Returns the index of the peer whose Sender ID is @a kid, -1 if there is none
+static int find_sender_peer(array kid) {
+    for (size_t i = 0; i < num_peers; i++) {
+        if (array_equals(peer_sender_id(&peers[i]), kid)) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+/// Replay window of a peer, without deriving its context
+static const struct replay_state* peer_replay(const struct peer* peer) {
+    return peer->derived != 0 ? &derived[peer->derived - 1].replay : &peer->replay;
+}
+
+/**
+ * Returns the index in `derived` a peer's context is derived or restored into.
+ * With OSCORE_LAZY_CONTEXTS, it's the least recently used context of the peer's set, whose state is saved in its peer.
+ * @param index Index of the peer
+ * @return index of the context
+ */
+static size_t context_slot(size_t index) {
+#ifdef OSCORE_LAZY_CONTEXTS
+    u32_t set = oscore_kid_hash(peer_kid(&peers[index])) & (OSCORE_CONTEXT_SETS - 1);
+    size_t victim = set * OSCORE_CONTEXT_WAYS;
+    for (size_t i = victim; i < (set + 1) * OSCORE_CONTEXT_WAYS; i++) {
+        if (derived_peer[i] == 0) {
+            victim = i;
+            break;
+        }
+        if (last_use[i] < last_use[victim]) {
+            victim = i;
+        }
+    }
+    if (derived_peer[victim] != 0) {
+        // the keys can be derived again, the sequence number and replay window can't
+        struct security_context* ctx = &derived[victim];
+        struct peer* evicted = &peers[derived_peer[victim] - 1];
+        memcpy(evicted->sender_seq_num, ctx->sender_seq_num, sizeof(evicted->sender_seq_num));
+        evicted->replay = ctx->replay;
+        evicted->derived = 0;
+        derived_peer[victim] = 0;
+        context_stats.evictions++;
+    }
+    return victim;
+#else
+    // every peer has its own context
+    return index;
+#endif
+}
+
+/// Makes the context at @a slot the one of peer @a index, with the sequence number and replay window of the peer
+static void attach_context(size_t slot, size_t index) {
+    struct peer* peer = &peers[index];
+    struct security_context* ctx = &derived[slot];
+    memcpy(ctx->sender_seq_num, peer->sender_seq_num, sizeof(peer->sender_seq_num));
+    ctx->replay = peer->replay;
+#ifdef OSCORE_LAZY_CONTEXTS
+    derived_peer[slot] = (u16_t) (index + 1);
+#endif
+    peer->derived = (u16_t) (slot + 1);
+}
+
+/// Derives the context of a peer, see `context_slot`
+static OscoreError derive_peer_context(size_t index) {
+    size_t slot = context_slot(index);
+    struct pre_established_opt opt = peer_opt(&peers[index]);
+    try(derive_security_context(peer_pre_established(&peers[index], &opt), &derived[slot]));
+    attach_context(slot, index);
+    context_stats.derivations++;
     return OscoreNoError;
 }
 
 /**
- * Initialize the packet at @a out, copy the request's UDP/IP and CoAP header with given @a coap_code.
- * @param request Request to copy UDP/IP and CoAP header (except CoAP Code) from
- * @param coap_code CoAP Code to write to out-packet
- * @param out packet to copy headers into
+ * Returns the derived security context of a peer, deriving it first if it isn't.
+ * The context stays valid until the next call for another peer of the same set.
+ * @param index Index of the peer
+ * @param out out-pointer to the security context
  * @return OscoreError
  */
-static OscoreError init_decrypted_packet(struct coap_packet* request, u8_t coap_code, struct coap_packet* out) {
-    struct sockaddr_in6 from;
-    get_from_ip_addr(request, &from);
+static OscoreError peer_context(size_t index, struct security_context** out) {
+    struct peer* peer = &peers[index];
+#ifdef OSCORE_LAZY_CONTEXTS
+    if (peer->derived == 0) {
+        try(derive_peer_context(index));
+    }
+    last_use[peer->derived - 1] = ++set_clock[(peer->derived - 1) / OSCORE_CONTEXT_WAYS];
+#endif
+    *out = &derived[peer->derived - 1];
+    return OscoreNoError;
+}
 
-    u8_t version = coap_header_get_version(request);
-    u8_t type = coap_header_get_type(request);
-    u8_t token[8];
-    u8_t tkl = coap_header_get_token(request, token);
-    u16_t id = coap_header_get_id(request);
-
-    struct net_pkt* pkt = net_pkt_get_rx(context, K_FOREVER);
-    ensure(pkt != NULL, OscorePktError);
-    struct net_buf* frag = net_pkt_get_data(context, K_FOREVER);
-    ensure(frag != NULL, OscorePktError);
-    net_pkt_frag_add(pkt, frag);
-
-    // We can't use coap_packet_init here, because we need to also add the original IPv6 and UDP header to the packet,
-    // which coap_packet_init doesn't allow. Thus we need to do the relevant work here.
-//    ensure_eq(coap_packet_init(out, pkt, version, type, tkl, (u8_t *)token, coap_code, id), 0, OscoreCoapPacketInitError);
-    u16_t ip_udp_header_len = request->offset;
-    out->pkt = pkt;
-    out->frag = pkt->frags;
-    out->offset = ip_udp_header_len;
-    out->hdr_len = 0;
-    // set opt_len and last_delta to zero, as they'll be set when we write the options with `coap_append_option`
-    out->opt_len = 0;
-    out->last_delta = 0;
-
-    // Restore IP and UDP header from request to newly built request
-    // The checksum and length field of the UDP header will be wrong, but those checks should already have happened anyways.
-    // TODO: calculate and set correct checksum and length
-    u8_t ip_udp_header[ip_udp_header_len];
-    u16_t pos;
-    frag = net_frag_read(request->frag, 0, &pos, ip_udp_header_len, ip_udp_header);
-    ensure(!(frag == NULL && pos == 0xffff), OscorePktError);
-    ensure(net_pkt_append_all(pkt, ip_udp_header_len, ip_udp_header, K_SECONDS(1)), OscoreNetPacketAppendError);
-    get_from_ip_addr(request, &from);
-    net_pkt_set_ip_hdr_len(out->pkt, net_pkt_ip_hdr_len(request->pkt));
-    net_pkt_set_ipv6_ext_len(out->pkt, net_pkt_ipv6_ext_len(request->pkt));
-    net_pkt_set_family(out->pkt, net_pkt_family(request->pkt));
-    net_pkt_set_iface(out->pkt, net_pkt_iface(request->pkt));
-
-    ensure(version < 4, OscoreInvalidVersion);
-    ensure(type < 4, OscoreInvalidType);
-    ensure(tkl < 16, OscoreInvalidTokenLength);
-    u8_t info_byte = version << 6;
-    info_byte += type << 4;
-    info_byte += tkl;
-
-    ensure_eq(net_pkt_append_u8(pkt, info_byte), true, OscoreNetPacketAppendError);
-    ensure_eq(net_pkt_append_u8(pkt, coap_code), true, OscoreNetPacketAppendError);
-    ensure_eq(net_pkt_append_be16(pkt, id), true, OscoreNetPacketAppendError);
-    out->hdr_len += 4;
-    ensure_eq(net_pkt_append_all(pkt, tkl, token, K_SECONDS(1)), true, OscoreNetPacketAppendError);
-    out->hdr_len += tkl;
+/// Returns the security context whose Recipient ID is @a kid, OscoreInvalidKid if there is none
+static OscoreError recipient_context(array kid, struct security_context** out) {
+    int index = find_recipient_peer(kid);
+    ensure(index >= 0, OscoreInvalidKid);
+    return peer_context((size_t) index, out);
+}
+
+/// Removes all peers
+static void reset_peers(void) {
+    num_peers = 0;
+    memset(buckets, 0, sizeof(buckets));
+#ifdef OSCORE_LAZY_CONTEXTS
+    memset(derived_peer, 0, sizeof(derived_peer));
+    memset(last_use, 0, sizeof(last_use));
+    memset(set_clock, 0, sizeof(set_clock));
+#endif
+    memset(&context_stats, 0, sizeof(context_stats));
+}
+
+/// Writes the next peer of the table, which is only added by `link_peer`
+static OscoreError init_peer(struct pre_established pre_established) {
+    ensure(num_peers < OSCORE_MAX_CONTEXTS, OscoreTooManyContexts);
+    array master_salt = pre_established.opt != NULL ? pre_established.opt->master_salt : EMPTY_ARRAY;
+    ensure(pre_established.sender_id.len <= OSCORE_MAX_ID_LEN, OscoreInvalidKidLength);
+    ensure(pre_established.recipient_id.len <= OSCORE_MAX_ID_LEN, OscoreInvalidKidLength);
+    ensure(pre_established.common_id_context.len <= OSCORE_MAX_ID_CONTEXT_LEN, OscoreInvalidKidContextLength);
+    ensure(pre_established.master_secret.len <= OSCORE_MAX_SECRET_LEN, OscoreInvalidKeyLength);
+    ensure(master_salt.len <= OSCORE_MAX_SECRET_LEN, OscoreInvalidKeyLength);
+    // requests are assigned to their security context by kid
+    ensure(find_recipient_peer(pre_established.recipient_id) < 0, OscoreInvalidKid);
+    struct peer* peer = &peers[num_peers];
+    memset(peer, 0, sizeof(*peer));
+    memcpy(peer->kid, pre_established.recipient_id.ptr, pre_established.recipient_id.len);
+    peer->kid_len = (u8_t) pre_established.recipient_id.len;
+
+    struct peer_material* material = &peer->material;
+    memcpy(material->master_secret, pre_established.master_secret.ptr, pre_established.master_secret.len);
+    material->master_secret_len = (u8_t) pre_established.master_secret.len;
+    if (master_salt.len > 0) {
+        memcpy(material->master_salt, master_salt.ptr, master_salt.len);
+    }
+    material->master_salt_len = (u8_t) master_salt.len;
+    if (pre_established.common_id_context.ptr != NULL) {
+        memcpy(material->id_context, pre_established.common_id_context.ptr, pre_established.common_id_context.len);
+        material->has_id_context = true;
+    }
+    material->id_context_len = (u8_t) pre_established.common_id_context.len;
+    memcpy(material->sender_id, pre_established.sender_id.ptr, pre_established.sender_id.len);
+    material->sender_id_len = (u8_t) pre_established.sender_id.len;
+    material->aead_alg = (u8_t) (pre_established.opt != NULL ? pre_established.opt->aead_alg : AES_CCM_16_64_128);
+    return OscoreNoError;
+}
+
+/// Adds the peer written by `init_peer` to the table
+static void link_peer(void) {
+    u16_t* bucket = &buckets[oscore_kid_hash(peer_kid(&peers[num_peers])) & (OSCORE_CONTEXT_BUCKETS - 1)];
+    next_in_bucket[num_peers] = *bucket;
+    num_peers++;
+    *bucket = (u16_t) num_peers;
+}
+
+OscoreError oscore_init(struct pre_established pre_established) {
+    reset_peers();
+    try(oscore_add_context(pre_established));
+    exchange_init();
+    echo_init();
+    return OscoreNoError;
+}
+
+OscoreError oscore_add_context(struct pre_established pre_established) {
+    try(init_peer(pre_established));
+#ifndef OSCORE_LAZY_CONTEXTS
+    try(derive_peer_context(num_peers));
+#endif
+    link_peer();
+    return OscoreNoError;
+}
+
+/// Value of a 5-byte big-endian Sender Sequence Number
+static u64_t seq_value(const u8_t* seq) {
+    u64_t value = 0;
+    for (size_t i = 0; i < 5; i++) {
+        value = (value << 8) | seq[i];
+    }
+    return value;
+}
+
+/// Writes @a value as 5-byte big-endian Sender Sequence Number
+static void seq_store(u64_t value, u8_t* seq) {
+    for (size_t i = 5; i > 0; i--) {
+        seq[i - 1] = (u8_t) value;
+        value >>= 8;
+    }
+}
+
+size_t oscore_snapshot_len(void) {
+    return snapshot_len(num_peers);
+}
+
+OscoreError oscore_snapshot_save(array key, array out) {
+    ensure(out.len >= snapshot_len(num_peers), OscoreOutTooLong);
+    snapshot_write_header(num_peers, out.ptr);
+    u8_t* entry = out.ptr + SNAPSHOT_HEADER_LEN;
+    for (size_t i = 0; i < num_peers; i++) {
+        struct peer* peer = &peers[i];
+        struct pre_established_opt opt = peer_opt(peer);
+        try(snapshot_fingerprint(key, peer_pre_established(peer, &opt), entry));
+        struct security_context record;
+        if (peer->derived != 0) {
+            record = derived[peer->derived - 1];
+            entry[SNAPSHOT_FINGERPRINT_LEN] = SNAPSHOT_DERIVED;
+        } else {
+            memset(&record, 0, sizeof(record));
+            memcpy(record.sender_seq_num, peer->sender_seq_num, sizeof(record.sender_seq_num));
+            record.replay = peer->replay;
+            entry[SNAPSHOT_FINGERPRINT_LEN] = 0;
+        }
+        // the context may send OSCORE_SEQ_RESERVATION messages before the next snapshot, so it continues after
+        // them when this one is restored (RFC8613 B.1.1)
+        u64_t reserved = seq_value(record.sender_seq_num) + OSCORE_SEQ_RESERVATION;
+        if (reserved > 0xffffffffffull) {
+            reserved = 0xffffffffffull;
+        }
+        seq_store(reserved, record.sender_seq_num);
+        peer->seq_limit = reserved;
+        memcpy(entry + SNAPSHOT_FINGERPRINT_LEN + 1, &record, sizeof(record));
+        entry += SNAPSHOT_ENTRY_LEN;
+    }
+    array data = {
+        .len = (size_t) (entry - out.ptr),
+        .ptr = out.ptr,
+    };
+    try(snapshot_tag(key, data, entry));
+    return OscoreNoError;
+}
+
+/// Restores the peer written by `init_peer` from its entry of a snapshot
+static OscoreError restore_peer(size_t index, const u8_t* entry) {
+    struct peer* peer = &peers[index];
+    struct security_context record;
+    // the snapshot isn't aligned
+    memcpy(&record, entry + SNAPSHOT_FINGERPRINT_LEN + 1, sizeof(record));
+    memcpy(peer->sender_seq_num, record.sender_seq_num, sizeof(peer->sender_seq_num));
+    peer->replay = record.replay;
+    peer->seq_limit = seq_value(record.sender_seq_num);
+    // requests accepted after the snapshot was saved aren't in its replay window
+    peer->echo_required = true;
+    if (entry[SNAPSHOT_FINGERPRINT_LEN] & SNAPSHOT_DERIVED) {
+        size_t slot = context_slot(index);
+        derived[slot] = record;
+        attach_context(slot, index);
+        context_stats.restored++;
+        return OscoreNoError;
+    }
+#ifndef OSCORE_LAZY_CONTEXTS
+    // written by a build which derives contexts on first use
+    try(derive_peer_context(index));
+#endif
+    return OscoreNoError;
+}
+
+OscoreError oscore_restore(const struct pre_established* pre_established, size_t count, array key, array snapshot) {
+    ensure(count > 0, OscoreTooManyContexts);
+    size_t entries;
+    try(snapshot_verify(key, snapshot, &entries));
+    reset_peers();
+    for (size_t i = 0; i < count; i++) {
+        try(init_peer(pre_established[i]));
+        u8_t fingerprint[SNAPSHOT_FINGERPRINT_LEN];
+        try(snapshot_fingerprint(key, pre_established[i], fingerprint));
+        // entries are usually in the order of the peers, starting at the same index avoids a quadratic search
+        const u8_t* entry = NULL;
+        for (size_t j = 0; j < entries && entry == NULL; j++) {
+            const u8_t* candidate = snapshot.ptr + SNAPSHOT_HEADER_LEN + ((i + j) % entries) * SNAPSHOT_ENTRY_LEN;
+            if (memcmp(candidate, fingerprint, sizeof(fingerprint)) == 0) {
+                entry = candidate;
+            }
+        }
+        if (entry != NULL) {
+            try(restore_peer(num_peers, entry));
+        } else {
+#ifndef OSCORE_LAZY_CONTEXTS
+            // a new peer, or its pre-established material changed
+            try(derive_peer_context(num_peers));
+#endif
+        }
+        link_peer();
+    }
+    exchange_init();
+    echo_init();
     return OscoreNoError;
 }
 
+bool oscore_snapshot_due(void) {
+    for (size_t i = 0; i < num_peers; i++) {
+        const struct peer* peer = &peers[i];
+        const u8_t* seq = peer->derived != 0 ? derived[peer->derived - 1].sender_seq_num : peer->sender_seq_num;
+        if (peer->seq_limit != 0 && seq_value(seq) + OSCORE_SEQ_RESERVATION / 2 >= peer->seq_limit) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void oscore_require_echo(void) {
+    for (size_t i = 0; i < num_peers; i++) {
+        peers[i].echo_required = true;
+    }
+}
+
+void oscore_get_context_stats(struct oscore_context_stats* out) {
+    *out = context_stats;
+    out->peers = (u32_t) num_peers;
+    out->peer_bytes = sizeof(struct peer);
+    out->context_bytes = sizeof(struct security_context);
+    out->derived = 0;
+    for (size_t i = 0; i < num_peers; i++) {
+        out->derived += peers[i].derived != 0;
+    }
+}
+
 /**
  * Merge decrypted options into the rebuilt decrypted packet
  * @param opt_u Class U option array
@@ -200,12 +581,148 @@ static OscoreError merge_decrypted_options(struct coap_option* opt_u, u16_t opt_
     return OscoreNoError;
 }
 
+/**
+ * Decodes the OSCORE option of a received message and creates the nonce to decrypt it.
+ * @param oscore_value Value of the OSCORE option
+ * @param unprotected Buffers to decode the option into
+ * @param nonce out-parameter to write the 13-byte nonce into
+ * @param ctx out-pointer to the security context of the sender
+ * @return OscoreError
+ */
+static OscoreError recipient_nonce(array oscore_value, struct unprotected* unprotected, u8_t* nonce,
+                                   struct security_context** ctx) {
+    try(from_oscore_option(oscore_value, unprotected));
+    // TODO: use unprotected.kid_context
+
+    // create nonce
+    // TODO: can the kid be NULL and the recipient id is just used?
+    try(recipient_context(unprotected->kid, ctx));
+    // only responses may omit the Partial IV
+    ensure(unprotected->partial_iv.len > 0, OscoreInvalidPartialIvLength);
+    ensure(replay_check(&(*ctx)->replay, unprotected->partial_iv), OscoreReplayedPartialIv);
+    try(create_nonce(unprotected->kid, unprotected->partial_iv, context_common_iv(*ctx), nonce));
+    return OscoreNoError;
+}
+
+/**
+ * Marks the Partial IV of a verified request as received. If the replay window of its peer is unknown, the request
+ * has to echo the peer's challenge and restarts the window instead.
+ * @param peer Index of the peer the request is from
+ * @param ctx Security context of the peer
+ * @param partial_iv Partial IV of the request
+ * @param request Decrypted request, NULL if its options aren't available
+ * @return OscoreError, OscoreEchoRequired if the request doesn't echo the challenge of its peer
+ */
+static OscoreError accept_request(int peer, struct security_context* ctx, array partial_iv,
+                                  struct coap_packet* request) {
+    if (!peers[peer].echo_required) {
+        replay_update(&ctx->replay, partial_iv);
+        return OscoreNoError;
+    }
+    // the request is authentic, but it may have been sent before the reboot
+    struct coap_option echo;
+    array echo_value = NULL_ARRAY;
+    if (request != NULL && coap_find_options(request, COAP_OPTION_ECHO, &echo, 1) == 1) {
+        echo_value.len = echo.len;
+        echo_value.ptr = echo.value;
+    }
+    ensure(echo_verify((u16_t) peer, echo_value), OscoreEchoRequired);
+    replay_restart(&ctx->replay, partial_iv);
+    peers[peer].echo_required = false;
+    return OscoreNoError;
+}
+
+static struct oscore_drop_stats drop_stats;
+
+OscoreError oscore_prefilter(struct coap_packet* request) {
+    struct coap_option option;
+    if (coap_find_options(request, COAP_OPTION_OSCORE, &option, 1) != 1) {
+        drop_stats.invalid_option++;
+        return OscoreNoOscoreOption;
+    }
+    // no need for the kid context, it isn't used yet
+    u8_t partial_iv_bytes[8];
+    u8_t kid_bytes[7];
+    u8_t kid_context_bytes[16];
+    struct unprotected unprotected = {
+        .partial_iv = {
+            .len = sizeof(partial_iv_bytes),
+            .ptr = partial_iv_bytes,
+        },
+        .kid = {
+            .len = sizeof(kid_bytes),
+            .ptr = kid_bytes,
+        },
+        .kid_context = {
+            .len = sizeof(kid_context_bytes),
+            .ptr = kid_context_bytes,
+        }
+    };
+    array oscore_value = {
+        .len = option.len,
+        .ptr = option.value,
+    };
+    if (from_oscore_option(oscore_value, &unprotected) != OscoreNoError) {
+        drop_stats.invalid_option++;
+        return OscoreInvalidOptionLength;
+    }
+    // the context isn't derived, nothing is done here which costs more than a lookup
+    int peer = find_recipient_peer(unprotected.kid);
+    if (peer < 0) {
+        drop_stats.unknown_kid++;
+        return OscoreInvalidKid;
+    }
+    if (unprotected.partial_iv.len == 0 || unprotected.partial_iv.len > sizeof(peers[peer].sender_seq_num)) {
+        drop_stats.invalid_partial_iv++;
+        return OscoreInvalidPartialIvLength;
+    }
+
+    // the ciphertext is at least the encrypted CoAP Code and the tag, a single outer block may be shorter
+    u16_t offset;
+    u16_t len;
+    struct coap_option block1;
+    u16_t min_len = coap_find_options(request, COAP_OPTION_BLOCK1, &block1, 1) == 1 ? 1 : 1 + AES_CCM_TAG_LEN;
+    if (coap_packet_get_payload(request, &offset, &len) == NULL || len < min_len) {
+        drop_stats.invalid_payload++;
+        return OscoreCoapPacketNoPayload;
+    }
+
+    if (!replay_check(peer_replay(&peers[peer]), unprotected.partial_iv)) {
+        drop_stats.replayed++;
+        return OscoreReplayedPartialIv;
+    }
+    return OscoreNoError;
+}
+
+void oscore_get_drop_stats(struct oscore_drop_stats* out) {
+    *out = drop_stats;
+}
+
+/**
+ * Decrypts the payload of a received OSCORE message and builds the unprotected CoAP message from it.
+ * @param ctx Security context of the sender of @a message
+ * @param message Received OSCORE message, it isn't consumed
+ * @param options Outer options of @a message
+ * @param opt_num Number of @a options
+ * @param request_kid request_kid of the AAD
+ * @param request_piv request_piv of the AAD
+ * @param nonce 13-byte AEAD nonce
+ * @param out out-pointer which will contain the decrypted CoAP packet
+ * @return OscoreError
+ * The ciphertext, AAD and plaintext are allocated from the scratch arena, which the caller has to release.
+ */
+static OscoreError decrypt_message(struct security_context* ctx, struct coap_packet* message,
+                                   struct coap_option* options, u8_t opt_num, array request_kid, array request_piv,
+                                   const u8_t* nonce, struct coap_packet* out);
+
 OscoreError from_oscore(struct coap_packet request, struct coap_packet* out) {
+    profile_begin(total);
+    profile_begin(stage);
     // Class I / U options
-    // TODO: find out actual number of options, assume max 10 for now
-    u8_t opt_num = 10;
-    struct coap_option options[opt_num];
+    u8_t opt_num = OSCORE_MAX_OPTIONS;
+    struct coap_option options[OSCORE_MAX_OPTIONS];
     try(get_options(&request, options, &opt_num));
+    profile_end(ProfileUnprotectOptions, stage);
 
     // get the OSCORE option value
     array oscore_value = get_option_value(options, opt_num, COAP_OPTION_OSCORE);
@@ -232,49 +749,68 @@ OscoreError from_oscore(struct coap_packet request, struct coap_packet* out) {
             .ptr = kid_context_bytes,
         }
     };
-    try(from_oscore_option(oscore_value, &unprotected));
-    // TODO: replay protection
-    // TODO: use unprotected.kid_context
+    u8_t nonce[13];
+    struct security_context* ctx;
+    try(recipient_nonce(oscore_value, &unprotected, nonce, &ctx));
+    profile_end(ProfileUnprotectNonce, stage);
+
+    size_t mark = scratch_mark();
+    OscoreError res = decrypt_message(ctx, &request, options, opt_num, context_recipient_id(ctx),
+                                      unprotected.partial_iv, nonce, out);
+    scratch_release(mark);
+    trace(TraceUnprotected, res, net_pkt_get_len(request.pkt));
+    try(res);
+    res = accept_request(find_recipient_peer(unprotected.kid), ctx, unprotected.partial_iv, out);
+    if (res != OscoreNoError) {
+        net_pkt_unref(out->pkt);
+        return res;
+    }
+    profile_end(ProfileUnprotect, total);
 
+    // "consume" original request
+    net_pkt_unref(request.pkt);
+    return OscoreNoError;
+}
+
+static OscoreError decrypt_message(struct security_context* ctx, struct coap_packet* message,
+                                   struct coap_option* options, u8_t opt_num, array request_kid, array request_piv,
+                                   const u8_t* nonce, struct coap_packet* out) {
+    profile_begin(stage);
     // ciphertext (original payload)
     struct payload_info request_info;
-    try(get_payload_info(&request, &request_info));
-    u8_t ciphertext_bytes[request_info.len];
+    try(get_payload_info(message, &request_info));
+    ensure(request_info.len > AES_CCM_TAG_LEN, OscoreCoapPacketNoPayload);
     array ciphertext = {
         .len = request_info.len,
-        .ptr = ciphertext_bytes,
+        .ptr = scratch_alloc(request_info.len),
     };
+    ensure(ciphertext.ptr != NULL, OscoreScratchExhausted);
     try(read_payload(request_info, ciphertext));
     log_hex("received ciphertext", ciphertext.ptr, ciphertext.len);
 
 
-    // create nonce
-    // TODO: can the kid be NULL and the recipient id is just used?
-    ensure(array_equals(rctx.recipient_id, unprotected.kid), OscoreInvalidKid);
-    u8_t nonce[13];
-    try(create_nonce(unprotected.kid, unprotected.partial_iv, cctx.common_iv, &nonce[0]));
-
     // construct aad
     size_t aad_len;
-    try(aad_length(options, opt_num, cctx.aead_alg, rctx.recipient_id, unprotected.partial_iv, &aad_len));
-    u8_t aad_bytes[aad_len];
+    try(aad_length(options, opt_num, (enum aead_algorithm) ctx->aead_alg, request_kid, request_piv, &aad_len));
     array aad = {
         .len = aad_len,
-        .ptr = aad_bytes,
+        .ptr = scratch_alloc(aad_len),
     };
-    try(create_aad(options, opt_num, cctx.aead_alg, rctx.recipient_id, unprotected.partial_iv, aad));
+    ensure(aad.ptr != NULL, OscoreScratchExhausted);
+    try(create_aad(options, opt_num, (enum aead_algorithm) ctx->aead_alg, request_kid, request_piv, aad));
+    profile_end(ProfileUnprotectAad, stage);
 
 
     // actually decrypt
-    u8_t plaintext_bytes[ciphertext.len - 8];
-    memset(&plaintext_bytes, 0, sizeof(plaintext_bytes));
     array plaintext = {
-        .len = sizeof(plaintext_bytes),
-        .ptr = plaintext_bytes,
+        .len = ciphertext.len - 8,
+        .ptr = scratch_alloc(ciphertext.len - 8),
     };
-    ensure_eq(rctx.recipient_key.len, 16, OscoreInvalidKeyLength);
-    try(from_oscore_cose_encrypt0(rctx.recipient_key.ptr, nonce, ciphertext, aad, plaintext));
+    ensure(plaintext.ptr != NULL, OscoreScratchExhausted);
+    memset(plaintext.ptr, 0, plaintext.len);
+    try(from_oscore_cose_encrypt0(&ctx->recipient_sched, nonce, ciphertext, aad, plaintext));
     log_hex("decrypted plaintext", plaintext.ptr, plaintext.len);
+    profile_end(ProfileUnprotectCcm, stage);
 
     // Plaintext: CoAP Code || Class E options || 0xFF (if payload) || payload (if any)
     u8_t coap_code = plaintext.ptr[0];
@@ -287,7 +823,8 @@ OscoreError from_oscore(struct coap_packet request, struct coap_packet* out) {
     };
     u16_t opt_e_num;
     try(num_options(options_array, &opt_e_num));
-    struct coap_option opt_e[opt_e_num];
+    struct coap_option* opt_e = scratch_alloc(opt_e_num * sizeof(struct coap_option));
+    ensure(opt_e != NULL, OscoreScratchExhausted);
     u16_t opt_e_byte_len;
     try(decode_options(options_array, opt_e, &opt_e_byte_len));
 
@@ -302,7 +839,7 @@ OscoreError from_oscore(struct coap_packet request, struct coap_packet* out) {
     plaintext.ptr = &plaintext.ptr[payload_offset];
 
     // construct unencrypted coap_packet
-    try(init_decrypted_packet(&request, coap_code, out));
+    try(init_received_packet(message, coap_code, out));
 
     // merge options
     try(merge_decrypted_options(options, opt_num, opt_e, opt_e_num, out));
@@ -312,41 +849,34 @@ OscoreError from_oscore(struct coap_packet request, struct coap_packet* out) {
         ensure_eq(coap_packet_append_payload_marker(out), 0, OscoreCoapPacketAppendError);
         ensure_eq(coap_packet_append_payload(out, plaintext.ptr, (u16_t)plaintext.len), 0, OscoreCoapPacketAppendError);
     }
-
-    // "consume" original request
-    net_pkt_unref(request.pkt);
+    profile_end(ProfileUnprotectRebuild, stage);
     return OscoreNoError;
 }
 
 /**
- * Inits the encrypted packet @a out with data parsed from the unencrypted packet @a response
- * @param response Original unencrypted packet
+ * Inits the encrypted packet @a out with the given CoAP header fields.
+ * @param type CoAP Type of the encrypted packet
+ * @param token Token of the encrypted packet
+ * @param tkl Length of @a token
+ * @param code Outer CoAP Code of the encrypted packet
+ * @param id Message ID of the encrypted packet
  * @param out Packet to write encrypted data to
  * @return OscoreError
  */
-static OscoreError init_encrypted_packet(struct coap_packet* response, struct coap_packet* out) {
-    u8_t version = coap_header_get_version(response);
-    u8_t type = coap_header_get_type(response);
-    u8_t token[8];
-    u8_t tkl = coap_header_get_token(response, token);
-    u16_t id = coap_header_get_id(response);
-
-    struct net_pkt* pkt = net_pkt_get_tx(context, K_FOREVER);
-    ensure(pkt != NULL, OscorePktError);
-    struct net_buf* frag = net_pkt_get_data(context, K_FOREVER);
-    ensure(frag != NULL, OscorePktError);
-    net_pkt_frag_add(pkt, frag);
-
-//    u8_t request_code = coap_header_get_code(request);
-    // TODO: Observe
-    u8_t code_faked = COAP_RESPONSE_CODE_CHANGED;
-    ensure_eq(coap_packet_init(out, pkt, version, type, tkl, (u8_t *)token, code_faked, id), 0, OscoreCoapPacketInitError);
+static OscoreError init_encrypted_packet(u8_t type, const u8_t* token, u8_t tkl, u8_t code, u16_t id, struct coap_packet* out) {
+    struct net_pkt* pkt;
+    try(pkt_pool_get(false, OSCORE_PKT_TIMEOUT_MS, &pkt));
+    if (coap_packet_init(out, pkt, 1, type, tkl, (u8_t *)token, code, id) != 0) {
+        net_pkt_unref(pkt);
+        return OscoreCoapPacketInitError;
+    }
     return OscoreNoError;
 }
 
 /**
  * Writes all Class U options from @a options to the out-packet and adds the OSCORE CoAP Option @a oscore_option.
- * @param request Request to get from-IP from (for the Proxy-URI option).
+ * @param request Request to get from-IP from (for the Proxy-URI option). Can be NULL if there is no request, e.g.
+ *          for notifications, in which case a Proxy-URI option results in an error.
  * @param options Array containing all options.
  * @param opt_num Number of options in @a options.
  * @param oscore_option Value of the OSCORE Option to be included in the correct position into the packet.
@@ -366,6 +896,7 @@ static OscoreError write_class_u_options(struct coap_packet* request, struct coa
         // special cases
         //   * Max-Age: outer: "MAY"
         if (total_delta == COAP_OPTION_PROXY_URI) {
+            ensure(request != NULL, OscoreCoapPacketParseError);
             // only forward scheme, host, port; strip path and query
             struct sockaddr_in6 to;
             get_from_ip_addr(request, &to);
@@ -399,11 +930,14 @@ static OscoreError write_class_u_options(struct coap_packet* request, struct coa
     return OscoreNoError;
 }
 
-OscoreError into_oscore(struct coap_packet response, struct coap_packet* request, struct coap_packet* out) {
-    // get request OSCORE option value, which is needed for nonce construction
-    // TODO: find out actual number of options, assume max 10 for now
-    u8_t request_opt_num = 10;
-    struct coap_option request_options[request_opt_num];
+bool has_oscore_option(struct coap_packet* packet) {
+    struct coap_option option;
+    return coap_find_options(packet, COAP_OPTION_OSCORE, &option, 1) > 0;
+}
+
+OscoreError oscore_request_init(struct coap_packet* request, struct oscore_request* out) {
+    u8_t request_opt_num = OSCORE_MAX_OPTIONS;
+    struct coap_option request_options[OSCORE_MAX_OPTIONS];
     try(get_options(request, request_options, &request_opt_num));
 
     // get the request's OSCORE option value
@@ -411,8 +945,6 @@ OscoreError into_oscore(struct coap_packet response, struct coap_packet* request
     ensure(!array_equals(request_oscore_option_value, NULL_ARRAY), OscoreNoOscoreOption);
     // extract info
     u8_t partial_iv_bytes[8] = { 0 };
-    // TODO: actually be generic over the algorithm
-    u8_t kid_bytes[7] = { 0 };
     // MUST be shorter than 256 bytes
     // TODO: don't only assume <16 bytes
     u8_t kid_context_bytes[16] = { 0 };
@@ -422,8 +954,8 @@ OscoreError into_oscore(struct coap_packet response, struct coap_packet* request
                     .ptr = partial_iv_bytes,
             },
             .kid = {
-                    .len = sizeof(kid_bytes),
-                    .ptr = kid_bytes,
+                    .len = sizeof(out->kid),
+                    .ptr = out->kid,
             },
             .kid_context = {
                     .len = sizeof(kid_context_bytes),
@@ -431,146 +963,708 @@ OscoreError into_oscore(struct coap_packet response, struct coap_packet* request
             }
     };
     try(from_oscore_option(request_oscore_option_value, &request_unprotected));
+    ensure(request_unprotected.partial_iv.len <= sizeof(out->piv), OscoreInvalidPartialIvLength);
+    memcpy(out->piv, partial_iv_bytes, request_unprotected.partial_iv.len);
+    out->piv_len = (u8_t)request_unprotected.partial_iv.len;
+    out->kid_len = (u8_t)request_unprotected.kid.len;
+    out->fresh_piv = false;
+    return OscoreNoError;
+}
 
-
-
-    // AEAD Nonce (could be reused, but implemented for completeness)
-    // reuse nonce (we create a new one, thus commented out)
-//    u8_t nonce[13];
-//    try(create_nonce(request_unprotected.kid, request_unprotected.partial_iv, cctx->common_iv, &nonce[0]));
-
-    // increment seq_num
-    size_t index = sizeof(sctx.sender_seq_num) - 1;
-    do {
-        sctx.sender_seq_num[index] += 1;
-        index--;
-    } while (index > 0 && sctx.sender_seq_num[index+1] == 0);
-    // TODO: save new seq num to disk
-
-    // build nonce
-    u8_t nonce[13];
-//    array piv = {
-//        .len = sizeof(sctx.sender_seq_num),
-//        .ptr = sctx.sender_seq_num,
-//    };
-    u8_t piv_leading_zeroes = 0;
-    while(sctx.sender_seq_num[piv_leading_zeroes] == 0) {
-        piv_leading_zeroes++;
+OscoreError read_built_options(struct coap_packet* message, struct coap_option* options, u16_t max_opt_num, u16_t* opt_num) {
+    // without options and payload the message ends with the header, there is no fragment left to read from
+    if (message->opt_len == 0) {
+        *opt_num = 0;
+        return OscoreNoError;
     }
-    array piv_stripped = {
-        .ptr = &sctx.sender_seq_num[piv_leading_zeroes],
-        .len = (size_t)(sizeof(sctx.sender_seq_num) - piv_leading_zeroes),
-    };
-    try(create_nonce(sctx.sender_id, piv_stripped, cctx.common_iv, &nonce[0]));
-
-    // Collect all information to create plaintext to encrypt
-
-    // We can't use coap_packet_parse here because it assumes a fully built packet, which this isn't (yet before sending it).
-    // coap_packet_parse will skip over the network headers to get to the COAP header,
-    // but our COAP header already starts where the offset is pointing to.
-//    ensure_eq(coap_packet_parse(&response, response.pkt, &options[0], opt_len), 0, OscoreCoapPacketParseError);
-    // All that coap_packet_parse does is
-    // 1. Skip headers (not needed here)
-    // 2. Check that the fragment is valid (we assume this here as it should have been written to before being
-    //    passed to us.
-    // 3. Set the hdr_len (also not needed here) and check if tkl is valid (also not needed here)
-    // 4. Parse the options (done below)
-    u8_t option_bytes[response.opt_len];
+    // the decoded options contain copies of their values, so the raw options can be released right away
+    size_t mark = scratch_mark();
     array option_bytes_array = {
-            .ptr = &option_bytes[0],
-            .len = response.opt_len,
+            .ptr = scratch_alloc(message->opt_len),
+            .len = message->opt_len,
     };
+    ensure(option_bytes_array.ptr != NULL, OscoreScratchExhausted);
     u16_t option_offset;
-    struct net_buf* option_frag = net_frag_skip(response.frag, response.offset, &option_offset, response.hdr_len);
+    struct net_buf* option_frag = net_frag_skip(message->frag, message->offset, &option_offset, message->hdr_len);
     u16_t new_pos;
     struct net_buf* ret = net_frag_read(option_frag, option_offset, &new_pos, (u16_t)option_bytes_array.len, option_bytes_array.ptr);
     assert_actually(!(ret == NULL && new_pos == 0xFFFF), "option copy failed");
 
-    u16_t opt_num;
-    try(num_options(option_bytes_array, &opt_num));
-    struct coap_option options[opt_num];
-    decode_options(option_bytes_array, options, NULL);
+    OscoreError res = num_options(option_bytes_array, opt_num);
+    if (res == OscoreNoError && *opt_num > max_opt_num) {
+        warn("too many options: %d > %d", *opt_num, max_opt_num);
+        res = OscoreTooManyOptions;
+    }
+    if (res == OscoreNoError) {
+        res = decode_options(option_bytes_array, options, NULL);
+    }
+    scratch_release(mark);
+    return res;
+}
+
+OscoreError oscore_inner_encode(struct coap_packet* message, array buffer, struct oscore_inner* out) {
+    profile_begin(stage);
+    try(read_built_options(message, out->options, OSCORE_MAX_OPTIONS, &out->opt_num));
 
     u16_t payload_offset;
     u16_t payload_len;
     // payload already contains payload marker `0xff`
-    struct net_buf* frag = net_frag_skip(response.frag, response.offset, &payload_offset, response.hdr_len + response.opt_len);
+    struct net_buf* frag = net_frag_skip(message->frag, message->offset, &payload_offset, message->hdr_len + message->opt_len);
     ensure(!(frag == NULL && payload_offset == 0xffff), OscoreCoapPacketParseError);
-    payload_len = (u16_t)(net_pkt_get_len(response.pkt) - response.offset - response.hdr_len - response.opt_len);
+    payload_len = (u16_t)(net_pkt_get_len(message->pkt) - message->offset - message->hdr_len - message->opt_len);
 
-    u32_t encoded_opt_len = encoded_option_len(options, opt_num, CLASS_E);
-    size_t maxlen = 1 + encoded_opt_len + payload_len;
-    u8_t plaintext_bytes[maxlen];
-    array plaintext = {
-            .len = maxlen,
-            .ptr = plaintext_bytes,
-    };
+    u32_t encoded_opt_len = encoded_option_len(out->options, out->opt_num, CLASS_E);
+    size_t len = 1 + encoded_opt_len + payload_len;
+    ensure(buffer.len >= len, OscoreOutTooLong);
 
     // Plaintext (Payload): CoAP Code || Class E options || 0xFF (if payload) || payload (if any)
 
     // CoAP Code
-    plaintext.ptr[0] = coap_header_get_code(&response);
+    buffer.ptr[0] = coap_header_get_code(message);
 
     // encode Class E options
-    u32_t len = encode_options(options, opt_num, CLASS_E, &plaintext.ptr[1]);
-    assert_eq(len, encoded_opt_len);
-    u32_t idx = 1 + len;
+    u32_t opt_len = encode_options(out->options, out->opt_num, CLASS_E, &buffer.ptr[1]);
+    assert_eq(opt_len, encoded_opt_len);
+    u32_t idx = 1 + opt_len;
 
     // payload (with contained payload marker `0xff`)
     if (!(frag == NULL && payload_offset == 0)) {
-        ret = net_frag_read(frag, payload_offset, &new_pos, payload_len, &plaintext.ptr[idx]);
+        u16_t new_pos;
+        struct net_buf* ret = net_frag_read(frag, payload_offset, &new_pos, payload_len, &buffer.ptr[idx]);
         assert_actually(!(ret == NULL && new_pos == 0xFFFF), "payload copy failed");
     }
-    assert_eq(idx + payload_len, plaintext.len);
+    assert_eq(idx + payload_len, len);
+
+    out->plaintext.ptr = buffer.ptr;
+    out->plaintext.len = len;
+    profile_end(ProfileProtectEncode, stage);
+    return OscoreNoError;
+}
+
+/**
+ * Increments the sender sequence number, which is used as Partial IV for the next protected message.
+ * @param peer Peer the security context belongs to, whose last snapshot limits the sequence number
+ * @param sctx Security context whose sequence number is incremented
+ * @param out out-pointer to the new sender sequence number stripped from leading zeroes
+ * @return OscoreError, OscoreSequenceExhausted without incrementing it if the sequence number reached the one
+ *          reserved by the last snapshot or the largest Partial IV
+ */
+static OscoreError next_partial_iv(const struct peer* peer, struct security_context* sctx, array* out) {
+    u64_t seq = seq_value(sctx->sender_seq_num);
+    // a restored context would repeat the sequence numbers after the reserved one, see `oscore_snapshot_save`
+    ensure(peer->seq_limit == 0 || seq < peer->seq_limit, OscoreSequenceExhausted);
+    ensure(seq < 0xffffffffffull, OscoreSequenceExhausted);
+    seq_store(seq + 1, sctx->sender_seq_num);
+
+    u8_t piv_leading_zeroes = 0;
+    while(sctx->sender_seq_num[piv_leading_zeroes] == 0) {
+        piv_leading_zeroes++;
+    }
+    out->ptr = &sctx->sender_seq_num[piv_leading_zeroes];
+    out->len = (size_t)(sizeof(sctx->sender_seq_num) - piv_leading_zeroes);
+    return OscoreNoError;
+}
 
+/**
+ * Checks whether a message needs its own Partial IV.
+ * "the Partial IV MUST be present in all Observe notifications", and the server can't know if a response to an Observe
+ * registration ends up being the first notification, so every message with an Observe Option gets one.
+ */
+static bool needs_fresh_piv(struct coap_option* options, u16_t opt_num, struct oscore_request* request_info) {
+    // the Observe Option is empty for sequence number 0, so check the pointer instead of comparing with NULL_ARRAY
+    return request_info->fresh_piv || get_option_value(options, (u8_t)opt_num, COAP_OPTION_OBSERVE).ptr != NULL;
+}
 
+/**
+ * Initializes the AEAD with the AAD and writes the outer header, the Class U options including the OSCORE option
+ * and the payload marker into @a out. The ciphertext and tag need to be appended afterwards.
+ * @param ctx Security context to protect the message with
+ * @param options Options of the message to protect
+ * @param opt_num Number of @a options
+ * @param request_kid request_kid to include into the AAD
+ * @param request_piv request_piv to include into the AAD
+ * @param unprotected Content of the OSCORE Option
+ * @param nonce 13-byte AEAD nonce
+ * @param request Original request packet (for the Proxy-URI option), can be NULL
+ * @param type CoAP Type of the OSCORE packet
+ * @param token Token of the OSCORE packet
+ * @param tkl Length of @a token
+ * @param code Outer CoAP Code of the OSCORE packet
+ * @param id Message ID of the OSCORE packet
+ * @param plaintext_len Total length of the plaintext
+ * @param ccm out-pointer to the AEAD state to initialize
+ * @param out out-pointer which will contain the OSCORE packet
+ * @return OscoreError
+ */
+static OscoreError start_protected_message(struct security_context* ctx, struct coap_option* options, u16_t opt_num,
+                                           array request_kid, array request_piv, struct unprotected unprotected, const u8_t* nonce,
+                                           struct coap_packet* request, u8_t type, const u8_t* token, u8_t tkl,
+                                           u8_t code, u16_t id, size_t plaintext_len, struct aes_ccm_stream* ccm,
+                                           struct coap_packet* out) {
+    profile_begin(stage);
     // additional authenticated data
     // "NOTE: The format of the external_aad is for simplicity the same for
     //   requests and responses, although some parameters, e.g. request_kid,
     //   need not be integrity protected in all requests."
     size_t aad_len;
-    try(aad_length(options, opt_num, cctx.aead_alg, request_unprotected.kid, request_unprotected.partial_iv, &aad_len));
-    u8_t aad_bytes[aad_len];
+    try(aad_length(options, opt_num, (enum aead_algorithm) ctx->aead_alg, request_kid, request_piv, &aad_len));
+    // the AAD is absorbed into the AEAD state, so it's only needed until the stream is initialized
+    size_t mark = scratch_mark();
     array aad = {
         .len = aad_len,
-        .ptr = aad_bytes,
-    };
-    try(create_aad(options, opt_num, cctx.aead_alg, request_unprotected.kid, request_unprotected.partial_iv, aad));
-
-    // encrypt
-    u8_t payload_bytes[plaintext.len + 8];
-    array payload = {
-        .len = sizeof(payload_bytes),
-        .ptr = payload_bytes,
+        .ptr = scratch_alloc(aad_len),
     };
-    try(to_oscore_cose_encrypt0(sctx.sender_key.ptr, nonce, plaintext, aad, payload));
-    log_hex("plaintext to send", plaintext.ptr, plaintext.len);
-    log_hex("encrypted ciphertext", payload.ptr, payload.len);
+    ensure(aad.ptr != NULL, OscoreScratchExhausted);
+    OscoreError res = create_aad(options, opt_num, (enum aead_algorithm) ctx->aead_alg, request_kid, request_piv, aad);
+    if (res == OscoreNoError) {
+        res = cose_encrypt0_stream_init(ccm, &ctx->sender_sched, nonce, aad, plaintext_len);
+    }
+    scratch_release(mark);
+    try(res);
+    profile_end(ProfileProtectAad, stage);
 
-    // OSCORE Option
-    struct unprotected unprotected = {
-        .partial_iv = piv_stripped,
-        .kid = sctx.sender_id,
-        .kid_context = NULL_ARRAY,
-    };
+    // OSCORE Option, empty if the request's nonce is reused
     size_t oscore_option_len = option_value_length(unprotected);
-    u8_t oscore_option_bytes[oscore_option_len];
     array oscore_option = {
         .len = oscore_option_len,
-        .ptr = oscore_option_bytes,
+        .ptr = scratch_alloc(oscore_option_len),
     };
-    try(to_oscore_option(unprotected, oscore_option));
+    ensure(oscore_option.ptr != NULL, OscoreScratchExhausted);
+    res = to_oscore_option(unprotected, oscore_option);
 
     // actually write data
 
-    try(init_encrypted_packet(&response, out));
-    try(write_class_u_options(request, options, opt_num, oscore_option, out));
+    if (res == OscoreNoError) {
+        res = init_encrypted_packet(type, token, tkl, code, id, out);
+    }
+    if (res == OscoreNoError) {
+        res = write_class_u_options(request, options, opt_num, oscore_option, out);
+    }
+    scratch_release(mark);
+    try(res);
     // there is always a payload, at least the original CoAP Code
     ensure_eq(coap_packet_append_payload_marker(out), 0, OscoreCoapPacketAppendError);
-    ensure_eq(coap_packet_append_payload(out, payload.ptr, (u16_t)payload.len), 0, OscoreCoapPacketAppendError);
+    profile_end(ProfileProtectRebuild, stage);
+    return OscoreNoError;
+}
+
+/**
+ * Starts the protection of a response, either with a fresh Partial IV or reusing the nonce of the request.
+ * The response is protected with the security context of the request's sender.
+ * See `start_protected_message` for the parameters.
+ * @param request_info request_kid and request_piv to include into the AAD
+ * @return OscoreError
+ */
+static OscoreError start_protected_packet(struct coap_option* options, u16_t opt_num,
+                                          struct oscore_request* request_info, struct coap_packet* request,
+                                          u8_t type, const u8_t* token, u8_t tkl, u8_t code, u16_t id,
+                                          size_t plaintext_len, struct aes_ccm_stream* ccm, struct coap_packet* out) {
+    profile_begin(stage);
+    array request_kid = {
+        .len = request_info->kid_len,
+        .ptr = request_info->kid,
+    };
+    array request_piv = {
+        .len = request_info->piv_len,
+        .ptr = request_info->piv,
+    };
+    int peer = find_recipient_peer(request_kid);
+    ensure(peer >= 0, OscoreInvalidKid);
+    struct security_context* ctx;
+    try(peer_context((size_t) peer, &ctx));
+
+    // AEAD Nonce
+    // The request's nonce is unique and we encrypt with our sender key, so reusing it doesn't repeat a (key, nonce)
+    // pair unless there is more than one response to the request.
+    struct unprotected unprotected = {
+        .partial_iv = EMPTY_ARRAY,
+        .kid = NULL_ARRAY,
+        .kid_context = NULL_ARRAY,
+    };
+    u8_t nonce[13];
+    if (needs_fresh_piv(options, opt_num, request_info)) {
+        try(next_partial_iv(&peers[peer], ctx, &unprotected.partial_iv));
+        unprotected.kid = context_sender_id(ctx);
+        try(create_nonce(unprotected.kid, unprotected.partial_iv, context_common_iv(ctx), &nonce[0]));
+    } else {
+        try(create_nonce(request_kid, request_piv, context_common_iv(ctx), &nonce[0]));
+    }
+    profile_end(ProfileProtectNonce, stage);
+
+    return start_protected_message(ctx, options, opt_num, request_kid, request_piv, unprotected, nonce, request, type,
+                                   token, tkl, code, id, plaintext_len, ccm, out);
+}
+
+/**
+ * Encrypts the next chunk of the plaintext block by block and appends the ciphertext to the payload of @a out.
+ * @param ccm AEAD state initialized by `start_protected_packet`
+ * @param plaintext Next chunk of the plaintext
+ * @param out Packet to append the ciphertext to
+ * @return OscoreError
+ */
+static OscoreError append_encrypted(struct aes_ccm_stream* ccm, array plaintext, struct coap_packet* out) {
+    u8_t block[16];
+    for (size_t i = 0; i < plaintext.len; i += sizeof(block)) {
+        array chunk = {
+            .len = min(sizeof(block), plaintext.len - i),
+            .ptr = &plaintext.ptr[i],
+        };
+        array ciphertext = {
+            .len = chunk.len,
+            .ptr = block,
+        };
+        try(aes_ccm_stream_encrypt(ccm, chunk, ciphertext));
+        ensure_eq(coap_packet_append_payload(out, ciphertext.ptr, (u16_t)ciphertext.len), 0,
+                  OscoreCoapPacketAppendError);
+    }
+    return OscoreNoError;
+}
+
+/**
+ * Appends the authentication tag after the whole plaintext was encrypted.
+ * @param ccm AEAD state
+ * @param out Packet to append the tag to
+ * @return OscoreError
+ */
+static OscoreError append_tag(struct aes_ccm_stream* ccm, struct coap_packet* out) {
+    u8_t tag_bytes[AES_CCM_TAG_LEN];
+    array tag = {
+        .len = sizeof(tag_bytes),
+        .ptr = tag_bytes,
+    };
+    try(aes_ccm_stream_tag(ccm, tag));
+    ensure_eq(coap_packet_append_payload(out, tag.ptr, (u16_t)tag.len), 0, OscoreCoapPacketAppendError);
+    return OscoreNoError;
+}
+
+/**
+ * Protects an already encoded plaintext with a fresh Partial IV and writes the resulting OSCORE packet.
+ * @param inner Encoded plaintext and options of the message to protect
+ * @param request_info request_kid and request_piv to include into the AAD
+ * @param request Original request packet (for the Proxy-URI option), can be NULL
+ * @param type CoAP Type of the OSCORE packet
+ * @param token Token of the OSCORE packet
+ * @param tkl Length of @a token
+ * @param code Outer CoAP Code of the OSCORE packet
+ * @param id Message ID of the OSCORE packet
+ * @param out out-pointer which will contain the OSCORE packet
+ * @return OscoreError
+ */
+static OscoreError protect_inner(struct oscore_inner* inner, struct oscore_request* request_info, struct coap_packet* request,
+                                 u8_t type, const u8_t* token, u8_t tkl, u8_t code, u16_t id, struct coap_packet* out) {
+    profile_begin(total);
+    struct aes_ccm_stream ccm;
+    OscoreError res = start_protected_packet(inner->options, inner->opt_num, request_info, request, type, token, tkl,
+                                             code, id, inner->plaintext.len, &ccm, out);
+    if (res == OscoreNoError) {
+        log_hex("plaintext to send", inner->plaintext.ptr, inner->plaintext.len);
+        profile_begin(stage);
+        res = append_encrypted(&ccm, inner->plaintext, out);
+        if (res == OscoreNoError) {
+            res = append_tag(&ccm, out);
+        }
+        if (res != OscoreNoError) {
+            net_pkt_unref(out->pkt);
+        }
+        profile_end(ProfileProtectCcm, stage);
+    }
+    trace(TraceProtected, res, inner->plaintext.len);
+    profile_end(ProfileProtect, total);
+    return res;
+}
+
+OscoreError into_oscore(struct coap_packet response, struct coap_packet* request, struct coap_packet* out) {
+    // get request OSCORE option value, which is needed for the AAD
+    struct oscore_request request_info;
+    try(oscore_request_init(request, &request_info));
+
+    // Collect all information to create plaintext to encrypt
+    // The plaintext is at most as long as the CoAP Code, all options and the payload together.
+    size_t max_len = 1 + net_pkt_get_len(response.pkt) - response.offset - response.hdr_len;
+    size_t mark = scratch_mark();
+    array plaintext_buffer = {
+        .len = max_len,
+        .ptr = scratch_alloc(max_len),
+    };
+    ensure(plaintext_buffer.ptr != NULL, OscoreScratchExhausted);
+    struct oscore_inner inner;
+    OscoreError res = oscore_inner_encode(&response, plaintext_buffer, &inner);
+
+    u8_t token[8];
+    u8_t tkl = coap_header_get_token(&response, token);
+//    u8_t request_code = coap_header_get_code(request);
+    u8_t code_faked = COAP_RESPONSE_CODE_CHANGED;
+    if (res == OscoreNoError) {
+        res = protect_inner(&inner, &request_info, request, coap_header_get_type(&response), token, tkl, code_faked,
+                            coap_header_get_id(&response), out);
+    }
+    scratch_release(mark);
+    try(res);
 
     // TODO: find out if we need to unref `request` because we constructed it manually
     net_pkt_unref(response.pkt);
     return OscoreNoError;
 }
 
+OscoreError into_oscore_inner(struct oscore_inner* inner, struct coap_packet* request, u8_t type, u16_t id,
+                              struct coap_packet* out) {
+    struct oscore_request request_info;
+    try(oscore_request_init(request, &request_info));
+
+    u8_t token[8];
+    u8_t tkl = coap_header_get_token(request, token);
+    u8_t code_faked = COAP_RESPONSE_CODE_CHANGED;
+    return protect_inner(inner, &request_info, request, type, token, tkl, code_faked, id, out);
+}
+
+OscoreError into_oscore_notification(struct oscore_inner* notification, struct oscore_request* registration, u8_t type,
+                                     const u8_t* token, u8_t tkl, u16_t id, struct coap_packet* out) {
+    // "the Outer Code of [...] Observe notifications SHALL be 2.05 (Content)"
+    // Every notification gets a fresh Partial IV, but keeps the request_kid and request_piv of the registration.
+    struct oscore_request notification_info = *registration;
+    notification_info.fresh_piv = true;
+    return protect_inner(notification, &notification_info, NULL, type, token, tkl, COAP_RESPONSE_CODE_CONTENT, id,
+                         out);
+}
+
+OscoreError oscore_echo_challenge(struct coap_packet* request, u8_t type, u16_t id, struct coap_packet* out) {
+    struct oscore_request request_info;
+    try(oscore_request_init(request, &request_info));
+    array kid = {
+        .len = request_info.kid_len,
+        .ptr = request_info.kid,
+    };
+    int peer = find_recipient_peer(kid);
+    ensure(peer >= 0, OscoreInvalidKid);
+
+    // Plaintext: 4.01 (Unauthorized) || Echo Option
+    struct oscore_inner inner;
+    inner.opt_num = 1;
+    inner.options[0].delta = COAP_OPTION_ECHO;
+    inner.options[0].len = OSCORE_ECHO_LEN;
+    echo_challenge((u16_t) peer, inner.options[0].value);
+    u8_t plaintext[1 + 2 + OSCORE_ECHO_LEN];
+    plaintext[0] = COAP_RESPONSE_CODE_UNAUTHORIZED;
+    inner.plaintext.len = 1 + encode_options(inner.options, inner.opt_num, CLASS_E, &plaintext[1]);
+    inner.plaintext.ptr = plaintext;
+    assert_eq(inner.plaintext.len, sizeof(plaintext));
+
+    // another challenge of the same request would reuse its nonce with a different plaintext
+    request_info.fresh_piv = true;
+    u8_t token[8];
+    u8_t tkl = coap_header_get_token(request, token);
+    return protect_inner(&inner, &request_info, request, type, token, tkl, COAP_RESPONSE_CODE_CHANGED, id, out);
+}
+
+OscoreError oscore_protect_stream_init(struct coap_packet* response, struct coap_packet* request, u16_t payload_len,
+                                       struct oscore_protect_stream* stream, struct coap_packet* out) {
+    struct oscore_request request_info;
+    try(oscore_request_init(request, &request_info));
+
+    struct coap_option options[OSCORE_MAX_OPTIONS];
+    u16_t opt_num;
+    try(read_built_options(response, options, OSCORE_MAX_OPTIONS, &opt_num));
+    // the payload is passed to `oscore_protect_stream_update` instead
+    ensure_eq(net_pkt_get_len(response->pkt) - response->offset - response->hdr_len - response->opt_len, 0,
+              OscoreCoapPacketParseError);
+
+    // Plaintext: CoAP Code || Class E options || 0xFF (if payload) || payload (if any)
+    // Everything but the payload is encrypted right away.
+    u32_t encoded_opt_len = encoded_option_len(options, opt_num, CLASS_E);
+    size_t mark = scratch_mark();
+    array header = {
+        .len = 1 + encoded_opt_len,
+        .ptr = scratch_alloc(1 + encoded_opt_len + 1),
+    };
+    ensure(header.ptr != NULL, OscoreScratchExhausted);
+    header.ptr[0] = coap_header_get_code(response);
+    assert_eq(encode_options(options, opt_num, CLASS_E, &header.ptr[1]), encoded_opt_len);
+    if (payload_len > 0) {
+        header.ptr[header.len++] = 0xff;
+    }
+
+    u8_t token[8];
+    u8_t tkl = coap_header_get_token(response, token);
+    u8_t code_faked = COAP_RESPONSE_CODE_CHANGED;
+    OscoreError res = start_protected_packet(options, opt_num, &request_info, request, coap_header_get_type(response),
+                                             token, tkl, code_faked, coap_header_get_id(response),
+                                             header.len + payload_len, &stream->ccm, out);
+    if (res == OscoreNoError) {
+        res = append_encrypted(&stream->ccm, header, out);
+        if (res != OscoreNoError) {
+            net_pkt_unref(out->pkt);
+        }
+    }
+    scratch_release(mark);
+    try(res);
+
+    net_pkt_unref(response->pkt);
+    return OscoreNoError;
+}
+
+OscoreError oscore_protect_stream_update(struct oscore_protect_stream* stream, struct net_buf* frag, u16_t offset,
+                                         u16_t len, struct coap_packet* out) {
+    while (len > 0) {
+        ensure(frag != NULL, OscoreNetPacketReadError);
+        if (offset >= frag->len) {
+            offset -= frag->len;
+            frag = frag->frags;
+            continue;
+        }
+        array chunk = {
+            .len = min(len, frag->len - offset),
+            .ptr = &frag->data[offset],
+        };
+        try(append_encrypted(&stream->ccm, chunk, out));
+        len -= chunk.len;
+        offset = 0;
+        frag = frag->frags;
+    }
+    return OscoreNoError;
+}
+
+OscoreError oscore_protect_stream_finish(struct oscore_protect_stream* stream, struct coap_packet* out) {
+    // fails if less payload was passed than announced in `oscore_protect_stream_init`
+    return append_tag(&stream->ccm, out);
+}
+
+OscoreError oscore_unprotect_stream_init(struct coap_packet* request, struct oscore_unprotect_stream* stream,
+                                         u16_t* plaintext_len) {
+    u8_t opt_num = OSCORE_MAX_OPTIONS;
+    struct coap_option options[OSCORE_MAX_OPTIONS];
+    try(get_options(request, options, &opt_num));
+
+    array oscore_value = get_option_value(options, opt_num, COAP_OPTION_OSCORE);
+    ensure(!array_equals(oscore_value, NULL_ARRAY), OscoreNoOscoreOption);
+    u8_t partial_iv_bytes[8] = { 0 };
+    u8_t kid_bytes[7] = { 0 };
+    u8_t kid_context_bytes[16] = { 0 };
+    struct unprotected unprotected = {
+        .partial_iv = {
+            .len = sizeof(partial_iv_bytes),
+            .ptr = partial_iv_bytes,
+        },
+        .kid = {
+            .len = sizeof(kid_bytes),
+            .ptr = kid_bytes,
+        },
+        .kid_context = {
+            .len = sizeof(kid_context_bytes),
+            .ptr = kid_context_bytes,
+        }
+    };
+    u8_t nonce[13];
+    struct security_context* ctx;
+    try(recipient_nonce(oscore_value, &unprotected, nonce, &ctx));
+    ensure(unprotected.partial_iv.len <= sizeof(stream->piv), OscoreInvalidPartialIvLength);
+    memcpy(stream->piv, unprotected.partial_iv.ptr, unprotected.partial_iv.len);
+    stream->piv_len = (u8_t)unprotected.partial_iv.len;
+
+    struct payload_info info;
+    try(get_payload_info(request, &info));
+    ensure(info.len > AES_CCM_TAG_LEN, OscoreCoapPacketNoPayload);
+
+    size_t aad_len;
+    try(aad_length(options, opt_num, (enum aead_algorithm) ctx->aead_alg, context_recipient_id(ctx),
+                   unprotected.partial_iv, &aad_len));
+    size_t mark = scratch_mark();
+    array aad = {
+        .len = aad_len,
+        .ptr = scratch_alloc(aad_len),
+    };
+    ensure(aad.ptr != NULL, OscoreScratchExhausted);
+    OscoreError res = create_aad(options, opt_num, (enum aead_algorithm) ctx->aead_alg, context_recipient_id(ctx),
+                                 unprotected.partial_iv, aad);
+    if (res == OscoreNoError) {
+        res = cose_encrypt0_stream_init(&stream->ccm, &ctx->recipient_sched, nonce, aad,
+                                        info.len - AES_CCM_TAG_LEN);
+    }
+    scratch_release(mark);
+    try(res);
+    stream->peer = find_recipient_peer(unprotected.kid);
+
+    stream->frag = info.frag;
+    stream->offset = info.offset;
+    *plaintext_len = info.len - AES_CCM_TAG_LEN;
+    return OscoreNoError;
+}
+
+OscoreError oscore_unprotect_stream_read(struct oscore_unprotect_stream* stream, array out) {
+    ensure(out.len <= stream->ccm.remaining, OscoreOutTooLong);
+    stream->frag = net_frag_read(stream->frag, stream->offset, &stream->offset, (u16_t)out.len, out.ptr);
+    ensure(!(stream->frag == NULL && stream->offset == 0xFFFF), OscoreNetPacketReadError);
+    try(aes_ccm_stream_decrypt(&stream->ccm, out, out));
+    return OscoreNoError;
+}
+
+OscoreError oscore_unprotect_stream_finish(struct oscore_unprotect_stream* stream) {
+    u8_t tag_bytes[AES_CCM_TAG_LEN];
+    array tag = {
+        .len = sizeof(tag_bytes),
+        .ptr = tag_bytes,
+    };
+    struct net_buf* frag = net_frag_read(stream->frag, stream->offset, &stream->offset, (u16_t)tag.len, tag.ptr);
+    ensure(!(frag == NULL && stream->offset == 0xFFFF), OscoreNetPacketReadError);
+    // fails if not all of the plaintext was read
+    try(aes_ccm_stream_verify(&stream->ccm, tag));
+    array partial_iv = {
+        .len = stream->piv_len,
+        .ptr = stream->piv,
+    };
+    // the context may have been evicted and derived again while the plaintext was read
+    struct security_context* ctx;
+    try(peer_context((size_t) stream->peer, &ctx));
+    return accept_request(stream->peer, ctx, partial_iv, NULL);
+}
+
+/// FETCH (RFC8132) isn't part of Zephyr's `enum coap_method`
+#define OSCORE_METHOD_FETCH 5
+
+/**
+ * Protects @a request, whose plaintext is encoded into @a plaintext_buffer. See `oscore_protect_request`.
+ * @param request Unprotected request
+ * @param plaintext_buffer Buffer with at least room for the CoAP Code, all options and the payload of @a request
+ * @param out out-pointer which will contain the OSCORE request
+ * @return OscoreError
+ */
+static OscoreError protect_request(struct coap_packet request, array plaintext_buffer, struct coap_packet* out) {
+    struct oscore_inner inner;
+    try(oscore_inner_encode(&request, plaintext_buffer, &inner));
+
+    // request_kid and request_piv of the AAD are our own sender ID and the fresh Partial IV
+    struct security_context* ctx;
+    try(peer_context(0, &ctx));
+    struct unprotected unprotected = {
+        .partial_iv = EMPTY_ARRAY,
+        .kid = context_sender_id(ctx),
+        .kid_context = NULL_ARRAY,
+    };
+    try(next_partial_iv(&peers[0], ctx, &unprotected.partial_iv));
+    struct oscore_request request_info;
+    ensure(unprotected.kid.len <= sizeof(request_info.kid), OscoreInvalidKidLength);
+    ensure(unprotected.partial_iv.len <= sizeof(request_info.piv), OscoreInvalidPartialIvLength);
+    memcpy(request_info.kid, unprotected.kid.ptr, unprotected.kid.len);
+    request_info.kid_len = (u8_t)unprotected.kid.len;
+    memcpy(request_info.piv, unprotected.partial_iv.ptr, unprotected.partial_iv.len);
+    request_info.piv_len = (u8_t)unprotected.partial_iv.len;
+    request_info.fresh_piv = false;
+    array request_kid = {
+        .len = request_info.kid_len,
+        .ptr = request_info.kid,
+    };
+    array request_piv = {
+        .len = request_info.piv_len,
+        .ptr = request_info.piv,
+    };
+    u8_t nonce[13];
+    try(create_nonce(request_kid, request_piv, context_common_iv(ctx), &nonce[0]));
+
+    // "The Outer Code of the OSCORE message SHALL be set to 0.02 (POST) or 0.05 (FETCH)", FETCH for Observe
+    bool observe = get_option_value(inner.options, (u8_t)inner.opt_num, COAP_OPTION_OBSERVE).ptr != NULL;
+    u8_t code = observe ? OSCORE_METHOD_FETCH : COAP_METHOD_POST;
+    u8_t token[8];
+    u8_t tkl = coap_header_get_token(&request, token);
+    try(exchange_add(token, tkl, &request_info, observe));
+
+    struct aes_ccm_stream ccm;
+    OscoreError res = start_protected_message(ctx, inner.options, inner.opt_num, request_kid, request_piv, unprotected,
+                                              nonce, NULL, coap_header_get_type(&request), token, tkl, code,
+                                              coap_header_get_id(&request), inner.plaintext.len, &ccm, out);
+    if (res != OscoreNoError) {
+        exchange_remove(token, tkl);
+        return res;
+    }
+    res = append_encrypted(&ccm, inner.plaintext, out);
+    if (res == OscoreNoError) {
+        res = append_tag(&ccm, out);
+    }
+    if (res != OscoreNoError) {
+        exchange_remove(token, tkl);
+        net_pkt_unref(out->pkt);
+        return res;
+    }
+
+    net_pkt_unref(request.pkt);
+    return OscoreNoError;
+}
+
+OscoreError oscore_protect_request(struct coap_packet request, struct coap_packet* out) {
+    size_t max_len = 1 + net_pkt_get_len(request.pkt) - request.offset - request.hdr_len;
+    size_t mark = scratch_mark();
+    array plaintext_buffer = {
+        .len = max_len,
+        .ptr = scratch_alloc(max_len),
+    };
+    ensure(plaintext_buffer.ptr != NULL, OscoreScratchExhausted);
+    OscoreError res = protect_request(request, plaintext_buffer, out);
+    scratch_release(mark);
+    return res;
+}
+
+OscoreError oscore_unprotect_response(struct coap_packet response, struct coap_packet* out) {
+    u8_t opt_num = OSCORE_MAX_OPTIONS;
+    struct coap_option options[OSCORE_MAX_OPTIONS];
+    try(get_options(&response, options, &opt_num));
+
+    // the OSCORE option of a response may be empty, thus check the pointer instead of comparing with NULL_ARRAY
+    array oscore_value = get_option_value(options, opt_num, COAP_OPTION_OSCORE);
+    ensure(oscore_value.ptr != NULL, OscoreNoOscoreOption);
+    u8_t partial_iv_bytes[8] = { 0 };
+    // TODO: actually be generic over the algorithm
+    u8_t kid_bytes[7] = { 0 };
+    u8_t kid_context_bytes[16] = { 0 };
+    struct unprotected unprotected = {
+        .partial_iv = {
+            .len = sizeof(partial_iv_bytes),
+            .ptr = partial_iv_bytes,
+        },
+        .kid = {
+            .len = sizeof(kid_bytes),
+            .ptr = kid_bytes,
+        },
+        .kid_context = {
+            .len = sizeof(kid_context_bytes),
+            .ptr = kid_context_bytes,
+        }
+    };
+    try(from_oscore_option(oscore_value, &unprotected));
+
+    u8_t token[8];
+    u8_t tkl = coap_header_get_token(&response, token);
+    struct oscore_request request_info;
+    try(exchange_find(token, tkl, &request_info));
+    array request_kid = {
+        .len = request_info.kid_len,
+        .ptr = request_info.kid,
+    };
+    array request_piv = {
+        .len = request_info.piv_len,
+        .ptr = request_info.piv,
+    };
+    // the request was protected with our sender ID as kid
+    int peer = find_sender_peer(request_kid);
+    ensure(peer >= 0, OscoreInvalidKid);
+    struct security_context* ctx;
+    try(peer_context((size_t) peer, &ctx));
+
+    u8_t nonce[13];
+    if (unprotected.partial_iv.len == 0) {
+        // the server reused the nonce of our request
+        try(create_nonce(request_kid, request_piv, context_common_iv(ctx), nonce));
+    } else {
+        // the Partial IV was generated by the server, whose sender ID is our recipient ID
+        try(create_nonce(context_recipient_id(ctx), unprotected.partial_iv, context_common_iv(ctx), nonce));
+    }
+    size_t mark = scratch_mark();
+    OscoreError res = decrypt_message(ctx, &response, options, opt_num, request_kid, request_piv, nonce, out);
+    scratch_release(mark);
+    try(res);
+    exchange_complete(token, tkl);
+
+    net_pkt_unref(response.pkt);
+    return OscoreNoError;
+}
+
+void oscore_cancel_request(const u8_t* token, u8_t tkl) {
+    exchange_remove(token, tkl);
+}
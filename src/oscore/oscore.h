@@ -18,6 +18,7 @@
 #include <tinycrypt/ccm_mode.h>
 #include "../util/array.h"
 #include "../crypto/security_context.h"
+#include "../crypto/aes.h"
 
 
 extern u8_t MASTER_SECRET[16];
@@ -27,15 +28,190 @@ extern struct pre_established PRE_ESTABLISHED;
 
 // TODO: temporary assignment to comply with oscore_californium and aiocoap
 static const int COAP_OPTION_OSCORE = 9;
+/// Echo Option (RFC9175), not known to Zephyr's CoAP library
+static const int COAP_OPTION_ECHO = 252;
+
+#ifndef OSCORE_MAX_CONTEXTS
+/// Maximum number of security contexts, i.e. peers, see `oscore_add_context`
+#define OSCORE_MAX_CONTEXTS 4
+#endif
+
+#ifndef OSCORE_CONTEXT_BUCKETS
+/// Number of hash buckets the security contexts are looked up in by Recipient ID, a power of two
+#define OSCORE_CONTEXT_BUCKETS 16
+#endif
+
+// With OSCORE_LAZY_CONTEXTS, `oscore_add_context` only keeps the pre-established material of a peer. Its keys and
+// Common IV are derived when its first message is protected or unprotected, into a cache of OSCORE_DERIVED_CONTEXTS
+// contexts. The cache consists of sets of OSCORE_CONTEXT_WAYS contexts, a peer's set is selected by the hash of its
+// Recipient ID. The least recently used context of the set is evicted, its Sender Sequence Number and replay window
+// are kept with the peer and restored when it's derived again. Adding a peer then takes constant time and the
+// memory of derived contexts is bounded by the number of active peers.
+//
+// Without it, every context is derived by `oscore_add_context`.
+#ifdef OSCORE_LAZY_CONTEXTS
+#ifndef OSCORE_DERIVED_CONTEXTS
+/// Number of derived security contexts, a power of two multiple of OSCORE_CONTEXT_WAYS
+#define OSCORE_DERIVED_CONTEXTS 2
+#endif
+#ifndef OSCORE_CONTEXT_WAYS
+/// Number of derived security contexts a peer's context can be cached in
+#define OSCORE_CONTEXT_WAYS OSCORE_DERIVED_CONTEXTS
+#endif
+#else
+#define OSCORE_DERIVED_CONTEXTS OSCORE_MAX_CONTEXTS
+#define OSCORE_CONTEXT_WAYS 1
+#endif
+/// Number of sets of derived security contexts
+#define OSCORE_CONTEXT_SETS (OSCORE_DERIVED_CONTEXTS / OSCORE_CONTEXT_WAYS)
 
 /**
  * Initializes the security contexts given the pre-established data.
  * This function must be called before invoking `into_oscore` or `from_oscore`.
  * It should be called once during app initialisaiton.
+ * Security contexts added before are dropped, @a pre_established becomes the only one.
  * @param pre_established pre-established data
  * @return OscoreError
  */
 OscoreError oscore_init(struct pre_established pre_established);
+
+/**
+ * Derives the security context of another peer, after `oscore_init`.
+ * Received requests are decrypted with the context whose Recipient ID is their kid, their responses are protected
+ * with the same context. Requests are always protected with the context of `oscore_init`.
+ * @param pre_established pre-established data, which is copied: the IDs, ID Context and keying material needn't stay
+ *          valid afterwards
+ * @return OscoreError, OscoreInvalidKid if another context has the same Recipient ID,
+ *          OscoreTooManyContexts if there are OSCORE_MAX_CONTEXTS already. OscoreInvalidKidLength,
+ *          OscoreInvalidKidContextLength or OscoreInvalidKeyLength if an ID, the ID Context, the Master Secret or the
+ *          Master Salt is longer than OSCORE_MAX_ID_LEN, OSCORE_MAX_ID_CONTEXT_LEN or OSCORE_MAX_SECRET_LEN
+ */
+OscoreError oscore_add_context(struct pre_established pre_established);
+
+/**
+ * Hash of a kid, which selects the bucket and set of its security context.
+ * @param kid kid of a request, i.e. the Recipient ID of its security context
+ * @return hash
+ */
+u32_t oscore_kid_hash(array kid);
+
+/**
+ * Partition of the security contexts a kid belongs to.
+ * A server running the OSCORE path on several threads can process every request on thread
+ * `oscore_kid_partition(kid, threads)`: then each context (its sequence number and replay window) and each set of
+ * derived contexts belongs to a single thread and needs no locking. With OSCORE_LAZY_CONTEXTS, only
+ * OSCORE_CONTEXT_SETS partitions can be used.
+ * @param kid kid of a request, i.e. the Recipient ID of its security context
+ * @param partitions Number of partitions, e.g. threads
+ * @return partition
+ */
+u32_t oscore_kid_partition(array kid, u32_t partitions);
+
+/// Usage of the security contexts
+struct oscore_context_stats {
+    /// peers added with `oscore_init` and `oscore_add_context`
+    u32_t peers;
+    /// peers whose context is derived at the moment
+    u32_t derived;
+    /// derivations of security contexts
+    u32_t derivations;
+    /// derived contexts evicted to make room for another peer's
+    u32_t evictions;
+    /// derived contexts taken from a snapshot by `oscore_restore`
+    u32_t restored;
+    /// bytes per peer of the peer table, which holds the pre-established material and the lookup key
+    u32_t peer_bytes;
+    /// bytes per derived context, of which there are OSCORE_DERIVED_CONTEXTS
+    u32_t context_bytes;
+};
+
+/**
+ * Copies the usage of the security contexts.
+ * @param out out-pointer to write the statistics into
+ */
+void oscore_get_context_stats(struct oscore_context_stats* out);
+
+// A snapshot holds the derived security contexts (keys, Common IV, Sender Sequence Number and replay window) of all
+// peers in a versioned binary format protected by an HMAC, see `oscore/snapshot.h`. Saved to flash, it lets a device
+// restore its contexts at boot without deriving them again and keep its sequence numbers across a reset.
+// The snapshot contains the keys in plain, so it has to be stored where the Master Secrets may be stored.
+//
+// Every context may send OSCORE_SEQ_RESERVATION messages after a snapshot was saved, a restored context continues
+// after them (RFC8613 B.1.1). Once a context used them up, messages which need a fresh Partial IV fail with
+// OscoreSequenceExhausted. The application has to save a new snapshot before that, see `oscore_snapshot_due`, and
+// right after `oscore_restore`, which reserves nothing, as another reset would restore the same sequence numbers.
+// Requests accepted after the snapshot was saved aren't in the restored replay windows, so the restored peers have to
+// answer an Echo challenge first, see `oscore_require_echo`.
+
+#ifndef OSCORE_SEQ_RESERVATION
+/// Sender Sequence Numbers a context may use after its snapshot was saved. A snapshot is due every
+/// OSCORE_SEQ_RESERVATION / 2 fresh Partial IVs, and every reset skips up to OSCORE_SEQ_RESERVATION of them.
+#define OSCORE_SEQ_RESERVATION 1024
+#endif
+
+/**
+ * Length of a snapshot of the current security contexts.
+ * @return length in bytes
+ */
+size_t oscore_snapshot_len(void);
+
+/**
+ * Saves a snapshot of the security contexts. It must not run concurrently with the protection or verification of
+ * messages.
+ * @param key Key of the snapshot's HMAC
+ * @param out Buffer of at least `oscore_snapshot_len` bytes
+ * @return OscoreError, OscoreOutTooLong if @a out is too short
+ */
+OscoreError oscore_snapshot_save(array key, array out);
+
+/**
+ * Initializes the security contexts like `oscore_init` with the first peer and `oscore_add_context` with the others,
+ * but takes the contexts from a snapshot instead of deriving them. Peers whose pre-established material isn't in
+ * the snapshot are derived as usual.
+ * @param pre_established pre-established data of the peers, the first one is used to protect requests
+ * @param count Number of peers
+ * @param key Key of the snapshot's HMAC
+ * @param snapshot Snapshot written by `oscore_snapshot_save`, e.g. in memory-mapped flash. It isn't referenced
+ *          afterwards.
+ * @return OscoreError, OscoreInvalidSnapshot without changing the contexts if the snapshot was written by another
+ *          version or build of this implementation, or was modified
+ */
+OscoreError oscore_restore(const struct pre_established* pre_established, size_t count, array key, array snapshot);
+
+/**
+ * Checks whether a context used half of the sequence numbers reserved by the last snapshot, so a new one should be
+ * saved.
+ * @return true if a snapshot is due, always after `oscore_restore`. false if none was saved or restored yet.
+ */
+bool oscore_snapshot_due(void);
+
+// After a reboot the replay windows are lost, or miss the requests accepted since the snapshot they were restored
+// from. Accepting any Partial IV would let old requests be replayed, saving the windows would cost a flash write per
+// request. Instead, a peer whose replay window is unknown has to prove that a request is fresh (RFC8613 B.1.2):
+// `from_oscore` verifies its requests, but rejects them with OscoreEchoRequired until one repeats the value of an
+// Echo Option. The server answers the rejected requests with `oscore_echo_challenge`, a 4.01 (Unauthorized) with a
+// random Echo value. A request echoing it was sent after the challenge, so its Partial IV becomes the lower limit of
+// the replay window and the peer is served again after one round trip. Up to OSCORE_ECHO_CHALLENGES peers can be
+// challenged at the same time, see `oscore/echo.h`.
+
+/**
+ * Marks the replay windows of all peers as unknown. To be called at boot after `oscore_init` and
+ * `oscore_add_context` if the Master Secrets were used before. `oscore_restore` marks the peers it restores.
+ */
+void oscore_require_echo(void);
+
+/**
+ * Protects the response to a request rejected with OscoreEchoRequired: a 4.01 (Unauthorized) with the Echo Option
+ * its peer has to repeat. The request may be a replay, so the response gets a fresh Partial IV instead of reusing
+ * the request's nonce.
+ * @param request Received OSCORE request, `from_oscore` didn't consume it
+ * @param type CoAP Type of the response
+ * @param id Message ID of the response
+ * @param out out-pointer which will contain the OSCORE response
+ * @return OscoreError
+ */
+OscoreError oscore_echo_challenge(struct coap_packet* request, u8_t type, u16_t id, struct coap_packet* out);
+
 // There are two ways of implementing oscore transformation. The first is to make the user build the packet
 // with a custom API similar to how coap-packets are built. That would be rather fast but require the user
 // to rewrite everything if they have already implemented a coap handler.
@@ -46,19 +222,133 @@ OscoreError oscore_init(struct pre_established pre_established);
 // needs to be allocated and filled.
 // Nevertheless this is an implementation of the second way for simplicity and easier integration.
 //
-// Observer is not supported ("Observe [RFC7641] is an optional feature")
-// TODO: support Observer
+// Observe ("Observe [RFC7641] is an optional feature") is supported by encoding the plaintext of a notification
+// once with `oscore_inner_encode` and protecting it for every observer with `into_oscore_notification`.
+
+/// Maximum number of CoAP Options of a message whose plaintext is encoded with `oscore_inner_encode`.
+#define OSCORE_MAX_OPTIONS 10
+
+/**
+ * request_kid and request_piv of a protected request.
+ * Those are part of the AAD of every response to the request, including all notifications of an Observe registration.
+ */
+struct oscore_request {
+    // TODO: actually be generic over the algorithm
+    u8_t kid[7];
+    u8_t kid_len;
+    u8_t piv[5];
+    u8_t piv_len;
+    /**
+     * Whether responses need their own Partial IV. Otherwise they reuse the request's nonce and carry an empty
+     * OSCORE Option (RFC8613 8.3), which saves the option bytes and a sender sequence number per response.
+     * `oscore_request_init` leaves this unset, responses with an Observe Option always get a fresh Partial IV.
+     */
+    bool fresh_piv;
+};
+
+/**
+ * Plaintext (CoAP Code, Class E Options and payload) of a message together with all of its options.
+ * It can be protected any number of times, e.g. once for every observer of a resource.
+ */
+struct oscore_inner {
+    struct coap_option options[OSCORE_MAX_OPTIONS];
+    u16_t opt_num;
+    /// points into the buffer passed to `oscore_inner_encode`
+    array plaintext;
+};
+
+/**
+ * Returns whether the given packet contains an OSCORE Option.
+ * Decrypted requests keep their OSCORE Option, which can be used by handlers to find out if they need to
+ * protect their response.
+ * @param packet Packet to check
+ * @return true if the packet contains an OSCORE Option
+ */
+bool has_oscore_option(struct coap_packet* packet);
+
+/**
+ * Saves the request_kid and request_piv of a (decrypted) OSCORE request, e.g. for an Observe registration.
+ * @param request Request containing an OSCORE Option
+ * @param out out-pointer to write request_kid and request_piv into
+ * @return OscoreError
+ */
+OscoreError oscore_request_init(struct coap_packet* request, struct oscore_request* out);
+
+/**
+ * Copies the options of a locally built packet into @a options.
+ *
+ * We can't use coap_packet_parse here because it assumes a fully built packet, which this isn't (yet before sending it).
+ * coap_packet_parse will skip over the network headers to get to the COAP header,
+ * but our COAP header already starts where the offset is pointing to.
+ * All that coap_packet_parse does is
+ * 1. Skip headers (not needed here)
+ * 2. Check that the fragment is valid (we assume this here as it should have been written to before being
+ *    passed to us.
+ * 3. Set the hdr_len (also not needed here) and check if tkl is valid (also not needed here)
+ * 4. Parse the options (done here)
+ * @param message Locally built packet
+ * @param options Option-array with @a max_opt_num entries to decode the options into
+ * @param max_opt_num Length of @a options
+ * @param opt_num out-pointer to write the number of decoded options into
+ * @return OscoreError
+ */
+OscoreError read_built_options(struct coap_packet* message, struct coap_option* options, u16_t max_opt_num,
+                               u16_t* opt_num);
+
+/**
+ * Encodes the plaintext of a locally built, unencrypted packet.
+ * The packet is not consumed.
+ * @param message Unencrypted packet
+ * @param buffer Buffer to encode the plaintext into. Must be at least as long as the CoAP Code, options and payload
+ *          of @a message together.
+ * @param out out-pointer which will contain the options and plaintext
+ * @return OscoreError
+ */
+OscoreError oscore_inner_encode(struct coap_packet* message, array buffer, struct oscore_inner* out);
 
 /**
  * Decrypts an OSCORE coap_packet and transforms it into a CoAP packet
  * @param request Packet to decrypt
  * @param out out-pointer which will contain the decrypted CoAP packet
- * @return OscoreError
+ * @return OscoreError, OscoreEchoRequired if the request is authentic, but its peer has to answer the challenge of
+ *          `oscore_echo_challenge` first
  */
 OscoreError from_oscore(struct coap_packet request, struct coap_packet* out);
 
+/// Number of requests dropped by `oscore_prefilter`, per reason
+struct oscore_drop_stats {
+    /// no OSCORE Option or one which can't be decoded
+    u32_t invalid_option;
+    /// kid isn't the recipient ID of any security context
+    u32_t unknown_kid;
+    /// Partial IV missing or longer than 5 bytes
+    u32_t invalid_partial_iv;
+    /// payload missing or shorter than the authentication tag
+    u32_t invalid_payload;
+    /// Partial IV already received or outside the replay window
+    u32_t replayed;
+};
+
 /**
- * Encrypts a coap_packet and converts it to its OSCORE form
+ * Checks a received OSCORE request before anything is copied or decrypted.
+ *
+ * Only the OSCORE Option is decoded; kid, Partial IV, payload length and the replay window are checked against the
+ * security context. Requests failing the filter can be dropped right away, every other check of `from_oscore` still
+ * applies. Not thread-safe, must only be called from the thread receiving requests.
+ * @param request Received OSCORE request, only its header and options need to be parsed
+ * @return OscoreError, OscoreNoError if the request should be decrypted
+ */
+OscoreError oscore_prefilter(struct coap_packet* request);
+
+/**
+ * Copies the drop counters of `oscore_prefilter`.
+ * @param out out-pointer to write the counters into
+ */
+void oscore_get_drop_stats(struct oscore_drop_stats* out);
+
+/**
+ * Encrypts a coap_packet and converts it to its OSCORE form.
+ * The response reuses the nonce of the request and gets an empty OSCORE Option, unless it contains an Observe Option.
  * @param response Packet to encrypt. The packet will be consumed and freed.
  * @param request Original request packet
  * @param out out-pointer which will contain the transformed OSCORE packet
@@ -66,4 +356,153 @@ OscoreError from_oscore(struct coap_packet request, struct coap_packet* out);
  */
 OscoreError into_oscore(struct coap_packet response, struct coap_packet* request, struct coap_packet* out);
 
+/**
+ * Protects an already encoded response to a (decrypted) OSCORE request, e.g. one served from a cache.
+ * Like `into_oscore`, the response reuses the request's nonce unless it is an Observe notification.
+ * @param inner Plaintext of the response as encoded by `oscore_inner_encode`. It isn't modified.
+ * @param request Original request packet, its token is used for the response
+ * @param type CoAP Type of the response
+ * @param id Message ID of the response
+ * @param out out-pointer which will contain the OSCORE packet
+ * @return OscoreError
+ */
+OscoreError into_oscore_inner(struct oscore_inner* inner, struct coap_packet* request, u8_t type, u16_t id,
+                              struct coap_packet* out);
+
+/**
+ * Protects an Observe notification with a fresh Partial IV and the request_kid / request_piv of its registration.
+ * @param notification Plaintext of the notification as encoded by `oscore_inner_encode`. It isn't modified, thus it
+ *          can be reused for all observers of the same resource state.
+ * @param registration request_kid and request_piv of the Observe registration
+ * @param type CoAP Type of the notification
+ * @param token Token of the Observe registration
+ * @param tkl Length of @a token
+ * @param id Message ID of the notification
+ * @param out out-pointer which will contain the OSCORE packet
+ * @return OscoreError
+ */
+OscoreError into_oscore_notification(struct oscore_inner* notification, struct oscore_request* registration, u8_t type,
+                                     const u8_t* token, u8_t tkl, u16_t id, struct coap_packet* out);
+
+/// State of a streamed protection, see `oscore_protect_stream_init`
+struct oscore_protect_stream {
+    struct aes_ccm_stream ccm;
+};
+
+/**
+ * Starts protecting a response whose payload is passed in chunks afterwards, e.g. directly from the fragments of
+ * another packet. Only a 16-byte block is held on the stack at a time, independent of the payload length.
+ *
+ * The total payload length needs to be known up front, as AES-CCM authenticates it before the first block.
+ * Call `oscore_protect_stream_update` until exactly @a payload_len bytes were passed,
+ * then `oscore_protect_stream_finish`.
+ * @param response Locally built response with all options, but without payload. The packet will be consumed and
+ *          freed on success.
+ * @param request Original request packet
+ * @param payload_len Total length of the payload which will be passed
+ * @param stream out-pointer to the stream state to initialize
+ * @param out out-pointer which will contain the OSCORE packet. The ciphertext is appended to it incrementally.
+ * @return OscoreError
+ */
+OscoreError oscore_protect_stream_init(struct coap_packet* response, struct coap_packet* request, u16_t payload_len,
+                                       struct oscore_protect_stream* stream, struct coap_packet* out);
+
+/**
+ * Encrypts the next chunk of the payload and appends it to the OSCORE packet.
+ * @param stream Stream state
+ * @param frag First fragment of the buffer chain containing the chunk
+ * @param offset Offset of the chunk within @a frag, may point into one of the following fragments
+ * @param len Length of the chunk
+ * @param out OSCORE packet created by `oscore_protect_stream_init`
+ * @return OscoreError
+ */
+OscoreError oscore_protect_stream_update(struct oscore_protect_stream* stream, struct net_buf* frag, u16_t offset,
+                                         u16_t len, struct coap_packet* out);
+
+/**
+ * Appends the authentication tag after the whole payload was passed.
+ * @param stream Stream state
+ * @param out OSCORE packet created by `oscore_protect_stream_init`
+ * @return OscoreError
+ */
+OscoreError oscore_protect_stream_finish(struct oscore_protect_stream* stream, struct coap_packet* out);
+
+/// State of a streamed decryption, see `oscore_unprotect_stream_init`
+struct oscore_unprotect_stream {
+    struct aes_ccm_stream ccm;
+    /// position of the next ciphertext byte
+    struct net_buf* frag;
+    u16_t offset;
+    /// Partial IV of the request, marked as received once the tag was verified
+    u8_t piv[5];
+    u8_t piv_len;
+    /// peer the request is from, its security context may be evicted while the stream is read
+    int peer;
+};
+
+/**
+ * Starts decrypting an OSCORE request chunk by chunk, instead of copying the whole ciphertext and plaintext
+ * to the stack like `from_oscore`.
+ *
+ * Call `oscore_unprotect_stream_read` until exactly @a plaintext_len bytes were read, then
+ * `oscore_unprotect_stream_finish`. The plaintext (CoAP Code || Class E options || 0xFF || payload) is
+ * unauthenticated until `oscore_unprotect_stream_finish` succeeded, thus MUST NOT be acted upon before.
+ * @param request OSCORE packet to decrypt. It is not consumed and must be kept until the stream is finished.
+ * @param stream out-pointer to the stream state to initialize
+ * @param plaintext_len out-pointer to write the total length of the plaintext into
+ * @return OscoreError
+ */
+OscoreError oscore_unprotect_stream_init(struct coap_packet* request, struct oscore_unprotect_stream* stream,
+                                         u16_t* plaintext_len);
+
+/**
+ * Decrypts the next chunk of the plaintext.
+ * @param stream Stream state
+ * @param out Buffer to write the next `out.len` bytes of the plaintext into
+ * @return OscoreError
+ */
+OscoreError oscore_unprotect_stream_read(struct oscore_unprotect_stream* stream, array out);
+
+/**
+ * Verifies the authentication tag after the whole plaintext was read.
+ * @param stream Stream state
+ * @return OscoreError, OscoreTinyCryptError if the message isn't authentic. OscoreEchoRequired if the peer's replay
+ *          window is unknown, see `oscore_require_echo`: the Echo Option of a streamed request isn't checked, so the
+ *          peer has to answer the challenge with a request passed to `from_oscore`.
+ */
+OscoreError oscore_unprotect_stream_finish(struct oscore_unprotect_stream* stream);
+
+// Client side: requests are protected with `oscore_protect_request`, which remembers the request_kid and request_piv
+// of every outstanding request by its token (see exchange.h). Responses are matched by their token in
+// `oscore_unprotect_response`, so many requests can be in flight at the same time.
+
+/**
+ * Protects a request to the peer of the security context of `oscore_init` with a fresh Partial IV.
+ * The request is remembered until its response arrives, EXCHANGE_LIFETIME passed or it is canceled.
+ * A request with an Observe Option is remembered for all notifications until it is canceled.
+ * @param request Packet to protect, its token MUST be unique among all outstanding requests. The packet will be
+ *          consumed and freed.
+ * @param out out-pointer which will contain the OSCORE packet
+ * @return OscoreError, OscoreTooManyExchanges if NUM_OSCORE_EXCHANGES requests are outstanding already
+ */
+OscoreError oscore_protect_request(struct coap_packet request, struct coap_packet* out);
+
+/**
+ * Verifies and decrypts a response to a request protected with `oscore_protect_request`.
+ * Responses reusing the request's nonce (empty OSCORE Option) as well as responses with their own Partial IV
+ * are accepted.
+ * @param response Received OSCORE response. It is consumed if decrypting succeeded.
+ * @param out out-pointer which will contain the decrypted CoAP packet
+ * @return OscoreError, OscoreUnknownExchange if no request with the response's token is outstanding
+ */
+OscoreError oscore_unprotect_response(struct coap_packet response, struct coap_packet* out);
+
+/**
+ * Forgets an outstanding request, e.g. to end an Observe registration or if the request couldn't be sent.
+ * Later responses with its token are rejected.
+ * @param token Token of the request
+ * @param tkl Length of @a token
+ */
+void oscore_cancel_request(const u8_t* token, u8_t tkl);
+
 #endif //NONE_OSCORE_H
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <kernel.h>
+#include "pkt_pool.h"
+
+NET_PKT_TX_SLAB_DEFINE(oscore_tx, OSCORE_TX_PKT_COUNT);
+NET_PKT_DATA_POOL_DEFINE(oscore_data, OSCORE_DATA_COUNT);
+
+static struct net_context* pool_context;
+static u32_t tx_high_water;
+static u32_t failures;
+
+static struct k_mem_slab* tx_pool(void) {
+    return &oscore_tx;
+}
+
+static struct net_buf_pool* data_pool(void) {
+    return &oscore_data;
+}
+
+void pkt_pool_setup(struct net_context* context) {
+    pool_context = context;
+    net_context_setup_pools(context, tx_pool, data_pool);
+}
+
+OscoreError pkt_pool_get(bool rx, s32_t timeout, struct net_pkt** out) {
+    struct net_pkt* pkt = rx ? net_pkt_get_rx(pool_context, timeout) : net_pkt_get_tx(pool_context, timeout);
+    if (pkt == NULL) {
+        failures++;
+        return OscorePktError;
+    }
+    struct net_buf* frag = net_pkt_get_data(pool_context, timeout);
+    if (frag == NULL) {
+        failures++;
+        net_pkt_unref(pkt);
+        return OscorePktError;
+    }
+    net_pkt_frag_add(pkt, frag);
+
+    if (!rx) {
+        // only a hint, concurrent allocations might skip a maximum
+        tx_high_water = max(tx_high_water, k_mem_slab_num_used_get(&oscore_tx));
+    }
+    *out = pkt;
+    return OscoreNoError;
+}
+
+void pkt_pool_get_stats(struct pkt_pool_stats* out) {
+    out->tx_used = k_mem_slab_num_used_get(&oscore_tx);
+    out->tx_high_water = tx_high_water;
+    out->failures = failures;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_PKT_POOL_H
+#define NONE_PKT_POOL_H
+
+#include <net/net_pkt.h>
+#include <net/net_context.h>
+#include "../util/error.h"
+
+// Protected messages are sent from their own pools, so a burst of OSCORE traffic can't starve the shared
+// CONFIG_NET_PKT_TX_COUNT pool and the shared pool can't block the OSCORE path indefinitely.
+
+/// Number of packets in the OSCORE TX pool
+#define OSCORE_TX_PKT_COUNT 10
+/**
+ * Number of data fragments in the OSCORE pool. Protecting adds the OSCORE Option (up to 13 bytes), the encrypted
+ * CoAP Code and the 8 byte tag, so a message filling one fragment before may need a second one afterwards.
+ * Decrypted requests take their fragments from this pool as well.
+ */
+#define OSCORE_DATA_COUNT 24
+/// Maximum time in milliseconds to wait for a free packet or fragment before a request is answered with 5.03
+#define OSCORE_PKT_TIMEOUT_MS 100
+
+/// Occupancy and failures of the OSCORE pools
+struct pkt_pool_stats {
+    /// TX packets in use
+    u32_t tx_used;
+    /// maximum number of TX packets in use at the same time
+    u32_t tx_high_water;
+    /// allocations of a packet or fragment which timed out
+    u32_t failures;
+};
+
+/**
+ * Makes @a context allocate its TX packets and data fragments from the OSCORE pools. Packets allocated with
+ * `pkt_pool_get` belong to this context.
+ * @param context Context used to send and receive OSCORE messages
+ */
+void pkt_pool_setup(struct net_context* context);
+
+/**
+ * Allocates a packet with one data fragment, waiting at most @a timeout for each of them.
+ * @param rx Whether to allocate an RX packet, e.g. for a decrypted request, instead of a TX packet
+ * @param timeout Timeout in milliseconds, or K_NO_WAIT
+ * @param out out-pointer to write the packet into
+ * @return OscoreError, OscorePktError if no packet or fragment was available in time
+ */
+OscoreError pkt_pool_get(bool rx, s32_t timeout, struct net_pkt** out);
+
+/**
+ * Copies the current occupancy and counters of the OSCORE pools.
+ * @param out out-pointer to write the statistics into
+ */
+void pkt_pool_get_stats(struct pkt_pool_stats* out);
+
+#endif //NONE_PKT_POOL_H
@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <string.h>
+#include <kernel.h>
+#include "response_cache.h"
+#include "options.h"
+#include "../util/macros.h"
+
+#define MAX_KEY_OPTIONS 8
+
+static struct response_cache_entry entries[NUM_RESPONSE_CACHE_ENTRIES];
+/// used entries, most recently used first
+static sys_dlist_t lru;
+static sys_dlist_t free_list;
+static struct response_cache_stats stats;
+
+/**
+ * Appends all values of an option of the request to the key, each prefixed by its length.
+ * @return OscoreError, OscoreTooManyOptions if the key gets too long
+ */
+static OscoreError append_key_options(struct coap_packet* request, u16_t code, u8_t* key, u8_t* key_len) {
+    struct coap_option options[MAX_KEY_OPTIONS];
+    int num = coap_find_options(request, code, options, MAX_KEY_OPTIONS);
+    ensure(num >= 0 && num < MAX_KEY_OPTIONS, OscoreTooManyOptions);
+    for (int i = 0; i < num; i++) {
+        ensure(*key_len + 1 + options[i].len <= RESPONSE_CACHE_MAX_KEY_LEN, OscoreTooManyOptions);
+        key[(*key_len)++] = options[i].len;
+        memcpy(&key[*key_len], options[i].value, options[i].len);
+        *key_len += options[i].len;
+    }
+    // separates the Uri-Path from the Uri-Query, as no option value is longer than 12 bytes
+    ensure(*key_len < RESPONSE_CACHE_MAX_KEY_LEN, OscoreTooManyOptions);
+    key[(*key_len)++] = 0xff;
+    return OscoreNoError;
+}
+
+/**
+ * Builds the cache key of a request from the kid of its sender and its Uri-Path, Uri-Query and Accept Options.
+ * The kid keeps a response from being served to another client, which might not be allowed to read it.
+ * @return OscoreError
+ */
+static OscoreError cache_key(struct coap_packet* request, u8_t* key, u8_t* key_len) {
+    struct oscore_request request_info;
+    try(oscore_request_init(request, &request_info));
+    key[0] = request_info.kid_len;
+    memcpy(&key[1], request_info.kid, request_info.kid_len);
+    *key_len = (u8_t)(1 + request_info.kid_len);
+    try(append_key_options(request, COAP_OPTION_URI_PATH, key, key_len));
+    try(append_key_options(request, COAP_OPTION_URI_QUERY, key, key_len));
+    try(append_key_options(request, COAP_OPTION_ACCEPT, key, key_len));
+    return OscoreNoError;
+}
+
+/**
+ * Block-wise transfers depend on the state of their session, thus blocks are never cached.
+ */
+static bool has_block_option(struct coap_packet* packet) {
+    struct coap_option option;
+    return coap_find_options(packet, COAP_OPTION_BLOCK1, &option, 1) > 0 ||
+           coap_find_options(packet, COAP_OPTION_BLOCK2, &option, 1) > 0;
+}
+
+/**
+ * Copies the plaintext of a response into @a entry and adds a Max-Age Option of @a max_age_len bytes, or replaces the
+ * one of the response, whose value is set to the remaining lifetime of the entry on every hit.
+ * @param inner Plaintext of the response as encoded by `oscore_inner_encode`
+ * @param max_age_len Length of the Max-Age value, which is at least the length of the lifetime of the entry
+ * @param entry Entry to copy the plaintext into
+ * @return OscoreError, OscoreOutTooLong if the plaintext doesn't fit into the entry
+ */
+static OscoreError copy_plaintext(struct oscore_inner* inner, u8_t max_age_len, struct response_cache_entry* entry) {
+    struct coap_option options[OSCORE_MAX_OPTIONS + 1];
+    u16_t opt_num = 0;
+    u16_t max_age_index = 0;
+    bool has_max_age = false;
+    u16_t code = 0;
+    u16_t last_code = 0;
+    for (u16_t i = 0; i < inner->opt_num; i++) {
+        code += inner->options[i].delta;
+        if (!has_max_age && code >= COAP_OPTION_MAX_AGE) {
+            options[opt_num] = (struct coap_option) {
+                .delta = (u16_t)(COAP_OPTION_MAX_AGE - last_code),
+                .len = max_age_len,
+            };
+            max_age_index = opt_num++;
+            last_code = COAP_OPTION_MAX_AGE;
+            has_max_age = true;
+            if (code == COAP_OPTION_MAX_AGE) {
+                continue;
+            }
+        }
+        options[opt_num] = inner->options[i];
+        options[opt_num++].delta = (u16_t)(code - last_code);
+        last_code = code;
+    }
+    if (!has_max_age) {
+        options[opt_num] = (struct coap_option) {
+            .delta = (u16_t)(COAP_OPTION_MAX_AGE - last_code),
+            .len = max_age_len,
+        };
+        max_age_index = opt_num++;
+    }
+
+    // the payload (with its marker) follows the CoAP Code and the Class E options
+    u32_t payload_offset = 1 + encoded_option_len(inner->options, inner->opt_num, CLASS_E);
+    size_t payload_len = inner->plaintext.len - payload_offset;
+    u32_t opt_len = encoded_option_len(options, opt_num, CLASS_E);
+    ensure(1 + opt_len + payload_len <= RESPONSE_CACHE_MAX_LEN, OscoreOutTooLong);
+
+    entry->plaintext[0] = inner->plaintext.ptr[0];
+    encode_options(options, opt_num, CLASS_E, &entry->plaintext[1]);
+    memcpy(&entry->plaintext[1 + opt_len], &inner->plaintext.ptr[payload_offset], payload_len);
+    // the encoded options up to the Max-Age Option end with its value
+    entry->max_age_offset = (u16_t)(1 + encoded_option_len(options, (u16_t)(max_age_index + 1), CLASS_E) - max_age_len);
+    entry->max_age_len = max_age_len;
+    entry->inner = *inner;
+    entry->inner.plaintext.ptr = entry->plaintext;
+    entry->inner.plaintext.len = 1 + opt_len + payload_len;
+    return OscoreNoError;
+}
+
+/**
+ * Sets the Max-Age of a cached response to the seconds until it expires, rounded up.
+ * This never exceeds the Max-Age of the response, thus it fits into the value written by `copy_plaintext`.
+ */
+static void set_remaining_max_age(struct response_cache_entry* entry, u32_t now) {
+    u32_t remaining = (entry->expiry_ms - now + MSEC_PER_SEC - 1) / MSEC_PER_SEC;
+    for (int i = entry->max_age_len - 1; i >= 0; i--) {
+        entry->plaintext[entry->max_age_offset + i] = (u8_t) remaining;
+        remaining >>= 8;
+    }
+}
+
+static void release(struct response_cache_entry* entry) {
+    sys_dlist_remove(&entry->node);
+    sys_dlist_append(&free_list, &entry->node);
+}
+
+void response_cache_init(void) {
+    sys_dlist_init(&lru);
+    sys_dlist_init(&free_list);
+    for (int i = 0; i < NUM_RESPONSE_CACHE_ENTRIES; i++) {
+        sys_dlist_append(&free_list, &entries[i].node);
+    }
+    memset(&stats, 0, sizeof(stats));
+}
+
+OscoreError response_cache_lookup(struct coap_packet* request, struct response_cache_entry** out) {
+    *out = NULL;
+    ensure_eq(coap_header_get_code(request), COAP_METHOD_GET, OscoreCoapPacketParseError);
+
+    u8_t key[RESPONSE_CACHE_MAX_KEY_LEN];
+    u8_t key_len;
+    if (has_block_option(request) || cache_key(request, key, &key_len) != OscoreNoError) {
+        // not cacheable
+        stats.misses++;
+        return OscoreNoError;
+    }
+
+    u32_t now = k_uptime_get_32();
+    struct response_cache_entry* entry;
+    struct response_cache_entry* next;
+    SYS_DLIST_FOR_EACH_CONTAINER_SAFE(&lru, entry, next, node) {
+        if ((s32_t)(now - entry->expiry_ms) >= 0) {
+            release(entry);
+            continue;
+        }
+        if (entry->key_len == key_len && memcmp(entry->key, key, key_len) == 0) {
+            sys_dlist_remove(&entry->node);
+            sys_dlist_prepend(&lru, &entry->node);
+            set_remaining_max_age(entry, now);
+            stats.hits++;
+            *out = entry;
+            return OscoreNoError;
+        }
+    }
+    stats.misses++;
+    return OscoreNoError;
+}
+
+OscoreError response_cache_add(struct coap_packet* request, struct coap_packet* response, struct oscore_inner* inner) {
+    if (coap_header_get_code(request) != COAP_METHOD_GET ||
+        coap_header_get_code(response) != COAP_RESPONSE_CODE_CONTENT ||
+        inner->plaintext.len > RESPONSE_CACHE_MAX_LEN ||
+        has_block_option(response)) {
+        return OscoreNoError;
+    }
+
+    u32_t max_age = COAP_DEFAULT_MAX_AGE;
+    struct coap_option option;
+    if (coap_find_options(response, COAP_OPTION_MAX_AGE, &option, 1) == 1) {
+        max_age = coap_option_value_to_int(&option);
+    }
+    if (max_age == 0) {
+        return OscoreNoError;
+    }
+
+    u8_t max_age_len = 0;
+    for (u32_t value = max_age; value > 0; value >>= 8) {
+        max_age_len++;
+    }
+
+    u8_t key[RESPONSE_CACHE_MAX_KEY_LEN];
+    u8_t key_len;
+    if (cache_key(request, key, &key_len) != OscoreNoError) {
+        return OscoreNoError;
+    }
+
+    sys_dnode_t* node = sys_dlist_get(&free_list);
+    if (node == NULL) {
+        node = sys_dlist_peek_tail(&lru);
+        release(CONTAINER_OF(node, struct response_cache_entry, node));
+        node = sys_dlist_get(&free_list);
+    }
+    struct response_cache_entry* entry = CONTAINER_OF(node, struct response_cache_entry, node);
+
+    memcpy(entry->key, key, key_len);
+    entry->key_len = key_len;
+    entry->etag_len = 0;
+    if (coap_find_options(response, COAP_OPTION_ETAG, &option, 1) == 1 && option.len <= sizeof(entry->etag)) {
+        memcpy(entry->etag, option.value, option.len);
+        entry->etag_len = option.len;
+    }
+    entry->expiry_ms = k_uptime_get_32() + max_age * MSEC_PER_SEC;
+    if (copy_plaintext(inner, max_age_len, entry) != OscoreNoError) {
+        sys_dlist_append(&free_list, &entry->node);
+        return OscoreNoError;
+    }
+    sys_dlist_prepend(&lru, &entry->node);
+    return OscoreNoError;
+}
+
+bool response_cache_etag_matches(struct coap_packet* request, struct response_cache_entry* entry) {
+    if (entry->etag_len == 0) {
+        return false;
+    }
+    struct coap_option etags[MAX_KEY_OPTIONS];
+    int num = coap_find_options(request, COAP_OPTION_ETAG, etags, MAX_KEY_OPTIONS);
+    for (int i = 0; i < num; i++) {
+        if (etags[i].len == entry->etag_len && memcmp(etags[i].value, entry->etag, entry->etag_len) == 0) {
+            stats.validations++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void response_cache_clear(void) {
+    sys_dnode_t* node;
+    while ((node = sys_dlist_get(&lru)) != NULL) {
+        sys_dlist_append(&free_list, node);
+    }
+}
+
+struct response_cache_stats response_cache_get_stats(void) {
+    return stats;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_RESPONSE_CACHE_H
+#define NONE_RESPONSE_CACHE_H
+
+#include <stdbool.h>
+#include <net/coap.h>
+#include "../util/error.h"
+#include "oscore.h"
+
+/// Number of cached responses
+#define NUM_RESPONSE_CACHE_ENTRIES 4
+/// Maximum length of a cached plaintext
+#define RESPONSE_CACHE_MAX_LEN 256
+/// Maximum length of the cache key, i.e. the kid and the encoded Uri-Path, Uri-Query and Accept options of a request
+#define RESPONSE_CACHE_MAX_KEY_LEN 56
+/// Max-Age of a response without Max-Age Option in seconds (RFC7252 5.10.5)
+#define COAP_DEFAULT_MAX_AGE 60
+
+/**
+ * Plaintext of a successful response to an OSCORE GET request.
+ *
+ * OSCORE ciphertexts can't be reused, because every response needs a fresh nonce.
+ * Therefore the response is cached in its encoded, but unencrypted form, which can be passed to
+ * `into_oscore_inner` directly. The cached plaintext always contains a Max-Age Option, whose value is updated to the
+ * remaining lifetime on every hit.
+ */
+struct response_cache_entry {
+    sys_dnode_t node;
+    u8_t key[RESPONSE_CACHE_MAX_KEY_LEN];
+    u8_t key_len;
+    u8_t etag[8];
+    u8_t etag_len;
+    u32_t expiry_ms;
+    /// position of the Max-Age value in `plaintext`
+    u16_t max_age_offset;
+    u8_t max_age_len;
+    struct oscore_inner inner;
+    u8_t plaintext[RESPONSE_CACHE_MAX_LEN];
+};
+
+struct response_cache_stats {
+    u32_t hits;
+    u32_t misses;
+    /// hits answered with 2.03 Valid, because the client already knew the ETag
+    u32_t validations;
+};
+
+/**
+ * Initializes the response cache.
+ * The cache isn't thread-safe, it must only be used from the thread receiving requests.
+ */
+void response_cache_init(void);
+
+/**
+ * Looks up the cached response to a decrypted GET request of the same client and counts the hit or miss.
+ * On a hit, the Max-Age of the cached response is set to the seconds until it expires.
+ * @param request Decrypted request
+ * @param out out-pointer which will point to the cached response, or NULL on a miss.
+ *          The entry is valid until the next call to `response_cache_add` or `response_cache_clear`.
+ * @return OscoreError
+ */
+OscoreError response_cache_lookup(struct coap_packet* request, struct response_cache_entry** out);
+
+/**
+ * Caches the encoded plaintext of a response to a client until its Max-Age has passed.
+ * Does nothing if the request isn't a GET, the response isn't 2.05 (Content), has a Max-Age of 0, is a block
+ * of a block-wise transfer, or doesn't fit into the cache. The least recently used response is replaced if the cache is
+ * full.
+ * @param request Decrypted request
+ * @param response Unencrypted response
+ * @param inner Plaintext of @a response as encoded by `oscore_inner_encode`, which is copied
+ * @return OscoreError
+ */
+OscoreError response_cache_add(struct coap_packet* request, struct coap_packet* response, struct oscore_inner* inner);
+
+/**
+ * Returns whether @a request contains an ETag Option matching the one of @a entry.
+ * @param request Decrypted request
+ * @param entry Cached response
+ * @return true if the client's representation is still valid
+ */
+bool response_cache_etag_matches(struct coap_packet* request, struct response_cache_entry* entry);
+
+/**
+ * Drops all cached responses, e.g. because an unsafe request might have changed a resource.
+ */
+void response_cache_clear(void);
+
+/**
+ * Returns the hit and miss counters of the cache.
+ * @return statistics since `response_cache_init`
+ */
+struct response_cache_stats response_cache_get_stats(void);
+
+#endif //NONE_RESPONSE_CACHE_H
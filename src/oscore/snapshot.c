@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <string.h>
+#include <tinycrypt/hmac.h>
+#include <tinycrypt/sha256.h>
+#include "snapshot.h"
+
+static const u8_t MAGIC[4] = { 'O', 'S', 'C', 'S' };
+
+size_t snapshot_len(size_t peers) {
+    return SNAPSHOT_HEADER_LEN + peers * SNAPSHOT_ENTRY_LEN + SNAPSHOT_TAG_LEN;
+}
+
+void snapshot_write_header(size_t peers, u8_t* out) {
+    memcpy(out, MAGIC, sizeof(MAGIC));
+    out[4] = SNAPSHOT_VERSION;
+    out[5] = (u8_t) (sizeof(struct security_context) >> 8);
+    out[6] = (u8_t) sizeof(struct security_context);
+    out[7] = (u8_t) (peers >> 8);
+    out[8] = (u8_t) peers;
+}
+
+/// Adds a length-prefixed field to an HMAC, so the concatenation of the fields is unambiguous
+static OscoreError hmac_field(struct tc_hmac_state_struct* h, array field) {
+    u8_t len[2] = { (u8_t) (field.len >> 8), (u8_t) field.len };
+    try_tc(tc_hmac_update(h, len, sizeof(len)));
+    if (field.len > 0) {
+        try_tc(tc_hmac_update(h, field.ptr, field.len));
+    }
+    return OscoreNoError;
+}
+
+OscoreError snapshot_fingerprint(array key, struct pre_established pre, u8_t* out) {
+    struct tc_hmac_state_struct h;
+    memset(&h, 0x00, sizeof(h));
+    try_tc(tc_hmac_set_key(&h, key.ptr, key.len));
+    try_tc(tc_hmac_init(&h));
+    try(hmac_field(&h, pre.master_secret));
+    try(hmac_field(&h, pre.opt != NULL ? pre.opt->master_salt : EMPTY_ARRAY));
+    try(hmac_field(&h, pre.sender_id));
+    try(hmac_field(&h, pre.recipient_id));
+    try(hmac_field(&h, pre.common_id_context));
+    u8_t aead_alg = (u8_t) (pre.opt != NULL ? pre.opt->aead_alg : AES_CCM_16_64_128);
+    try_tc(tc_hmac_update(&h, &aead_alg, 1));
+    u8_t digest[TC_SHA256_DIGEST_SIZE];
+    try_tc(tc_hmac_final(digest, TC_SHA256_DIGEST_SIZE, &h));
+    memcpy(out, digest, SNAPSHOT_FINGERPRINT_LEN);
+    return OscoreNoError;
+}
+
+OscoreError snapshot_tag(array key, array data, u8_t* out) {
+    struct tc_hmac_state_struct h;
+    memset(&h, 0x00, sizeof(h));
+    try_tc(tc_hmac_set_key(&h, key.ptr, key.len));
+    try_tc(tc_hmac_init(&h));
+    try_tc(tc_hmac_update(&h, data.ptr, data.len));
+    try_tc(tc_hmac_final(out, SNAPSHOT_TAG_LEN, &h));
+    return OscoreNoError;
+}
+
+OscoreError snapshot_verify(array key, array snapshot, size_t* peers) {
+    ensure(snapshot.len >= SNAPSHOT_HEADER_LEN + SNAPSHOT_TAG_LEN, OscoreInvalidSnapshot);
+    ensure(memcmp(snapshot.ptr, MAGIC, sizeof(MAGIC)) == 0, OscoreInvalidSnapshot);
+    ensure_eq(snapshot.ptr[4], SNAPSHOT_VERSION, OscoreInvalidSnapshot);
+    ensure_eq((snapshot.ptr[5] << 8) | snapshot.ptr[6], sizeof(struct security_context), OscoreInvalidSnapshot);
+    size_t count = (size_t) ((snapshot.ptr[7] << 8) | snapshot.ptr[8]);
+    ensure_eq(snapshot.len, snapshot_len(count), OscoreInvalidSnapshot);
+
+    u8_t tag[SNAPSHOT_TAG_LEN];
+    array data = {
+        .len = snapshot.len - SNAPSHOT_TAG_LEN,
+        .ptr = snapshot.ptr,
+    };
+    try(snapshot_tag(key, data, tag));
+    // compare in constant time
+    u8_t diff = 0;
+    for (size_t i = 0; i < SNAPSHOT_TAG_LEN; i++) {
+        diff |= tag[i] ^ snapshot.ptr[data.len + i];
+    }
+    ensure(diff == 0, OscoreInvalidSnapshot);
+    *peers = count;
+    return OscoreNoError;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_SNAPSHOT_H
+#define NONE_SNAPSHOT_H
+
+#include <zephyr/types.h>
+#include "../util/array.h"
+#include "../util/error.h"
+#include "../crypto/security_context.h"
+
+// Binary format of a snapshot of the security contexts (see `oscore_snapshot_save`), integers are big-endian:
+//
+//   "OSCS" | version (1) | record length (2) | number of peers (2) | entry... | tag (32)
+//   entry: fingerprint (8) | flags (1) | `struct security_context` (record length)
+//
+// The records are copied byte by byte, so a snapshot can only be restored by a build with the same layout of
+// `struct security_context`, which is what the version and record length are checked for. The fingerprint binds an
+// entry to the pre-established material of its peer, the tag is an HMAC-SHA256 over everything before it.
+
+/// Version of the snapshot format, incremented whenever it or `struct security_context` changes
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_HEADER_LEN 9
+#define SNAPSHOT_FINGERPRINT_LEN 8
+#define SNAPSHOT_TAG_LEN 32
+/// Length of the entry of one peer
+#define SNAPSHOT_ENTRY_LEN (SNAPSHOT_FINGERPRINT_LEN + 1 + sizeof(struct security_context))
+/// Flag of an entry whose record holds derived keys, otherwise only its Sender Sequence Number and replay window are
+#define SNAPSHOT_DERIVED 0x01
+
+/**
+ * Length of a snapshot of @a peers peers.
+ * @param peers Number of peers
+ * @return length in bytes
+ */
+size_t snapshot_len(size_t peers);
+
+/**
+ * Writes the header of a snapshot.
+ * @param peers Number of peers, at most 65535
+ * @param out Buffer of at least SNAPSHOT_HEADER_LEN bytes
+ */
+void snapshot_write_header(size_t peers, u8_t* out);
+
+/**
+ * Fingerprint of the pre-established material of a peer: the first SNAPSHOT_FINGERPRINT_LEN bytes of its HMAC.
+ * @param key Key of the snapshot
+ * @param pre pre-established data
+ * @param out Buffer of SNAPSHOT_FINGERPRINT_LEN bytes
+ * @return OscoreError
+ */
+OscoreError snapshot_fingerprint(array key, struct pre_established pre, u8_t* out);
+
+/**
+ * Computes the tag of a snapshot.
+ * @param key Key of the snapshot
+ * @param data Header and entries of the snapshot
+ * @param out Buffer of SNAPSHOT_TAG_LEN bytes
+ * @return OscoreError
+ */
+OscoreError snapshot_tag(array key, array data, u8_t* out);
+
+/**
+ * Checks the header, length and tag of a snapshot.
+ * @param key Key of the snapshot
+ * @param snapshot Complete snapshot
+ * @param peers out-pointer to write the number of entries into
+ * @return OscoreError, OscoreInvalidSnapshot if it was written by another version or build, or was modified
+ */
+OscoreError snapshot_verify(array key, array snapshot, size_t* peers);
+
+#endif //NONE_SNAPSHOT_H
@@ -0,0 +1,497 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+// End-to-end benchmark of the OSCORE server path on the host: `from_oscore` → handler → `into_oscore`.
+//
+// For every option mix and payload size, requests are protected in the client role first, then the core is
+// switched to the server role and the requests are processed one by one with `host_server_handle`.
+// Every run prints one JSON object per line to stdout, so results can be compared between commits:
+//
+//   {"bench":"message","mix":"typical","payload":256,"messages":1000,"errors":0,"msgs_per_sec":...,
+//    "cycles_per_byte":...,"p50_ns":...,"p99_ns":...,"max_ns":...,"stack_peak":...,"heap_peak":...,
+//    "pkts_high_water":...,"frags_high_water":...,"scratch_high_water":...}
+//   {"bench":"derive","contexts":16,"ns_per_context":...}
+//   {"bench":"restore","contexts":16,"snapshot_bytes":...,"derive_ns":...,"restore_ns":...}
+//   {"bench":"peers","peers":1023,"messages":...,"ns_per_message":...,"peer_bytes":...,"context_bytes":...}
+//   {"bench":"option_savings","fresh_piv":false,"responses":16,"datagram_bytes":...,"seq_consumed":0}
+//
+// cycles_per_byte counts TSC cycles on x86 and nanoseconds elsewhere, per byte of request and response datagram.
+// stack_peak is measured by painting the stack of the benchmark thread, heap_peak are the packets and fragments
+// allocated at the same time.
+// The peers runs spread minimal requests over that many security contexts in a shuffled order, so they measure the
+// cost of context lookups and cache misses compared to the run with a single peer. peer_bytes and context_bytes are
+// the memory per peer, see `struct oscore_context_stats`.
+// The option_savings runs protect the same response to the same GET request with and without a fresh Partial IV.
+// datagram_bytes is the length of one protected response, seq_consumed the sender sequence numbers used up by all of
+// them together.
+//
+// Usage: oscore_bench [iterations] (default 1000)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <net/net_pkt.h>
+#include "host_client.h"
+#include "host_server.h"
+#include "../../oscore/oscore.h"
+#include "../../oscore/coap_helper.h"
+#include "../../oscore/pkt_pool.h"
+#include "../../codec/oscore_option.h"
+#include "../../util/scratch.h"
+
+#define WARMUP 50
+#define MAX_DATAGRAM 1400
+#define BENCH_STACK_SIZE (256 * 1024)
+#define STACK_PATTERN 0xa5
+/// Responses protected per option_savings run
+#define SAVINGS_RESPONSES 16
+
+static const u16_t PAYLOADS[] = { 0, 16, 64, 256, 512, 1024 };
+static const u32_t CONTEXT_COUNTS[] = { 1, 16, 256 };
+static const u32_t PEER_COUNTS[] = { 1, 64, OSCORE_MAX_CONTEXTS - 1 };
+
+/// Option mixes, the payload is set per run
+static const struct {
+    const char* name;
+    struct host_request request;
+} MIXES[] = {
+    {
+        "minimal",
+        { .code = COAP_METHOD_POST, .type = COAP_TYPE_CON, .path = "echo", .content_format = -1, .accept = -1, .block2 = -1 },
+    },
+    {
+        "typical",
+        {
+            .code = COAP_METHOD_POST, .type = COAP_TYPE_CON, .host = "gw.example", .path = "echo",
+            .content_format = 60, .query = "id=42", .accept = 60, .block2 = -1,
+        },
+    },
+    {
+        // GET with Observe, answered with a fresh Partial IV instead of the request's nonce
+        "observe",
+        {
+            .code = COAP_METHOD_GET, .type = COAP_TYPE_CON, .path = "echo", .observe = true, .content_format = -1,
+            .accept = -1, .block2 = -1,
+        },
+    },
+};
+
+static u32_t iterations = 1000;
+static u8_t* stack_base;
+
+static u64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static inline u64_t cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return now_ns();
+#endif
+}
+
+/// Fills the unused part of the stack of the calling thread with STACK_PATTERN
+static __attribute__((noinline)) void paint_stack(void) {
+    u8_t* sp = __builtin_frame_address(0);
+    // keep some distance to the frame of this function
+    memset(stack_base, STACK_PATTERN, (size_t) (sp - 512 - stack_base));
+}
+
+/// Returns the number of bytes of the stack which were used since `paint_stack`
+static size_t stack_peak(void) {
+    u8_t* p = stack_base;
+    while (p < stack_base + BENCH_STACK_SIZE && *p == STACK_PATTERN) {
+        p++;
+    }
+    return (size_t) (stack_base + BENCH_STACK_SIZE - p);
+}
+
+static int compare_u32(const void* a, const void* b) {
+    u32_t l = *(const u32_t*) a;
+    u32_t r = *(const u32_t*) b;
+    return (l > r) - (l < r);
+}
+
+static void bench_messages(const struct host_request* mix, const char* name, u16_t payload_len) {
+    u32_t count = iterations + WARMUP;
+    u8_t* requests = malloc((size_t) count * MAX_DATAGRAM);
+    u16_t* request_lens = malloc(count * sizeof(u16_t));
+    u32_t* latencies = malloc(iterations * sizeof(u32_t));
+    static u8_t payload[1024];
+    memset(payload, 'x', sizeof(payload));
+    assert_actually(requests != NULL && request_lens != NULL && latencies != NULL, "out of memory");
+
+    // client role: protect all requests up front
+    assert_no_error(host_client_init());
+    struct host_request request = *mix;
+    request.payload = payload;
+    request.payload_len = payload_len;
+    for (u32_t i = 0; i < count; i++) {
+        u8_t token[2] = { (u8_t) (i >> 8), (u8_t) i };
+        array out = { .len = MAX_DATAGRAM, .ptr = &requests[(size_t) i * MAX_DATAGRAM] };
+        assert_no_error(host_client_protect(&request, token, sizeof(token), (u16_t) i, out, &request_lens[i]));
+        oscore_cancel_request(token, sizeof(token));
+    }
+
+    // server role
+    assert_no_error(host_server_init());
+    struct sockaddr_in6 from = { .sin6_family = AF_INET6, .sin6_addr = IN6ADDR_LOOPBACK_INIT, .sin6_port = htons(5683) };
+    u8_t response_bytes[MAX_DATAGRAM];
+    array response = { .len = sizeof(response_bytes), .ptr = response_bytes };
+    u32_t errors = 0;
+    u32_t measured = 0;
+    u64_t bytes = 0;
+    u64_t total_cycles = 0;
+
+    paint_stack();
+    net_pkt_reset_high_water();
+    u64_t start = 0;
+    for (u32_t i = 0; i < count; i++) {
+        if (i == WARMUP) {
+            start = now_ns();
+        }
+        u16_t response_len = 0;
+        enum host_stage stage;
+        u64_t t0 = cycles();
+        u64_t n0 = now_ns();
+        OscoreError res = host_server_handle(&from, &requests[(size_t) i * MAX_DATAGRAM], request_lens[i], response,
+                                             &response_len, &stage);
+        u64_t n1 = now_ns();
+        u64_t t1 = cycles();
+        if (i < WARMUP) {
+            continue;
+        }
+        if (res != OscoreNoError) {
+            errors++;
+            continue;
+        }
+        latencies[measured++] = (u32_t) (n1 - n0);
+        total_cycles += t1 - t0;
+        bytes += request_lens[i] + response_len;
+    }
+    u64_t elapsed = now_ns() - start;
+    size_t stack = stack_peak();
+
+    struct net_pkt_stats pkt_stats;
+    net_pkt_get_stats(&pkt_stats);
+    struct scratch_stats scratch;
+    scratch_get_stats(&scratch);
+    qsort(latencies, measured, sizeof(u32_t), compare_u32);
+    u32_t p50 = measured > 0 ? latencies[measured / 2] : 0;
+    u32_t p99 = measured > 0 ? latencies[(u32_t) ((u64_t) measured * 99 / 100)] : 0;
+    u32_t max_latency = measured > 0 ? latencies[measured - 1] : 0;
+    size_t heap = pkt_stats.pkts_high_water * sizeof(struct net_pkt) +
+                  pkt_stats.frags_high_water * sizeof(struct net_buf);
+
+    printf("{\"bench\":\"message\",\"mix\":\"%s\",\"payload\":%u,\"messages\":%u,\"errors\":%u,"
+           "\"msgs_per_sec\":%.0f,\"cycles_per_byte\":%.2f,\"p50_ns\":%u,\"p99_ns\":%u,\"max_ns\":%u,"
+           "\"stack_peak\":%zu,\"heap_peak\":%zu,\"pkts_high_water\":%u,\"frags_high_water\":%u,"
+           "\"scratch_high_water\":%u}\n",
+           name, payload_len, measured, errors,
+           elapsed > 0 ? measured * 1e9 / elapsed : 0.0, bytes > 0 ? (double) total_cycles / bytes : 0.0,
+           p50, p99, max_latency, stack, heap, pkt_stats.pkts_high_water, pkt_stats.frags_high_water,
+           scratch.high_water);
+    fflush(stdout);
+
+    free(requests);
+    free(request_lens);
+    free(latencies);
+}
+
+/// Cost of deriving the security contexts for a number of peers
+static void bench_derive(u32_t contexts) {
+    u64_t start = now_ns();
+    for (u32_t i = 0; i < contexts; i++) {
+        assert_no_error(host_server_init());
+    }
+    u64_t elapsed = now_ns() - start;
+    printf("{\"bench\":\"derive\",\"contexts\":%u,\"ns_per_context\":%llu}\n", contexts,
+           (unsigned long long) (elapsed / contexts));
+    fflush(stdout);
+}
+
+/// Cost of deriving the security contexts of @a contexts peers at boot compared to restoring them from a snapshot
+static void bench_restore(u32_t contexts) {
+    static struct host_peer storage[OSCORE_MAX_CONTEXTS];
+    static struct pre_established pre[OSCORE_MAX_CONTEXTS];
+    u8_t key_bytes[32] = { 0 };
+    array key = { .len = sizeof(key_bytes), .ptr = key_bytes };
+    // the members of `struct pre_established` are const
+    memcpy(&pre[0], &PRE_ESTABLISHED, sizeof(PRE_ESTABLISHED));
+    for (u32_t i = 1; i < contexts; i++) {
+        struct pre_established peer = host_peer(i - 1, true, &storage[i]);
+        memcpy(&pre[i], &peer, sizeof(peer));
+    }
+
+    u64_t start = now_ns();
+    assert_no_error(oscore_init(pre[0]));
+    for (u32_t i = 1; i < contexts; i++) {
+        assert_no_error(oscore_add_context(pre[i]));
+    }
+    u64_t derive = now_ns() - start;
+
+    array snapshot = { .len = oscore_snapshot_len(), .ptr = malloc(oscore_snapshot_len()) };
+    assert_actually(snapshot.ptr != NULL, "out of memory");
+    assert_no_error(oscore_snapshot_save(key, snapshot));
+    start = now_ns();
+    assert_no_error(oscore_restore(pre, contexts, key, snapshot));
+    u64_t restore = now_ns() - start;
+    printf("{\"bench\":\"restore\",\"contexts\":%u,\"snapshot_bytes\":%zu,\"derive_ns\":%llu,\"restore_ns\":%llu}\n",
+           contexts, snapshot.len, (unsigned long long) derive, (unsigned long long) restore);
+    fflush(stdout);
+    free(snapshot.ptr);
+}
+
+/// Processes minimal requests of @a peers simulated clients in a shuffled order
+static void bench_peers(u32_t peers) {
+    u32_t rounds = (iterations + peers - 1) / peers;
+    u32_t count = rounds * peers;
+    u8_t* requests = malloc((size_t) count * MAX_DATAGRAM);
+    u16_t* request_lens = malloc(count * sizeof(u16_t));
+    u32_t* order = malloc(count * sizeof(u32_t));
+    assert_actually(requests != NULL && request_lens != NULL && order != NULL, "out of memory");
+
+    // client role: request i is sent by client i % peers
+    struct host_request request = MIXES[0].request;
+    for (u32_t peer = 0; peer < peers; peer++) {
+        assert_no_error(host_client_init_peer(peer));
+        for (u32_t i = peer; i < count; i += peers) {
+            u8_t token[2] = { (u8_t) (i >> 8), (u8_t) i };
+            array out = { .len = MAX_DATAGRAM, .ptr = &requests[(size_t) i * MAX_DATAGRAM] };
+            assert_no_error(host_client_protect(&request, token, sizeof(token), (u16_t) i, out, &request_lens[i]));
+            oscore_cancel_request(token, sizeof(token));
+        }
+    }
+    // the Partial IVs of a client have to arrive in ascending order within the replay window, so only the peers of
+    // a round are shuffled
+    srand(peers);
+    for (u32_t i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    for (u32_t round = 0; round < rounds; round++) {
+        u32_t* slice = &order[round * peers];
+        for (u32_t i = peers - 1; i > 0; i--) {
+            u32_t j = (u32_t) rand() % (i + 1);
+            u32_t tmp = slice[i];
+            slice[i] = slice[j];
+            slice[j] = tmp;
+        }
+    }
+
+    assert_no_error(host_server_init());
+    assert_no_error(host_server_add_peers(peers));
+    struct sockaddr_in6 from = { .sin6_family = AF_INET6, .sin6_addr = IN6ADDR_LOOPBACK_INIT, .sin6_port = htons(5683) };
+    u8_t response_bytes[MAX_DATAGRAM];
+    array response = { .len = sizeof(response_bytes), .ptr = response_bytes };
+    u32_t errors = 0;
+    u64_t start = now_ns();
+    for (u32_t i = 0; i < count; i++) {
+        u32_t index = order[i];
+        u16_t response_len = 0;
+        enum host_stage stage;
+        if (host_server_handle(&from, &requests[(size_t) index * MAX_DATAGRAM], request_lens[index], response,
+                               &response_len, &stage) != OscoreNoError) {
+            errors++;
+        }
+    }
+    u64_t elapsed = now_ns() - start;
+    struct oscore_context_stats stats;
+    oscore_get_context_stats(&stats);
+    printf("{\"bench\":\"peers\",\"peers\":%u,\"messages\":%u,\"errors\":%u,\"ns_per_message\":%llu,"
+           "\"peer_bytes\":%u,\"context_bytes\":%u}\n", peers, count, errors, (unsigned long long) (elapsed / count),
+           stats.peer_bytes, stats.context_bytes);
+    fflush(stdout);
+
+    free(requests);
+    free(request_lens);
+    free(order);
+}
+
+// the ports don't matter to the OSCORE layer
+static const struct sockaddr_in6 CLIENT = { .sin6_family = AF_INET6, .sin6_addr = IN6ADDR_LOOPBACK_INIT };
+static const struct sockaddr_in6 SERVER = { .sin6_family = AF_INET6, .sin6_addr = IN6ADDR_LOOPBACK_INIT };
+
+/// Builds the 2.05 "Hello World!" response of the `hello` resource to a decrypted request
+static void hello_response(struct coap_packet* request, struct coap_packet* out) {
+    static u8_t payload[] = "Hello World!";
+    u8_t token[8];
+    u8_t tkl = coap_header_get_token(request, token);
+    struct net_pkt* pkt;
+    assert_no_error(pkt_pool_get(false, K_NO_WAIT, &pkt));
+    assert_eq(coap_packet_init(out, pkt, 1, COAP_TYPE_ACK, tkl, token, COAP_RESPONSE_CODE_CONTENT,
+                               coap_header_get_id(request)), 0);
+    assert_eq(coap_packet_append_payload_marker(out), 0);
+    assert_eq(coap_packet_append_payload(out, payload, sizeof(payload) - 1), 0);
+}
+
+/**
+ * Releases a protected response and returns the length of its datagram.
+ * @param piv out-pointer to write the Partial IV of the response into, 0 if it has none
+ */
+static u16_t response_piv(struct coap_packet* protected, u64_t* piv) {
+    u8_t datagram_bytes[MAX_DATAGRAM];
+    array datagram = { .len = coap_message_len(protected), .ptr = datagram_bytes };
+    assert_actually(datagram.len <= sizeof(datagram_bytes), "response too long");
+    assert_no_error(read_coap_message(protected, datagram));
+    net_pkt_unref(protected->pkt);
+
+    struct net_pkt* pkt = net_pkt_from_datagram(&SERVER, &CLIENT, datagram.ptr, (u16_t) datagram.len);
+    assert_actually(pkt != NULL, "out of packets");
+    struct coap_packet response;
+    assert_eq(coap_packet_parse(&response, pkt, NULL, 0), 0);
+    struct coap_option option;
+    assert_eq(coap_find_options(&response, COAP_OPTION_OSCORE, &option, 1), 1);
+    u8_t piv_bytes[8];
+    u8_t kid_bytes[8];
+    u8_t kid_context_bytes[16];
+    struct unprotected unprotected = {
+        .partial_iv = { .len = sizeof(piv_bytes), .ptr = piv_bytes },
+        .kid = { .len = sizeof(kid_bytes), .ptr = kid_bytes },
+        .kid_context = { .len = sizeof(kid_context_bytes), .ptr = kid_context_bytes },
+    };
+    assert_no_error(from_oscore_option((array) { .len = option.len, .ptr = option.value }, &unprotected));
+    net_pkt_unref(pkt);
+    *piv = 0;
+    for (size_t i = 0; i < unprotected.partial_iv.len; i++) {
+        *piv = *piv << 8 | piv_bytes[i];
+    }
+    return (u16_t) datagram.len;
+}
+
+/**
+ * Protects the response to @a request with a fresh Partial IV, like every Observe notification and Echo challenge.
+ * `into_oscore_notification` with the request as registration is `into_oscore` with `fresh_piv` set.
+ * @return length of the protected datagram
+ */
+static u16_t protect_fresh(struct coap_packet* request, u64_t* piv) {
+    struct oscore_request registration;
+    assert_no_error(oscore_request_init(request, &registration));
+    struct coap_packet plain;
+    hello_response(request, &plain);
+    u8_t plaintext_bytes[64];
+    struct oscore_inner inner;
+    assert_no_error(oscore_inner_encode(&plain, (array) { .len = sizeof(plaintext_bytes), .ptr = plaintext_bytes },
+                                        &inner));
+    u8_t token[8];
+    u8_t tkl = coap_header_get_token(request, token);
+    struct coap_packet protected;
+    assert_no_error(into_oscore_notification(&inner, &registration, COAP_TYPE_ACK, token, tkl,
+                                             coap_header_get_id(request), &protected));
+    net_pkt_unref(plain.pkt);
+    return response_piv(&protected, piv);
+}
+
+/// Protects the response to @a request with `into_oscore`, which reuses the request's nonce
+static u16_t protect_reused(struct coap_packet* request, u64_t* piv) {
+    struct coap_packet plain;
+    hello_response(request, &plain);
+    struct coap_packet protected;
+    assert_no_error(into_oscore(plain, request, &protected));
+    return response_piv(&protected, piv);
+}
+
+static void print_option_savings(bool fresh_piv, u16_t datagram_len, u64_t seq_consumed) {
+    printf("{\"bench\":\"option_savings\",\"fresh_piv\":%s,\"responses\":%u,\"datagram_bytes\":%u,"
+           "\"seq_consumed\":%llu}\n", fresh_piv ? "true" : "false", SAVINGS_RESPONSES, datagram_len,
+           (unsigned long long) seq_consumed);
+}
+
+/**
+ * Datagram length and sender sequence numbers of responses to the same GET request of the `hello` resource, with and
+ * without a fresh Partial IV. The sequence numbers are read from the Partial IVs of fresh responses protected before,
+ * between and after both runs.
+ */
+static void bench_option_savings(void) {
+    struct host_request get = {
+        .code = COAP_METHOD_GET, .type = COAP_TYPE_CON, .path = "hello", .content_format = -1, .accept = -1,
+        .block2 = -1,
+    };
+    u8_t token[2] = { 0x5a, 0x01 };
+    u8_t datagram_bytes[MAX_DATAGRAM];
+    u16_t datagram_len;
+    assert_no_error(host_client_init());
+    assert_no_error(host_client_protect(&get, token, sizeof(token), 1, (array) {
+        .len = sizeof(datagram_bytes), .ptr = datagram_bytes,
+    }, &datagram_len));
+    oscore_cancel_request(token, sizeof(token));
+
+    assert_no_error(host_server_init());
+    struct net_pkt* pkt = net_pkt_from_datagram(&CLIENT, &SERVER, datagram_bytes, datagram_len);
+    assert_actually(pkt != NULL, "out of packets");
+    struct coap_packet packet;
+    struct coap_packet request;
+    assert_eq(coap_packet_parse(&packet, pkt, NULL, 0), 0);
+    assert_no_error(from_oscore(packet, &request));
+    assert_eq(coap_packet_parse(&request, request.pkt, NULL, 0), 0);
+
+    u64_t before;
+    u64_t between;
+    u64_t after;
+    u64_t piv;
+    u16_t reused_len = 0;
+    u16_t fresh_len = 0;
+    protect_fresh(&request, &before);
+    for (u32_t i = 0; i < SAVINGS_RESPONSES; i++) {
+        reused_len = protect_reused(&request, &piv);
+        assert_eq(piv, 0);
+    }
+    protect_fresh(&request, &between);
+    for (u32_t i = 0; i < SAVINGS_RESPONSES; i++) {
+        fresh_len = protect_fresh(&request, &piv);
+    }
+    protect_fresh(&request, &after);
+    net_pkt_unref(request.pkt);
+
+    print_option_savings(false, reused_len, between - before - 1);
+    print_option_savings(true, fresh_len, after - between - 1);
+    fflush(stdout);
+}
+
+static void* run(void* arg) {
+    for (size_t mix = 0; mix < ARRAY_SIZE(MIXES); mix++) {
+        for (size_t payload = 0; payload < ARRAY_SIZE(PAYLOADS); payload++) {
+            bench_messages(&MIXES[mix].request, MIXES[mix].name, PAYLOADS[payload]);
+        }
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(CONTEXT_COUNTS); i++) {
+        bench_derive(CONTEXT_COUNTS[i]);
+        bench_restore(CONTEXT_COUNTS[i]);
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(PEER_COUNTS); i++) {
+        bench_peers(PEER_COUNTS[i]);
+    }
+    bench_option_savings();
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        iterations = (u32_t) strtoul(argv[1], NULL, 10);
+        assert_actually(iterations > 0, "iterations must be positive");
+    }
+
+    // the benchmark runs on its own thread, so its stack can be painted and measured
+    stack_base = malloc(BENCH_STACK_SIZE);
+    assert_actually(stack_base != NULL, "out of memory");
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack_base, BENCH_STACK_SIZE);
+    pthread_t thread;
+    assert_actually(pthread_create(&thread, &attr, run, NULL) == 0, "can't start benchmark thread");
+    pthread_join(thread, NULL);
+    pthread_attr_destroy(&attr);
+    free(stack_base);
+    return 0;
+}
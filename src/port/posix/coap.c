@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <errno.h>
+#include <net/coap.h>
+
+/// Reads one byte at @a offset of the CoAP message
+static int read_u8(const struct coap_packet* cpkt, u16_t offset, u8_t* out) {
+    u16_t pos;
+    struct net_buf* frag = net_frag_read(cpkt->frag, cpkt->offset + offset, &pos, 1, out);
+    return (frag == NULL && pos == 0xffff) ? -EINVAL : 0;
+}
+
+/// Reads the extended delta or length of an option
+static int read_extended(const struct coap_packet* cpkt, u16_t* offset, u8_t nibble, u16_t* out) {
+    u8_t bytes[2];
+    if (nibble < 13) {
+        *out = nibble;
+        return 0;
+    }
+    if (nibble == 13) {
+        if (read_u8(cpkt, *offset, &bytes[0]) != 0) {
+            return -EINVAL;
+        }
+        *offset += 1;
+        *out = (u16_t) (bytes[0] + 13);
+        return 0;
+    }
+    if (nibble == 14) {
+        if (read_u8(cpkt, *offset, &bytes[0]) != 0 || read_u8(cpkt, *offset + 1, &bytes[1]) != 0) {
+            return -EINVAL;
+        }
+        *offset += 2;
+        *out = (u16_t) (((bytes[0] << 8) | bytes[1]) + 269);
+        return 0;
+    }
+    return -EINVAL;
+}
+
+/**
+ * Parses the option at @a offset.
+ * @param option Option to write the relative delta and value into, can be NULL
+ * @param offset offset of the option in the message, advanced past it
+ * @param delta out-pointer to the relative delta
+ * @return 1 for an option, 0 at the payload marker or the end of the message, -EINVAL on errors
+ */
+static int parse_option(const struct coap_packet* cpkt, u16_t msg_len, struct coap_option* option, u16_t* offset,
+                        u16_t* delta) {
+    if (*offset >= msg_len) {
+        return 0;
+    }
+    u8_t byte;
+    if (read_u8(cpkt, *offset, &byte) != 0) {
+        return -EINVAL;
+    }
+    *offset += 1;
+    if (byte == COAP_MARKER) {
+        // a payload marker without payload is malformed
+        return *offset < msg_len ? 0 : -EINVAL;
+    }
+    u16_t len;
+    if (read_extended(cpkt, offset, byte >> 4, delta) != 0 || read_extended(cpkt, offset, byte & 0xf, &len) != 0) {
+        return -EINVAL;
+    }
+    if (*offset + len > msg_len) {
+        return -EINVAL;
+    }
+    if (option != NULL) {
+        option->delta = *delta;
+        option->len = (u8_t) min(len, sizeof(option->value));
+        u16_t pos;
+        struct net_buf* frag = net_frag_read(cpkt->frag, cpkt->offset + *offset, &pos, option->len, option->value);
+        if (frag == NULL && pos == 0xffff && option->len > 0) {
+            return -EINVAL;
+        }
+    }
+    *offset += len;
+    return 1;
+}
+
+static u16_t message_len(const struct coap_packet* cpkt) {
+    return (u16_t) (net_pkt_get_len(cpkt->pkt) - cpkt->offset);
+}
+
+int coap_packet_init(struct coap_packet* cpkt, struct net_pkt* pkt, u8_t ver, u8_t type, u8_t tokenlen,
+                     u8_t* token, u8_t code, u16_t id) {
+    if (cpkt == NULL || pkt == NULL || pkt->frags == NULL || tokenlen > 8) {
+        return -EINVAL;
+    }
+    memset(cpkt, 0, sizeof(*cpkt));
+    cpkt->pkt = pkt;
+    cpkt->frag = pkt->frags;
+    u8_t hdr = (u8_t) (((ver & 0x3) << 6) | ((type & 0x3) << 4) | tokenlen);
+    if (!net_pkt_append_u8(pkt, hdr) || !net_pkt_append_u8(pkt, code) || !net_pkt_append_be16(pkt, id)) {
+        return -EINVAL;
+    }
+    if (tokenlen > 0 && !net_pkt_append_all(pkt, tokenlen, token, K_FOREVER)) {
+        return -EINVAL;
+    }
+    cpkt->hdr_len = (u8_t) (4 + tokenlen);
+    return 0;
+}
+
+int coap_packet_parse(struct coap_packet* cpkt, struct net_pkt* pkt, struct coap_option* options, u8_t opt_num) {
+    if (cpkt == NULL || pkt == NULL || pkt->frags == NULL) {
+        return -EINVAL;
+    }
+    memset(cpkt, 0, sizeof(*cpkt));
+    cpkt->pkt = pkt;
+    u16_t offset = net_pkt_ip_hdr_len(pkt) + net_pkt_ipv6_ext_len(pkt) + NET_UDPH_LEN;
+    cpkt->frag = net_frag_skip(pkt->frags, 0, &cpkt->offset, offset);
+    if (cpkt->frag == NULL) {
+        return -EINVAL;
+    }
+    u16_t msg_len = message_len(cpkt);
+    u8_t hdr;
+    if (msg_len < 4 || read_u8(cpkt, 0, &hdr) != 0) {
+        return -EINVAL;
+    }
+    u8_t tkl = (u8_t) (hdr & 0xf);
+    if ((hdr >> 6) != COAP_VERSION_1 || tkl > 8 || msg_len < 4 + tkl) {
+        return -EINVAL;
+    }
+    cpkt->hdr_len = (u8_t) (4 + tkl);
+
+    u16_t opt_offset = cpkt->hdr_len;
+    u8_t num = 0;
+    while (true) {
+        u16_t delta;
+        struct coap_option* option = (options != NULL && num < opt_num) ? &options[num] : NULL;
+        int r = parse_option(cpkt, msg_len, option, &opt_offset, &delta);
+        if (r < 0) {
+            return -EINVAL;
+        }
+        if (r == 0) {
+            break;
+        }
+        num++;
+    }
+    cpkt->opt_len = opt_offset - cpkt->hdr_len;
+    return 0;
+}
+
+int coap_find_options(const struct coap_packet* cpkt, u16_t code, struct coap_option* options, u16_t veclen) {
+    u16_t msg_len = message_len(cpkt);
+    u16_t offset = cpkt->hdr_len;
+    u16_t number = 0;
+    u16_t count = 0;
+    while (count < veclen) {
+        u16_t delta;
+        struct coap_option option;
+        int r = parse_option(cpkt, msg_len, &option, &offset, &delta);
+        if (r < 0) {
+            return r;
+        }
+        if (r == 0) {
+            break;
+        }
+        number += delta;
+        if (number == code) {
+            options[count++] = option;
+        } else if (number > code) {
+            break;
+        }
+    }
+    return count;
+}
+
+u8_t coap_header_get_version(const struct coap_packet* cpkt) {
+    u8_t hdr = 0;
+    read_u8(cpkt, 0, &hdr);
+    return (u8_t) (hdr >> 6);
+}
+
+u8_t coap_header_get_type(const struct coap_packet* cpkt) {
+    u8_t hdr = 0;
+    read_u8(cpkt, 0, &hdr);
+    return (u8_t) ((hdr >> 4) & 0x3);
+}
+
+u8_t coap_header_get_token(const struct coap_packet* cpkt, u8_t* token) {
+    u8_t hdr = 0;
+    read_u8(cpkt, 0, &hdr);
+    u8_t tkl = (u8_t) (hdr & 0xf);
+    if (tkl > 8) {
+        return 0;
+    }
+    for (u8_t i = 0; i < tkl; i++) {
+        if (read_u8(cpkt, (u16_t) (4 + i), &token[i]) != 0) {
+            return 0;
+        }
+    }
+    return tkl;
+}
+
+u8_t coap_header_get_code(const struct coap_packet* cpkt) {
+    u8_t code = 0;
+    read_u8(cpkt, 1, &code);
+    return code;
+}
+
+u16_t coap_header_get_id(const struct coap_packet* cpkt) {
+    u8_t bytes[2] = { 0 };
+    read_u8(cpkt, 2, &bytes[0]);
+    read_u8(cpkt, 3, &bytes[1]);
+    return (u16_t) ((bytes[0] << 8) | bytes[1]);
+}
+
+/// Encodes the nibble and the extended bytes of an option delta or length
+static u8_t encode_extended(u16_t value, u8_t* ext, u8_t* ext_len) {
+    if (value < 13) {
+        return (u8_t) value;
+    }
+    if (value < 269) {
+        ext[(*ext_len)++] = (u8_t) (value - 13);
+        return 13;
+    }
+    ext[(*ext_len)++] = (u8_t) ((value - 269) >> 8);
+    ext[(*ext_len)++] = (u8_t) (value - 269);
+    return 14;
+}
+
+int coap_packet_append_option(struct coap_packet* cpkt, u16_t code, const u8_t* value, u16_t len) {
+    if (cpkt == NULL || code < cpkt->last_delta || (len > 0 && value == NULL)) {
+        return -EINVAL;
+    }
+    u8_t ext[5];
+    u8_t ext_len = 0;
+    u8_t delta_nibble = encode_extended((u16_t) (code - cpkt->last_delta), ext, &ext_len);
+    u8_t len_nibble = encode_extended(len, ext, &ext_len);
+    if (!net_pkt_append_u8(cpkt->pkt, (u8_t) ((delta_nibble << 4) | len_nibble)) ||
+        !net_pkt_append_all(cpkt->pkt, ext_len, ext, K_FOREVER) ||
+        (len > 0 && !net_pkt_append_all(cpkt->pkt, len, value, K_FOREVER))) {
+        return -EINVAL;
+    }
+    cpkt->opt_len += 1 + ext_len + len;
+    cpkt->last_delta = code;
+    return 0;
+}
+
+int coap_packet_append_payload_marker(struct coap_packet* cpkt) {
+    return net_pkt_append_u8(cpkt->pkt, COAP_MARKER) ? 0 : -EINVAL;
+}
+
+int coap_packet_append_payload(struct coap_packet* cpkt, u8_t* payload, u16_t payload_len) {
+    return net_pkt_append_all(cpkt->pkt, payload_len, payload, K_FOREVER) ? 0 : -EINVAL;
+}
+
+struct net_buf* coap_packet_get_payload(const struct coap_packet* cpkt, u16_t* offset, u16_t* len) {
+    *offset = 0xffff;
+    *len = 0;
+    u16_t msg_len = message_len(cpkt);
+    if (msg_len < cpkt->hdr_len + cpkt->opt_len) {
+        return NULL;
+    }
+    *len = (u16_t) (msg_len - cpkt->hdr_len - cpkt->opt_len);
+    if (*len == 0) {
+        *offset = 0;
+        return NULL;
+    }
+    struct net_buf* frag = net_frag_skip(cpkt->frag, cpkt->offset, offset, cpkt->hdr_len + cpkt->opt_len);
+    if (frag == NULL) {
+        *len = 0;
+    }
+    return frag;
+}
+
+unsigned int coap_option_value_to_int(const struct coap_option* option) {
+    unsigned int value = 0;
+    for (u8_t i = 0; i < option->len && i < 4; i++) {
+        value = (value << 8) | option->value[i];
+    }
+    return value;
+}
+
+int coap_append_option_int(struct coap_packet* cpkt, u16_t code, unsigned int val) {
+    u8_t bytes[4];
+    u8_t len = 0;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        if (len > 0 || (val >> shift) & 0xff) {
+            bytes[len++] = (u8_t) (val >> shift);
+        }
+    }
+    return coap_packet_append_option(cpkt, code, bytes, len);
+}
+
+/**
+ * Encodes a Block Option value (RFC7959 2.2).
+ * @param more_in_requests whether the M bit is set for requests (Block1) or responses (Block2)
+ */
+static unsigned int block_value(const struct coap_packet* cpkt, const struct coap_block_context* ctx,
+                                bool more_in_requests) {
+    u16_t bytes = coap_block_size_to_bytes(ctx->block_size);
+    bool request = (coap_header_get_code(cpkt) >> 5) == 0;
+    bool more = request == more_in_requests && ctx->current + bytes < ctx->total_size;
+    return (unsigned int) ((ctx->current / bytes) << 4 | (more ? 0x08 : 0) | ctx->block_size);
+}
+
+int coap_append_block1_option(struct coap_packet* cpkt, struct coap_block_context* ctx) {
+    return coap_append_option_int(cpkt, COAP_OPTION_BLOCK1, block_value(cpkt, ctx, true));
+}
+
+int coap_append_block2_option(struct coap_packet* cpkt, struct coap_block_context* ctx) {
+    return coap_append_option_int(cpkt, COAP_OPTION_BLOCK2, block_value(cpkt, ctx, false));
+}
+
+int coap_append_size1_option(struct coap_packet* cpkt, struct coap_block_context* ctx) {
+    return coap_append_option_int(cpkt, COAP_OPTION_SIZE1, (unsigned int) ctx->total_size);
+}
+
+int coap_append_size2_option(struct coap_packet* cpkt, struct coap_block_context* ctx) {
+    return coap_append_option_int(cpkt, COAP_OPTION_SIZE2, (unsigned int) ctx->total_size);
+}
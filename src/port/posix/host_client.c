@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <string.h>
+#include <net/coap.h>
+#include "host_client.h"
+#include "../../oscore/oscore.h"
+#include "../../oscore/coap_helper.h"
+#include "../../oscore/pkt_pool.h"
+
+OscoreError host_client_init(void) {
+    struct pre_established client = {
+        .master_secret = PRE_ESTABLISHED.master_secret,
+        .sender_id = PRE_ESTABLISHED.recipient_id,
+        .recipient_id = PRE_ESTABLISHED.sender_id,
+        .common_id_context = PRE_ESTABLISHED.common_id_context,
+        .opt = PRE_ESTABLISHED.opt,
+    };
+    return oscore_init(client);
+}
+
+struct pre_established host_peer(u32_t index, bool server, struct host_peer* storage) {
+    storage->client_id[0] = (u8_t) (index >> 8);
+    storage->client_id[1] = (u8_t) index;
+    storage->id_context[0] = 'L';
+    storage->id_context[1] = 'D';
+    storage->id_context[2] = (u8_t) (index >> 8);
+    storage->id_context[3] = (u8_t) index;
+    array client_id = { .len = sizeof(storage->client_id), .ptr = storage->client_id };
+    struct pre_established pre = {
+        .master_secret = PRE_ESTABLISHED.master_secret,
+        .sender_id = server ? PRE_ESTABLISHED.sender_id : client_id,
+        .recipient_id = server ? client_id : PRE_ESTABLISHED.sender_id,
+        .common_id_context = { .len = sizeof(storage->id_context), .ptr = storage->id_context },
+        .opt = PRE_ESTABLISHED.opt,
+    };
+    return pre;
+}
+
+OscoreError host_client_init_peer(u32_t index) {
+    static struct host_peer storage;
+    return oscore_init(host_peer(index, false, &storage));
+}
+
+static OscoreError append_string_option(struct coap_packet* packet, u16_t code, const char* value, size_t len) {
+    ensure_eq(coap_packet_append_option(packet, code, (const u8_t*) value, (u16_t) len), 0,
+              OscoreCoapPacketAppendError);
+    return OscoreNoError;
+}
+
+/// Writes header, options and payload of @a request into @a packet
+static OscoreError build_request(const struct host_request* request, const u8_t* token, u8_t tkl, u16_t id,
+                                 struct coap_packet* packet, struct net_pkt* pkt) {
+    ensure_eq(coap_packet_init(packet, pkt, 1, request->type, tkl, (u8_t*) token, request->code, id), 0,
+              OscoreCoapPacketInitError);
+    if (request->host != NULL) {
+        try(append_string_option(packet, COAP_OPTION_URI_HOST, request->host, strlen(request->host)));
+    }
+    if (request->observe) {
+        ensure_eq(coap_append_option_int(packet, COAP_OPTION_OBSERVE, 0), 0, OscoreCoapPacketAppendError);
+    }
+    const char* segment = request->path;
+    while (segment != NULL && *segment != '\0') {
+        const char* end = strchr(segment, '/');
+        size_t len = end != NULL ? (size_t) (end - segment) : strlen(segment);
+        try(append_string_option(packet, COAP_OPTION_URI_PATH, segment, len));
+        segment = end != NULL ? end + 1 : NULL;
+    }
+    if (request->content_format >= 0) {
+        ensure_eq(coap_append_option_int(packet, COAP_OPTION_CONTENT_FORMAT, (u32_t) request->content_format), 0,
+                  OscoreCoapPacketAppendError);
+    }
+    if (request->query != NULL) {
+        try(append_string_option(packet, COAP_OPTION_URI_QUERY, request->query, strlen(request->query)));
+    }
+    if (request->accept >= 0) {
+        ensure_eq(coap_append_option_int(packet, COAP_OPTION_ACCEPT, (u32_t) request->accept), 0,
+                  OscoreCoapPacketAppendError);
+    }
+    if (request->block2 >= 0) {
+        ensure_eq(coap_append_option_int(packet, COAP_OPTION_BLOCK2, (u32_t) request->block2), 0,
+                  OscoreCoapPacketAppendError);
+    }
+    if (request->payload_len > 0) {
+        ensure_eq(coap_packet_append_payload_marker(packet), 0, OscoreCoapPacketAppendError);
+        ensure_eq(coap_packet_append_payload(packet, (u8_t*) request->payload, request->payload_len), 0,
+                  OscoreCoapPacketAppendError);
+    }
+    return OscoreNoError;
+}
+
+OscoreError host_client_protect(const struct host_request* request, const u8_t* token, u8_t tkl, u16_t id, array out,
+                                u16_t* out_len) {
+    struct net_pkt* pkt;
+    try(pkt_pool_get(false, K_NO_WAIT, &pkt));
+    struct coap_packet packet;
+    OscoreError res = build_request(request, token, tkl, id, &packet, pkt);
+    if (res != OscoreNoError) {
+        net_pkt_unref(pkt);
+        return res;
+    }
+
+    struct coap_packet protected;
+    res = oscore_protect_request(packet, &protected);
+    if (res != OscoreNoError) {
+        net_pkt_unref(pkt);
+        return res;
+    }
+    u16_t len = coap_message_len(&protected);
+    if (len > out.len) {
+        res = OscoreOutTooLong;
+    } else {
+        out.len = len;
+        res = read_coap_message(&protected, out);
+    }
+    net_pkt_unref(protected.pkt);
+    if (res != OscoreNoError) {
+        oscore_cancel_request(token, tkl);
+        return res;
+    }
+    *out_len = len;
+    return OscoreNoError;
+}
+
+OscoreError host_client_unprotect(const struct sockaddr_in6* from, const u8_t* response, u16_t len, array payload,
+                                  struct host_response* out) {
+    struct sockaddr_in6 local = { .sin6_family = AF_INET6, .sin6_addr = IN6ADDR_LOOPBACK_INIT };
+    struct net_pkt* pkt = net_pkt_from_datagram(from, &local, response, len);
+    ensure(pkt != NULL, OscorePktError);
+    struct coap_packet packet;
+    if (coap_packet_parse(&packet, pkt, NULL, 0) < 0) {
+        net_pkt_unref(pkt);
+        return OscoreCoapPacketParseError;
+    }
+    struct coap_packet decrypted;
+    OscoreError res = oscore_unprotect_response(packet, &decrypted);
+    if (res != OscoreNoError) {
+        net_pkt_unref(pkt);
+        return res;
+    }
+
+    struct coap_packet parsed;
+    if (coap_packet_parse(&parsed, decrypted.pkt, NULL, 0) < 0) {
+        net_pkt_unref(decrypted.pkt);
+        return OscoreCoapPacketParseError;
+    }
+    struct coap_option option;
+    out->code = coap_header_get_code(&parsed);
+    out->observe = coap_find_options(&parsed, COAP_OPTION_OBSERVE, &option, 1) == 1;
+    out->block2 = -1;
+    if (coap_find_options(&parsed, COAP_OPTION_BLOCK2, &option, 1) == 1) {
+        out->block2 = (s32_t) coap_option_value_to_int(&option);
+    }
+    out->payload_len = 0;
+    u16_t offset;
+    u16_t payload_len;
+    // checked here, `get_payload_info` warns about responses without payload, e.g. Observe notifications
+    struct net_buf* frag = coap_packet_get_payload(&parsed, &offset, &payload_len);
+    struct payload_info info;
+    if (frag != NULL || offset != 0) {
+        res = get_payload_info(&parsed, &info);
+    } else {
+        res = OscoreCoapPacketNoPayload;
+    }
+    if (res == OscoreNoError) {
+        out->payload_len = info.len;
+        info.len = (u16_t) min(info.len, payload.len);
+        if (payload.ptr != NULL) {
+            res = read_payload(info, payload);
+        }
+    } else if (res == OscoreCoapPacketNoPayload) {
+        res = OscoreNoError;
+    }
+    net_pkt_unref(decrypted.pkt);
+    return res;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_HOST_CLIENT_H
+#define NONE_HOST_CLIENT_H
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <net/net_ip.h>
+#include "../../util/array.h"
+#include "../../util/error.h"
+
+// Client side of the host harnesses: builds CoAP requests and protects them with the core's own client API
+// (`oscore_protect_request` / `oscore_unprotect_response`).
+//
+// Requests are protected with the first security context of the core. `host_client_init` derives it as the peer of
+// PRE_ESTABLISHED, i.e. with sender and recipient ID swapped, so a process can't be client and server at the same
+// time. The benchmark switches roles between generating and processing requests, every simulated client of the load
+// generator is a process of its own.
+
+/// Request to build with `host_client_protect`
+struct host_request {
+    /// COAP_METHOD_*
+    u8_t code;
+    /// COAP_TYPE_*
+    u8_t type;
+    /// Uri-Path segments separated by '/', e.g. "api/v1/echo"
+    const char* path;
+    /// single Uri-Query, NULL if none
+    const char* query;
+    /// Uri-Host, NULL if none
+    const char* host;
+    /// whether to register as observer (Observe: 0)
+    bool observe;
+    /// Content-Format, negative if none
+    s32_t content_format;
+    /// Accept, negative if none
+    s32_t accept;
+    /// Block2 value (NUM << 4 | M << 3 | SZX), negative if none
+    s32_t block2;
+    const u8_t* payload;
+    u16_t payload_len;
+};
+
+/// Decrypted response, see `host_client_unprotect`
+struct host_response {
+    u8_t code;
+    bool observe;
+    /// Block2 value, negative if none
+    s32_t block2;
+    u16_t payload_len;
+};
+
+/**
+ * Initializes the security context of the core as the client of PRE_ESTABLISHED.
+ * @return OscoreError
+ */
+OscoreError host_client_init(void);
+
+/// Storage of the IDs and ID Context the pre-established material of `host_peer` points to
+struct host_peer {
+    u8_t client_id[2];
+    u8_t id_context[4];
+};
+
+/**
+ * Pre-established material of simulated client @a index of the load generator and the server.
+ * Master Secret, Master Salt and the server's Sender ID are the ones of PRE_ESTABLISHED. Every client has its own
+ * 2-byte Sender ID and ID Context, so the server's Sender Key differs per client, too.
+ * @param index Number of the client
+ * @param server Whether to return the server's side, i.e. with Sender and Recipient ID swapped
+ * @param storage Memory the IDs and ID Context are written to, it has to outlive the security context
+ * @return pre-established material
+ */
+struct pre_established host_peer(u32_t index, bool server, struct host_peer* storage);
+
+/**
+ * Initializes the security context of the core as simulated client @a index, see `host_peer`.
+ * @return OscoreError
+ */
+OscoreError host_client_init_peer(u32_t index);
+
+/**
+ * Builds and protects a request, serialized as UDP payload.
+ * @param request Request to build
+ * @param token Token of the request, must be unique among outstanding requests
+ * @param tkl Length of @a token
+ * @param id Message ID
+ * @param out Buffer to write the OSCORE message into
+ * @param out_len out-pointer to write the length of the OSCORE message into
+ * @return OscoreError, OscoreOutTooLong if @a out is too short
+ */
+OscoreError host_client_protect(const struct host_request* request, const u8_t* token, u8_t tkl, u16_t id, array out,
+                                u16_t* out_len);
+
+/**
+ * Verifies and decrypts the response to a request protected with `host_client_protect`.
+ * @param from Source of the response
+ * @param response Received UDP payload
+ * @param len Length of @a response
+ * @param payload Buffer for the decrypted payload, its length is truncated to `payload.len`. Can be NULL_ARRAY.
+ * @param out out-pointer to write code and payload length of the response into
+ * @return OscoreError
+ */
+OscoreError host_client_unprotect(const struct sockaddr_in6* from, const u8_t* response, u16_t len, array payload,
+                                  struct host_response* out);
+
+#endif //NONE_HOST_CLIENT_H
@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <string.h>
+#include <net/coap.h>
+#include "host_server.h"
+#include "host_client.h"
+#include "../../oscore/oscore.h"
+#include "../../oscore/options.h"
+#include "../../oscore/coap_helper.h"
+#include "../../oscore/pkt_pool.h"
+#include "../../codec/oscore_option.h"
+
+static const char* const STAGE_NAMES[NUM_HOST_STAGES] = {
+    [HostParse] = "parse",
+    [HostPrefilter] = "prefilter",
+    [HostUnprotect] = "unprotect",
+    [HostHandler] = "handler",
+    [HostProtect] = "protect",
+    [HostAnswered] = "answered",
+};
+
+/// shared by the threads of a sharded server
+static atomic_t observe_seq;
+
+/// IDs and ID Contexts the security contexts of the simulated clients point to
+static struct host_peer peers[OSCORE_MAX_CONTEXTS];
+
+OscoreError host_server_init(void) {
+    return oscore_init(PRE_ESTABLISHED);
+}
+
+OscoreError host_server_add_peers(u32_t count) {
+    ensure(count < OSCORE_MAX_CONTEXTS, OscoreTooManyContexts);
+    for (u32_t i = 0; i < count; i++) {
+        try(oscore_add_context(host_peer(i, true, &peers[i])));
+    }
+    return OscoreNoError;
+}
+
+/// Byte @a i of the body of the `large` resource
+static u8_t large_byte(u16_t i) {
+    return (u8_t) ('a' + i % 26);
+}
+
+/// Reads the extended option delta or length of a nibble, returns false if the datagram is too short
+static bool option_nibble(u8_t nibble, const u8_t** pos, const u8_t* end, u16_t* out) {
+    if (nibble == 13) {
+        if (end - *pos < 1) {
+            return false;
+        }
+        *out = (u16_t) (**pos + 13);
+        *pos += 1;
+    } else if (nibble == 14) {
+        if (end - *pos < 2) {
+            return false;
+        }
+        *out = (u16_t) (((*pos)[0] << 8 | (*pos)[1]) + 269);
+        *pos += 2;
+    } else {
+        *out = nibble;
+    }
+    return nibble != 15;
+}
+
+bool host_server_shard(const u8_t* request, u16_t len, u32_t shards, u32_t* shard) {
+    const u8_t* end = request + len;
+    if (len < 4 || (request[0] & 0xf) > 8 || len < 4 + (request[0] & 0xf)) {
+        return false;
+    }
+    const u8_t* pos = request + 4 + (request[0] & 0xf);
+    u16_t code = 0;
+    while (pos < end && *pos != 0xff) {
+        u8_t header = *pos++;
+        u16_t delta;
+        u16_t option_len;
+        if (!option_nibble(header >> 4, &pos, end, &delta) || !option_nibble(header & 0xf, &pos, end, &option_len)
+                || end - pos < option_len) {
+            return false;
+        }
+        code += delta;
+        if (code == COAP_OPTION_OSCORE) {
+            u8_t partial_iv[8];
+            u8_t kid[7];
+            u8_t kid_context[16];
+            struct unprotected unprotected = {
+                .partial_iv = { .len = sizeof(partial_iv), .ptr = partial_iv },
+                .kid = { .len = sizeof(kid), .ptr = kid },
+                .kid_context = { .len = sizeof(kid_context), .ptr = kid_context },
+            };
+            if (from_oscore_option((array) { .len = option_len, .ptr = (u8_t*) pos }, &unprotected) != OscoreNoError) {
+                return false;
+            }
+            *shard = oscore_kid_partition(unprotected.kid, shards);
+            return true;
+        }
+        if (code > COAP_OPTION_OSCORE) {
+            break;
+        }
+        pos += option_len;
+    }
+    return false;
+}
+
+const char* host_stage_name(enum host_stage stage) {
+    return stage < NUM_HOST_STAGES ? STAGE_NAMES[stage] : "unknown";
+}
+
+/// Whether the Uri-Path of @a options is the single segment @a name
+static bool path_equals(struct coap_option* options, u8_t opt_num, const char* name) {
+    array path = get_option_value(options, opt_num, COAP_OPTION_URI_PATH);
+    return path.ptr != NULL && path.len == strlen(name) && memcmp(path.ptr, name, path.len) == 0;
+}
+
+/**
+ * Builds the response of the host resources to a decrypted request.
+ * @param request Decrypted request
+ * @param options Parsed options of @a request
+ * @param opt_num Number of options in @a options
+ * @param out out-pointer to the unprotected response
+ * @return OscoreError
+ */
+static OscoreError handle(struct coap_packet* request, struct coap_option* options, u8_t opt_num,
+                          struct coap_packet* out) {
+    u8_t token[8];
+    u8_t tkl = coap_header_get_token(request, token);
+    u8_t type = coap_header_get_type(request) == COAP_TYPE_CON ? COAP_TYPE_ACK : COAP_TYPE_NON_CON;
+    u8_t method = coap_header_get_code(request);
+
+    u8_t code;
+    const u8_t* payload = NULL;
+    u16_t payload_len = 0;
+    struct payload_info info = { 0 };
+    u16_t offset;
+    bool echo = path_equals(options, opt_num, "echo");
+    bool hello = path_equals(options, opt_num, "hello") || path_equals(options, opt_num, "tv1");
+    bool large = path_equals(options, opt_num, "large") && method == COAP_METHOD_GET;
+    // Block2 of the response: NUM << 4 | M << 3 | SZX, the size of a block is 2^(SZX + 4)
+    s32_t block2 = -1;
+    u16_t block_start = 0;
+    if (large) {
+        u32_t requested = 2;
+        array block = get_option_value(options, opt_num, COAP_OPTION_BLOCK2);
+        if (block.ptr != NULL) {
+            ensure(block.len <= 3, OscoreInvalidOptionLength);
+            requested = 0;
+            for (size_t i = 0; i < block.len; i++) {
+                requested = requested << 8 | block.ptr[i];
+            }
+        }
+        u32_t szx = min(requested & 0x7, 6u);
+        u32_t size = 16u << szx;
+        u32_t num = requested >> 4;
+        if (num * size >= HOST_LARGE_LEN) {
+            code = COAP_RESPONSE_CODE_BAD_OPTION;
+        } else {
+            code = COAP_RESPONSE_CODE_CONTENT;
+            block_start = (u16_t) (num * size);
+            payload_len = (u16_t) min(size, HOST_LARGE_LEN - block_start);
+            bool more = block_start + payload_len < HOST_LARGE_LEN;
+            block2 = (s32_t) (num << 4 | (more ? 0x8 : 0) | szx);
+        }
+    } else if (hello && method == COAP_METHOD_GET) {
+        code = COAP_RESPONSE_CODE_CONTENT;
+        payload = (const u8_t*) "Hello World!";
+        payload_len = (u16_t) strlen((const char*) payload);
+    } else if (echo) {
+        code = method == COAP_METHOD_GET ? COAP_RESPONSE_CODE_CONTENT : COAP_RESPONSE_CODE_CHANGED;
+        info.frag = coap_packet_get_payload(request, &offset, &info.len);
+        ensure(!(info.frag == NULL && offset == 0xffff), OscoreCoapPacketParseError);
+        info.offset = offset;
+    } else {
+        code = COAP_RESPONSE_CODE_NOT_FOUND;
+    }
+    bool observe = echo && get_option_value(options, opt_num, COAP_OPTION_OBSERVE).ptr != NULL;
+
+    struct net_pkt* pkt;
+    try(pkt_pool_get(false, OSCORE_PKT_TIMEOUT_MS, &pkt));
+    OscoreError res = OscoreNoError;
+    if (coap_packet_init(out, pkt, 1, type, tkl, token, code, coap_header_get_id(request)) != 0) {
+        res = OscoreCoapPacketInitError;
+    }
+    if (res == OscoreNoError && observe) {
+        u32_t next = (u32_t) atomic_inc(&observe_seq);
+        u8_t seq[3] = { (u8_t) (next >> 16), (u8_t) (next >> 8), (u8_t) next };
+        if (coap_packet_append_option(out, COAP_OPTION_OBSERVE, seq, sizeof(seq)) != 0) {
+            res = OscoreCoapPacketAppendError;
+        }
+    }
+    if (res == OscoreNoError && block2 >= 0) {
+        if (coap_append_option_int(out, COAP_OPTION_BLOCK2, (u32_t) block2) != 0) {
+            res = OscoreCoapPacketAppendError;
+        }
+    }
+    if (res == OscoreNoError && (payload_len > 0 || info.len > 0)) {
+        if (coap_packet_append_payload_marker(out) != 0) {
+            res = OscoreCoapPacketAppendError;
+        }
+    }
+    if (res == OscoreNoError && payload_len > 0 && payload != NULL) {
+        if (coap_packet_append_payload(out, (u8_t*) payload, payload_len) != 0) {
+            res = OscoreCoapPacketAppendError;
+        }
+    }
+    for (u16_t done = 0; res == OscoreNoError && large && done < payload_len;) {
+        u8_t chunk[64];
+        u16_t len = (u16_t) min(sizeof(chunk), (size_t) (payload_len - done));
+        for (u16_t i = 0; i < len; i++) {
+            chunk[i] = large_byte(block_start + done + i);
+        }
+        if (coap_packet_append_payload(out, chunk, len) != 0) {
+            res = OscoreCoapPacketAppendError;
+        }
+        done += len;
+    }
+    // the echoed payload is copied fragment by fragment, like the block-wise handlers do
+    u16_t copied = 0;
+    while (res == OscoreNoError && copied < info.len) {
+        u8_t chunk[64];
+        u16_t len = (u16_t) min(sizeof(chunk), (size_t) (info.len - copied));
+        u16_t pos;
+        struct net_buf* frag = net_frag_read(info.frag, info.offset, &pos, len, chunk);
+        if (frag == NULL && pos == 0xffff) {
+            res = OscoreNetPacketReadError;
+        } else if (!net_pkt_append_all(pkt, len, chunk, K_NO_WAIT)) {
+            res = OscoreNetPacketAppendError;
+        }
+        info.frag = frag;
+        info.offset = pos;
+        copied += len;
+    }
+    if (res != OscoreNoError) {
+        net_pkt_unref(pkt);
+    }
+    return res;
+}
+
+/// Serializes a protected response into @a response and releases it
+static OscoreError write_response(struct coap_packet* protected, array response, u16_t* response_len) {
+    OscoreError res;
+    u16_t protected_len = coap_message_len(protected);
+    if (protected_len > response.len) {
+        res = OscoreOutTooLong;
+    } else {
+        response.len = protected_len;
+        res = read_coap_message(protected, response);
+    }
+    net_pkt_unref(protected->pkt);
+    if (res == OscoreNoError) {
+        *response_len = protected_len;
+    }
+    return res;
+}
+
+OscoreError host_server_handle(const struct sockaddr_in6* from, const u8_t* request, u16_t len, array response,
+                               u16_t* response_len, enum host_stage* stage) {
+    static const struct sockaddr_in6 local = { .sin6_family = AF_INET6, .sin6_addr = IN6ADDR_LOOPBACK_INIT };
+    struct coap_option options[16];
+    u8_t opt_num = sizeof(options) / sizeof(options[0]);
+
+    *stage = HostParse;
+    struct net_pkt* pkt = net_pkt_from_datagram(from, &local, request, len);
+    ensure(pkt != NULL, OscorePktError);
+    struct coap_packet packet;
+    if (coap_packet_parse(&packet, pkt, NULL, 0) < 0) {
+        net_pkt_unref(pkt);
+        return OscoreCoapPacketParseError;
+    }
+
+    *stage = HostPrefilter;
+    OscoreError res = oscore_prefilter(&packet);
+    if (res != OscoreNoError) {
+        net_pkt_unref(pkt);
+        return res;
+    }
+
+    *stage = HostUnprotect;
+    struct coap_packet decrypted;
+    res = from_oscore(packet, &decrypted);
+    if (res == OscoreEchoRequired) {
+        // the replay window of the peer is unknown, it has to echo a challenge first
+        *stage = HostProtect;
+        u8_t type = coap_header_get_type(&packet) == COAP_TYPE_CON ? COAP_TYPE_ACK : COAP_TYPE_NON_CON;
+        struct coap_packet challenge;
+        res = oscore_echo_challenge(&packet, type, coap_header_get_id(&packet), &challenge);
+        net_pkt_unref(pkt);
+        try(res);
+        try(write_response(&challenge, response, response_len));
+        *stage = HostAnswered;
+        return OscoreNoError;
+    }
+    if (res != OscoreNoError) {
+        net_pkt_unref(pkt);
+        return res;
+    }
+    if (coap_packet_parse(&decrypted, decrypted.pkt, NULL, 0) < 0) {
+        net_pkt_unref(decrypted.pkt);
+        return OscoreCoapPacketParseError;
+    }
+    get_options(&decrypted, options, &opt_num);
+
+    *stage = HostHandler;
+    struct coap_packet plain;
+    res = handle(&decrypted, options, opt_num, &plain);
+    if (res != OscoreNoError) {
+        net_pkt_unref(decrypted.pkt);
+        return res;
+    }
+
+    *stage = HostProtect;
+    struct coap_packet protected;
+    res = into_oscore(plain, &decrypted, &protected);
+    net_pkt_unref(decrypted.pkt);
+    if (res != OscoreNoError) {
+        net_pkt_unref(plain.pkt);
+        return res;
+    }
+    res = write_response(&protected, response, response_len);
+    if (res == OscoreNoError) {
+        *stage = HostAnswered;
+    }
+    return res;
+}
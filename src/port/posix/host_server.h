@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_HOST_SERVER_H
+#define NONE_HOST_SERVER_H
+
+#include <zephyr/types.h>
+#include <net/net_ip.h>
+#include "../../util/array.h"
+#include "../../util/error.h"
+
+// Server side of the host harnesses: the OSCORE path of `server/coap-server.c:udp_receive` (parse, prefilter,
+// `from_oscore`, handler, `into_oscore`) for a single datagram, with a few resources standing in for the handlers
+// of the Zephyr server:
+//
+// * `hello` and `tv1` (GET): 2.05 "Hello World!", `tv1` is the resource of the RFC 8613 Appendix C test vectors
+// * `echo` (any method): 2.05 for GET, 2.04 otherwise, with the request's payload. A request with an Observe Option
+//   is answered with an Observe Option, which makes the response use a fresh Partial IV.
+// * `large` (GET): 2.05 with a body of HOST_LARGE_LEN bytes, returned block-wise with the Block2 Option. The block
+//   size and number are the ones of the request's Block2 Option, the first 64-byte block if it has none.
+// * everything else: 4.04
+
+/// Length of the body of the `large` resource
+#define HOST_LARGE_LEN 256
+
+/// Stage of `host_server_handle` a request was dropped in
+enum host_stage {
+    HostParse,
+    HostPrefilter,
+    HostUnprotect,
+    HostHandler,
+    HostProtect,
+    HostAnswered,
+    NUM_HOST_STAGES,
+};
+
+/**
+ * Initializes the security context of the core as server of PRE_ESTABLISHED.
+ * @return OscoreError
+ */
+OscoreError host_server_init(void);
+
+/**
+ * Adds the security contexts of the simulated clients 0 to @a count - 1 of the load generator, see `host_peer`.
+ * @param count Number of clients, at most OSCORE_MAX_CONTEXTS - 1
+ * @return OscoreError
+ */
+OscoreError host_server_add_peers(u32_t count);
+
+/**
+ * Processes an OSCORE request and protects its response. Requests of a peer whose replay window is unknown are
+ * answered with an Echo challenge instead, see `oscore_require_echo`.
+ * @param from Source of the datagram
+ * @param request UDP payload
+ * @param len Length of @a request
+ * @param response Buffer for the protected response
+ * @param response_len out-pointer to write the length of the response into
+ * @param stage out-pointer to write the stage into, `HostAnswered` if a response was written
+ * @return OscoreError of the failed stage, OscorePktError if the request couldn't be parsed
+ */
+OscoreError host_server_handle(const struct sockaddr_in6* from, const u8_t* request, u16_t len, array response,
+                               u16_t* response_len, enum host_stage* stage);
+
+/**
+ * Selects the thread of a sharded server a request belongs to: `oscore_kid_partition` of its kid.
+ * Only the CoAP header and options of the datagram are parsed, nothing is copied or decrypted.
+ * @param request UDP payload
+ * @param len Length of @a request
+ * @param shards Number of threads
+ * @param shard out-pointer to write the thread into
+ * @return whether the datagram has a valid OSCORE Option, others can be dropped by any thread
+ */
+bool host_server_shard(const u8_t* request, u16_t len, u32_t shards, u32_t* shard);
+
+/// Name of a stage for reports
+const char* host_stage_name(enum host_stage stage);
+
+#endif //NONE_HOST_SERVER_H
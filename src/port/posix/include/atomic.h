@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_PORT_ATOMIC_H
+#define NONE_PORT_ATOMIC_H
+
+typedef int atomic_t;
+typedef atomic_t atomic_val_t;
+
+static inline atomic_val_t atomic_inc(atomic_t* target) {
+    return __atomic_fetch_add(target, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_dec(atomic_t* target) {
+    return __atomic_fetch_sub(target, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_add(atomic_t* target, atomic_val_t value) {
+    return __atomic_fetch_add(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_get(const atomic_t* target) {
+    return __atomic_load_n(target, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_set(atomic_t* target, atomic_val_t value) {
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline int atomic_cas(atomic_t* target, atomic_val_t old_value, atomic_val_t new_value) {
+    return __atomic_compare_exchange_n(target, &old_value, new_value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+#endif //NONE_PORT_ATOMIC_H
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_PORT_KERNEL_H
+#define NONE_PORT_KERNEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+#include <zephyr/types.h>
+#include <toolchain.h>
+#include <atomic.h>
+#include <misc/util.h>
+#include <misc/dlist.h>
+
+// Timeouts are milliseconds like in Zephyr.
+#define MSEC_PER_SEC 1000
+#define K_NO_WAIT 0
+#define K_FOREVER (-1)
+#define K_MSEC(ms) (ms)
+#define K_SECONDS(s) K_MSEC((s) * 1000)
+#define K_MINUTES(m) K_SECONDS((m) * 60)
+
+/// Every POSIX thread gets its own `struct k_thread`, only used to tell threads apart.
+struct k_thread {
+    pthread_t thread;
+};
+typedef struct k_thread* k_tid_t;
+
+/// Returns the `struct k_thread` of the calling thread.
+k_tid_t k_current_get(void);
+
+/// Milliseconds since the first call of any timing function, plus the time skipped with `k_uptime_skip`.
+s64_t k_uptime_get(void);
+u32_t k_uptime_get_32(void);
+
+/// Moves the uptime forward by @a duration milliseconds, so tests can expire timeouts without waiting. Host only.
+void k_uptime_skip(s32_t duration);
+
+/// Nanoseconds of the monotonic clock, wrapping after about 4.3 seconds.
+u32_t k_cycle_get_32(void);
+
+/// Random number from the system's entropy source.
+u32_t sys_rand32_get(void);
+
+/// Blocks the calling thread for @a duration milliseconds.
+void k_sleep(s32_t duration);
+
+struct k_mutex {
+    pthread_mutex_t mutex;
+};
+
+void k_mutex_init(struct k_mutex* mutex);
+/**
+ * Locks @a mutex recursively.
+ * @param mutex Mutex
+ * @param timeout K_NO_WAIT, K_FOREVER or milliseconds
+ * @return 0 or -EBUSY if it wasn't locked with K_NO_WAIT, -EAGAIN if the timeout expired
+ */
+int k_mutex_lock(struct k_mutex* mutex, s32_t timeout);
+void k_mutex_unlock(struct k_mutex* mutex);
+
+/**
+ * There are no interrupts on the host, irq_lock takes a single global recursive lock instead, which gives the same
+ * mutual exclusion for the short critical sections using it.
+ */
+unsigned int irq_lock(void);
+void irq_unlock(unsigned int key);
+
+#endif //NONE_PORT_KERNEL_H
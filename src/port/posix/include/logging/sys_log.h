@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_PORT_LOGGING_SYS_LOG_H
+#define NONE_PORT_LOGGING_SYS_LOG_H
+
+#include <stdio.h>
+
+// Logs to stderr. The level is set with SYS_LOG_LEVEL like in Zephyr: 1 error, 2 warning, 3 info, 4 debug.
+#ifndef SYS_LOG_LEVEL
+#define SYS_LOG_LEVEL 2
+#endif
+
+#define SYS_LOG_LEVEL_ERROR 1
+#define SYS_LOG_LEVEL_WARNING 2
+#define SYS_LOG_LEVEL_INFO 3
+#define SYS_LOG_LEVEL_DEBUG 4
+
+#define SYS_LOG_BACKEND_FN(level, fmt, ...) do {\
+    if (SYS_LOG_LEVEL >= SYS_LOG_LEVEL_##level) {\
+        fprintf(stderr, "[" #level "] " fmt "\n", ##__VA_ARGS__);\
+    }\
+} while (0)
+
+#define SYS_LOG_ERR(fmt, ...) SYS_LOG_BACKEND_FN(ERROR, fmt, ##__VA_ARGS__)
+#define SYS_LOG_WRN(fmt, ...) SYS_LOG_BACKEND_FN(WARNING, fmt, ##__VA_ARGS__)
+#define SYS_LOG_INF(fmt, ...) SYS_LOG_BACKEND_FN(INFO, fmt, ##__VA_ARGS__)
+#define SYS_LOG_DBG(fmt, ...) SYS_LOG_BACKEND_FN(DEBUG, fmt, ##__VA_ARGS__)
+
+#define NET_ERR(fmt, ...) SYS_LOG_ERR(fmt, ##__VA_ARGS__)
+#define NET_WARN(fmt, ...) SYS_LOG_WRN(fmt, ##__VA_ARGS__)
+#define NET_INFO(fmt, ...) SYS_LOG_INF(fmt, ##__VA_ARGS__)
+#define NET_DBG(fmt, ...) SYS_LOG_DBG(fmt, ##__VA_ARGS__)
+
+#endif //NONE_PORT_LOGGING_SYS_LOG_H
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_PORT_MISC_DLIST_H
+#define NONE_PORT_MISC_DLIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <misc/util.h>
+
+// Doubly-linked list with the semantics of Zephyr's: the list is a node whose next is the head and prev the tail.
+
+struct _dnode {
+    struct _dnode* next;
+    struct _dnode* prev;
+};
+
+typedef struct _dnode sys_dlist_t;
+typedef struct _dnode sys_dnode_t;
+
+#define SYS_DLIST_FOR_EACH_NODE(list, node) \
+    for (node = sys_dlist_peek_head(list); node; node = sys_dlist_peek_next(list, node))
+
+#define SYS_DLIST_FOR_EACH_NODE_SAFE(list, node, next_node) \
+    for (node = sys_dlist_peek_head(list), next_node = sys_dlist_peek_next(list, node); node; \
+         node = next_node, next_node = sys_dlist_peek_next(list, node))
+
+#define SYS_DLIST_CONTAINER(node, container, field) \
+    ((node) ? CONTAINER_OF((node), __typeof__(*(container)), field) : NULL)
+
+#define SYS_DLIST_PEEK_HEAD_CONTAINER(list, container, field) \
+    SYS_DLIST_CONTAINER(sys_dlist_peek_head(list), container, field)
+
+#define SYS_DLIST_PEEK_NEXT_CONTAINER(list, container, field) \
+    ((container) ? SYS_DLIST_CONTAINER(sys_dlist_peek_next((list), &(container)->field), container, field) : NULL)
+
+#define SYS_DLIST_FOR_EACH_CONTAINER(list, container, field) \
+    for (container = SYS_DLIST_PEEK_HEAD_CONTAINER(list, container, field); container; \
+         container = SYS_DLIST_PEEK_NEXT_CONTAINER(list, container, field))
+
+#define SYS_DLIST_FOR_EACH_CONTAINER_SAFE(list, container, next_container, field) \
+    for (container = SYS_DLIST_PEEK_HEAD_CONTAINER(list, container, field), \
+         next_container = SYS_DLIST_PEEK_NEXT_CONTAINER(list, container, field); container; \
+         container = next_container, next_container = SYS_DLIST_PEEK_NEXT_CONTAINER(list, container, field))
+
+static inline void sys_dlist_init(sys_dlist_t* list) {
+    list->next = list;
+    list->prev = list;
+}
+
+static inline bool sys_dlist_is_empty(sys_dlist_t* list) {
+    return list->next == list;
+}
+
+static inline sys_dnode_t* sys_dlist_peek_head(sys_dlist_t* list) {
+    return sys_dlist_is_empty(list) ? NULL : list->next;
+}
+
+static inline sys_dnode_t* sys_dlist_peek_tail(sys_dlist_t* list) {
+    return sys_dlist_is_empty(list) ? NULL : list->prev;
+}
+
+static inline sys_dnode_t* sys_dlist_peek_next(sys_dlist_t* list, sys_dnode_t* node) {
+    return (node == NULL || node->next == list) ? NULL : node->next;
+}
+
+static inline void sys_dlist_append(sys_dlist_t* list, sys_dnode_t* node) {
+    node->next = list;
+    node->prev = list->prev;
+    list->prev->next = node;
+    list->prev = node;
+}
+
+static inline void sys_dlist_prepend(sys_dlist_t* list, sys_dnode_t* node) {
+    node->next = list->next;
+    node->prev = list;
+    list->next->prev = node;
+    list->next = node;
+}
+
+static inline void sys_dlist_remove(sys_dnode_t* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+}
+
+static inline sys_dnode_t* sys_dlist_get(sys_dlist_t* list) {
+    sys_dnode_t* node = sys_dlist_peek_head(list);
+    if (node != NULL) {
+        sys_dlist_remove(node);
+    }
+    return node;
+}
+
+#endif //NONE_PORT_MISC_DLIST_H
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_PORT_MISC_UTIL_H
+#define NONE_PORT_MISC_UTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <toolchain.h>
+
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+#define CONTAINER_OF(ptr, type, field) ((type*) (((char*) (ptr)) - offsetof(type, field)))
+#define ROUND_UP(x, align) \
+    ((((unsigned long) (x) + ((unsigned long) (align) - 1)) / (unsigned long) (align)) * (unsigned long) (align))
+#define POINTER_TO_UINT(x) ((uintptr_t) (x))
+#define UINT_TO_POINTER(x) ((void*) (uintptr_t) (x))
+#define BIT(n) (1UL << (n))
+
+#endif //NONE_PORT_MISC_UTIL_H
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_PORT_NET_BUF_H
+#define NONE_PORT_NET_BUF_H
+
+#include <zephyr/types.h>
+
+/// Size of the data of a fragment, CONFIG_NET_BUF_DATA_SIZE in Zephyr
+#ifndef NET_BUF_DATA_SIZE
+#define NET_BUF_DATA_SIZE 128
+#endif
+
+/// Data fragment of a packet
+struct net_buf {
+    /// next fragment of the packet or NULL
+    struct net_buf* frags;
+    u8_t* data;
+    u16_t len;
+    u16_t size;
+    u8_t __buf[NET_BUF_DATA_SIZE];
+};
+
+/// Opaque, fragments are allocated by `net_pkt_get_data`
+struct net_buf_pool;
+
+static inline size_t net_buf_tailroom(struct net_buf* buf) {
+    return buf->size - (size_t) (buf->data - buf->__buf) - buf->len;
+}
+
+#endif //NONE_PORT_NET_BUF_H
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_PORT_NET_COAP_H
+#define NONE_PORT_NET_COAP_H
+
+#include <zephyr/types.h>
+#include <net/net_pkt.h>
+
+// Subset of Zephyr's CoAP library used by the OSCORE core, with the same semantics as the Zephyr version the
+// firmware is built against: option deltas of parsed options are relative to the previous option, while
+// `coap_find_options` takes absolute option numbers. COAP_OPTION_OSCORE is defined in oscore/oscore.h.
+
+#define COAP_VERSION_1 1
+
+enum coap_option_num {
+    COAP_OPTION_IF_MATCH = 1,
+    COAP_OPTION_URI_HOST = 3,
+    COAP_OPTION_ETAG = 4,
+    COAP_OPTION_IF_NONE_MATCH = 5,
+    COAP_OPTION_OBSERVE = 6,
+    COAP_OPTION_URI_PORT = 7,
+    COAP_OPTION_LOCATION_PATH = 8,
+    COAP_OPTION_URI_PATH = 11,
+    COAP_OPTION_CONTENT_FORMAT = 12,
+    COAP_OPTION_MAX_AGE = 14,
+    COAP_OPTION_URI_QUERY = 15,
+    COAP_OPTION_ACCEPT = 17,
+    COAP_OPTION_LOCATION_QUERY = 20,
+    COAP_OPTION_BLOCK2 = 23,
+    COAP_OPTION_BLOCK1 = 27,
+    COAP_OPTION_SIZE2 = 28,
+    COAP_OPTION_PROXY_URI = 35,
+    COAP_OPTION_PROXY_SCHEME = 39,
+    COAP_OPTION_SIZE1 = 60,
+};
+
+enum coap_method {
+    COAP_METHOD_GET = 1,
+    COAP_METHOD_POST = 2,
+    COAP_METHOD_PUT = 3,
+    COAP_METHOD_DELETE = 4,
+};
+
+enum coap_msgtype {
+    COAP_TYPE_CON = 0,
+    COAP_TYPE_NON_CON = 1,
+    COAP_TYPE_ACK = 2,
+    COAP_TYPE_RESET = 3,
+};
+
+#define COAP_MAKE_RESPONSE_CODE(clas, det) (((clas) << 5) | (det))
+
+enum coap_response_code {
+    COAP_RESPONSE_CODE_OK = COAP_MAKE_RESPONSE_CODE(2, 0),
+    COAP_RESPONSE_CODE_CREATED = COAP_MAKE_RESPONSE_CODE(2, 1),
+    COAP_RESPONSE_CODE_DELETED = COAP_MAKE_RESPONSE_CODE(2, 2),
+    COAP_RESPONSE_CODE_VALID = COAP_MAKE_RESPONSE_CODE(2, 3),
+    COAP_RESPONSE_CODE_CHANGED = COAP_MAKE_RESPONSE_CODE(2, 4),
+    COAP_RESPONSE_CODE_CONTENT = COAP_MAKE_RESPONSE_CODE(2, 5),
+    COAP_RESPONSE_CODE_CONTINUE = COAP_MAKE_RESPONSE_CODE(2, 31),
+    COAP_RESPONSE_CODE_BAD_REQUEST = COAP_MAKE_RESPONSE_CODE(4, 0),
+    COAP_RESPONSE_CODE_UNAUTHORIZED = COAP_MAKE_RESPONSE_CODE(4, 1),
+    COAP_RESPONSE_CODE_BAD_OPTION = COAP_MAKE_RESPONSE_CODE(4, 2),
+    COAP_RESPONSE_CODE_FORBIDDEN = COAP_MAKE_RESPONSE_CODE(4, 3),
+    COAP_RESPONSE_CODE_NOT_FOUND = COAP_MAKE_RESPONSE_CODE(4, 4),
+    COAP_RESPONSE_CODE_NOT_ALLOWED = COAP_MAKE_RESPONSE_CODE(4, 5),
+    COAP_RESPONSE_CODE_INCOMPLETE = COAP_MAKE_RESPONSE_CODE(4, 8),
+    COAP_RESPONSE_CODE_REQUEST_TOO_LARGE = COAP_MAKE_RESPONSE_CODE(4, 13),
+    COAP_RESPONSE_CODE_INTERNAL_ERROR = COAP_MAKE_RESPONSE_CODE(5, 0),
+    COAP_RESPONSE_CODE_SERVICE_UNAVAILABLE = COAP_MAKE_RESPONSE_CODE(5, 3),
+};
+
+#define COAP_MARKER 0xFF
+
+/// CoAP message inside a packet
+struct coap_packet {
+    struct net_pkt* pkt;
+    /// fragment containing the CoAP header
+    struct net_buf* frag;
+    /// offset of the CoAP header in @a frag
+    u16_t offset;
+    /// length of the fixed header and the token
+    u8_t hdr_len;
+    /// length of all encoded options, including the payload marker of parsed packets
+    u16_t opt_len;
+    /// number of the last appended option
+    u16_t last_delta;
+};
+
+struct coap_option {
+    u16_t delta;
+    u8_t len;
+    u8_t value[12];
+};
+
+/**
+ * Writes a CoAP header and token to the start of @a pkt, which must already contain a fragment.
+ * @return 0 or -EINVAL
+ */
+int coap_packet_init(struct coap_packet* cpkt, struct net_pkt* pkt, u8_t ver, u8_t type, u8_t tokenlen,
+                     u8_t* token, u8_t code, u16_t id);
+
+/**
+ * Parses a received packet, skipping its IP and UDP header.
+ * @param options Array to write up to @a opt_num options into, can be NULL
+ * @return 0, -EINVAL if the packet is malformed
+ */
+int coap_packet_parse(struct coap_packet* cpkt, struct net_pkt* pkt, struct coap_option* options, u8_t opt_num);
+
+/**
+ * Finds the options with number @a code.
+ * @return number of options written into @a options, negative on parse errors
+ */
+int coap_find_options(const struct coap_packet* cpkt, u16_t code, struct coap_option* options, u16_t veclen);
+
+u8_t coap_header_get_version(const struct coap_packet* cpkt);
+u8_t coap_header_get_type(const struct coap_packet* cpkt);
+/// Copies the token into @a token, which must hold 8 bytes, and returns its length
+u8_t coap_header_get_token(const struct coap_packet* cpkt, u8_t* token);
+u8_t coap_header_get_code(const struct coap_packet* cpkt);
+u16_t coap_header_get_id(const struct coap_packet* cpkt);
+
+/**
+ * Appends an option. Options must be appended in ascending order.
+ * @return 0, -EINVAL for out of order options or if appending failed
+ */
+int coap_packet_append_option(struct coap_packet* cpkt, u16_t code, const u8_t* value, u16_t len);
+int coap_packet_append_payload_marker(struct coap_packet* cpkt);
+int coap_packet_append_payload(struct coap_packet* cpkt, u8_t* payload, u16_t payload_len);
+
+/**
+ * Locates the payload.
+ * @param offset out-pointer to the offset of the payload in the returned fragment, 0 if there is no payload and
+ *          0xffff on errors
+ * @param len out-pointer to the length of the payload
+ * @return fragment containing the start of the payload or NULL
+ */
+struct net_buf* coap_packet_get_payload(const struct coap_packet* cpkt, u16_t* offset, u16_t* len);
+
+/// Decodes an option value as unsigned big-endian integer of up to 4 bytes
+unsigned int coap_option_value_to_int(const struct coap_option* option);
+
+/// Appends an option with @a val encoded as unsigned integer of minimal length, see `coap_packet_append_option`
+int coap_append_option_int(struct coap_packet* cpkt, u16_t code, unsigned int val);
+
+/// Resource served by the CoAP server. The host has no server, so only the fields the server modules look at exist.
+struct coap_resource {
+    const char* const* path;
+    void* user_data;
+};
+
+enum coap_block_size {
+    COAP_BLOCK_16,
+    COAP_BLOCK_32,
+    COAP_BLOCK_64,
+    COAP_BLOCK_128,
+    COAP_BLOCK_256,
+    COAP_BLOCK_512,
+    COAP_BLOCK_1024,
+};
+
+static inline u16_t coap_block_size_to_bytes(enum coap_block_size block_size) {
+    return (u16_t) (1 << (block_size + 4));
+}
+
+/// State of a block-wise transfer (RFC7959)
+struct coap_block_context {
+    size_t total_size;
+    /// offset of the current block
+    size_t current;
+    enum coap_block_size block_size;
+};
+
+/**
+ * Appends a Block1 or Block2 Option for the block at `ctx->current`. Like in Zephyr, the M bit is only set in Block1
+ * Options of requests and Block2 Options of responses, depending on the code of @a cpkt.
+ * @return see `coap_packet_append_option`
+ */
+int coap_append_block1_option(struct coap_packet* cpkt, struct coap_block_context* ctx);
+int coap_append_block2_option(struct coap_packet* cpkt, struct coap_block_context* ctx);
+/// Appends a Size1 or Size2 Option with `ctx->total_size`
+int coap_append_size1_option(struct coap_packet* cpkt, struct coap_block_context* ctx);
+int coap_append_size2_option(struct coap_packet* cpkt, struct coap_block_context* ctx);
+
+#endif //NONE_PORT_NET_COAP_H
@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_PORT_NET_HTTP_PARSER_URL_H
+#define NONE_PORT_NET_HTTP_PARSER_URL_H
+
+// Zephyr ships the URL parser of the nodejs http-parser, on the host the library itself is used.
+#include <http_parser.h>
+
+#endif //NONE_PORT_NET_HTTP_PARSER_URL_H
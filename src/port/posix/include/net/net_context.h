@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_PORT_NET_NET_CONTEXT_H
+#define NONE_PORT_NET_NET_CONTEXT_H
+
+#include <net/net_ip.h>
+
+// There is no network stack on the host. The context only exists because the allocation functions take one, it's
+// never dereferenced and can be NULL.
+struct net_context;
+struct net_pkt;
+
+typedef void (*net_context_send_cb_t)(struct net_context* context, int status, void* token, void* user_data);
+
+/// Number of sent packets kept until they are taken with `net_context_sent_get`
+#define NET_CONTEXT_SENT_COUNT 8
+
+/**
+ * Sends a packet. The host port has no network stack, so the packet is queued until `net_context_sent_get` takes it.
+ * @param pkt Packet to send, which is consumed on success
+ * @param dst_addr Unused
+ * @param addrlen Unused
+ * @param cb Unused
+ * @param timeout Unused
+ * @param token Unused
+ * @param user_data Unused
+ * @return 0 or -ENOMEM if NET_CONTEXT_SENT_COUNT packets are queued already
+ */
+int net_context_sendto(struct net_pkt* pkt, const struct sockaddr* dst_addr, socklen_t addrlen,
+                       net_context_send_cb_t cb, s32_t timeout, void* token, void* user_data);
+
+/**
+ * Takes the oldest packet sent with `net_context_sendto`. Only exists on the host.
+ * @return packet, which has to be released by the caller, or NULL if nothing was sent
+ */
+struct net_pkt* net_context_sent_get(void);
+
+#endif //NONE_PORT_NET_NET_CONTEXT_H
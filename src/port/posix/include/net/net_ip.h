@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_PORT_NET_NET_IP_H
+#define NONE_PORT_NET_NET_IP_H
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <zephyr/types.h>
+#include <toolchain.h>
+
+#define net_ipaddr_copy(dest, src) (*(dest) = *(src))
+
+/// Opaque, packets of the host port don't belong to an interface
+struct net_if;
+
+struct net_ipv6_hdr {
+    u8_t vtc;
+    u8_t tcflow;
+    u16_t flow;
+    u8_t len[2];
+    u8_t nexthdr;
+    u8_t hop_limit;
+    struct in6_addr src;
+    struct in6_addr dst;
+} __packed;
+
+struct net_udp_hdr {
+    u16_t src_port;
+    u16_t dst_port;
+    u16_t len;
+    u16_t chksum;
+} __packed;
+
+#define NET_IPV6H_LEN sizeof(struct net_ipv6_hdr)
+#define NET_UDPH_LEN sizeof(struct net_udp_hdr)
+
+#endif //NONE_PORT_NET_NET_IP_H
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_PORT_NET_NET_PKT_H
+#define NONE_PORT_NET_NET_PKT_H
+
+#include <stdbool.h>
+#include <kernel.h>
+#include <net/buf.h>
+#include <net/net_ip.h>
+#include <net/net_context.h>
+
+/**
+ * Packet made of a chain of fragments, with the subset of Zephyr's `struct net_pkt` the OSCORE core uses.
+ *
+ * Received packets start with an IPv6 and a UDP header like in Zephyr (see `net_pkt_from_datagram`), packets
+ * allocated for sending only contain the CoAP message.
+ */
+struct net_pkt {
+    struct net_buf* frags;
+    struct net_if* iface;
+    u8_t family;
+    u8_t ip_hdr_len;
+    u8_t ipv6_ext_len;
+    u8_t ref;
+    /// usage counter of the pool the packet was taken from, decremented when the packet is freed. Can be NULL.
+    atomic_t* pool_used;
+};
+
+/**
+ * Allocates a packet without fragments. The host port has no pools, at most `NET_PKT_MAX_COUNT` packets can be
+ * allocated at the same time, which makes exhaustion reproducible.
+ * @param context Unused, can be NULL
+ * @param timeout Unused, the allocation never waits
+ * @return packet with a reference count of 1 or NULL
+ */
+struct net_pkt* net_pkt_get_rx(struct net_context* context, s32_t timeout);
+struct net_pkt* net_pkt_get_tx(struct net_context* context, s32_t timeout);
+/// Allocates an empty fragment of `NET_BUF_DATA_SIZE` bytes
+struct net_buf* net_pkt_get_data(struct net_context* context, s32_t timeout);
+
+/// Maximum number of packets allocated at the same time
+#ifndef NET_PKT_MAX_COUNT
+#define NET_PKT_MAX_COUNT 64
+#endif
+
+/// Allocations of the host port
+struct net_pkt_stats {
+    /// packets in use
+    u32_t pkts;
+    /// maximum number of packets in use at the same time
+    u32_t pkts_high_water;
+    /// fragments in use
+    u32_t frags;
+    /// maximum number of fragments in use at the same time
+    u32_t frags_high_water;
+};
+
+/// Copies the allocation counters
+void net_pkt_get_stats(struct net_pkt_stats* out);
+
+/// Restarts the high water marks at the current usage, e.g. between benchmark runs
+void net_pkt_reset_high_water(void);
+
+void net_pkt_ref(struct net_pkt* pkt);
+/// Drops a reference, freeing the packet and all of its fragments with the last one
+void net_pkt_unref(struct net_pkt* pkt);
+/// Appends @a frag and all fragments chained to it
+void net_pkt_frag_add(struct net_pkt* pkt, struct net_buf* frag);
+
+/// Total length of all fragments
+size_t net_pkt_get_len(struct net_pkt* pkt);
+
+/**
+ * Appends @a len bytes, allocating new fragments as needed.
+ * @return number of bytes appended
+ */
+u16_t net_pkt_append(struct net_pkt* pkt, u16_t len, const u8_t* data, s32_t timeout);
+
+static inline bool net_pkt_append_all(struct net_pkt* pkt, u16_t len, const u8_t* data, s32_t timeout) {
+    return net_pkt_append(pkt, len, data, timeout) == len;
+}
+
+static inline bool net_pkt_append_u8(struct net_pkt* pkt, u8_t data) {
+    return net_pkt_append(pkt, 1, &data, K_FOREVER) == 1;
+}
+
+static inline bool net_pkt_append_be16(struct net_pkt* pkt, u16_t data) {
+    u8_t bytes[2] = { (u8_t) (data >> 8), (u8_t) data };
+    return net_pkt_append(pkt, sizeof(bytes), bytes, K_FOREVER) == sizeof(bytes);
+}
+
+/**
+ * Copies @a len bytes starting @a offset bytes into @a frag.
+ * @param frag First fragment to read from
+ * @param offset Offset into @a frag, may point into one of the following fragments
+ * @param pos out-pointer to the offset after the read data in the returned fragment
+ * @param len Number of bytes to read
+ * @param data Buffer to copy into, NULL to only skip
+ * @return fragment containing the byte after the read data. NULL with @a pos 0 if the read ended exactly at the end
+ *          of the packet, NULL with @a pos 0xffff if the packet is too short.
+ */
+struct net_buf* net_frag_read(struct net_buf* frag, u16_t offset, u16_t* pos, u16_t len, u8_t* data);
+
+static inline struct net_buf* net_frag_skip(struct net_buf* frag, u16_t offset, u16_t* pos, u16_t len) {
+    return net_frag_read(frag, offset, pos, len, NULL);
+}
+
+static inline struct net_if* net_pkt_iface(struct net_pkt* pkt) {
+    return pkt->iface;
+}
+
+static inline void net_pkt_set_iface(struct net_pkt* pkt, struct net_if* iface) {
+    pkt->iface = iface;
+}
+
+static inline u8_t net_pkt_family(struct net_pkt* pkt) {
+    return pkt->family;
+}
+
+static inline void net_pkt_set_family(struct net_pkt* pkt, u8_t family) {
+    pkt->family = family;
+}
+
+static inline u8_t net_pkt_ip_hdr_len(struct net_pkt* pkt) {
+    return pkt->ip_hdr_len;
+}
+
+static inline void net_pkt_set_ip_hdr_len(struct net_pkt* pkt, u8_t len) {
+    pkt->ip_hdr_len = len;
+}
+
+static inline u8_t net_pkt_ipv6_ext_len(struct net_pkt* pkt) {
+    return pkt->ipv6_ext_len;
+}
+
+static inline void net_pkt_set_ipv6_ext_len(struct net_pkt* pkt, u8_t len) {
+    pkt->ipv6_ext_len = len;
+}
+
+static inline u8_t* net_pkt_ip_data(struct net_pkt* pkt) {
+    return pkt->frags->data;
+}
+
+#define NET_IPV6_HDR(pkt) ((struct net_ipv6_hdr*) net_pkt_ip_data(pkt))
+
+/**
+ * Wraps a received UDP payload into a packet as Zephyr's network stack would pass it to a receive callback, with an
+ * IPv6 and UDP header in front of the CoAP message. This is the entry point for feeding datagrams from sockets or
+ * capture files into the OSCORE core.
+ * @param src Source address and port of the datagram
+ * @param dst Destination address and port of the datagram
+ * @param data UDP payload
+ * @param len Length of @a data
+ * @return packet or NULL if allocating failed
+ */
+struct net_pkt* net_pkt_from_datagram(const struct sockaddr_in6* src, const struct sockaddr_in6* dst,
+                                      const u8_t* data, u16_t len);
+
+#endif //NONE_PORT_NET_NET_PKT_H
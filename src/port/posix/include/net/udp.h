@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_PORT_NET_UDP_H
+#define NONE_PORT_NET_UDP_H
+
+#include <net/net_pkt.h>
+
+/**
+ * Copies the UDP header of a received packet.
+ * @param pkt Packet created with `net_pkt_from_datagram`
+ * @param hdr Buffer for the header
+ * @return @a hdr or NULL if the packet is too short
+ */
+struct net_udp_hdr* net_udp_get_hdr(struct net_pkt* pkt, struct net_udp_hdr* hdr);
+
+#endif //NONE_PORT_NET_UDP_H
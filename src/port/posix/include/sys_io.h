@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+// Included by the OSCORE core, but nothing of it is used.
+
+#ifndef NONE_PORT_SYS_IO_H
+#define NONE_PORT_SYS_IO_H
+
+#endif //NONE_PORT_SYS_IO_H
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_PORT_ZEPHYR_TYPES_H
+#define NONE_PORT_ZEPHYR_TYPES_H
+
+#include <stddef.h>
+#include <stdint.h>
+// Zephyr's headers make the string functions available to everything including them, abort is used by panics
+#include <stdlib.h>
+#include <string.h>
+
+typedef int8_t s8_t;
+typedef int16_t s16_t;
+typedef int32_t s32_t;
+typedef int64_t s64_t;
+
+typedef uint8_t u8_t;
+typedef uint16_t u16_t;
+typedef uint32_t u32_t;
+typedef uint64_t u64_t;
+
+#endif //NONE_PORT_ZEPHYR_TYPES_H
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <errno.h>
+#include <time.h>
+#include <sys/random.h>
+#include <kernel.h>
+
+static __thread struct k_thread current;
+static pthread_mutex_t irq_mutex;
+static pthread_once_t irq_once = PTHREAD_ONCE_INIT;
+static pthread_once_t start_once = PTHREAD_ONCE_INIT;
+static struct timespec start;
+static atomic_t skipped;
+
+k_tid_t k_current_get(void) {
+    current.thread = pthread_self();
+    return &current;
+}
+
+static void init_start(void) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+}
+
+s64_t k_uptime_get(void) {
+    pthread_once(&start_once, init_start);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (s64_t) (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 +
+           atomic_get(&skipped);
+}
+
+void k_uptime_skip(s32_t duration) {
+    atomic_add(&skipped, duration);
+}
+
+u32_t k_uptime_get_32(void) {
+    return (u32_t) k_uptime_get();
+}
+
+u32_t k_cycle_get_32(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u32_t) ((u64_t) now.tv_sec * 1000000000 + now.tv_nsec);
+}
+
+u32_t sys_rand32_get(void) {
+    u32_t value = 0;
+    while (getrandom(&value, sizeof(value), 0) < 0 && errno == EINTR) {}
+    return value;
+}
+
+void k_sleep(s32_t duration) {
+    struct timespec time = {
+        .tv_sec = duration / 1000,
+        .tv_nsec = (duration % 1000) * 1000000,
+    };
+    while (nanosleep(&time, &time) != 0 && errno == EINTR) {}
+}
+
+void k_mutex_init(struct k_mutex* mutex) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    // Zephyr mutexes can be locked recursively by their owner
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&mutex->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+int k_mutex_lock(struct k_mutex* mutex, s32_t timeout) {
+    if (timeout == K_FOREVER) {
+        return pthread_mutex_lock(&mutex->mutex) == 0 ? 0 : -EINVAL;
+    }
+    if (timeout == K_NO_WAIT) {
+        return pthread_mutex_trylock(&mutex->mutex) == 0 ? 0 : -EBUSY;
+    }
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    return pthread_mutex_timedlock(&mutex->mutex, &deadline) == 0 ? 0 : -EAGAIN;
+}
+
+void k_mutex_unlock(struct k_mutex* mutex) {
+    pthread_mutex_unlock(&mutex->mutex);
+}
+
+static void init_irq_mutex(void) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&irq_mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+unsigned int irq_lock(void) {
+    pthread_once(&irq_once, init_irq_mutex);
+    pthread_mutex_lock(&irq_mutex);
+    return 0;
+}
+
+void irq_unlock(unsigned int key) {
+    (void) key;
+    pthread_mutex_unlock(&irq_mutex);
+}
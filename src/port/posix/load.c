@@ -0,0 +1,608 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+
+// Multi-client load generator: simulated OSCORE clients, each a process with its own security context (see
+// `host_peer`), send requests to an OSCORE server over UDP on the loopback interface at a fixed rate per client.
+//
+// Unless -x is given, the server (`udp_server`) is forked, too, with the security contexts of all clients. It
+// receives and sends -b datagrams per syscall (`recvmmsg`/`sendmmsg`), 1 for the single-packet path, on -w
+// threads with their own SO_REUSEPORT sockets (`udp_server_run_sharded`). With -S
+// only the server is run, until it is interrupted, so the generator can be pointed at it with -x from another shell
+// or machine with the same number of clients.
+//
+// The load is open-loop: request k of a client is due at start + k / rate and its latency is measured from that
+// time, so a slow server shows up in the latencies instead of lowering the request rate. Every client has a single
+// exchange outstanding at a time, an exchange is:
+//
+// * get: GET /hello
+// * post: POST /echo with the payload size of -s
+// * observe: GET /echo with Observe, the registration is canceled after the first notification
+// * block: GET /large in 64-byte blocks with Block2 until the last block, one request per block
+//
+// The mix is given as weights, e.g. -m get=70,post=20,observe=5,block=5. The summary is printed as one JSON object:
+//
+//   {"load":"local","clients":8,"rate":100,"duration_s":2,"mix":"get=70,post=20,observe=5,block=5","payload":32,
+//    "exchanges":...,"completed":...,"timeouts":...,"late":...,"unexpected_code":...,"exchanges_per_sec":...,
+//    "p50_ns":...,"p99_ns":...,"max_ns":...,"errors":{"268":1,...},
+//    "server":{"workers":1,"batch":1,"received":...,"answered":...,"dropped":...,"handed_off":...,"syscalls":...,
+//    "syscalls_per_request":...}}
+//
+// errors counts the exchanges that failed by the OscoreError of the client, timeouts the ones without response
+// within a second, late the responses received after their exchange timed out and unexpected_code the responses
+// other than 2.05 and 2.04. The exit status is 1 if an exchange failed with an error or an unexpected code, or if
+// none completed.
+//
+// To compare the batched with the single-packet path, the same load is run with both, e.g. -c 64 -r 1000 -b 1 and
+// -b 32: throughput and latencies show the effect on the clients, syscalls_per_request the amortization.
+//
+// A list of worker counts, e.g. -w 1,2,4,8,16, runs the load once per count, which is the scaling benchmark of the
+// sharded server. handed_off counts the requests a worker received for a security context of another one. The
+// clients run on the same machine, so for the server to saturate its cores the rate has to be high enough and
+// the clients have to leave cores free, e.g. with taskset.
+//
+// Usage: oscore_load [-S] [-x] [-w workers[,workers...]] [-b batch] [-c clients] [-r rate] [-d seconds] [-m mix]
+//                    [-s payload] [-p port]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <net/coap.h>
+#include "host_client.h"
+#include "host_server.h"
+#include "udp_server.h"
+#include "../../oscore/oscore.h"
+
+#define MAX_DATAGRAM 1400
+#define MAX_PAYLOAD 1024
+/// Latencies kept per client, later exchanges are counted but not sampled
+#define MAX_SAMPLES 16384
+#define MAX_ERROR_KINDS 16
+#define TIMEOUT_MS 1000
+/// Block2 SZX of the block exchange, 64 bytes
+#define BLOCK_SZX 2
+
+enum exchange_kind {
+    ExchangeGet,
+    ExchangePost,
+    ExchangeObserve,
+    ExchangeBlock,
+    NUM_EXCHANGE_KINDS,
+};
+
+static const char* const KIND_NAMES[NUM_EXCHANGE_KINDS] = {
+    [ExchangeGet] = "get",
+    [ExchangePost] = "post",
+    [ExchangeObserve] = "observe",
+    [ExchangeBlock] = "block",
+};
+
+struct error_count {
+    OscoreError error;
+    u32_t count;
+};
+
+/// Results of one client, in memory shared with the parent
+struct client_result {
+    u64_t exchanges;
+    u64_t completed;
+    u64_t timeouts;
+    u64_t late;
+    u64_t unexpected_code;
+    u32_t num_errors;
+    struct error_count errors[MAX_ERROR_KINDS];
+    u32_t num_samples;
+    u32_t samples[MAX_SAMPLES];
+};
+
+struct options {
+    u32_t clients;
+    u32_t rate;
+    u32_t duration_s;
+    u32_t weights[NUM_EXCHANGE_KINDS];
+    const char* mix;
+    u16_t payload;
+    u16_t port;
+    u32_t batch;
+    /// threads of the server
+    u32_t workers;
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int signal) {
+    (void) signal;
+    stop = 1;
+}
+
+static u64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void sleep_until(u64_t due) {
+    u64_t now = now_ns();
+    if (due > now) {
+        struct timespec wait = { .tv_sec = (time_t) ((due - now) / 1000000000),
+                                 .tv_nsec = (long) ((due - now) % 1000000000) };
+        nanosleep(&wait, NULL);
+    }
+}
+
+static int compare_u32(const void* a, const void* b) {
+    u32_t l = *(const u32_t*) a;
+    u32_t r = *(const u32_t*) b;
+    return (l > r) - (l < r);
+}
+
+static void count_error(struct error_count* errors, u32_t* num_errors, OscoreError error, u32_t count) {
+    for (u32_t i = 0; i < *num_errors; i++) {
+        if (errors[i].error == error) {
+            errors[i].count += count;
+            return;
+        }
+    }
+    if (*num_errors < MAX_ERROR_KINDS) {
+        errors[*num_errors].error = error;
+        errors[*num_errors].count = count;
+        (*num_errors)++;
+    }
+}
+
+/// Parses weights like "get=70,post=30", kinds not given get weight 0
+static bool parse_mix(const char* mix, u32_t* weights) {
+    memset(weights, 0, NUM_EXCHANGE_KINDS * sizeof(u32_t));
+    u32_t total = 0;
+    const char* p = mix;
+    while (*p != 0) {
+        size_t name_len = strcspn(p, "=");
+        enum exchange_kind kind = NUM_EXCHANGE_KINDS;
+        for (u32_t k = 0; k < NUM_EXCHANGE_KINDS; k++) {
+            if (strlen(KIND_NAMES[k]) == name_len && strncmp(p, KIND_NAMES[k], name_len) == 0) {
+                kind = (enum exchange_kind) k;
+            }
+        }
+        if (kind == NUM_EXCHANGE_KINDS || p[name_len] != '=') {
+            return false;
+        }
+        char* end;
+        weights[kind] = (u32_t) strtoul(p + name_len + 1, &end, 10);
+        total += weights[kind];
+        if (*end != ',' && *end != 0) {
+            return false;
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return total > 0;
+}
+
+static enum exchange_kind pick_kind(const u32_t* weights, unsigned int* seed) {
+    u32_t total = 0;
+    for (u32_t k = 0; k < NUM_EXCHANGE_KINDS; k++) {
+        total += weights[k];
+    }
+    u32_t r = (u32_t) rand_r(seed) % total;
+    for (u32_t k = 0; k < NUM_EXCHANGE_KINDS; k++) {
+        if (r < weights[k]) {
+            return (enum exchange_kind) k;
+        }
+        r -= weights[k];
+    }
+    return ExchangeGet;
+}
+
+/// How an exchange ended, if not with an OscoreError
+enum outcome {
+    OutcomeCompleted,
+    OutcomeTimeout,
+    /// the response wasn't 2.05 or 2.04
+    OutcomeUnexpectedCode,
+};
+
+/// State of a simulated client
+struct client {
+    int fd;
+    struct sockaddr_in6 server;
+    u32_t next_token;
+    u16_t next_id;
+    struct client_result* result;
+};
+
+/**
+ * Sends one request and waits for its response, discarding responses of earlier, timed out requests.
+ * @return OscoreError of protecting or unprotecting, OscoreNoError with OutcomeTimeout if no response arrived
+ */
+static OscoreError round_trip(struct client* client, const struct host_request* request, u64_t deadline,
+                              struct host_response* response, enum outcome* outcome) {
+    u8_t token[4] = { (u8_t) (client->next_token >> 24), (u8_t) (client->next_token >> 16),
+                      (u8_t) (client->next_token >> 8), (u8_t) client->next_token };
+    client->next_token++;
+    u8_t datagram[MAX_DATAGRAM];
+    u16_t len;
+    try(host_client_protect(request, token, sizeof(token), client->next_id++, (array) { sizeof(datagram), datagram },
+                            &len));
+    *outcome = OutcomeCompleted;
+    if (send(client->fd, datagram, len, 0) < 0) {
+        oscore_cancel_request(token, sizeof(token));
+        *outcome = OutcomeTimeout;
+        return OscoreNoError;
+    }
+    while (true) {
+        u64_t now = now_ns();
+        if (now >= deadline) {
+            oscore_cancel_request(token, sizeof(token));
+            *outcome = OutcomeTimeout;
+            return OscoreNoError;
+        }
+        struct timeval timeout = { .tv_sec = (time_t) ((deadline - now) / 1000000000),
+                                   .tv_usec = (suseconds_t) ((deadline - now) % 1000000000 / 1000 + 1) };
+        setsockopt(client->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        ssize_t received = recv(client->fd, datagram, sizeof(datagram), 0);
+        if (received < 0) {
+            continue;
+        }
+        // the token is the first thing after the 4-byte header, responses to canceled requests don't match
+        if (received < 4 + (ssize_t) sizeof(token) || (datagram[0] & 0xf) != sizeof(token)
+                || memcmp(&datagram[4], token, sizeof(token)) != 0) {
+            client->result->late++;
+            continue;
+        }
+        OscoreError res = host_client_unprotect(&client->server, datagram, (u16_t) received, NULL_ARRAY, response);
+        if (request->observe) {
+            oscore_cancel_request(token, sizeof(token));
+        }
+        return res;
+    }
+}
+
+/**
+ * Runs one exchange of the given kind.
+ * @return OscoreError, OscoreNoError with OutcomeTimeout if a response didn't arrive within TIMEOUT_MS
+ */
+static OscoreError run_exchange(struct client* client, enum exchange_kind kind, const u8_t* payload, u16_t payload_len,
+                                enum outcome* outcome) {
+    struct host_request request = {
+        .code = COAP_METHOD_GET, .type = COAP_TYPE_CON, .path = "hello", .content_format = -1, .accept = -1,
+        .block2 = -1,
+    };
+    switch (kind) {
+        case ExchangePost:
+            request.code = COAP_METHOD_POST;
+            request.path = "echo";
+            request.payload = payload;
+            request.payload_len = payload_len;
+            break;
+        case ExchangeObserve:
+            request.path = "echo";
+            request.observe = true;
+            break;
+        case ExchangeBlock:
+            request.path = "large";
+            request.block2 = BLOCK_SZX;
+            break;
+        default:
+            break;
+    }
+
+    u64_t deadline = now_ns() + (u64_t) TIMEOUT_MS * 1000000;
+    struct host_response response;
+    while (true) {
+        try(round_trip(client, &request, deadline, &response, outcome));
+        if (*outcome != OutcomeCompleted) {
+            return OscoreNoError;
+        }
+        if (response.code != COAP_RESPONSE_CODE_CONTENT && response.code != COAP_RESPONSE_CODE_CHANGED) {
+            *outcome = OutcomeUnexpectedCode;
+            return OscoreNoError;
+        }
+        // the next block, if the server said there are more
+        if (kind != ExchangeBlock || response.block2 < 0 || (response.block2 & 0x8) == 0) {
+            return OscoreNoError;
+        }
+        request.block2 = ((response.block2 >> 4) + 1) << 4 | BLOCK_SZX;
+    }
+}
+
+static int run_client(u32_t index, const struct options* options, u64_t start, struct client_result* result) {
+    if (host_client_init_peer(index) != OscoreNoError) {
+        return 1;
+    }
+    struct client client = {
+        .fd = socket(AF_INET6, SOCK_DGRAM, 0),
+        .server = { .sin6_family = AF_INET6, .sin6_addr = IN6ADDR_LOOPBACK_INIT, .sin6_port = htons(options->port) },
+        .next_token = index << 20,
+        .next_id = (u16_t) (index << 8),
+        .result = result,
+    };
+    if (client.fd < 0 || connect(client.fd, (struct sockaddr*) &client.server, sizeof(client.server)) != 0) {
+        perror("client socket");
+        return 1;
+    }
+    static u8_t payload[MAX_PAYLOAD];
+    memset(payload, 'p', options->payload);
+    unsigned int seed = index + 1;
+
+    u64_t interval = 1000000000ull / options->rate;
+    u64_t end = start + (u64_t) options->duration_s * 1000000000;
+    // the clients start shifted against each other, so their requests don't arrive in bursts
+    u64_t due = start + interval * index / options->clients;
+    for (; due < end; due += interval) {
+        sleep_until(due);
+        enum exchange_kind kind = pick_kind(options->weights, &seed);
+        enum outcome outcome;
+        OscoreError res = run_exchange(&client, kind, payload, options->payload, &outcome);
+        result->exchanges++;
+        if (res != OscoreNoError) {
+            count_error(result->errors, &result->num_errors, res, 1);
+        } else if (outcome == OutcomeTimeout) {
+            result->timeouts++;
+        } else if (outcome == OutcomeUnexpectedCode) {
+            result->unexpected_code++;
+        } else {
+            result->completed++;
+            if (result->num_samples < MAX_SAMPLES) {
+                result->samples[result->num_samples++] = (u32_t) min(now_ns() - due, (u64_t) UINT32_MAX);
+            }
+        }
+    }
+    close(client.fd);
+    return 0;
+}
+
+/// Opens the socket of the server, of its first worker if it's sharded
+static int open_server(struct options* options, struct udp_server* server) {
+    int res = udp_server_open(server, options->port, options->workers > 1);
+    if (res != 0) {
+        fprintf(stderr, "can't open the server socket: %s\n", strerror(-res));
+        return res;
+    }
+    options->port = server->port;
+    res = udp_server_set_batch(server, options->batch);
+    if (res != 0) {
+        fprintf(stderr, "can't batch %u datagrams: %s\n", options->batch, strerror(-res));
+        udp_server_close(server);
+    }
+    return res;
+}
+
+/// Forked server, counters are written to @a stats when it's stopped
+static int run_server(struct udp_server* server, const struct options* options, struct udp_server_stats* stats) {
+    if (host_server_init() != OscoreNoError || host_server_add_peers(options->clients) != OscoreNoError) {
+        fprintf(stderr, "can't add the security contexts of %u clients\n", options->clients);
+        return 1;
+    }
+    stop = 0;
+    signal(SIGTERM, on_signal);
+    signal(SIGINT, on_signal);
+    int res;
+    if (options->workers > 1) {
+        res = udp_server_run_sharded(server, options->workers, &stop);
+    } else {
+        res = udp_server_run(server, &stop);
+    }
+    *stats = server->stats;
+    udp_server_close(server);
+    return res == 0 ? 0 : 1;
+}
+
+static void print_server_stats(const struct options* options, const struct udp_server_stats* stats) {
+    printf("\"server\":{\"workers\":%u,\"batch\":%u,\"received\":%llu,\"answered\":%llu,\"dropped\":%llu,"
+           "\"handed_off\":%llu,\"syscalls\":%llu,\"syscalls_per_request\":%.2f}",
+           options->workers, options->batch, (unsigned long long) stats->received,
+           (unsigned long long) stats->answered, (unsigned long long) stats->dropped,
+           (unsigned long long) stats->handed_off, (unsigned long long) stats->syscalls,
+           stats->received > 0 ? (double) stats->syscalls / stats->received : 0.0);
+}
+
+static void print_summary(const struct options* options, bool external, struct client_result* results,
+                          u64_t elapsed, const struct udp_server_stats* server) {
+    struct client_result total = { 0 };
+    size_t num_samples = 0;
+    for (u32_t i = 0; i < options->clients; i++) {
+        num_samples += results[i].num_samples;
+    }
+    u32_t* samples = malloc((num_samples > 0 ? num_samples : 1) * sizeof(u32_t));
+    assert_actually(samples != NULL, "out of memory");
+    num_samples = 0;
+    for (u32_t i = 0; i < options->clients; i++) {
+        struct client_result* result = &results[i];
+        total.exchanges += result->exchanges;
+        total.completed += result->completed;
+        total.timeouts += result->timeouts;
+        total.late += result->late;
+        total.unexpected_code += result->unexpected_code;
+        for (u32_t e = 0; e < result->num_errors; e++) {
+            count_error(total.errors, &total.num_errors, result->errors[e].error, result->errors[e].count);
+        }
+        memcpy(&samples[num_samples], result->samples, result->num_samples * sizeof(u32_t));
+        num_samples += result->num_samples;
+    }
+    qsort(samples, num_samples, sizeof(u32_t), compare_u32);
+
+    printf("{\"load\":\"%s\",\"clients\":%u,\"rate\":%u,\"duration_s\":%u,\"mix\":\"%s\",\"payload\":%u,"
+           "\"exchanges\":%llu,\"completed\":%llu,\"timeouts\":%llu,\"late\":%llu,\"unexpected_code\":%llu,"
+           "\"exchanges_per_sec\":%.0f,"
+           "\"p50_ns\":%u,\"p99_ns\":%u,\"max_ns\":%u,\"errors\":{",
+           external ? "external" : "local", options->clients, options->rate, options->duration_s, options->mix,
+           options->payload, (unsigned long long) total.exchanges, (unsigned long long) total.completed,
+           (unsigned long long) total.timeouts, (unsigned long long) total.late,
+           (unsigned long long) total.unexpected_code,
+           elapsed > 0 ? total.completed * 1e9 / elapsed : 0.0,
+           num_samples > 0 ? samples[num_samples / 2] : 0,
+           num_samples > 0 ? samples[(size_t) ((u64_t) num_samples * 99 / 100)] : 0,
+           num_samples > 0 ? samples[num_samples - 1] : 0);
+    for (u32_t e = 0; e < total.num_errors; e++) {
+        printf("%s\"%d\":%u", e > 0 ? "," : "", total.errors[e].error, total.errors[e].count);
+    }
+    printf("}");
+    if (server != NULL) {
+        printf(",");
+        print_server_stats(options, server);
+    }
+    printf("}\n");
+    free(samples);
+}
+
+/// Waits for a client, i.e. any child but the server
+static pid_t wait_client(pid_t server_pid, int* status) {
+    pid_t pid;
+    while ((pid = wait(status)) == server_pid) {
+        // the server stopped early, the clients will time out
+        fprintf(stderr, "server exited with status %d\n", *status);
+    }
+    return pid;
+}
+
+static int usage(const char* name) {
+    fprintf(stderr, "usage: %s [-S] [-x] [-w workers[,workers...]] [-b batch] [-c clients] [-r rate] [-d seconds] "
+            "[-m mix] [-s payload] [-p port]\n", name);
+    return 2;
+}
+
+/// Runs the clients, and the server unless @a external, and prints the summary
+static int run_load(struct options* options, bool external) {
+    struct udp_server server;
+    if (!external && open_server(options, &server) != 0) {
+        return 1;
+    }
+
+    // shared with the forked processes
+    size_t shared_len = sizeof(struct udp_server_stats) + options->clients * sizeof(struct client_result);
+    u8_t* shared = mmap(NULL, shared_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    struct udp_server_stats* server_stats = (struct udp_server_stats*) shared;
+    struct client_result* results = (struct client_result*) (shared + sizeof(struct udp_server_stats));
+
+    pid_t server_pid = -1;
+    if (!external) {
+        fflush(stdout);
+        server_pid = fork();
+        if (server_pid == 0) {
+            exit(run_server(&server, options, server_stats));
+        }
+        udp_server_close(&server);
+        if (server_pid < 0) {
+            perror("fork");
+            return 1;
+        }
+    }
+
+    // the server derives the contexts of all clients first
+    u64_t start = now_ns() + 200000000;
+    bool failed = false;
+    for (u32_t i = 0; i < options->clients; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            exit(run_client(i, options, start, &results[i]));
+        }
+        failed |= pid < 0;
+    }
+    int status;
+    for (u32_t i = 0; i < options->clients; i++) {
+        failed |= wait_client(server_pid, &status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+    u64_t elapsed = now_ns() - start;
+    if (server_pid > 0) {
+        kill(server_pid, SIGTERM);
+        waitpid(server_pid, &status, 0);
+        failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+
+    print_summary(options, external, results, elapsed, external ? NULL : server_stats);
+    fflush(stdout);
+    bool errors = false;
+    u64_t completed = 0;
+    for (u32_t i = 0; i < options->clients; i++) {
+        errors |= results[i].num_errors > 0 || results[i].unexpected_code > 0;
+        completed += results[i].completed;
+    }
+    munmap(shared, shared_len);
+    return failed || errors || completed == 0 ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    struct options options = {
+        .clients = 8, .rate = 100, .duration_s = 2, .mix = "get=70,post=20,observe=5,block=5", .payload = 32,
+        .port = 0, .batch = 1,
+    };
+    u32_t workers[UDP_SERVER_MAX_WORKERS] = { 1 };
+    u32_t num_runs = 1;
+    bool server_only = false;
+    bool external = false;
+    bool valid = true;
+    int opt;
+    while ((opt = getopt(argc, argv, "Sxw:b:c:r:d:m:s:p:")) != -1) {
+        switch (opt) {
+            case 'S': server_only = true; break;
+            case 'x': external = true; break;
+            case 'w': {
+                char* pos = optarg;
+                for (num_runs = 0; valid && *pos != 0; num_runs++) {
+                    workers[num_runs] = (u32_t) strtoul(pos, &pos, 10);
+                    valid = workers[num_runs] > 0 && workers[num_runs] <= UDP_SERVER_MAX_WORKERS
+                            && (*pos == 0 || (*pos++ == ',' && num_runs + 1 < UDP_SERVER_MAX_WORKERS));
+                }
+                break;
+            }
+            case 'b': options.batch = (u32_t) strtoul(optarg, NULL, 10); break;
+            case 'c': options.clients = (u32_t) strtoul(optarg, NULL, 10); break;
+            case 'r': options.rate = (u32_t) strtoul(optarg, NULL, 10); break;
+            case 'd': options.duration_s = (u32_t) strtoul(optarg, NULL, 10); break;
+            case 'm': options.mix = optarg; break;
+            case 's': options.payload = (u16_t) strtoul(optarg, NULL, 10); break;
+            case 'p': options.port = (u16_t) strtoul(optarg, NULL, 10); break;
+            default: return usage(argv[0]);
+        }
+    }
+    if (!valid || num_runs == 0 || optind != argc || options.clients == 0 || options.clients >= OSCORE_MAX_CONTEXTS
+            || options.rate == 0 || options.payload > MAX_PAYLOAD || !parse_mix(options.mix, options.weights)
+            || (external && options.port == 0) || (server_only && num_runs > 1)) {
+        return usage(argv[0]);
+    }
+
+    if (server_only) {
+        struct udp_server server;
+        struct udp_server_stats stats;
+        options.workers = workers[0];
+        options.port = options.port == 0 ? 5683 : options.port;
+        if (open_server(&options, &server) != 0) {
+            return 1;
+        }
+        fprintf(stderr, "serving %u clients on port %u\n", options.clients, options.port);
+        int res = run_server(&server, &options, &stats);
+        printf("{");
+        print_server_stats(&options, &stats);
+        printf("}\n");
+        return res;
+    }
+
+    // one run per number of workers, e.g. to measure the scaling of the sharded server
+    int res = 0;
+    u16_t port = options.port;
+    for (u32_t i = 0; i < num_runs; i++) {
+        options.workers = workers[i];
+        options.port = port;
+        res |= run_load(&options, external);
+    }
+    return res;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <errno.h>
+#include <kernel.h>
+#include <net/net_context.h>
+
+// Sent packets are kept in a ring, so the unit tests can check what the server modules send.
+
+static struct net_pkt* sent[NET_CONTEXT_SENT_COUNT];
+static u32_t head;
+static u32_t count;
+
+int net_context_sendto(struct net_pkt* pkt, const struct sockaddr* dst_addr, socklen_t addrlen,
+                       net_context_send_cb_t cb, s32_t timeout, void* token, void* user_data) {
+    unsigned int key = irq_lock();
+    if (count == NET_CONTEXT_SENT_COUNT) {
+        irq_unlock(key);
+        return -ENOMEM;
+    }
+    sent[(head + count++) % NET_CONTEXT_SENT_COUNT] = pkt;
+    irq_unlock(key);
+    return 0;
+}
+
+struct net_pkt* net_context_sent_get(void) {
+    struct net_pkt* pkt = NULL;
+    unsigned int key = irq_lock();
+    if (count > 0) {
+        pkt = sent[head];
+        head = (head + 1) % NET_CONTEXT_SENT_COUNT;
+        count--;
+    }
+    irq_unlock(key);
+    return pkt;
+}
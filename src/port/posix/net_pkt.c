@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <stdlib.h>
+#include <net/net_pkt.h>
+#include <net/udp.h>
+
+static atomic_t pkt_count;
+static atomic_t frag_count;
+// only hints, concurrent allocations might skip a maximum
+static u32_t pkts_high_water;
+static u32_t frags_high_water;
+
+static struct net_pkt* pkt_alloc(void) {
+    atomic_val_t used = atomic_inc(&pkt_count);
+    if (used >= NET_PKT_MAX_COUNT) {
+        atomic_dec(&pkt_count);
+        return NULL;
+    }
+    pkts_high_water = max(pkts_high_water, (u32_t) used + 1);
+    struct net_pkt* pkt = calloc(1, sizeof(struct net_pkt));
+    if (pkt == NULL) {
+        atomic_dec(&pkt_count);
+        return NULL;
+    }
+    pkt->ref = 1;
+    return pkt;
+}
+
+struct net_pkt* net_pkt_get_rx(struct net_context* context, s32_t timeout) {
+    return pkt_alloc();
+}
+
+struct net_pkt* net_pkt_get_tx(struct net_context* context, s32_t timeout) {
+    return pkt_alloc();
+}
+
+struct net_buf* net_pkt_get_data(struct net_context* context, s32_t timeout) {
+    struct net_buf* frag = calloc(1, sizeof(struct net_buf));
+    if (frag == NULL) {
+        return NULL;
+    }
+    frag->data = frag->__buf;
+    frag->size = sizeof(frag->__buf);
+    // `max` evaluates its arguments twice
+    u32_t used = (u32_t) atomic_inc(&frag_count) + 1;
+    frags_high_water = max(frags_high_water, used);
+    return frag;
+}
+
+void net_pkt_get_stats(struct net_pkt_stats* out) {
+    out->pkts = (u32_t) atomic_get(&pkt_count);
+    out->pkts_high_water = pkts_high_water;
+    out->frags = (u32_t) atomic_get(&frag_count);
+    out->frags_high_water = frags_high_water;
+}
+
+void net_pkt_reset_high_water(void) {
+    pkts_high_water = (u32_t) atomic_get(&pkt_count);
+    frags_high_water = (u32_t) atomic_get(&frag_count);
+}
+
+void net_pkt_ref(struct net_pkt* pkt) {
+    pkt->ref++;
+}
+
+void net_pkt_unref(struct net_pkt* pkt) {
+    if (pkt == NULL || --pkt->ref > 0) {
+        return;
+    }
+    struct net_buf* frag = pkt->frags;
+    while (frag != NULL) {
+        struct net_buf* next = frag->frags;
+        free(frag);
+        atomic_dec(&frag_count);
+        frag = next;
+    }
+    if (pkt->pool_used != NULL) {
+        atomic_dec(pkt->pool_used);
+    }
+    free(pkt);
+    atomic_dec(&pkt_count);
+}
+
+void net_pkt_frag_add(struct net_pkt* pkt, struct net_buf* frag) {
+    struct net_buf** last = &pkt->frags;
+    while (*last != NULL) {
+        last = &(*last)->frags;
+    }
+    *last = frag;
+}
+
+size_t net_pkt_get_len(struct net_pkt* pkt) {
+    size_t len = 0;
+    for (struct net_buf* frag = pkt->frags; frag != NULL; frag = frag->frags) {
+        len += frag->len;
+    }
+    return len;
+}
+
+u16_t net_pkt_append(struct net_pkt* pkt, u16_t len, const u8_t* data, s32_t timeout) {
+    struct net_buf* frag = pkt->frags;
+    while (frag != NULL && frag->frags != NULL) {
+        frag = frag->frags;
+    }
+    u16_t appended = 0;
+    while (appended < len) {
+        if (frag == NULL || net_buf_tailroom(frag) == 0) {
+            struct net_buf* next = net_pkt_get_data(NULL, timeout);
+            if (next == NULL) {
+                break;
+            }
+            net_pkt_frag_add(pkt, next);
+            frag = next;
+        }
+        u16_t count = (u16_t) min(net_buf_tailroom(frag), (size_t) (len - appended));
+        memcpy(&frag->data[frag->len], &data[appended], count);
+        frag->len += count;
+        appended += count;
+    }
+    return appended;
+}
+
+struct net_buf* net_frag_read(struct net_buf* frag, u16_t offset, u16_t* pos, u16_t len, u8_t* data) {
+    // skip to the fragment containing the offset
+    while (frag != NULL && offset >= frag->len) {
+        offset -= frag->len;
+        frag = frag->frags;
+    }
+    if (frag == NULL) {
+        *pos = 0xffff;
+        return NULL;
+    }
+    *pos = offset;
+    u16_t copied = 0;
+    while (copied < len && frag != NULL) {
+        u16_t count = (u16_t) min((u16_t) (frag->len - *pos), (u16_t) (len - copied));
+        if (data != NULL) {
+            memcpy(&data[copied], &frag->data[*pos], count);
+        }
+        copied += count;
+        *pos += count;
+        if (*pos == frag->len) {
+            frag = frag->frags;
+            *pos = 0;
+        }
+    }
+    if (copied != len) {
+        *pos = 0xffff;
+        return NULL;
+    }
+    return frag;
+}
+
+struct net_udp_hdr* net_udp_get_hdr(struct net_pkt* pkt, struct net_udp_hdr* hdr) {
+    u16_t pos;
+    u16_t offset = net_pkt_ip_hdr_len(pkt) + net_pkt_ipv6_ext_len(pkt);
+    struct net_buf* frag = net_frag_read(pkt->frags, offset, &pos, sizeof(*hdr), (u8_t*) hdr);
+    if (frag == NULL && pos == 0xffff) {
+        return NULL;
+    }
+    return hdr;
+}
+
+struct net_pkt* net_pkt_from_datagram(const struct sockaddr_in6* src, const struct sockaddr_in6* dst,
+                                      const u8_t* data, u16_t len) {
+    struct net_pkt* pkt = net_pkt_get_rx(NULL, K_NO_WAIT);
+    if (pkt == NULL) {
+        return NULL;
+    }
+    // the IPv6 header has to be contiguous for NET_IPV6_HDR
+    struct net_buf* frag = net_pkt_get_data(NULL, K_NO_WAIT);
+    if (frag == NULL) {
+        net_pkt_unref(pkt);
+        return NULL;
+    }
+    net_pkt_frag_add(pkt, frag);
+
+    u16_t udp_len = (u16_t) (NET_UDPH_LEN + len);
+    struct net_ipv6_hdr ip = {
+        .vtc = 0x60,
+        .len = { (u8_t) (udp_len >> 8), (u8_t) udp_len },
+        .nexthdr = IPPROTO_UDP,
+        .hop_limit = 64,
+        .src = src->sin6_addr,
+        .dst = dst->sin6_addr,
+    };
+    struct net_udp_hdr udp = {
+        .src_port = src->sin6_port,
+        .dst_port = dst->sin6_port,
+        .len = htons(udp_len),
+    };
+    if (!net_pkt_append_all(pkt, NET_IPV6H_LEN, (u8_t*) &ip, K_NO_WAIT) ||
+        !net_pkt_append_all(pkt, NET_UDPH_LEN, (u8_t*) &udp, K_NO_WAIT) ||
+        !net_pkt_append_all(pkt, len, data, K_NO_WAIT)) {
+        net_pkt_unref(pkt);
+        return NULL;
+    }
+    net_pkt_set_family(pkt, AF_INET6);
+    net_pkt_set_ip_hdr_len(pkt, NET_IPV6H_LEN);
+    return pkt;
+}
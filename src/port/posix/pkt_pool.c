@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <kernel.h>
+#include "../../oscore/pkt_pool.h"
+
+// Host backend of the OSCORE pools. There are no slabs on the host, the TX pool is a counter bounding the number of
+// packets handed out at the same time, so exhaustion and the 5.03 path behave like on the device.
+
+static atomic_t tx_used;
+static u32_t tx_high_water;
+static u32_t failures;
+
+void pkt_pool_setup(struct net_context* context) {
+}
+
+OscoreError pkt_pool_get(bool rx, s32_t timeout, struct net_pkt** out) {
+    if (!rx && atomic_inc(&tx_used) >= OSCORE_TX_PKT_COUNT) {
+        atomic_dec(&tx_used);
+        failures++;
+        return OscorePktError;
+    }
+    struct net_pkt* pkt = rx ? net_pkt_get_rx(NULL, timeout) : net_pkt_get_tx(NULL, timeout);
+    if (pkt == NULL) {
+        if (!rx) {
+            atomic_dec(&tx_used);
+        }
+        failures++;
+        return OscorePktError;
+    }
+    if (!rx) {
+        pkt->pool_used = &tx_used;
+    }
+    struct net_buf* frag = net_pkt_get_data(NULL, timeout);
+    if (frag == NULL) {
+        failures++;
+        net_pkt_unref(pkt);
+        return OscorePktError;
+    }
+    net_pkt_frag_add(pkt, frag);
+
+    if (!rx) {
+        tx_high_water = max(tx_high_water, (u32_t) atomic_get(&tx_used));
+    }
+    *out = pkt;
+    return OscoreNoError;
+}
+
+void pkt_pool_get_stats(struct pkt_pool_stats* out) {
+    out->tx_used = (u32_t) atomic_get(&tx_used);
+    out->tx_high_water = tx_high_water;
+    out->failures = failures;
+}
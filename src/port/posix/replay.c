@@ -0,0 +1,408 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+// Replays captured CoAP/OSCORE requests through the server path of the host port (`host_server_handle`, which
+// stands in for `udp_receive` with a stub `net_context`).
+//
+// Captures are either pcap files (Ethernet, Linux cooked, BSD loopback or raw IP link types), of which the UDP
+// datagrams to the server port are replayed, or text files with one datagram per line:
+//
+//   # comment
+//   <time in us> <datagram in hex> [<expected response in hex> | drop]
+//
+// Requests are replayed as fast as possible or, with -r, at the recorded times. Every pass starts with a freshly
+// initialized security context, like after a reboot of the server. With -v every packet is printed, the summary is
+// printed as one JSON object:
+//
+//   {"replay":"capture.pcap","packets":4,"passes":1,"answered":1,"dropped":3,"mismatches":0,"pkts_per_sec":...,
+//    "bytes_per_sec":...,"p50_ns":...,"p99_ns":...,"max_ns":...,"drops":{"prefilter/268":1,...}}
+//
+// Drops are keyed by the stage (see `enum host_stage`) and the OscoreError. The exit status is 1 if a response
+// didn't match its expectation.
+//
+// Usage: oscore_replay [-r] [-v] [-n passes] [-p port] capture
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include "host_server.h"
+
+#define MAX_DATAGRAM 1400
+#define MAX_DROP_REASONS 32
+
+/// What a text capture expects as response to a request
+enum expect {
+    ExpectNothing,
+    ExpectResponse,
+    ExpectDrop,
+};
+
+/// One captured request
+struct record {
+    u64_t time_us;
+    struct sockaddr_in6 from;
+    u16_t len;
+    u8_t data[MAX_DATAGRAM];
+    enum expect expect;
+    u16_t expected_len;
+    u8_t expected[MAX_DATAGRAM];
+};
+
+struct drop_reason {
+    enum host_stage stage;
+    OscoreError error;
+    u32_t count;
+};
+
+static struct record* records;
+static size_t num_records;
+static u16_t server_port = 5683;
+static bool verbose;
+
+static struct record* add_record(void) {
+    struct record* grown = realloc(records, (num_records + 1) * sizeof(struct record));
+    if (grown == NULL) {
+        return NULL;
+    }
+    records = grown;
+    struct record* record = &records[num_records++];
+    memset(record, 0, sizeof(*record));
+    return record;
+}
+
+static u16_t read_be16(const u8_t* p) {
+    return (u16_t) (p[0] << 8 | p[1]);
+}
+
+static u32_t read_u32(const u8_t* p, bool big_endian) {
+    if (big_endian) {
+        return (u32_t) p[0] << 24 | (u32_t) p[1] << 16 | (u32_t) p[2] << 8 | p[3];
+    }
+    return (u32_t) p[3] << 24 | (u32_t) p[2] << 16 | (u32_t) p[1] << 8 | p[0];
+}
+
+/**
+ * Adds the UDP datagram of an IP packet to the records if it is sent to the server port.
+ * @param time_us Capture time of the packet
+ * @param ip IPv4 or IPv6 header followed by the UDP header
+ * @param len Length of @a ip
+ * @return false if the capture is invalid
+ */
+static bool add_ip_packet(u64_t time_us, const u8_t* ip, size_t len) {
+    struct sockaddr_in6 from = { .sin6_family = AF_INET6 };
+    size_t udp_offset;
+    if (len >= 20 && ip[0] >> 4 == 4) {
+        // fragmented datagrams are skipped
+        if (ip[9] != IPPROTO_UDP || (read_be16(&ip[6]) & 0x3fff) != 0) {
+            return true;
+        }
+        udp_offset = (size_t) (ip[0] & 0x0f) * 4;
+        // IPv4-mapped source
+        from.sin6_addr.s6_addr[10] = 0xff;
+        from.sin6_addr.s6_addr[11] = 0xff;
+        memcpy(&from.sin6_addr.s6_addr[12], &ip[12], 4);
+    } else if (len >= 40 && ip[0] >> 4 == 6) {
+        // extension headers aren't followed
+        if (ip[6] != IPPROTO_UDP) {
+            return true;
+        }
+        udp_offset = 40;
+        memcpy(&from.sin6_addr, &ip[8], sizeof(from.sin6_addr));
+    } else {
+        return true;
+    }
+    if (len < udp_offset + 8 || read_be16(&ip[udp_offset + 2]) != server_port) {
+        return true;
+    }
+    size_t udp_len = read_be16(&ip[udp_offset + 4]);
+    if (udp_len < 8 || udp_offset + udp_len > len || udp_len - 8 > MAX_DATAGRAM) {
+        fprintf(stderr, "truncated or oversized UDP datagram at %llu us\n", (unsigned long long) time_us);
+        return false;
+    }
+    struct record* record = add_record();
+    if (record == NULL) {
+        return false;
+    }
+    record->time_us = time_us;
+    record->from = from;
+    record->from.sin6_port = htons(read_be16(&ip[udp_offset]));
+    record->len = (u16_t) (udp_len - 8);
+    memcpy(record->data, &ip[udp_offset + 8], record->len);
+    return true;
+}
+
+/// Reads a pcap file, @a header are its first 24 bytes
+static bool read_pcap(FILE* file, const u8_t* header) {
+    u32_t magic = read_u32(header, false);
+    bool big_endian = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+    bool nanoseconds = magic == 0xa1b23c4d || magic == 0x4d3cb2a1;
+    u32_t link_type = read_u32(&header[20], big_endian) & 0xffff;
+    size_t link_len;
+    switch (link_type) {
+        case 0: link_len = 4; break; // BSD loopback
+        case 1: link_len = 14; break; // Ethernet
+        case 101: case 228: case 229: link_len = 0; break; // raw IP
+        case 113: link_len = 16; break; // Linux cooked
+        default:
+            fprintf(stderr, "unsupported pcap link type %u\n", link_type);
+            return false;
+    }
+
+    static u8_t packet[65536];
+    u8_t record_header[16];
+    while (fread(record_header, sizeof(record_header), 1, file) == 1) {
+        u64_t time_us = (u64_t) read_u32(&record_header[0], big_endian) * 1000000;
+        u32_t fraction = read_u32(&record_header[4], big_endian);
+        time_us += nanoseconds ? fraction / 1000 : fraction;
+        u32_t captured = read_u32(&record_header[8], big_endian);
+        if (captured > sizeof(packet) || fread(packet, 1, captured, file) != captured) {
+            fprintf(stderr, "truncated pcap record\n");
+            return false;
+        }
+        size_t offset = link_len;
+        if (link_type == 1) {
+            // skip a VLAN tag
+            if (captured >= 18 && read_be16(&packet[12]) == 0x8100) {
+                offset += 4;
+            }
+        }
+        if (captured < offset) {
+            continue;
+        }
+        if (!add_ip_packet(time_us, &packet[offset], captured - offset)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Decodes the hex string at @a *pos into @a out.
+ * @return false if it isn't valid hex or longer than MAX_DATAGRAM bytes
+ */
+static bool parse_hex(char** pos, u8_t* out, u16_t* out_len) {
+    char* p = *pos;
+    u16_t len = 0;
+    while (isxdigit((unsigned char) p[0]) && isxdigit((unsigned char) p[1])) {
+        if (len == MAX_DATAGRAM) {
+            return false;
+        }
+        char byte[3] = { p[0], p[1], 0 };
+        out[len++] = (u8_t) strtoul(byte, NULL, 16);
+        p += 2;
+    }
+    if (*p != 0 && !isspace((unsigned char) *p)) {
+        return false;
+    }
+    *pos = p;
+    *out_len = len;
+    return true;
+}
+
+static char* skip_space(char* p) {
+    while (*p != 0 && isspace((unsigned char) *p)) {
+        p++;
+    }
+    return p;
+}
+
+/// Reads a text capture
+static bool read_text(FILE* file) {
+    static char line[4 * MAX_DATAGRAM + 64];
+    u32_t line_num = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_num++;
+        char* p = skip_space(line);
+        if (*p == 0 || *p == '#') {
+            continue;
+        }
+        struct record* record = add_record();
+        if (record == NULL) {
+            return false;
+        }
+        record->from.sin6_family = AF_INET6;
+        record->from.sin6_addr = (struct in6_addr) IN6ADDR_LOOPBACK_INIT;
+        record->from.sin6_port = htons(server_port + 1);
+        record->time_us = strtoull(p, &p, 10);
+        p = skip_space(p);
+        if (!parse_hex(&p, record->data, &record->len) || record->len == 0) {
+            fprintf(stderr, "line %u: invalid datagram\n", line_num);
+            return false;
+        }
+        p = skip_space(p);
+        if (strncmp(p, "drop", 4) == 0) {
+            record->expect = ExpectDrop;
+        } else if (*p != 0) {
+            if (!parse_hex(&p, record->expected, &record->expected_len)) {
+                fprintf(stderr, "line %u: invalid expected response\n", line_num);
+                return false;
+            }
+            record->expect = ExpectResponse;
+        }
+    }
+    return true;
+}
+
+static bool read_capture(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+    u8_t header[24];
+    bool ok;
+    size_t read = fread(header, 1, sizeof(header), file);
+    u32_t magic = read == sizeof(header) ? read_u32(header, false) : 0;
+    if (magic == 0xa1b2c3d4 || magic == 0xd4c3b2a1 || magic == 0xa1b23c4d || magic == 0x4d3cb2a1) {
+        ok = read_pcap(file, header);
+    } else {
+        rewind(file);
+        ok = read_text(file);
+    }
+    fclose(file);
+    return ok;
+}
+
+static u64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static int compare_u32(const void* a, const void* b) {
+    u32_t l = *(const u32_t*) a;
+    u32_t r = *(const u32_t*) b;
+    return (l > r) - (l < r);
+}
+
+static void count_drop(struct drop_reason* reasons, size_t* num_reasons, enum host_stage stage, OscoreError error) {
+    for (size_t i = 0; i < *num_reasons; i++) {
+        if (reasons[i].stage == stage && reasons[i].error == error) {
+            reasons[i].count++;
+            return;
+        }
+    }
+    if (*num_reasons < MAX_DROP_REASONS) {
+        reasons[(*num_reasons)++] = (struct drop_reason) { .stage = stage, .error = error, .count = 1 };
+    }
+}
+
+/// Whether the outcome of replaying @a record is what its capture expects
+static bool matches(const struct record* record, bool answered, const u8_t* response, u16_t response_len) {
+    switch (record->expect) {
+        case ExpectDrop:
+            return !answered;
+        case ExpectResponse:
+            return answered && response_len == record->expected_len &&
+                   memcmp(response, record->expected, response_len) == 0;
+        default:
+            return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    bool recorded_speed = false;
+    u32_t passes = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "rvn:p:")) != -1) {
+        switch (opt) {
+            case 'r': recorded_speed = true; break;
+            case 'v': verbose = true; break;
+            case 'n': passes = (u32_t) strtoul(optarg, NULL, 10); break;
+            case 'p': server_port = (u16_t) strtoul(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "usage: %s [-r] [-v] [-n passes] [-p port] capture\n", argv[0]);
+                return 2;
+        }
+    }
+    if (optind != argc - 1 || passes == 0) {
+        fprintf(stderr, "usage: %s [-r] [-v] [-n passes] [-p port] capture\n", argv[0]);
+        return 2;
+    }
+    const char* path = argv[optind];
+    if (!read_capture(path)) {
+        return 2;
+    }
+
+    size_t total = num_records * passes;
+    u32_t* latencies = malloc((total > 0 ? total : 1) * sizeof(u32_t));
+    assert_actually(latencies != NULL, "out of memory");
+    struct drop_reason reasons[MAX_DROP_REASONS];
+    size_t num_reasons = 0;
+    u32_t answered = 0;
+    u32_t mismatches = 0;
+    u64_t bytes = 0;
+    u8_t response_bytes[MAX_DATAGRAM];
+
+    u64_t start = now_ns();
+    for (u32_t pass = 0; pass < passes; pass++) {
+        assert_no_error(host_server_init());
+        u64_t pass_start = now_ns();
+        for (size_t i = 0; i < num_records; i++) {
+            const struct record* record = &records[i];
+            if (recorded_speed) {
+                u64_t due = pass_start + (record->time_us - records[0].time_us) * 1000;
+                u64_t now = now_ns();
+                if (due > now) {
+                    struct timespec wait = { .tv_sec = (time_t) ((due - now) / 1000000000),
+                                             .tv_nsec = (long) ((due - now) % 1000000000) };
+                    nanosleep(&wait, NULL);
+                }
+            }
+            array response = { .len = sizeof(response_bytes), .ptr = response_bytes };
+            u16_t response_len = 0;
+            enum host_stage stage;
+            u64_t t0 = now_ns();
+            OscoreError res = host_server_handle(&record->from, record->data, record->len, response, &response_len,
+                                                 &stage);
+            u32_t latency = (u32_t) (now_ns() - t0);
+            latencies[pass * num_records + i] = latency;
+            bytes += record->len + response_len;
+
+            bool ok = res == OscoreNoError;
+            if (ok) {
+                answered++;
+            } else {
+                count_drop(reasons, &num_reasons, stage, res);
+            }
+            bool match = matches(record, ok, response_bytes, response_len);
+            if (!match) {
+                mismatches++;
+            }
+            if (verbose || !match) {
+                printf("{\"pass\":%u,\"packet\":%zu,\"stage\":\"%s\",\"error\":%d,\"latency_ns\":%u,"
+                       "\"response_len\":%u,\"match\":%s}\n",
+                       pass, i, host_stage_name(stage), res, latency, response_len, match ? "true" : "false");
+            }
+        }
+    }
+    u64_t elapsed = now_ns() - start;
+
+    qsort(latencies, total, sizeof(u32_t), compare_u32);
+    printf("{\"replay\":\"%s\",\"packets\":%zu,\"passes\":%u,\"answered\":%u,\"dropped\":%zu,\"mismatches\":%u,"
+           "\"pkts_per_sec\":%.0f,\"bytes_per_sec\":%.0f,\"p50_ns\":%u,\"p99_ns\":%u,\"max_ns\":%u,\"drops\":{",
+           path, num_records, passes, answered, total - answered, mismatches,
+           elapsed > 0 ? total * 1e9 / elapsed : 0.0, elapsed > 0 ? bytes * 1e9 / elapsed : 0.0,
+           total > 0 ? latencies[total / 2] : 0, total > 0 ? latencies[(size_t) ((u64_t) total * 99 / 100)] : 0,
+           total > 0 ? latencies[total - 1] : 0);
+    for (size_t i = 0; i < num_reasons; i++) {
+        printf("%s\"%s/%d\":%u", i > 0 ? "," : "", host_stage_name(reasons[i].stage), reasons[i].error,
+               reasons[i].count);
+    }
+    printf("}}\n");
+
+    free(latencies);
+    free(records);
+    return mismatches > 0 ? 1 : 0;
+}
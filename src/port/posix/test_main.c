@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <stdio.h>
+#include "../../tests.h"
+
+// Runs the unit tests of src/tests.c on the host. A failing test panics, so reaching the end means success.
+int main(void) {
+    test_hkdf_sha256_tc1();
+    test_hkdf_sha256_tc2();
+    test_derive_sender_key();
+    test_derive_recipient_key();
+    test_derive_common_iv();
+    test_aes_ccm_stream();
+    test_timer_wheel();
+    test_response_option_savings();
+    test_exchange_table();
+    test_replay_window();
+    test_scratch_arena();
+    test_pkt_pool();
+    test_class_e_option_encoding();
+    test_response_cache();
+    test_prefilter_drops();
+    test_security_contexts();
+    test_context_snapshot();
+#ifdef OSCORE_LAZY_CONTEXTS
+    test_lazy_contexts();
+#endif
+    test_coap_message_layout();
+#ifdef OSCORE_HOST
+    test_dedup();
+    test_block_sessions();
+    test_outer_block();
+    test_rate_limit();
+#endif
+#ifdef OSCORE_TRACE
+    test_trace_ring();
+#endif
+#ifdef OSCORE_PROFILE
+    test_profile_histogram();
+#endif
+    // protects responses, which the profile histogram test expects not to have happened yet
+    test_echo_recovery();
+    test_sequence_reservation();
+    printf("all tests successful\n");
+    return 0;
+}
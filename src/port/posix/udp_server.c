@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+
+#ifdef __linux__
+// recvmmsg and sendmmsg
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include "udp_server.h"
+#include "host_server.h"
+#include "../../util/scratch.h"
+
+#define MAX_DATAGRAM 1400
+
+/// How often the stop flag is checked while no datagrams arrive
+#define UDP_SERVER_POLL_MS 100
+
+#ifndef __linux__
+/// Only used for the buffers of a batch of 1 on other systems
+struct mmsghdr {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+};
+#endif
+
+/// Datagrams one worker can hand off to another before further ones are dropped, a power of two
+#define HANDOFF_RING_SIZE 64
+
+/// A datagram passed to the worker owning its security context
+struct handoff {
+    struct sockaddr_in6 from;
+    u16_t len;
+    u8_t data[MAX_DATAGRAM];
+};
+
+/// Single-producer single-consumer ring, the indices only grow and are read with acquire, written with release
+struct handoff_ring {
+    /// next slot to read, written by the consumer
+    u32_t head __aligned(64);
+    /// next slot to write, written by the producer
+    u32_t tail __aligned(64);
+    struct handoff slots[HANDOFF_RING_SIZE];
+};
+
+struct udp_shards {
+    u32_t workers;
+    /// ring from worker i to worker j at i * workers + j
+    struct handoff_ring* rings;
+    /// pipe per worker to wake it up from `poll` after a handoff
+    int wake[UDP_SERVER_MAX_WORKERS][2];
+    /// whether a wakeup was written to the pipe of a worker and not read yet
+    u32_t wake_pending[UDP_SERVER_MAX_WORKERS];
+};
+
+/// Buffers of one batch, requests received and responses to send
+struct batch {
+    struct mmsghdr requests[UDP_SERVER_MAX_BATCH];
+    struct iovec request_iov[UDP_SERVER_MAX_BATCH];
+    struct sockaddr_in6 from[UDP_SERVER_MAX_BATCH];
+    u8_t request_data[UDP_SERVER_MAX_BATCH][MAX_DATAGRAM];
+    u32_t num_responses;
+    struct mmsghdr responses[UDP_SERVER_MAX_BATCH];
+    struct iovec response_iov[UDP_SERVER_MAX_BATCH];
+    struct sockaddr_in6 to[UDP_SERVER_MAX_BATCH];
+    u8_t response_data[UDP_SERVER_MAX_BATCH][MAX_DATAGRAM];
+};
+
+int udp_server_open(struct udp_server* server, u16_t port, bool reuse_port) {
+    memset(server, 0, sizeof(*server));
+    server->fd = socket(AF_INET6, SOCK_DGRAM, 0);
+    if (server->fd < 0) {
+        return -errno;
+    }
+    struct sockaddr_in6 addr = {
+        .sin6_family = AF_INET6, .sin6_addr = IN6ADDR_LOOPBACK_INIT, .sin6_port = htons(port),
+    };
+    struct timeval timeout = { .tv_sec = 0, .tv_usec = UDP_SERVER_POLL_MS * 1000 };
+    int one = 1;
+    socklen_t addr_len = sizeof(addr);
+    if (setsockopt(server->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0
+            || (reuse_port && setsockopt(server->fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0)
+            || bind(server->fd, (struct sockaddr*) &addr, sizeof(addr)) != 0
+            || getsockname(server->fd, (struct sockaddr*) &addr, &addr_len) != 0) {
+        int res = -errno;
+        close(server->fd);
+        server->fd = -1;
+        return res;
+    }
+    server->port = ntohs(addr.sin6_port);
+    server->batch = 1;
+    return 0;
+}
+
+int udp_server_set_batch(struct udp_server* server, u32_t batch) {
+    if (batch == 0 || batch > UDP_SERVER_MAX_BATCH) {
+        return -EINVAL;
+    }
+#ifndef __linux__
+    if (batch > 1) {
+        return -ENOSYS;
+    }
+#endif
+    server->batch = batch;
+    return 0;
+}
+
+/**
+ * Receives up to `server->batch` datagrams into @a b.
+ * @param wait Whether to block until the first datagram or SO_RCVTIMEO
+ * @return number of datagrams, 0 if there were none, or a negative errno
+ */
+static int receive(struct udp_server* server, struct batch* b, bool wait) {
+    int received;
+#ifdef __linux__
+    if (server->batch > 1) {
+        for (u32_t i = 0; i < server->batch; i++) {
+            b->request_iov[i] = (struct iovec) { .iov_base = b->request_data[i], .iov_len = MAX_DATAGRAM };
+            b->requests[i].msg_hdr = (struct msghdr) {
+                .msg_name = &b->from[i], .msg_namelen = sizeof(b->from[i]), .msg_iov = &b->request_iov[i],
+                .msg_iovlen = 1,
+            };
+        }
+        // takes what is queued already after the first datagram
+        received = recvmmsg(server->fd, b->requests, server->batch, wait ? MSG_WAITFORONE : MSG_DONTWAIT, NULL);
+    } else
+#endif
+    {
+        socklen_t from_len = sizeof(b->from[0]);
+        ssize_t len = recvfrom(server->fd, b->request_data[0], MAX_DATAGRAM, wait ? 0 : MSG_DONTWAIT,
+                               (struct sockaddr*) &b->from[0], &from_len);
+        b->requests[0].msg_len = (unsigned int) len;
+        received = len < 0 ? -1 : 1;
+    }
+    if (received < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -errno;
+    }
+    server->stats.syscalls++;
+    return received;
+}
+
+/// Sends the responses collected in @a b
+static void flush(struct udp_server* server, struct batch* b) {
+    u32_t sent = 0;
+    while (sent < b->num_responses) {
+        int n;
+#ifdef __linux__
+        if (server->batch > 1) {
+            // sendmmsg stops at the first datagram that fails, it is dropped and the rest is sent again
+            n = sendmmsg(server->fd, &b->responses[sent], b->num_responses - sent, 0);
+        } else
+#endif
+        {
+            struct msghdr* msg = &b->responses[sent].msg_hdr;
+            n = sendto(server->fd, msg->msg_iov->iov_base, msg->msg_iov->iov_len, 0, msg->msg_name,
+                       msg->msg_namelen) < 0 ? -1 : 1;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            server->stats.dropped++;
+            n = 1;
+        } else {
+            server->stats.syscalls++;
+            server->stats.answered += (u32_t) n;
+        }
+        sent += (u32_t) n;
+    }
+    b->num_responses = 0;
+}
+
+/// Processes a request, its response is sent with the next `flush`
+static void respond(struct udp_server* server, struct batch* b, const struct sockaddr_in6* from,
+                    const u8_t* request, u16_t len) {
+    if (b->num_responses == server->batch) {
+        flush(server, b);
+    }
+    u32_t i = b->num_responses;
+    u16_t response_len;
+    enum host_stage stage;
+    array out = { .len = MAX_DATAGRAM, .ptr = b->response_data[i] };
+    if (host_server_handle(from, request, len, out, &response_len, &stage) != OscoreNoError) {
+        // like the Zephyr server, requests that can't be processed are dropped silently
+        server->stats.dropped++;
+        return;
+    }
+    b->to[i] = *from;
+    b->response_iov[i] = (struct iovec) { .iov_base = b->response_data[i], .iov_len = response_len };
+    b->responses[i].msg_hdr = (struct msghdr) {
+        .msg_name = &b->to[i], .msg_namelen = sizeof(b->to[i]), .msg_iov = &b->response_iov[i], .msg_iovlen = 1,
+    };
+    b->num_responses++;
+}
+
+/// Passes a datagram to worker @a to, returns false if its ring is full
+static bool hand_off(struct udp_server* server, u32_t to, const struct sockaddr_in6* from, const u8_t* request,
+                     u16_t len) {
+    struct udp_shards* shards = server->shards;
+    struct handoff_ring* ring = &shards->rings[server->shard * shards->workers + to];
+    u32_t tail = ring->tail;
+    if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == HANDOFF_RING_SIZE) {
+        return false;
+    }
+    struct handoff* slot = &ring->slots[tail & (HANDOFF_RING_SIZE - 1)];
+    slot->from = *from;
+    slot->len = len;
+    memcpy(slot->data, request, len);
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    if (__atomic_exchange_n(&shards->wake_pending[to], 1, __ATOMIC_ACQ_REL) == 0) {
+        u8_t wake = 1;
+        if (write(shards->wake[to][1], &wake, 1) < 0) {
+            // the pipe is full, so the worker is woken up anyway
+        }
+    }
+    return true;
+}
+
+/// Processes the datagrams other workers handed off to this one
+static void take_handoffs(struct udp_server* server, struct batch* b) {
+    struct udp_shards* shards = server->shards;
+    u8_t drain[64];
+    // cleared before the rings are read, so a handoff after reading them wakes the worker again
+    __atomic_store_n(&shards->wake_pending[server->shard], 0, __ATOMIC_RELEASE);
+    while (read(shards->wake[server->shard][0], drain, sizeof(drain)) > 0) {}
+    for (u32_t from = 0; from < shards->workers; from++) {
+        struct handoff_ring* ring = &shards->rings[from * shards->workers + server->shard];
+        u32_t head = ring->head;
+        u32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct handoff* slot = &ring->slots[head & (HANDOFF_RING_SIZE - 1)];
+            server->stats.received++;
+            respond(server, b, &slot->from, slot->data, slot->len);
+            __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+/// Processes a received datagram or hands it off to the worker owning its security context
+static void dispatch(struct udp_server* server, struct batch* b, u32_t i) {
+    u16_t len = (u16_t) b->requests[i].msg_len;
+    u32_t shard;
+    if (server->shards != NULL && host_server_shard(b->request_data[i], len, server->shards->workers, &shard)
+            && shard != server->shard) {
+        if (hand_off(server, shard, &b->from[i], b->request_data[i], len)) {
+            server->stats.handed_off++;
+        } else {
+            server->stats.dropped++;
+        }
+        return;
+    }
+    server->stats.received++;
+    respond(server, b, &b->from[i], b->request_data[i], len);
+}
+
+int udp_server_run(struct udp_server* server, volatile sig_atomic_t* stop) {
+    struct batch* b = malloc(sizeof(struct batch));
+    if (b == NULL) {
+        return -ENOMEM;
+    }
+    b->num_responses = 0;
+    int res = 0;
+    while (!*stop && res >= 0) {
+        bool readable = true;
+        if (server->shards != NULL) {
+            // handed off datagrams wake the worker up, too
+            struct pollfd fds[2] = {
+                { .fd = server->fd, .events = POLLIN },
+                { .fd = server->shards->wake[server->shard][0], .events = POLLIN },
+            };
+            if (poll(fds, 2, UDP_SERVER_POLL_MS) < 0 && errno != EINTR) {
+                res = -errno;
+                break;
+            }
+            take_handoffs(server, b);
+            readable = (fds[0].revents & POLLIN) != 0;
+        }
+        if (readable) {
+            res = receive(server, b, server->shards == NULL);
+            for (int i = 0; i < res; i++) {
+                dispatch(server, b, (u32_t) i);
+            }
+        }
+        flush(server, b);
+    }
+    free(b);
+    return res < 0 ? res : 0;
+}
+
+struct worker_args {
+    struct udp_server* server;
+    volatile sig_atomic_t* stop;
+    int res;
+};
+
+static void* run_worker(void* arg) {
+    struct worker_args* args = arg;
+    args->res = udp_server_run(args->server, args->stop);
+    // the arena can be claimed by the workers of a later run
+    scratch_detach();
+    return NULL;
+}
+
+int udp_server_run_sharded(struct udp_server* first, u32_t workers, volatile sig_atomic_t* stop) {
+    if (workers == 0 || workers > UDP_SERVER_MAX_WORKERS) {
+        return -EINVAL;
+    }
+    struct udp_shards shards = { .workers = workers };
+    memset(shards.wake, -1, sizeof(shards.wake));
+    shards.rings = calloc(workers * workers, sizeof(struct handoff_ring));
+    struct udp_server servers[UDP_SERVER_MAX_WORKERS];
+    struct worker_args args[UDP_SERVER_MAX_WORKERS];
+    pthread_t threads[UDP_SERVER_MAX_WORKERS];
+    u32_t opened = 0;
+    u32_t started = 0;
+    int res = shards.rings != NULL ? 0 : -ENOMEM;
+    for (; res == 0 && opened < workers; opened++) {
+        if (opened == 0) {
+            servers[0] = *first;
+        } else if ((res = udp_server_open(&servers[opened], first->port, true)) != 0) {
+            break;
+        }
+        servers[opened].batch = first->batch;
+        servers[opened].shards = &shards;
+        servers[opened].shard = opened;
+        if (pipe(shards.wake[opened]) != 0) {
+            res = -errno;
+        } else {
+            fcntl(shards.wake[opened][0], F_SETFL, O_NONBLOCK);
+            fcntl(shards.wake[opened][1], F_SETFL, O_NONBLOCK);
+        }
+    }
+    for (; res == 0 && started < workers; started++) {
+        args[started] = (struct worker_args) { .server = &servers[started], .stop = stop };
+        if (pthread_create(&threads[started], NULL, run_worker, &args[started]) != 0) {
+            res = -EAGAIN;
+            break;
+        }
+    }
+
+    // the first worker is stopped with the others if one couldn't be started
+    if (res != 0) {
+        *stop = 1;
+    }
+    memset(&first->stats, 0, sizeof(first->stats));
+    for (u32_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        if (res == 0) {
+            res = args[i].res;
+        }
+        first->stats.received += servers[i].stats.received;
+        first->stats.answered += servers[i].stats.answered;
+        first->stats.dropped += servers[i].stats.dropped;
+        first->stats.syscalls += servers[i].stats.syscalls;
+        first->stats.handed_off += servers[i].stats.handed_off;
+    }
+    for (u32_t i = 1; i < opened; i++) {
+        udp_server_close(&servers[i]);
+    }
+    for (u32_t i = 0; i < workers; i++) {
+        if (shards.wake[i][0] >= 0) {
+            close(shards.wake[i][0]);
+            close(shards.wake[i][1]);
+        }
+    }
+    free(shards.rings);
+    return res;
+}
+
+void udp_server_close(struct udp_server* server) {
+    if (server->fd >= 0) {
+        close(server->fd);
+        server->fd = -1;
+    }
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+
+#ifndef NONE_UDP_SERVER_H
+#define NONE_UDP_SERVER_H
+
+#include <zephyr/types.h>
+#include <stdbool.h>
+#include <signal.h>
+
+// OSCORE server on a UDP socket of the host, standing in for `server/coap-server.c`: every datagram received is
+// passed to `host_server_handle` and its response is sent back to the source. The security contexts have to be
+// initialized with `host_server_init` (and `host_server_add_peers`) first.
+//
+// On Linux, datagrams can be received and sent in batches with `recvmmsg`/`sendmmsg` (see `udp_server.batch`):
+// every datagram received by one call is processed before the responses are sent with one call, so a server under
+// load needs two syscalls per batch instead of two per request.
+//
+// `udp_server_run_sharded` runs a worker thread per core, each with its own socket bound to the same port with
+// SO_REUSEPORT. The security contexts are partitioned by `oscore_kid_hash`: a worker only processes requests of its
+// own contexts, so their sequence numbers and replay windows are never touched by two threads. The kernel
+// distributes datagrams by their addresses, not by kid, so a datagram of another worker's context is handed off
+// through a single-producer single-consumer ring per pair of workers, and answered by the worker owning it.
+
+/// Maximum of `udp_server.batch`
+#define UDP_SERVER_MAX_BATCH 64
+/// Maximum number of workers of `udp_server_run_sharded`
+#define UDP_SERVER_MAX_WORKERS 16
+
+/// Counters of a server loop
+struct udp_server_stats {
+    u64_t received;
+    u64_t answered;
+    u64_t dropped;
+    /// Receive and send calls that returned datagrams or sent them
+    u64_t syscalls;
+    /// Datagrams passed to the worker owning their security context
+    u64_t handed_off;
+};
+
+/// Handoff rings between the workers of a sharded server
+struct udp_shards;
+
+struct udp_server {
+    int fd;
+    /// Bound port, in host byte order
+    u16_t port;
+    /// Datagrams received and sent per syscall, 1 for `recvfrom`/`sendto`. Only Linux supports more.
+    u32_t batch;
+    /// Rings of the sharded server this is a worker of, NULL if it isn't sharded
+    struct udp_shards* shards;
+    /// Number of the worker, i.e. the partition of the security contexts it owns
+    u32_t shard;
+    struct udp_server_stats stats;
+};
+
+/**
+ * Opens the socket of a server on the IPv6 loopback address, with a batch size of 1.
+ * @param server Server to initialize
+ * @param port Port to bind to, 0 for an ephemeral one, which is written to `server->port`
+ * @param reuse_port Whether to set SO_REUSEPORT, required for the first worker of `udp_server_run_sharded`
+ * @return 0 or a negative errno
+ */
+int udp_server_open(struct udp_server* server, u16_t port, bool reuse_port);
+
+/**
+ * Sets the number of datagrams received and sent per syscall.
+ * @param server Opened server
+ * @param batch Batch size, 1 to UDP_SERVER_MAX_BATCH
+ * @return 0, -EINVAL if @a batch is out of range, -ENOSYS if the system can't batch
+ */
+int udp_server_set_batch(struct udp_server* server, u32_t batch);
+
+/**
+ * Receives, processes and answers datagrams until @a stop is set.
+ * The flag is checked at least every 100ms, so it can be set from a signal handler or another thread.
+ * @param server Opened server
+ * @param stop Flag to stop the loop
+ * @return 0 or a negative errno if receiving failed
+ */
+int udp_server_run(struct udp_server* server, volatile sig_atomic_t* stop);
+
+/**
+ * Runs @a workers threads until @a stop is set, see above.
+ * @param first Server opened with SO_REUSEPORT, the other workers bind to its port and use its batch size. Its
+ *          statistics are the sum of all workers afterwards.
+ * @param workers Number of threads, 1 to UDP_SERVER_MAX_WORKERS
+ * @param stop Flag to stop the workers
+ * @return 0 or a negative errno
+ */
+int udp_server_run_sharded(struct udp_server* first, u32_t workers, volatile sig_atomic_t* stop);
+
+/// Closes the socket of a server
+void udp_server_close(struct udp_server* server);
+
+#endif //NONE_UDP_SERVER_H
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <string.h>
+#include <kernel.h>
+#include "block_session.h"
+
+struct block_session {
+    sys_dnode_t node;
+    /// `struct sockaddr` might be too small for an IPv6 address, e.g. on POSIX
+    struct sockaddr_in6 addr;
+    const struct coap_resource* resource;
+    u32_t last_used_ms;
+    struct coap_block_context ctx;
+};
+
+static struct block_session sessions[NUM_BLOCK_SESSIONS];
+/// sessions in use, most recently used first
+static sys_dlist_t lru;
+static sys_dlist_t free_list;
+
+static bool addr_equals(const struct sockaddr* left, const struct sockaddr* right) {
+    const struct sockaddr_in6* l = (const struct sockaddr_in6*)left;
+    const struct sockaddr_in6* r = (const struct sockaddr_in6*)right;
+    return l->sin6_port == r->sin6_port && memcmp(&l->sin6_addr, &r->sin6_addr, sizeof(l->sin6_addr)) == 0;
+}
+
+static void release(struct block_session* session) {
+    sys_dlist_remove(&session->node);
+    sys_dlist_append(&free_list, &session->node);
+}
+
+void block_session_init(void) {
+    sys_dlist_init(&lru);
+    sys_dlist_init(&free_list);
+    for (int i = 0; i < NUM_BLOCK_SESSIONS; i++) {
+        sys_dlist_append(&free_list, &sessions[i].node);
+    }
+}
+
+struct coap_block_context* block_session_get(const struct sockaddr* addr, const struct coap_resource* resource) {
+    u32_t now = k_uptime_get_32();
+    struct block_session* session;
+    struct block_session* next;
+    SYS_DLIST_FOR_EACH_CONTAINER_SAFE(&lru, session, next, node) {
+        if (now - session->last_used_ms >= BLOCK_SESSION_TIMEOUT_MS) {
+            release(session);
+            continue;
+        }
+        if (session->resource == resource && addr_equals((const struct sockaddr*)&session->addr, addr)) {
+            sys_dlist_remove(&session->node);
+            sys_dlist_prepend(&lru, &session->node);
+            session->last_used_ms = now;
+            return &session->ctx;
+        }
+    }
+
+    sys_dnode_t* node = sys_dlist_get(&free_list);
+    if (node == NULL) {
+        // all sessions are active, drop the one which waited the longest for its next block
+        node = sys_dlist_peek_tail(&lru);
+        sys_dlist_remove(node);
+    }
+    session = CONTAINER_OF(node, struct block_session, node);
+    session->addr = *(const struct sockaddr_in6*)addr;
+    session->resource = resource;
+    session->last_used_ms = now;
+    memset(&session->ctx, 0, sizeof(session->ctx));
+    sys_dlist_prepend(&lru, &session->node);
+    return &session->ctx;
+}
+
+void block_session_end(struct coap_block_context* ctx) {
+    release(CONTAINER_OF(ctx, struct block_session, ctx));
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_BLOCK_SESSION_H
+#define NONE_BLOCK_SESSION_H
+
+#include <net/coap.h>
+
+/// Maximum number of concurrent block-wise transfers
+#define NUM_BLOCK_SESSIONS 8
+/// Time in milliseconds after which an unfinished block-wise transfer is dropped
+#define BLOCK_SESSION_TIMEOUT_MS 60000
+
+/**
+ * Initializes the block-wise transfer session table.
+ * The table isn't thread-safe, it must only be used from the thread receiving requests.
+ */
+void block_session_init(void);
+
+/**
+ * Returns the block context of the transfer between an endpoint and a resource.
+ *
+ * If there is no such transfer yet, a new session with a zeroed context is created. Sessions which weren't used for
+ * BLOCK_SESSION_TIMEOUT_MS are dropped, and if the table is full, the least recently used session is replaced.
+ * As Block options of OSCORE requests are Inner options, this works the same for decrypted requests.
+ * @param addr Address of the endpoint
+ * @param resource Resource the blocks are transferred for
+ * @return block context, valid until `block_session_end` or the session is replaced
+ */
+struct coap_block_context* block_session_get(const struct sockaddr* addr, const struct coap_resource* resource);
+
+/**
+ * Ends the transfer of the given block context, e.g. after its last block.
+ * @param ctx Block context returned by `block_session_get`
+ */
+void block_session_end(struct coap_block_context* ctx);
+
+#endif //NONE_BLOCK_SESSION_H
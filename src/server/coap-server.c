@@ -30,10 +30,20 @@
 
 #include "net_private.h"
 #include "resources.h"
+#include "retransmit.h"
+#include "dedup.h"
+#include "block_session.h"
+#include "outer_block.h"
+#include "rate_limit.h"
+#include "context_store.h"
+#include "../oscore/response_cache.h"
 #include "../oscore/options.h"
 #include "../oscore/coap-uri.h"
 #include "../oscore/oscore.h"
+#include "../oscore/pkt_pool.h"
 #include "../util/macros.h"
+#include "../util/scratch.h"
+#include "../util/trace.h"
 
 #define MY_COAP_PORT 5683
 
@@ -50,8 +60,6 @@
 
 #define NUM_OBSERVERS 3
 
-#define NUM_PENDINGS 3
-
 /* block option helper */
 #define GET_BLOCK_NUM(v)	((v) >> 4)
 #define GET_BLOCK_SIZE(v)	(((v) & 0x7))
@@ -63,29 +71,303 @@ static const u8_t plain_text_format;
 
 static struct coap_observer observers[NUM_OBSERVERS];
 
-static struct coap_pending pendings[NUM_PENDINGS];
-
 static struct k_delayed_work observer_work;
 
 static int obs_counter;
 
 static struct coap_resource *resource_to_notify;
 
-struct k_delayed_work retransmit_work;
+/* OSCORE state of an observer, indexed like `observers` */
+struct observer_security {
+	bool oscore;
+	struct oscore_request registration;
+};
+
+static struct observer_security observer_security[NUM_OBSERVERS];
+
+/* Plaintext of the latest protected notification, shared by all observers */
+static struct oscore_inner notification;
 
-void get_from_ip_addr(struct coap_packet *cpkt,
-			     struct sockaddr_in6 *from)
+static u8_t notification_plaintext[32];
+
+static u16_t notification_age;
+
+static bool notification_valid;
+
+/* Protects a response to an OSCORE request and caches its plaintext. The
+ * unprotected response is consumed.
+ */
+static int protect_response(struct coap_packet *response,
+			    struct coap_packet *request,
+			    struct coap_packet *out)
 {
-	struct net_udp_hdr hdr, *udp_hdr;
+	struct oscore_inner inner;
+	size_t mark;
+	u8_t type;
+	u16_t id;
+	int r;
 
-	udp_hdr = net_udp_get_hdr(cpkt->pkt, &hdr);
-	if (!udp_hdr) {
-		return;
+	/* The plaintext is at most as long as the CoAP Code, all options and
+	 * the payload together.
+	 */
+	array buffer = {
+		.len = 1 + net_pkt_get_len(response->pkt) - response->offset -
+		       response->hdr_len,
+	};
+
+	mark = scratch_mark();
+	buffer.ptr = scratch_alloc(buffer.len);
+	if (!buffer.ptr) {
+		NET_ERR("No scratch memory for %zu byte plaintext\n",
+			buffer.len);
+		net_pkt_unref(response->pkt);
+		return -ENOMEM;
+	}
+
+	r = oscore_inner_encode(response, buffer, &inner);
+	if (r != OscoreNoError) {
+		NET_ERR("Could not encode response (%d)\n", r);
+		scratch_release(mark);
+		net_pkt_unref(response->pkt);
+		return -EINVAL;
+	}
+
+	r = response_cache_add(request, response, &inner);
+	if (r != OscoreNoError) {
+		NET_ERR("Could not cache response (%d)\n", r);
+	}
+
+	type = coap_header_get_type(response);
+	id = coap_header_get_id(response);
+	net_pkt_unref(response->pkt);
+
+	r = into_oscore_inner(&inner, request, type, id, out);
+	scratch_release(mark);
+	if (r == OscorePktError || r == OscoreScratchExhausted) {
+		return -ENOMEM;
+	}
+	if (r != OscoreNoError) {
+		NET_ERR("Could not protect response (%d)\n", r);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int send_service_unavailable(struct coap_packet *request,
+			     const struct sockaddr *addr)
+{
+	struct coap_packet response;
+	struct net_pkt *pkt;
+	u8_t type = COAP_TYPE_NON_CON;
+	u8_t token[8];
+	u8_t tkl;
+	int r;
+
+	/* don't wait, the pools are exhausted already */
+	if (pkt_pool_get(false, K_NO_WAIT, &pkt) != OscoreNoError) {
+		return -ENOMEM;
+	}
+
+	if (coap_header_get_type(request) == COAP_TYPE_CON) {
+		type = COAP_TYPE_ACK;
+	}
+
+	tkl = coap_header_get_token(request, token);
+	r = coap_packet_init(&response, pkt, 1, type, tkl, token,
+			     COAP_RESPONSE_CODE_SERVICE_UNAVAILABLE,
+			     coap_header_get_id(request));
+	if (r == 0) {
+		/* ask the client to retry after a second */
+		r = coap_append_option_int(&response, COAP_OPTION_MAX_AGE, 1);
+	}
+	if (r == 0) {
+		r = net_context_sendto(pkt, addr, sizeof(struct sockaddr_in6),
+				       NULL, 0, NULL, NULL);
+	}
+	if (r < 0) {
+		net_pkt_unref(pkt);
+	}
+
+	return r;
+}
+
+/* Allocates the packet of a response to @a request from the OSCORE pools.
+ * Waits at most OSCORE_PKT_TIMEOUT_MS, so exhausted pools don't stall the RX
+ * thread, and answers 5.03 (Service Unavailable) instead.
+ */
+static struct net_pkt *get_response_pkt(struct coap_packet *request,
+					const struct sockaddr *addr)
+{
+	struct net_pkt *pkt;
+
+	if (pkt_pool_get(false, OSCORE_PKT_TIMEOUT_MS, &pkt) != OscoreNoError) {
+		send_service_unavailable(request, addr);
+		return NULL;
+	}
+
+	return pkt;
+}
+
+/* Answers an authentic request of a peer whose replay window is unknown
+ * after a reboot with a protected 4.01 (Unauthorized) carrying an Echo
+ * Option, see `oscore_echo_challenge`.
+ */
+static int send_echo_challenge(struct coap_packet *request,
+			       const struct sockaddr *addr)
+{
+	struct coap_packet challenge;
+	u8_t type = COAP_TYPE_NON_CON;
+	int r;
+
+	if (coap_header_get_type(request) == COAP_TYPE_CON) {
+		type = COAP_TYPE_ACK;
+	}
+
+	r = oscore_echo_challenge(request, type, coap_header_get_id(request),
+				  &challenge);
+	if (r != OscoreNoError) {
+		NET_ERR("Could not protect Echo challenge (%d)\n", r);
+		return -EINVAL;
 	}
 
-	net_ipaddr_copy(&from->sin6_addr, &NET_IPV6_HDR(cpkt->pkt)->src);
-	from->sin6_port = udp_hdr->src_port;
-	from->sin6_family = AF_INET6;
+	trace(TraceSent, 0, net_pkt_get_len(challenge.pkt));
+	r = net_context_sendto(challenge.pkt, addr,
+			       sizeof(struct sockaddr_in6), NULL, 0, NULL,
+			       NULL);
+	if (r < 0) {
+		net_pkt_unref(challenge.pkt);
+	}
+
+	return r;
+}
+
+int send_response(struct coap_packet *response, struct coap_packet *request,
+		  const struct sockaddr *addr)
+{
+	struct coap_packet protected;
+	struct coap_packet first;
+	int r;
+
+	if (has_oscore_option(request)) {
+		r = protect_response(response, request, &protected);
+		if (r == -ENOMEM) {
+			send_service_unavailable(request, addr);
+		}
+		if (r < 0) {
+			return r;
+		}
+
+		r = outer_block_split(&protected, request, addr, &first);
+		if (r < 0) {
+			net_pkt_unref(protected.pkt);
+			return r;
+		}
+
+		response = &first;
+		dedup_add(response, addr);
+	}
+
+	trace(TraceSent, 0, net_pkt_get_len(response->pkt));
+	r = net_context_sendto(response->pkt, addr, sizeof(struct sockaddr_in6),
+			       NULL, 0, NULL, NULL);
+	if (r < 0) {
+		net_pkt_unref(response->pkt);
+	}
+
+	return r;
+}
+
+/* Answers a GET request, whose response is still cached, with 2.03 Valid if
+ * the client already has the cached representation.
+ */
+static int send_valid_response(struct coap_packet *request,
+			       struct response_cache_entry *entry, u8_t type,
+			       const struct sockaddr *addr)
+{
+	struct coap_packet response;
+	struct net_pkt *pkt;
+	u8_t token[8];
+	u8_t tkl;
+	int r;
+
+	pkt = get_response_pkt(request, addr);
+	if (!pkt) {
+		return -ENOMEM;
+	}
+
+	tkl = coap_header_get_token(request, token);
+	r = coap_packet_init(&response, pkt, 1, type, tkl, token,
+			     COAP_RESPONSE_CODE_VALID,
+			     coap_header_get_id(request));
+	if (r < 0) {
+		net_pkt_unref(pkt);
+		return -EINVAL;
+	}
+
+	r = coap_packet_append_option(&response, COAP_OPTION_ETAG,
+				      entry->etag, entry->etag_len);
+	if (r < 0) {
+		net_pkt_unref(pkt);
+		return -EINVAL;
+	}
+
+	return send_response(&response, request, addr);
+}
+
+/* Answers a decrypted GET request from the response cache. On a hit, the
+ * cached plaintext is protected directly, skipping the resource handler and
+ * the option encoding.
+ */
+static bool send_cached_response(struct coap_packet *request,
+				 const struct sockaddr *addr)
+{
+	struct response_cache_entry *entry;
+	struct coap_packet protected;
+	struct coap_packet first;
+	u8_t type = COAP_TYPE_NON_CON;
+	int r;
+
+	r = response_cache_lookup(request, &entry);
+	if (r != OscoreNoError || !entry) {
+		return false;
+	}
+
+	if (coap_header_get_type(request) == COAP_TYPE_CON) {
+		type = COAP_TYPE_ACK;
+	}
+
+	if (response_cache_etag_matches(request, entry)) {
+		send_valid_response(request, entry, type, addr);
+		return true;
+	}
+
+	r = into_oscore_inner(&entry->inner, request, type,
+			      coap_header_get_id(request), &protected);
+	if (r == OscorePktError) {
+		send_service_unavailable(request, addr);
+		return true;
+	}
+	if (r != OscoreNoError) {
+		NET_ERR("Could not protect cached response (%d)\n", r);
+		return true;
+	}
+
+	r = outer_block_split(&protected, request, addr, &first);
+	if (r < 0) {
+		net_pkt_unref(protected.pkt);
+		return true;
+	}
+
+	dedup_add(&first, addr);
+
+	r = net_context_sendto(first.pkt, addr, sizeof(struct sockaddr_in6),
+			       NULL, 0, NULL, NULL);
+	if (r < 0) {
+		net_pkt_unref(first.pkt);
+	}
+
+	return true;
 }
 
 int well_known_core_get(struct coap_resource *resource,
@@ -94,15 +376,15 @@ int well_known_core_get(struct coap_resource *resource,
 	struct coap_packet response;
 	struct sockaddr_in6 from;
 	struct net_pkt *pkt;
-	struct net_buf *frag;
 	int r;
 
 	NET_DBG("");
 
-	pkt = net_pkt_get_tx(context, K_FOREVER);
-	frag = net_pkt_get_data(context, K_FOREVER);
-
-	net_pkt_frag_add(pkt, frag);
+	get_from_ip_addr(request, &from);
+	pkt = get_response_pkt(request, (const struct sockaddr *)&from);
+	if (!pkt) {
+		return -ENOMEM;
+	}
 
 	r = coap_well_known_core_get(resource, request, &response, pkt);
 	if (r < 0) {
@@ -110,15 +392,8 @@ int well_known_core_get(struct coap_resource *resource,
 		return r;
 	}
 
-	get_from_ip_addr(request, &from);
-	r = net_context_sendto(response.pkt, (const struct sockaddr *)&from,
-			       sizeof(struct sockaddr_in6),
-			       NULL, 0, NULL, NULL);
-	if (r < 0) {
-		net_pkt_unref(response.pkt);
-	}
-
-	return r;
+	return send_response(&response, request,
+			     (const struct sockaddr *)&from);
 }
 
 static void payload_dump(const char *s, struct net_buf *frag,
@@ -137,7 +412,6 @@ int test_del(struct coap_resource *resource,
 		    struct coap_packet *request)
 {
 	struct net_pkt *pkt;
-	struct net_buf *frag;
 	struct sockaddr_in6 from;
 	struct coap_packet response;
 	u8_t tkl, code, type;
@@ -155,10 +429,10 @@ int test_del(struct coap_resource *resource,
 	NET_INFO("type: %u code %u id %u\n", type, code, id);
 	NET_INFO("*******\n");
 
-	pkt = net_pkt_get_tx(context, K_FOREVER);
-	frag = net_pkt_get_data(context, K_FOREVER);
-
-	net_pkt_frag_add(pkt, frag);
+	pkt = get_response_pkt(request, (const struct sockaddr *)&from);
+	if (!pkt) {
+		return -ENOMEM;
+	}
 
 	if (type == COAP_TYPE_CON) {
 		type = COAP_TYPE_ACK;
@@ -174,16 +448,14 @@ int test_del(struct coap_resource *resource,
 		return -EINVAL;
 	}
 
-	return net_context_sendto(pkt, (const struct sockaddr *)&from,
-				  sizeof(struct sockaddr_in6),
-				  NULL, 0, NULL, NULL);
+	return send_response(&response, request,
+			     (const struct sockaddr *)&from);
 }
 
 int test_put(struct coap_resource *resource,
 		    struct coap_packet *request)
 {
 	struct net_pkt *pkt;
-	struct net_buf *frag;
 	struct sockaddr_in6 from;
 	struct coap_packet response;
 	u8_t code, type, tkl;
@@ -222,10 +494,10 @@ int test_put(struct coap_resource *resource,
 	payload_dump("put_payload", payloadfrag, offset, len);
 
 next:
-	pkt = net_pkt_get_tx(context, K_FOREVER);
-	frag = net_pkt_get_data(context, K_FOREVER);
-
-	net_pkt_frag_add(pkt, frag);
+	pkt = get_response_pkt(request, (const struct sockaddr *)&from);
+	if (!pkt) {
+		return -ENOMEM;
+	}
 
 	if (type == COAP_TYPE_CON) {
 		type = COAP_TYPE_ACK;
@@ -241,9 +513,8 @@ next:
 		return -EINVAL;
 	}
 
-	return net_context_sendto(pkt, (const struct sockaddr *)&from,
-				  sizeof(struct sockaddr_in6),
-				  NULL, 0, NULL, NULL);
+	return send_response(&response, request,
+			     (const struct sockaddr *)&from);
 }
 
 int test_post(struct coap_resource *resource,
@@ -255,7 +526,6 @@ int test_post(struct coap_resource *resource,
 						      NULL };
 	const char * const *p;
 	struct net_pkt *pkt;
-	struct net_buf *frag;
 	struct sockaddr_in6 from;
 	struct coap_packet response;
 	u8_t code, type, tkl;
@@ -293,10 +563,10 @@ int test_post(struct coap_resource *resource,
 	payload_dump("post_payload", payloadfrag, offset, len);
 
 next:
-	pkt = net_pkt_get_tx(context, K_FOREVER);
-	frag = net_pkt_get_data(context, K_FOREVER);
-
-	net_pkt_frag_add(pkt, frag);
+	pkt = get_response_pkt(request, (const struct sockaddr *)&from);
+	if (!pkt) {
+		return -ENOMEM;
+	}
 
 	if (type == COAP_TYPE_CON) {
 		type = COAP_TYPE_ACK;
@@ -321,9 +591,8 @@ next:
 		}
 	}
 
-	return net_context_sendto(pkt, (const struct sockaddr *)&from,
-				  sizeof(struct sockaddr_in6),
-				  NULL, 0, NULL, NULL);
+	return send_response(&response, request,
+			     (const struct sockaddr *)&from);
 }
 
 int location_query_post(struct coap_resource *resource,
@@ -334,7 +603,6 @@ int location_query_post(struct coap_resource *resource,
 						      NULL };
 	const char * const *p;
 	struct net_pkt *pkt;
-	struct net_buf *frag;
 	struct sockaddr_in6 from;
 	struct coap_packet response;
 	u8_t code, type, tkl;
@@ -354,10 +622,10 @@ int location_query_post(struct coap_resource *resource,
 	NET_INFO("type: %u code %u id %u\n", type, code, id);
 	NET_INFO("*******\n");
 
-	pkt = net_pkt_get_tx(context, K_FOREVER);
-	frag = net_pkt_get_data(context, K_FOREVER);
-
-	net_pkt_frag_add(pkt, frag);
+	pkt = get_response_pkt(request, (const struct sockaddr *)&from);
+	if (!pkt) {
+		return -ENOMEM;
+	}
 
 	if (type == COAP_TYPE_CON) {
 		type = COAP_TYPE_ACK;
@@ -381,16 +649,14 @@ int location_query_post(struct coap_resource *resource,
 		}
 	}
 
-	return net_context_sendto(pkt, (const struct sockaddr *)&from,
-				  sizeof(struct sockaddr_in6),
-				  NULL, 0, NULL, NULL);
+	return send_response(&response, request,
+			     (const struct sockaddr *)&from);
 }
 
 int piggyback_get(struct coap_resource *resource,
 			 struct coap_packet *request)
 {
 	struct net_pkt *pkt;
-	struct net_buf *frag;
 	struct sockaddr_in6 from;
 	struct coap_packet response;
 	u8_t token[8];
@@ -409,10 +675,10 @@ int piggyback_get(struct coap_resource *resource,
 	NET_INFO("type: %u code %u id %u\n", type, code, id);
 	NET_INFO("*******\n");
 
-	pkt = net_pkt_get_tx(context, K_FOREVER);
-	frag = net_pkt_get_data(context, K_FOREVER);
-
-	net_pkt_frag_add(pkt, frag);
+	pkt = get_response_pkt(request, (const struct sockaddr *)&from);
+	if (!pkt) {
+		return -ENOMEM;
+	}
 
 	if (type == COAP_TYPE_CON) {
 		type = COAP_TYPE_ACK;
@@ -436,6 +702,13 @@ int piggyback_get(struct coap_resource *resource,
 		return -EINVAL;
 	}
 
+	/* the payload echoes the Message ID, so it must not be cached */
+	r = coap_append_option_int(&response, COAP_OPTION_MAX_AGE, 0);
+	if (r < 0) {
+		net_pkt_unref(pkt);
+		return -EINVAL;
+	}
+
 	r = coap_packet_append_payload_marker(&response);
 	if (r) {
 		net_pkt_unref(pkt);
@@ -457,9 +730,8 @@ int piggyback_get(struct coap_resource *resource,
 		return -EINVAL;
 	}
 
-	return net_context_sendto(pkt, (const struct sockaddr *)&from,
-				  sizeof(struct sockaddr_in6),
-				  NULL, 0, NULL, NULL);
+	return send_response(&response, request,
+			     (const struct sockaddr *)&from);
 }
 
 int query_get(struct coap_resource *resource,
@@ -467,7 +739,6 @@ int query_get(struct coap_resource *resource,
 {
 	struct coap_option options[4];
 	struct net_pkt *pkt;
-	struct net_buf *frag;
 	struct sockaddr_in6 from;
 	struct coap_packet response;
 	u8_t payload[40], code, type, tkl;
@@ -508,10 +779,10 @@ int query_get(struct coap_resource *resource,
 
 	NET_INFO("*******\n");
 
-	pkt = net_pkt_get_tx(context, K_FOREVER);
-	frag = net_pkt_get_data(context, K_FOREVER);
-
-	net_pkt_frag_add(pkt, frag);
+	pkt = get_response_pkt(request, (const struct sockaddr *)&from);
+	if (!pkt) {
+		return -ENOMEM;
+	}
 
 	r = coap_packet_init(&response, pkt, 1, COAP_TYPE_ACK,
 			     tkl, (u8_t *) token,
@@ -529,6 +800,13 @@ int query_get(struct coap_resource *resource,
 		return -EINVAL;
 	}
 
+	/* the payload echoes the Message ID, so it must not be cached */
+	r = coap_append_option_int(&response, COAP_OPTION_MAX_AGE, 0);
+	if (r < 0) {
+		net_pkt_unref(pkt);
+		return -EINVAL;
+	}
+
 	r = coap_packet_append_payload_marker(&response);
 	if (r) {
 		net_pkt_unref(pkt);
@@ -549,19 +827,17 @@ int query_get(struct coap_resource *resource,
 		return -EINVAL;
 	}
 
-	return net_context_sendto(pkt, (const struct sockaddr *)&from,
-				  sizeof(struct sockaddr_in6),
-				  NULL, 0, NULL, NULL);
+	return send_response(&response, request,
+			     (const struct sockaddr *)&from);
 }
 
 int separate_get(struct coap_resource *resource,
 			struct coap_packet *request)
 {
 	struct net_pkt *pkt;
-	struct net_buf *frag;
 	struct sockaddr_in6 from;
 	struct coap_packet response;
-	struct coap_pending *pending;
+	struct coap_packet protected;
 	u8_t payload[40], code, type, tkl;
 	u8_t token[8];
 	u16_t id;
@@ -581,10 +857,10 @@ int separate_get(struct coap_resource *resource,
 		goto done;
 	}
 
-	pkt = net_pkt_get_tx(context, K_FOREVER);
-	frag = net_pkt_get_data(context, K_FOREVER);
-
-	net_pkt_frag_add(pkt, frag);
+	pkt = get_response_pkt(request, (const struct sockaddr *)&from);
+	if (!pkt) {
+		return -ENOMEM;
+	}
 
 	r = coap_packet_init(&response, pkt, 1, COAP_TYPE_ACK,
 			     tkl, (u8_t *)token, 0, id);
@@ -602,10 +878,12 @@ int separate_get(struct coap_resource *resource,
 	}
 
 done:
-	pkt = net_pkt_get_tx(context, K_FOREVER);
-	frag = net_pkt_get_data(context, K_FOREVER);
-
-	net_pkt_frag_add(pkt, frag);
+	/* a confirmable request was acknowledged already, don't answer it
+	 * with 5.03
+	 */
+	if (pkt_pool_get(false, OSCORE_PKT_TIMEOUT_MS, &pkt) != OscoreNoError) {
+		return -ENOMEM;
+	}
 
 	if (type == COAP_TYPE_CON) {
 		type = COAP_TYPE_CON;
@@ -629,6 +907,13 @@ done:
 		return -EINVAL;
 	}
 
+	/* the payload echoes the Message ID, so it must not be cached */
+	r = coap_append_option_int(&response, COAP_OPTION_MAX_AGE, 0);
+	if (r < 0) {
+		net_pkt_unref(pkt);
+		return -EINVAL;
+	}
+
 	r = coap_packet_append_payload_marker(&response);
 	if (r) {
 		net_pkt_unref(pkt);
@@ -650,24 +935,24 @@ done:
 		return -EINVAL;
 	}
 
-	if (type == COAP_TYPE_CON) {
-		pending = coap_pending_next_unused(pendings, NUM_PENDINGS);
-		if (!pending) {
-			net_pkt_unref(pkt);
-			return -EINVAL;
+	/* the empty ACK isn't protected, but the separate response is, and
+	 * retransmissions repeat the protected message
+	 */
+	if (has_oscore_option(request)) {
+		r = protect_response(&response, request, &protected);
+		if (r < 0) {
+			return r;
 		}
+		response = protected;
+		pkt = response.pkt;
+	}
 
-		r = coap_pending_init(pending, &response,
-				      (const struct sockaddr *)&from);
-		if (r) {
+	if (type == COAP_TYPE_CON) {
+		r = retransmit_add(&response, (const struct sockaddr *)&from);
+		if (r < 0) {
 			net_pkt_unref(pkt);
 			return -EINVAL;
 		}
-
-		coap_pending_cycle(pending);
-		pending = coap_pending_next_to_expire(pendings, NUM_PENDINGS);
-
-		k_delayed_work_submit(&retransmit_work, pending->timeout);
 	}
 
 	return net_context_sendto(pkt, (const struct sockaddr *)&from,
@@ -678,9 +963,8 @@ done:
 int large_get(struct coap_resource *resource,
 		     struct coap_packet *request)
 {
-	static struct coap_block_context ctx;
+	struct coap_block_context *ctx;
 	struct net_pkt *pkt;
-	struct net_buf *frag;
 	struct sockaddr_in6 from;
 	struct coap_packet response;
 	u8_t token[8], code, type;
@@ -690,17 +974,19 @@ int large_get(struct coap_resource *resource,
 	u8_t tkl;
 	int r;
 
-	if (ctx.total_size == 0) {
-		coap_block_transfer_init(&ctx, COAP_BLOCK_64,
+	get_from_ip_addr(request, &from);
+	ctx = block_session_get((const struct sockaddr *)&from, resource);
+
+	if (ctx->total_size == 0) {
+		coap_block_transfer_init(ctx, COAP_BLOCK_64,
 					 BLOCK_WISE_TRANSFER_SIZE_GET);
 	}
 
-	r = coap_update_from_block(request, &ctx);
+	r = coap_update_from_block(request, ctx);
 	if (r < 0) {
 		return -EINVAL;
 	}
 
-	get_from_ip_addr(request, &from);
 	code = coap_header_get_code(request);
 	type = coap_header_get_type(request);
 	id = coap_header_get_id(request);
@@ -710,10 +996,10 @@ int large_get(struct coap_resource *resource,
 	NET_INFO("type: %u code %u id %u\n", type, code, id);
 	NET_INFO("*******\n");
 
-	pkt = net_pkt_get_tx(context, K_FOREVER);
-	frag = net_pkt_get_data(context, K_FOREVER);
-
-	net_pkt_frag_add(pkt, frag);
+	pkt = get_response_pkt(request, (const struct sockaddr *)&from);
+	if (!pkt) {
+		return -ENOMEM;
+	}
 
 	r = coap_packet_init(&response, pkt, 1, COAP_TYPE_ACK,
 			     tkl, (u8_t *) token,
@@ -729,7 +1015,7 @@ int large_get(struct coap_resource *resource,
 		return -EINVAL;
 	}
 
-	r = coap_append_block2_option(&response, &ctx);
+	r = coap_append_block2_option(&response, ctx);
 	if (r < 0) {
 		return -EINVAL;
 	}
@@ -740,8 +1026,8 @@ int large_get(struct coap_resource *resource,
 		return -EINVAL;
 	}
 
-	size = min(coap_block_size_to_bytes(ctx.block_size),
-		   ctx.total_size - ctx.current);
+	size = min(coap_block_size_to_bytes(ctx->block_size),
+		   ctx->total_size - ctx->current);
 
 	memset(payload, 'A', size);
 
@@ -751,15 +1037,15 @@ int large_get(struct coap_resource *resource,
 		return -EINVAL;
 	}
 
-	r = coap_next_block(&response, &ctx);
+	r = coap_next_block(&response, ctx);
 	if (!r) {
 		/* Will return 0 when it's the last block. */
-		memset(&ctx, 0, sizeof(ctx));
+		block_session_end(ctx);
 	}
 
-	return net_context_sendto(pkt, (const struct sockaddr *)&from,
-				  sizeof(struct sockaddr_in6),
-				  NULL, 0, NULL, NULL);
+	/* Block options of OSCORE requests are Inner options */
+	return send_response(&response, request,
+			     (const struct sockaddr *)&from);
 }
 
 static int get_option_int(const struct coap_packet *pkt, u8_t opt)
@@ -778,7 +1064,7 @@ static int get_option_int(const struct coap_packet *pkt, u8_t opt)
 int large_update_put(struct coap_resource *resource,
 			    struct coap_packet *request)
 {
-	static struct coap_block_context ctx;
+	struct coap_block_context *ctx;
 	struct net_pkt *pkt;
 	struct net_buf *frag;
 	struct sockaddr_in6 from;
@@ -798,12 +1084,15 @@ int large_update_put(struct coap_resource *resource,
 
 	last_block = !GET_MORE(r);
 
+	get_from_ip_addr(request, &from);
+	ctx = block_session_get((const struct sockaddr *)&from, resource);
+
 	/* initialize block context upon the arrival of first block */
 	if (!GET_BLOCK_NUM(r)) {
-		coap_block_transfer_init(&ctx, COAP_BLOCK_64, 0);
+		coap_block_transfer_init(ctx, COAP_BLOCK_64, 0);
 	}
 
-	r = coap_update_from_block(request, &ctx);
+	r = coap_update_from_block(request, ctx);
 	if (r < 0) {
 		NET_ERR("Invalid block size option from request");
 		return -EINVAL;
@@ -817,11 +1106,10 @@ int large_update_put(struct coap_resource *resource,
 
 	NET_INFO("**************\n");
 	NET_INFO("[ctx] current %u block_size %u total_size %u\n",
-		 ctx.current, coap_block_size_to_bytes(ctx.block_size),
-		 ctx.total_size);
+		 ctx->current, coap_block_size_to_bytes(ctx->block_size),
+		 ctx->total_size);
 	NET_INFO("**************\n");
 
-	get_from_ip_addr(request, &from);
 	code = coap_header_get_code(request);
 	type = coap_header_get_type(request);
 	id = coap_header_get_id(request);
@@ -833,10 +1121,10 @@ int large_update_put(struct coap_resource *resource,
 
 	/* Do something with the payload */
 
-	pkt = net_pkt_get_tx(context, K_FOREVER);
-	frag = net_pkt_get_data(context, K_FOREVER);
-
-	net_pkt_frag_add(pkt, frag);
+	pkt = get_response_pkt(request, (const struct sockaddr *)&from);
+	if (!pkt) {
+		return -ENOMEM;
+	}
 
 	if (!last_block) {
 		code = COAP_RESPONSE_CODE_CONTINUE;
@@ -850,21 +1138,24 @@ int large_update_put(struct coap_resource *resource,
 		return -EINVAL;
 	}
 
-	r = coap_append_block1_option(&response, &ctx);
+	r = coap_append_block1_option(&response, ctx);
 	if (r < 0) {
 		NET_ERR("Could not add Block1 option to response");
 		return -EINVAL;
 	}
 
-	return net_context_sendto(pkt, (const struct sockaddr *)&from,
-				  sizeof(struct sockaddr_in6),
-				  NULL, 0, NULL, NULL);
+	if (last_block) {
+		block_session_end(ctx);
+	}
+
+	return send_response(&response, request,
+			     (const struct sockaddr *)&from);
 }
 
 int large_create_post(struct coap_resource *resource,
 			     struct coap_packet *request)
 {
-	static struct coap_block_context ctx;
+	struct coap_block_context *ctx;
 	struct net_pkt *pkt;
 	struct net_buf *frag;
 	struct sockaddr_in6 from;
@@ -883,12 +1174,15 @@ int large_create_post(struct coap_resource *resource,
 
 	last_block = !GET_MORE(r);
 
+	get_from_ip_addr(request, &from);
+	ctx = block_session_get((const struct sockaddr *)&from, resource);
+
 	/* initialize block context upon the arrival of first block */
 	if (!GET_BLOCK_NUM(r)) {
-		coap_block_transfer_init(&ctx, COAP_BLOCK_32, 0);
+		coap_block_transfer_init(ctx, COAP_BLOCK_32, 0);
 	}
 
-	r = coap_update_from_block(request, &ctx);
+	r = coap_update_from_block(request, ctx);
 	if (r < 0) {
 		NET_ERR("Invalid block size option from request");
 		return -EINVAL;
@@ -900,7 +1194,6 @@ int large_create_post(struct coap_resource *resource,
 		return -EINVAL;
 	}
 
-	get_from_ip_addr(request, &from);
 	code = coap_header_get_code(request);
 	type = coap_header_get_type(request);
 	id = coap_header_get_id(request);
@@ -910,9 +1203,10 @@ int large_create_post(struct coap_resource *resource,
 	NET_INFO("type: %u code %u id %u\n", type, code, id);
 	NET_INFO("*******\n");
 
-	pkt = net_pkt_get_tx(context, K_FOREVER);
-	frag = net_pkt_get_data(context, K_FOREVER);
-	net_pkt_frag_add(pkt, frag);
+	pkt = get_response_pkt(request, (const struct sockaddr *)&from);
+	if (!pkt) {
+		return -ENOMEM;
+	}
 
 	if (!last_block) {
 		code = COAP_RESPONSE_CODE_CONTINUE;
@@ -926,20 +1220,32 @@ int large_create_post(struct coap_resource *resource,
 		return -EINVAL;
 	}
 
-	r = coap_append_block1_option(&response, &ctx);
+	r = coap_append_block1_option(&response, ctx);
 	if (r < 0) {
 		NET_ERR("Could not add Block1 option to response");
 		return -EINVAL;
 	}
 
-	return net_context_sendto(pkt, (const struct sockaddr *)&from,
-				  sizeof(struct sockaddr_in6),
-				  NULL, 0, NULL, NULL);
+	if (last_block) {
+		block_session_end(ctx);
+	}
+
+	return send_response(&response, request,
+			     (const struct sockaddr *)&from);
 }
 
 static void update_counter(struct k_work *work)
 {
+	/* notifications are protected from the work queue, too */
+	if (context_store_save_if_due() != OscoreNoError) {
+		NET_ERR("Could not save the security contexts\n");
+	}
+
 	obs_counter++;
+	/* the resource changed, the next protected notification needs to
+	 * be encoded again
+	 */
+	notification_valid = false;
 
 	if (resource_to_notify) {
 		coap_resource_notify(resource_to_notify);
@@ -948,33 +1254,22 @@ static void update_counter(struct k_work *work)
 	k_delayed_work_submit(&observer_work, 5 * MSEC_PER_SEC);
 }
 
-static int send_notification_packet(const struct sockaddr *addr, u16_t age,
-				    socklen_t addrlen, u16_t id,
-				    const u8_t *token, u8_t tkl,
-				    bool is_response)
+/* Builds the counter representation of /obs. A Max-Age Option is added
+ * unless @a max_age is negative.
+ */
+static int build_notification_packet(struct coap_packet *response, u16_t age,
+				     int max_age, u8_t type, u16_t id,
+				     const u8_t *token, u8_t tkl)
 {
-	struct coap_packet response;
-	struct coap_pending *pending;
 	struct net_pkt *pkt;
-	struct net_buf *frag;
 	char payload[14];
-	u8_t type = COAP_TYPE_CON;
 	int r;
 
-	if (is_response) {
-		type = COAP_TYPE_ACK;
-	}
-
-	if (!is_response) {
-		id = coap_next_id();
+	if (pkt_pool_get(false, OSCORE_PKT_TIMEOUT_MS, &pkt) != OscoreNoError) {
+		return -ENOMEM;
 	}
 
-	pkt = net_pkt_get_tx(context, K_FOREVER);
-	frag = net_pkt_get_data(context, K_FOREVER);
-
-	net_pkt_frag_add(pkt, frag);
-
-	r = coap_packet_init(&response, pkt, 1, type,
+	r = coap_packet_init(response, pkt, 1, type,
 			     tkl, (u8_t *)token,
 			     COAP_RESPONSE_CODE_CONTENT, id);
 	if (r < 0) {
@@ -983,10 +1278,10 @@ static int send_notification_packet(const struct sockaddr *addr, u16_t age,
 	}
 
 	if (age >= 2) {
-		coap_append_option_int(&response, COAP_OPTION_OBSERVE, age);
+		coap_append_option_int(response, COAP_OPTION_OBSERVE, age);
 	}
 
-	r = coap_packet_append_option(&response, COAP_OPTION_CONTENT_FORMAT,
+	r = coap_packet_append_option(response, COAP_OPTION_CONTENT_FORMAT,
 				      &plain_text_format,
 				      sizeof(plain_text_format));
 	if (r < 0) {
@@ -994,7 +1289,19 @@ static int send_notification_packet(const struct sockaddr *addr, u16_t age,
 		return -EINVAL;
 	}
 
-	r = coap_packet_append_payload_marker(&response);
+	/* options are appended in ascending order, Max-Age follows
+	 * Content-Format
+	 */
+	if (max_age >= 0) {
+		r = coap_append_option_int(response, COAP_OPTION_MAX_AGE,
+					   max_age);
+		if (r < 0) {
+			net_pkt_unref(pkt);
+			return -EINVAL;
+		}
+	}
+
+	r = coap_packet_append_payload_marker(response);
 	if (r) {
 		net_pkt_unref(pkt);
 		return -EINVAL;
@@ -1004,46 +1311,134 @@ static int send_notification_packet(const struct sockaddr *addr, u16_t age,
 	r = snprintk((char *) payload, sizeof(payload),
 		     "Counter: %d\n", obs_counter);
 	if (r < 0) {
+		net_pkt_unref(pkt);
 		return -EINVAL;
 	}
 
-	r = coap_packet_append_payload(&response, (u8_t *)payload,
+	r = coap_packet_append_payload(response, (u8_t *)payload,
 				       strlen(payload));
 	if (r < 0) {
 		net_pkt_unref(pkt);
 		return -EINVAL;
 	}
 
-	if (type == COAP_TYPE_CON) {
-		pending = coap_pending_next_unused(pendings, NUM_PENDINGS);
-		if (!pending) {
+	return 0;
+}
+
+static int send_notification(struct coap_packet *response,
+			     const struct sockaddr *addr, socklen_t addrlen)
+{
+	int r;
+
+	if (coap_header_get_type(response) == COAP_TYPE_CON) {
+		r = retransmit_add(response, addr);
+		if (r < 0) {
+			net_pkt_unref(response->pkt);
 			return -EINVAL;
 		}
+	}
+
+	return net_context_sendto(response->pkt, addr, addrlen,
+				  NULL, 0, NULL, NULL);
+}
+
+static int send_notification_packet(const struct sockaddr *addr, u16_t age,
+				    socklen_t addrlen, u16_t id,
+				    const u8_t *token, u8_t tkl,
+				    bool is_response)
+{
+	struct coap_packet response;
+	u8_t type = COAP_TYPE_CON;
+	int r;
+
+	if (is_response) {
+		type = COAP_TYPE_ACK;
+	}
+
+	if (!is_response) {
+		id = coap_next_id();
+	}
+
+	r = build_notification_packet(&response, age, -1, type, id, token,
+				      tkl);
+	if (r < 0) {
+		return r;
+	}
+
+	return send_notification(&response, addr, addrlen);
+}
+
+static int send_protected_notification_packet(struct oscore_request *registration,
+					      const struct sockaddr *addr,
+					      u16_t age, socklen_t addrlen,
+					      u16_t id, const u8_t *token,
+					      u8_t tkl, bool is_response)
+{
+	struct coap_packet response;
+	struct coap_packet plain;
+	u8_t type = COAP_TYPE_CON;
+	int r;
+
+	if (is_response) {
+		type = COAP_TYPE_ACK;
+	}
 
-		r = coap_pending_init(pending, &response, addr);
-		if (r) {
+	if (!is_response) {
+		id = coap_next_id();
+	}
+
+	/* The plaintext only depends on the resource state, not on the
+	 * observer, thus it's encoded once and protected for every observer.
+	 */
+	if (!notification_valid || notification_age != age) {
+		r = build_notification_packet(&plain, age, -1, type, id, token,
+					      tkl);
+		if (r < 0) {
+			return r;
+		}
+
+		array buffer = {
+			.len = sizeof(notification_plaintext),
+			.ptr = notification_plaintext,
+		};
+		r = oscore_inner_encode(&plain, buffer, &notification);
+		net_pkt_unref(plain.pkt);
+		if (r != OscoreNoError) {
+			NET_ERR("Could not encode notification (%d)\n", r);
 			return -EINVAL;
 		}
 
-		coap_pending_cycle(pending);
-		pending = coap_pending_next_to_expire(pendings, NUM_PENDINGS);
+		notification_age = age;
+		notification_valid = true;
+	}
 
-		k_delayed_work_submit(&retransmit_work, pending->timeout);
+	r = into_oscore_notification(&notification, registration, type,
+				     token, tkl, id, &response);
+	if (r != OscoreNoError) {
+		NET_ERR("Could not protect notification (%d)\n", r);
+		return -EINVAL;
+	}
+
+	if (is_response) {
+		dedup_add(&response, addr);
 	}
 
-	return net_context_sendto(pkt, addr, addrlen, NULL, 0, NULL, NULL);
+	return send_notification(&response, addr, addrlen);
 }
 
 int obs_get(struct coap_resource *resource,
 		   struct coap_packet *request)
 {
-	struct coap_observer *observer;
+	struct coap_observer *observer = NULL;
 	struct sockaddr_in6 from;
 	u8_t token[8];
 	u8_t code, type;
 	u16_t id;
 	u8_t tkl;
 	bool observe = true;
+	bool oscore = has_oscore_option(request);
+	struct coap_packet response;
+	int r;
 
 	get_from_ip_addr(request, &from);
 
@@ -1057,6 +1452,18 @@ int obs_get(struct coap_resource *resource,
 		return -ENOMEM;
 	}
 
+	if (oscore) {
+		struct observer_security *security =
+			&observer_security[observer - observers];
+
+		r = oscore_request_init(request, &security->registration);
+		if (r != OscoreNoError) {
+			NET_ERR("Invalid OSCORE registration (%d)\n", r);
+			return -EINVAL;
+		}
+	}
+	observer_security[observer - observers].oscore = oscore;
+
 	coap_observer_init(observer, request,
 			   (const struct sockaddr *)&from);
 
@@ -1074,6 +1481,25 @@ done:
 	NET_INFO("type: %u code %u id %u\n", type, code, id);
 	NET_INFO("*******\n");
 
+	if (oscore && observe) {
+		return send_protected_notification_packet(
+			&observer_security[observer - observers].registration,
+			(const struct sockaddr *)&from, resource->age,
+			sizeof(struct sockaddr_in6), id, token, tkl, true);
+	}
+
+	if (oscore) {
+		/* the counter changes, so the response must not be cached */
+		r = build_notification_packet(&response, 0, 0, COAP_TYPE_ACK,
+					      id, token, tkl);
+		if (r < 0) {
+			return r;
+		}
+
+		return send_response(&response, request,
+				     (const struct sockaddr *)&from);
+	}
+
 	return send_notification_packet((const struct sockaddr *)&from,
 					observe ? resource->age : 0,
 					sizeof(struct sockaddr_in6), id,
@@ -1083,6 +1509,19 @@ done:
 void obs_notify(struct coap_resource *resource,
 		       struct coap_observer *observer)
 {
+	struct observer_security *security =
+		&observer_security[observer - observers];
+
+	if (security->oscore) {
+		send_protected_notification_packet(&security->registration,
+						   &observer->addr,
+						   resource->age,
+						   sizeof(observer->addr), 0,
+						   observer->token,
+						   observer->tkl, false);
+		return;
+	}
+
 	send_notification_packet(&observer->addr, resource->age,
 				 sizeof(observer->addr), 0,
 				 observer->token, observer->tkl, false);
@@ -1093,7 +1532,6 @@ int core_get(struct coap_resource *resource,
 {
 	static const char dummy_str[] = "Just a test\n";
 	struct net_pkt *pkt;
-	struct net_buf *frag;
 	struct sockaddr_in6 from;
 	struct coap_packet response;
 	u8_t tkl;
@@ -1105,10 +1543,10 @@ int core_get(struct coap_resource *resource,
 	id = coap_header_get_id(request);
 	tkl = coap_header_get_token(request, token);
 
-	pkt = net_pkt_get_tx(context, K_FOREVER);
-	frag = net_pkt_get_data(context, K_FOREVER);
-
-	net_pkt_frag_add(pkt, frag);
+	pkt = get_response_pkt(request, (const struct sockaddr *)&from);
+	if (!pkt) {
+		return -ENOMEM;
+	}
 
 	r = coap_packet_init(&response, pkt, 1, COAP_TYPE_ACK,
 			     tkl, (u8_t *)token,
@@ -1130,11 +1568,87 @@ int core_get(struct coap_resource *resource,
 		return -EINVAL;
 	}
 
-	return net_context_sendto(pkt, (const struct sockaddr *)&from,
-				  sizeof(struct sockaddr_in6),
-				  NULL, 0, NULL, NULL);
+	return send_response(&response, request,
+			     (const struct sockaddr *)&from);
 }
 
+#ifdef OSCORE_TRACE
+/* as many records as fit into a single response */
+#define TRACE_DUMP_EVENTS 32
+
+int trace_get(struct coap_resource *resource,
+	      struct coap_packet *request)
+{
+	/* application/octet-stream */
+	static const u8_t octet_stream_format = 42;
+	static struct trace_event events[TRACE_DUMP_EVENTS];
+	struct sockaddr_in6 from;
+	struct coap_packet response;
+	struct net_pkt *pkt;
+	struct net_buf *frag;
+	size_t count;
+	u8_t type;
+	u8_t tkl;
+	u8_t token[8];
+	int r;
+
+	get_from_ip_addr(request, &from);
+	tkl = coap_header_get_token(request, token);
+
+	type = COAP_TYPE_NON_CON;
+	if (coap_header_get_type(request) == COAP_TYPE_CON) {
+		type = COAP_TYPE_ACK;
+	}
+
+	pkt = get_response_pkt(request, (const struct sockaddr *)&from);
+	if (!pkt) {
+		return -ENOMEM;
+	}
+
+	r = coap_packet_init(&response, pkt, 1, type, tkl, token,
+			     COAP_RESPONSE_CODE_CONTENT,
+			     coap_header_get_id(request));
+	if (r < 0) {
+		net_pkt_unref(pkt);
+		return -EINVAL;
+	}
+
+	r = coap_packet_append_option(&response, COAP_OPTION_CONTENT_FORMAT,
+				      &octet_stream_format,
+				      sizeof(octet_stream_format));
+	if (r < 0) {
+		net_pkt_unref(pkt);
+		return -EINVAL;
+	}
+
+	/* the ring buffer changes with every message, so it is never cached */
+	r = coap_append_option_int(&response, COAP_OPTION_MAX_AGE, 0);
+	if (r < 0) {
+		net_pkt_unref(pkt);
+		return -EINVAL;
+	}
+
+	count = trace_dump(events, TRACE_DUMP_EVENTS);
+	if (count > 0) {
+		r = coap_packet_append_payload_marker(&response);
+		if (r < 0) {
+			net_pkt_unref(pkt);
+			return -EINVAL;
+		}
+
+		r = coap_packet_append_payload(&response, (u8_t *)events,
+					       count * sizeof(events[0]));
+		if (r < 0) {
+			net_pkt_unref(pkt);
+			return -EINVAL;
+		}
+	}
+
+	return send_response(&response, request,
+			     (const struct sockaddr *)&from);
+}
+#endif
+
 static struct coap_resource *find_resouce_by_observer(
 	struct coap_resource *resources, struct coap_observer *o)
 {
@@ -1159,12 +1673,20 @@ static void udp_receive(struct net_context *context,
 			void *user_data)
 {
 	struct coap_packet request;
-	struct coap_pending *pending;
 	struct sockaddr_in6 from;
 	struct coap_option options[16] = { 0 };
 	u8_t opt_num = 16;
 	int r;
 
+	trace(TraceReceived, 0, net_pkt_get_len(pkt));
+
+	/* reserve the next sequence numbers before the response to this
+	 * request needs one
+	 */
+	if (context_store_save_if_due() != OscoreNoError) {
+		NET_ERR("Could not save the security contexts\n");
+	}
+
 	r = coap_packet_parse(&request, pkt, options, opt_num);
 	if (r < 0) {
 		NET_ERR("Invalid data received (%d)\n", r);
@@ -1172,12 +1694,69 @@ static void udp_receive(struct net_context *context,
 		return;
 	}
 
-	SYS_LOG_INF("try getting oscore option value");
+	get_from_ip_addr(&request, &from);
+
+	/* answer duplicates with the stored response before spending any
+	 * work on decryption
+	 */
+	if (dedup_replay(&request, (struct sockaddr *)&from)) {
+		net_pkt_unref(pkt);
+		return;
+	}
+
 	if (get_option_value(options, opt_num, COAP_OPTION_OSCORE).ptr != NULL) {
-		SYS_LOG_INF("OSCORE option value found");
+		/* further blocks of a fragmented response are sent from the
+		 * stored ciphertext
+		 */
+		if (outer_block_serve(&request, (struct sockaddr *)&from)) {
+			net_pkt_unref(pkt);
+			return;
+		}
+
+		/* drop junk before it takes a reassembly buffer or any
+		 * decryption work
+		 */
+		r = oscore_prefilter(&request);
+		if (r != OscoreNoError) {
+			trace(TracePrefiltered, r, net_pkt_get_len(pkt));
+			net_pkt_unref(pkt);
+			return;
+		}
+
+		/* throttle peers before they cost any crypto, the prefilter
+		 * made sure the OSCORE option can be decoded
+		 */
+		struct oscore_request peer;
+		if (oscore_request_init(&request, &peer) != OscoreNoError ||
+		    !rate_limit_allow((struct sockaddr *)&from, peer.kid,
+				      peer.kid_len)) {
+			trace(TraceRateLimited, 0, net_pkt_get_len(pkt));
+			net_pkt_unref(pkt);
+			return;
+		}
+
+		/* collect all blocks before the message can be decrypted */
+		r = outer_block_reassemble(&request, (struct sockaddr *)&from);
+		if (r < 0) {
+			net_pkt_unref(request.pkt);
+			return;
+		}
+		pkt = request.pkt;
+
 		// decrypt / unpack OSCORE message
 		struct coap_packet decrypted;
-		try_oscore_void(from_oscore(request, &decrypted) != OscoreNoError);
+		OscoreError e = from_oscore(request, &decrypted);
+		rate_limit_report((struct sockaddr *)&from, peer.kid,
+				  peer.kid_len, e);
+		if (e == OscorePktError) {
+			send_service_unavailable(&request,
+						 (struct sockaddr *)&from);
+		}
+		if (e == OscoreEchoRequired) {
+			send_echo_challenge(&request,
+					    (struct sockaddr *)&from);
+		}
+		try_oscore_void(e);
 		request = decrypted;
 		pkt = decrypted.pkt;
 		// parse decrypted packet to switch based on that
@@ -1187,14 +1766,24 @@ static void udp_receive(struct net_context *context,
 			net_pkt_unref(pkt);
 			return;
 		}
-	} else {
-		SYS_LOG_INF("no OSCORE option value found :(");
+
+		if (coap_header_get_code(&request) == COAP_METHOD_GET &&
+		    send_cached_response(&request, (struct sockaddr *)&from)) {
+			net_pkt_unref(pkt);
+			return;
+		}
 	}
 
-	get_from_ip_addr(&request, &from);
-	pending = coap_pending_received(&request, pendings,
-					NUM_PENDINGS);
-	if (!pending) {
+	/* unsafe requests might change any resource */
+	switch (coap_header_get_code(&request)) {
+	case COAP_METHOD_POST:
+	case COAP_METHOD_PUT:
+	case COAP_METHOD_DELETE:
+		response_cache_clear();
+		break;
+	}
+
+	if (!retransmit_received(&request, (struct sockaddr *)&from)) {
 		goto not_found;
 	}
 
@@ -1273,38 +1862,6 @@ static bool join_coap_multicast_group(void)
 	return true;
 }
 
-static void retransmit_request(struct k_work *work)
-{
-	struct coap_pending *pending;
-	int r;
-
-	pending = coap_pending_next_to_expire(pendings, NUM_PENDINGS);
-	if (!pending) {
-		return;
-	}
-
-	/* ref to avoid being freed by sendto() */
-	net_pkt_ref(pending->pkt);
-
-	r = net_context_sendto(pending->pkt, &pending->addr,
-			       sizeof(struct sockaddr_in6),
-			       NULL, 0, NULL, NULL);
-	if (r < 0) {
-		/* no error, keeps retry */
-		net_pkt_unref(pending->pkt);
-	}
-
-	if (!coap_pending_cycle(pending)) {
-		/* last retransmit, clear pending and unreference packet */
-		coap_pending_clear(pending);
-		return;
-	}
-
-	/* unref to balance ref made previously */
-	net_pkt_unref(pending->pkt);
-	k_delayed_work_submit(&retransmit_work, pending->timeout);
-}
-
 void coap_server_init()
 {
 	static struct sockaddr_in6 any_addr = {
@@ -1324,6 +1881,8 @@ void coap_server_init()
 		return;
 	}
 
+	pkt_pool_setup(context);
+
 	r = net_context_bind(context, (struct sockaddr *) &any_addr,
 			     sizeof(any_addr));
 	if (r) {
@@ -1331,7 +1890,12 @@ void coap_server_init()
 		return;
 	}
 
-	k_delayed_work_init(&retransmit_work, retransmit_request);
+	retransmit_init();
+	dedup_init();
+	response_cache_init();
+	block_session_init();
+	outer_block_init();
+	rate_limit_init();
 
 	k_delayed_work_init(&observer_work, update_counter);
 	k_delayed_work_submit(&observer_work, 5 * MSEC_PER_SEC);
@@ -12,15 +12,27 @@
 
 #include <sys_io.h>
 #include <net/coap.h>
+#include "../oscore/coap_helper.h"
 
 extern struct net_context *context;
 static const u8_t plain_text_format;
 
 void coap_server_init();
+/**
+ * Sends a locally built response. If the request was an OSCORE request, the
+ * response is protected, and kept in the response cache if it is cacheable.
+ * The response packet is consumed.
+ */
+int send_response(struct coap_packet *response, struct coap_packet *request,
+                  const struct sockaddr *addr);
+/**
+ * Answers a request with an unprotected 5.03 (Service Unavailable) if no
+ * packet is left to build or protect its response.
+ */
+int send_service_unavailable(struct coap_packet *request,
+                             const struct sockaddr *addr);
 int piggyback_get(struct coap_resource *resource,
                          struct coap_packet *request);
-void get_from_ip_addr(struct coap_packet *cpkt,
-                             struct sockaddr_in6 *from);
 int test_post(struct coap_resource *resource,
                      struct coap_packet *request);
 int test_del(struct coap_resource *resource,
@@ -47,5 +59,13 @@ int well_known_core_get(struct coap_resource *resource,
                                struct coap_packet *request);
 int core_get(struct coap_resource *resource,
                     struct coap_packet *request);
+#ifdef OSCORE_TRACE
+/**
+ * Answers with the newest trace records as `struct trace_event` array,
+ * see util/trace.h.
+ */
+int trace_get(struct coap_resource *resource,
+              struct coap_packet *request);
+#endif
 
 #endif //NONE_COAP_SERVER_H
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <string.h>
+#include <kernel.h>
+#include <flash.h>
+#include <generated_dts_board.h>
+#include "context_store.h"
+#include "../crypto/hkdf.h"
+#include "../oscore/snapshot.h"
+
+/// A snapshot of up to OSCORE_MAX_CONTEXTS peers and the big-endian generation in the last 4 bytes, the length is
+/// a multiple of the flash's write block of 4 bytes
+#define RECORD_LEN ((SNAPSHOT_HEADER_LEN + OSCORE_MAX_CONTEXTS * SNAPSHOT_ENTRY_LEN + SNAPSHOT_TAG_LEN + 4 + 3) & ~3)
+#define SLOT_SIZE ((RECORD_LEN + CONTEXT_STORE_PAGE_SIZE - 1) / CONTEXT_STORE_PAGE_SIZE * CONTEXT_STORE_PAGE_SIZE)
+#define NUM_SLOTS (CONTEXT_STORE_SIZE / SLOT_SIZE)
+
+static struct device* flash;
+static u8_t key_bytes[32];
+/// the record which is read or written, too large for the stack
+static u8_t record[RECORD_LEN];
+/// slot of the latest snapshot and its generation, the next one is written to the following slot
+static u8_t current_slot;
+static u32_t generation;
+/// the RX thread and the work queue sending notifications both save, `record` and the slots are shared
+static struct k_mutex lock;
+
+static const array key = {
+    .len = sizeof(key_bytes),
+    .ptr = key_bytes,
+};
+
+static off_t slot_offset(u8_t slot) {
+    return CONTEXT_STORE_OFFSET + slot * SLOT_SIZE;
+}
+
+/**
+ * Reads the record of @a slot into `record` and checks its snapshot.
+ * @param slot Slot to read
+ * @param snapshot out-pointer to the snapshot in `record`
+ * @param gen out-pointer to the generation of the record
+ * @return OscoreError, OscoreInvalidSnapshot if the slot is empty or its snapshot was modified
+ */
+static OscoreError read_slot(u8_t slot, array* snapshot, u32_t* gen) {
+    ensure(flash_read(flash, slot_offset(slot), record, sizeof(record)) == 0, OscoreStorageError);
+    // an erased slot has no valid header, the count is only checked to stay within the record
+    size_t count = (size_t) ((record[7] << 8) | record[8]);
+    ensure(count <= OSCORE_MAX_CONTEXTS, OscoreInvalidSnapshot);
+    snapshot->ptr = record;
+    snapshot->len = snapshot_len(count);
+    size_t peers;
+    try(snapshot_verify(key, *snapshot, &peers));
+    const u8_t* g = &record[RECORD_LEN - 4];
+    *gen = ((u32_t) g[0] << 24) | ((u32_t) g[1] << 16) | ((u32_t) g[2] << 8) | g[3];
+    return OscoreNoError;
+}
+
+/// Writes a new snapshot into the slot after the one holding the latest snapshot, the oldest one
+static OscoreError save(void) {
+    array snapshot = {
+        .len = oscore_snapshot_len(),
+        .ptr = record,
+    };
+    ensure(snapshot.len <= RECORD_LEN - 4, OscoreOutTooLong);
+    memset(record, 0xff, sizeof(record));
+    try(oscore_snapshot_save(key, snapshot));
+    u32_t gen = generation + 1;
+    u8_t* g = &record[RECORD_LEN - 4];
+    g[0] = (u8_t) (gen >> 24);
+    g[1] = (u8_t) (gen >> 16);
+    g[2] = (u8_t) (gen >> 8);
+    g[3] = (u8_t) gen;
+
+    u8_t slot = (u8_t) ((current_slot + 1) % NUM_SLOTS);
+    int r = flash_write_protection_set(flash, false);
+    if (r == 0) {
+        r = flash_erase(flash, slot_offset(slot), SLOT_SIZE);
+    }
+    // some drivers enable the protection again after every erase
+    if (r == 0) {
+        r = flash_write_protection_set(flash, false);
+    }
+    if (r == 0) {
+        r = flash_write(flash, slot_offset(slot), record, sizeof(record));
+    }
+    flash_write_protection_set(flash, true);
+    ensure(r == 0, OscoreStorageError);
+    current_slot = slot;
+    generation = gen;
+    return OscoreNoError;
+}
+
+OscoreError context_store_load(const struct pre_established* pre_established, size_t count) {
+    ensure(count > 0, OscoreTooManyContexts);
+    k_mutex_init(&lock);
+    // two slots at least, so a reset during a write leaves the previous snapshot
+    ensure(NUM_SLOTS >= 2 && NUM_SLOTS <= 255, OscoreStorageError);
+    flash = device_get_binding(CONFIG_SOC_FLASH_NRF5_DEV_NAME);
+    ensure(flash != NULL, OscoreStorageError);
+    const u8_t info[] = "OSCORE snapshot";
+    array info_array = {
+        .len = sizeof(info) - 1,
+        .ptr = (u8_t*) info,
+    };
+    try(hkdf_sha256(EMPTY_ARRAY, pre_established[0].master_secret, info_array, key));
+
+    // the slot with the largest generation holds the latest snapshot
+    array snapshot;
+    bool found = false;
+    for (u8_t slot = 0; slot < NUM_SLOTS; slot++) {
+        u32_t gen;
+        OscoreError e = read_slot(slot, &snapshot, &gen);
+        ensure(e != OscoreStorageError, OscoreStorageError);
+        if (e == OscoreNoError && (!found || gen > generation)) {
+            found = true;
+            current_slot = slot;
+            generation = gen;
+        }
+    }
+    bool restored = false;
+    if (found) {
+        u32_t gen;
+        try(read_slot(current_slot, &snapshot, &gen));
+        restored = oscore_restore(pre_established, count, key, snapshot) == OscoreNoError;
+    } else {
+        // the first snapshot goes into slot 0
+        current_slot = NUM_SLOTS - 1;
+        generation = 0;
+    }
+    if (!restored) {
+        try(oscore_init(pre_established[0]));
+        for (size_t i = 1; i < count; i++) {
+            try(oscore_add_context(pre_established[i]));
+        }
+        // the Master Secrets may have been used before the flash was erased
+        oscore_require_echo();
+    }
+    // a restored context sends nothing until its sequence numbers are reserved again
+    return save();
+}
+
+OscoreError context_store_save_if_due(void) {
+    if (flash == NULL) {
+        return OscoreNoError;
+    }
+    k_mutex_lock(&lock, K_FOREVER);
+    // checked again with the lock held, the other thread may have saved in the meantime
+    OscoreError res = oscore_snapshot_due() ? save() : OscoreNoError;
+    k_mutex_unlock(&lock);
+    return res;
+}
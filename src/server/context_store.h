@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_CONTEXT_STORE_H
+#define NONE_CONTEXT_STORE_H
+
+#include "../oscore/oscore.h"
+
+// Keeps the snapshot of the security contexts (see `oscore_snapshot_save`) in the storage partition of the flash.
+// The partition is divided into slots of whole erase pages, which are written in turn, each snapshot followed by a
+// generation counter. A reset while a slot is erased or written leaves the previous snapshot, and the erases are
+// spread over all pages of the partition. Every snapshot is authenticated with a key derived from the Master Secret
+// of the first peer.
+//
+// A snapshot is saved every OSCORE_SEQ_RESERVATION / 2 fresh Partial IVs of a context, i.e. every 512 with the
+// default reservation. With one observer of /obs, which is notified every 5 s, that is one save every 43 minutes,
+// and with the 6 slots of a 24 KiB partition every page is erased about every 4 hours: 10000 erase cycles of the
+// nRF52 last about 4.8 years. Responses reuse the request's nonce and don't count.
+
+/// Flash offset of the slots, each one takes the erase pages needed for a snapshot of OSCORE_MAX_CONTEXTS peers
+#ifndef CONTEXT_STORE_OFFSET
+#define CONTEXT_STORE_OFFSET FLASH_AREA_STORAGE_OFFSET
+#endif
+/// Size of the flash area taken by the slots
+#ifndef CONTEXT_STORE_SIZE
+#define CONTEXT_STORE_SIZE FLASH_AREA_STORAGE_SIZE
+#endif
+/// Size of the flash's erase pages
+#ifndef CONTEXT_STORE_PAGE_SIZE
+#define CONTEXT_STORE_PAGE_SIZE 4096
+#endif
+
+/**
+ * Initializes the security contexts like `oscore_restore` from the latest snapshot in flash. If there is none or it
+ * doesn't match, they are derived like `oscore_init` and `oscore_add_context` do, and marked with
+ * `oscore_require_echo`. Saves a snapshot in both cases, which reserves the sequence numbers sent until the next one.
+ * @param pre_established pre-established data of the peers, the first one is used to protect requests
+ * @param count Number of peers
+ * @return OscoreError, OscoreStorageError if the flash couldn't be read or written
+ */
+OscoreError context_store_load(const struct pre_established* pre_established, size_t count);
+
+/**
+ * Saves a snapshot if `oscore_snapshot_due`. To be called between messages by the threads protecting them, so a
+ * snapshot is saved before the contexts used up their reservation and refuse to send. Saves are serialized, so the
+ * RX thread and the work queue sending notifications may both call it.
+ * @return OscoreError, OscoreStorageError if the flash couldn't be written
+ */
+OscoreError context_store_save_if_due(void);
+
+#endif //NONE_CONTEXT_STORE_H
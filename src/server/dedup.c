@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <errno.h>
+#include <kernel.h>
+#include <net/net_context.h>
+#include "dedup.h"
+#include "../oscore/coap_helper.h"
+
+/// Number of hash buckets used to find a response by its Message ID, must be a power of two
+#define NUM_ID_BUCKETS 8
+
+struct dedup_entry {
+    /// node in the age list, all entries have the same lifetime, thus the oldest is expired first
+    sys_dnode_t age_node;
+    /// node in the Message ID bucket, unlinked while the entry is unused
+    sys_dnode_t id_node;
+    /// `struct sockaddr` might be too small for an IPv6 address, e.g. on POSIX
+    struct sockaddr_in6 addr;
+    u32_t expiry_ms;
+    u16_t id;
+    u16_t len;
+    u8_t message[DEDUP_MAX_LEN];
+};
+
+static struct dedup_entry entries[NUM_DEDUP_ENTRIES];
+/// unused entries
+static sys_dlist_t free_list;
+/// used entries, oldest first
+static sys_dlist_t age_list;
+static sys_dlist_t id_buckets[NUM_ID_BUCKETS];
+static struct k_mutex lock;
+
+static sys_dlist_t* id_bucket(u16_t id) {
+    return &id_buckets[(id ^ (id >> 8)) & (NUM_ID_BUCKETS - 1)];
+}
+
+static bool addr_equals(const struct sockaddr* left, const struct sockaddr* right) {
+    const struct sockaddr_in6* l = (const struct sockaddr_in6*)left;
+    const struct sockaddr_in6* r = (const struct sockaddr_in6*)right;
+    return l->sin6_port == r->sin6_port && memcmp(&l->sin6_addr, &r->sin6_addr, sizeof(l->sin6_addr)) == 0;
+}
+
+static void release(struct dedup_entry* entry) {
+    sys_dlist_remove(&entry->id_node);
+    sys_dlist_remove(&entry->age_node);
+    sys_dlist_append(&free_list, &entry->age_node);
+}
+
+/// frees all entries older than EXCHANGE_LIFETIME
+static void expire(u32_t now) {
+    sys_dnode_t* node;
+    while ((node = sys_dlist_peek_head(&age_list)) != NULL) {
+        struct dedup_entry* entry = CONTAINER_OF(node, struct dedup_entry, age_node);
+        if ((s32_t)(now - entry->expiry_ms) < 0) {
+            break;
+        }
+        release(entry);
+    }
+}
+
+void dedup_init(void) {
+    k_mutex_init(&lock);
+    sys_dlist_init(&free_list);
+    sys_dlist_init(&age_list);
+    for (int i = 0; i < NUM_ID_BUCKETS; i++) {
+        sys_dlist_init(&id_buckets[i]);
+    }
+    for (int i = 0; i < NUM_DEDUP_ENTRIES; i++) {
+        sys_dlist_append(&free_list, &entries[i].age_node);
+    }
+}
+
+int dedup_add(struct coap_packet* response, const struct sockaddr* addr) {
+    if (coap_header_get_type(response) != COAP_TYPE_ACK) {
+        return 0;
+    }
+    u16_t len = coap_message_len(response);
+    if (len > DEDUP_MAX_LEN) {
+        return -EMSGSIZE;
+    }
+
+    k_mutex_lock(&lock, K_FOREVER);
+    u32_t now = k_uptime_get_32();
+    expire(now);
+    sys_dnode_t* node = sys_dlist_get(&free_list);
+    if (node == NULL) {
+        // replace the oldest response
+        node = sys_dlist_peek_head(&age_list);
+        release(CONTAINER_OF(node, struct dedup_entry, age_node));
+        node = sys_dlist_get(&free_list);
+    }
+    struct dedup_entry* entry = CONTAINER_OF(node, struct dedup_entry, age_node);
+    array bytes = {
+        .len = len,
+        .ptr = entry->message,
+    };
+    if (read_coap_message(response, bytes) != OscoreNoError) {
+        sys_dlist_append(&free_list, node);
+        k_mutex_unlock(&lock);
+        return -EINVAL;
+    }
+    entry->len = len;
+    entry->id = coap_header_get_id(response);
+    entry->addr = *(const struct sockaddr_in6*)addr;
+    entry->expiry_ms = now + COAP_EXCHANGE_LIFETIME_MS;
+    sys_dlist_append(&age_list, &entry->age_node);
+    sys_dlist_append(id_bucket(entry->id), &entry->id_node);
+    k_mutex_unlock(&lock);
+    return 0;
+}
+
+bool dedup_replay(struct coap_packet* request, const struct sockaddr* from) {
+    if (coap_header_get_type(request) != COAP_TYPE_CON) {
+        return false;
+    }
+    u16_t id = coap_header_get_id(request);
+
+    k_mutex_lock(&lock, K_FOREVER);
+    expire(k_uptime_get_32());
+    struct dedup_entry* entry;
+    SYS_DLIST_FOR_EACH_CONTAINER(id_bucket(id), entry, id_node) {
+        if (entry->id != id || !addr_equals((const struct sockaddr*)&entry->addr, from)) {
+            continue;
+        }
+        struct net_pkt* pkt;
+        array message = {
+            .len = entry->len,
+            .ptr = entry->message,
+        };
+        // a lost resend is no different from a lost response, the client will retransmit again
+        if (coap_message_to_pkt(message, K_NO_WAIT, &pkt) == OscoreNoError &&
+            net_context_sendto(pkt, (const struct sockaddr*)&entry->addr, sizeof(struct sockaddr_in6), NULL, 0, NULL,
+                               NULL) < 0) {
+            net_pkt_unref(pkt);
+        }
+        k_mutex_unlock(&lock);
+        return true;
+    }
+    k_mutex_unlock(&lock);
+    return false;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_DEDUP_H
+#define NONE_DEDUP_H
+
+#include <stdbool.h>
+#include <net/coap.h>
+
+/// CoAP EXCHANGE_LIFETIME in milliseconds (RFC7252 4.8.2)
+#define COAP_EXCHANGE_LIFETIME_MS 247000
+
+/// Maximum number of responses kept for deduplication
+#define NUM_DEDUP_ENTRIES 8
+/// Maximum length of a serialized response kept for deduplication
+#define DEDUP_MAX_LEN 128
+
+/**
+ * Initializes the deduplication cache.
+ * Must be called once before any other dedup function.
+ */
+void dedup_init(void);
+
+/**
+ * Remembers a piggybacked response, so a duplicate of its confirmable request is answered with the same bytes.
+ *
+ * Only ACKs are stored, keyed by the endpoint and their Message ID, which is the one of the request.
+ * If the cache is full, the oldest response is replaced. The packet is not consumed.
+ * @param response Locally built (protected) response
+ * @param addr Address of the requesting endpoint
+ * @return 0 if the response was stored or isn't an ACK, -EMSGSIZE if the response is too long
+ */
+int dedup_add(struct coap_packet* response, const struct sockaddr* addr);
+
+/**
+ * Resends the stored response if @a request is a duplicate of a confirmable request which was already answered
+ * within EXCHANGE_LIFETIME. Needs only the parsed header, thus can be called before the request is decrypted.
+ * @param request Received request
+ * @param from Address the request was received from
+ * @return true if @a request is a duplicate and must not be processed any further
+ */
+bool dedup_replay(struct coap_packet* request, const struct sockaddr* from);
+
+#endif //NONE_DEDUP_H
@@ -10,6 +10,7 @@
 #include <net/udp.h>
 #include "oscore_post.h"
 #include "../oscore/oscore.h"
+#include "../oscore/pkt_pool.h"
 #include "../util/macros.h"
 #include "coap-server.h"
 
@@ -26,10 +27,10 @@ int oscore_post(struct coap_resource *resource,
     u8_t token[8];
     u8_t tkl = coap_header_get_token(request, token);
 
-    struct net_pkt* pkt = net_pkt_get_tx(context, K_FOREVER);
-    struct net_buf* frag = net_pkt_get_data(context, K_FOREVER);
-
-    net_pkt_frag_add(pkt, frag);
+    struct net_pkt* pkt;
+    if (pkt_pool_get(false, OSCORE_PKT_TIMEOUT_MS, &pkt) != OscoreNoError) {
+        return send_service_unavailable(request, (const struct sockaddr *)&from);
+    }
 
     if (type == COAP_TYPE_CON) {
         type = COAP_TYPE_ACK;
@@ -57,12 +58,7 @@ int oscore_post(struct coap_resource *resource,
     try_einval(coap_packet_append_payload(&response, payload,
                                           (u16_t)strlen((const char*)payload)));
 
-    struct coap_packet oscore;
-    try_oscore_einval(into_oscore(response, request, &oscore));
-
-    int res = net_context_sendto(oscore.pkt, (const struct sockaddr *)&from,
-                                 sizeof(struct sockaddr_in6),
-                                 NULL, 0, NULL, NULL);
+    int res = send_response(&response, request, (const struct sockaddr *)&from);
     SYS_LOG_INF("sent");
     return res;
 }
\ No newline at end of file
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <net/udp.h>
+#include <cbor.h>
+#include "oscore_stats.h"
+#include "rate_limit.h"
+#include "coap-server.h"
+#include "../oscore/oscore.h"
+#include "../oscore/pkt_pool.h"
+#include "../oscore/response_cache.h"
+#include "../util/scratch.h"
+#include "../util/profile.h"
+#include "../util/macros.h"
+
+/// application/cbor
+static const u8_t cbor_format = 60;
+
+/// Room for all counters and the histograms of all stages
+#define OSCORE_STATS_MAX_LEN 768
+
+/// Encodes a text key and its unsigned value into the map @a enc.
+static OscoreError encode_counter(CborEncoder* enc, const char* key, u32_t value) {
+    try_cbor(cbor_encode_text_stringz(enc, key));
+    try_cbor(cbor_encode_uint(enc, value));
+    return OscoreNoError;
+}
+
+#ifdef OSCORE_PROFILE
+/// Encodes the histograms of all stages as map of stage names to [count, min, avg, max, p99].
+static OscoreError encode_cycles(CborEncoder* enc) {
+    CborEncoder map_enc;
+    try_cbor(cbor_encoder_create_map(enc, &map_enc, NUM_PROFILE_STAGES));
+    for (u8_t stage = 0; stage < NUM_PROFILE_STAGES; stage++) {
+        struct profile_stats stats;
+        profile_get(stage, &stats);
+        try_cbor(cbor_encode_text_stringz(&map_enc, profile_stage_name(stage)));
+        CborEncoder array_enc;
+        try_cbor(cbor_encoder_create_array(&map_enc, &array_enc, 5));
+        try_cbor(cbor_encode_uint(&array_enc, stats.count));
+        try_cbor(cbor_encode_uint(&array_enc, stats.min));
+        try_cbor(cbor_encode_uint(&array_enc, stats.avg));
+        try_cbor(cbor_encode_uint(&array_enc, stats.max));
+        try_cbor(cbor_encode_uint(&array_enc, stats.p99));
+        try_cbor(cbor_encoder_close_container(&map_enc, &array_enc));
+    }
+    try_cbor(cbor_encoder_close_container(enc, &map_enc));
+    return OscoreNoError;
+}
+#endif
+
+OscoreError oscore_stats_encode(array out, size_t* len) {
+    CborEncoder enc;
+    cbor_encoder_init(&enc, out.ptr, out.len, 0);
+    CborEncoder map_enc;
+    CborEncoder counters;
+#ifdef OSCORE_PROFILE
+    try_cbor(cbor_encoder_create_map(&enc, &map_enc, 6));
+#else
+    try_cbor(cbor_encoder_create_map(&enc, &map_enc, 5));
+#endif
+
+    struct oscore_drop_stats drops;
+    oscore_get_drop_stats(&drops);
+    try_cbor(cbor_encode_text_stringz(&map_enc, "drops"));
+    try_cbor(cbor_encoder_create_map(&map_enc, &counters, 5));
+    try(encode_counter(&counters, "invalid_option", drops.invalid_option));
+    try(encode_counter(&counters, "unknown_kid", drops.unknown_kid));
+    try(encode_counter(&counters, "invalid_partial_iv", drops.invalid_partial_iv));
+    try(encode_counter(&counters, "invalid_payload", drops.invalid_payload));
+    try(encode_counter(&counters, "replayed", drops.replayed));
+    try_cbor(cbor_encoder_close_container(&map_enc, &counters));
+
+    struct rate_limit_stats rate_limit;
+    rate_limit_get_stats(&rate_limit);
+    try_cbor(cbor_encode_text_stringz(&map_enc, "rate_limit"));
+    try_cbor(cbor_encoder_create_map(&map_enc, &counters, 3));
+    try(encode_counter(&counters, "throttled_source", rate_limit.throttled_source));
+    try(encode_counter(&counters, "throttled_kid", rate_limit.throttled_kid));
+    try(encode_counter(&counters, "failures", rate_limit.failures));
+    try_cbor(cbor_encoder_close_container(&map_enc, &counters));
+
+    struct pkt_pool_stats pool;
+    pkt_pool_get_stats(&pool);
+    try_cbor(cbor_encode_text_stringz(&map_enc, "pool"));
+    try_cbor(cbor_encoder_create_map(&map_enc, &counters, 3));
+    try(encode_counter(&counters, "tx_used", pool.tx_used));
+    try(encode_counter(&counters, "tx_high_water", pool.tx_high_water));
+    try(encode_counter(&counters, "failures", pool.failures));
+    try_cbor(cbor_encoder_close_container(&map_enc, &counters));
+
+    struct scratch_stats scratch;
+    scratch_get_stats(&scratch);
+    try_cbor(cbor_encode_text_stringz(&map_enc, "scratch"));
+    try_cbor(cbor_encoder_create_map(&map_enc, &counters, 2));
+    try(encode_counter(&counters, "high_water", scratch.high_water));
+    try(encode_counter(&counters, "failures", scratch.failures));
+    try_cbor(cbor_encoder_close_container(&map_enc, &counters));
+
+    struct response_cache_stats cache = response_cache_get_stats();
+    try_cbor(cbor_encode_text_stringz(&map_enc, "cache"));
+    try_cbor(cbor_encoder_create_map(&map_enc, &counters, 3));
+    try(encode_counter(&counters, "hits", cache.hits));
+    try(encode_counter(&counters, "misses", cache.misses));
+    try(encode_counter(&counters, "validations", cache.validations));
+    try_cbor(cbor_encoder_close_container(&map_enc, &counters));
+
+#ifdef OSCORE_PROFILE
+    try_cbor(cbor_encode_text_stringz(&map_enc, "cycles"));
+    try(encode_cycles(&map_enc));
+#endif
+
+    try_cbor(cbor_encoder_close_container(&enc, &map_enc));
+    *len = cbor_encoder_get_buffer_size(&enc, out.ptr);
+    return OscoreNoError;
+}
+
+int oscore_stats_get(struct coap_resource *resource,
+                     struct coap_packet *request)
+{
+    // only used from the RX thread, so the buffer doesn't need to be on its stack
+    static u8_t payload[OSCORE_STATS_MAX_LEN];
+
+    struct sockaddr_in6 from;
+    get_from_ip_addr(request, &from);
+    u8_t type = coap_header_get_type(request);
+    u16_t id = coap_header_get_id(request);
+    u8_t token[8];
+    u8_t tkl = coap_header_get_token(request, token);
+
+    array out = {
+        .len = sizeof(payload),
+        .ptr = payload,
+    };
+    size_t len;
+    OscoreError e = oscore_stats_encode(out, &len);
+    if (e != OscoreNoError) {
+        err("Could not encode stats: %d", e);
+        return -EINVAL;
+    }
+
+    struct net_pkt* pkt;
+    if (pkt_pool_get(false, OSCORE_PKT_TIMEOUT_MS, &pkt) != OscoreNoError) {
+        return send_service_unavailable(request, (const struct sockaddr *)&from);
+    }
+
+    if (type == COAP_TYPE_CON) {
+        type = COAP_TYPE_ACK;
+    } else {
+        type = COAP_TYPE_NON_CON;
+    }
+
+    struct coap_packet response;
+    try_einval(coap_packet_init(&response, pkt, 1, type,
+                                tkl, &token[0],
+                                COAP_RESPONSE_CODE_CONTENT, id));
+
+    try_einval(coap_packet_append_option(&response, COAP_OPTION_CONTENT_FORMAT,
+                                         &cbor_format,
+                                         sizeof(cbor_format)));
+    // the counters change with every request, so neither the response cache nor a proxy may keep them
+    try_einval(coap_append_option_int(&response, COAP_OPTION_MAX_AGE, 0));
+
+    try_einval(coap_packet_append_payload_marker(&response));
+    try_einval(coap_packet_append_payload(&response, payload, (u16_t)len));
+
+    return send_response(&response, request, (const struct sockaddr *)&from);
+}
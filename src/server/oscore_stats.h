@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_OSCORE_STATS_H
+#define NONE_OSCORE_STATS_H
+
+#include <net/coap.h>
+#include "../util/array.h"
+#include "../util/error.h"
+
+/**
+ * Encodes the counters of the OSCORE path as CBOR map: "drops", "rate_limit", "pool", "scratch" and "cache" map
+ * counter names to their values. If `OSCORE_PROFILE` is defined, "cycles" maps every stage of `enum profile_stage`
+ * to the array [count, min, avg, max, p99] of its cycle counts.
+ * @param out Buffer to encode into
+ * @param len out-pointer to write the encoded length into
+ * @return OscoreError
+ */
+OscoreError oscore_stats_encode(array out, size_t* len);
+
+/// Answers with the output of `oscore_stats_encode` (application/cbor).
+int oscore_stats_get(struct coap_resource *resource, struct coap_packet *request);
+
+#endif //NONE_OSCORE_STATS_H
@@ -0,0 +1,411 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <kernel.h>
+#include <net/net_context.h>
+#include "outer_block.h"
+#include "dedup.h"
+#include "../oscore/oscore.h"
+#include "../oscore/coap_helper.h"
+#include "../oscore/pkt_pool.h"
+
+/* block option helper */
+#define GET_BLOCK_NUM(v)	((v) >> 4)
+#define GET_BLOCK_SIZE(v)	(((v) & 0x7))
+#define GET_MORE(v)		(!!((v) & 0x08))
+
+/// Maximum number of options of a received block, including the outer Block1 Option
+#define MAX_RECEIVED_OPTIONS 16
+
+struct outer_block_buffer {
+    sys_dnode_t node;
+    /// `struct sockaddr` might be too small for an IPv6 address, e.g. on POSIX
+    struct sockaddr_in6 addr;
+    /// value of the OSCORE Option of the request, which is the same for all blocks of one transfer
+    u8_t key[sizeof(((struct coap_option*)0)->value)];
+    u8_t key_len;
+    u32_t last_used_ms;
+    /// whether the buffer holds a fragmented response or collects the blocks of a request
+    bool response;
+    /// outer CoAP Code and options of a fragmented response
+    u8_t code;
+    u16_t option_numbers[OUTER_BLOCK_MAX_OPTIONS];
+    struct coap_option options[OUTER_BLOCK_MAX_OPTIONS];
+    u8_t opt_num;
+    u16_t len;
+    u8_t payload[OUTER_BLOCK_MAX_LEN];
+};
+
+static struct outer_block_buffer buffers[NUM_OUTER_BLOCK_BUFFERS];
+static sys_dlist_t used_list;
+static sys_dlist_t free_list;
+
+static bool addr_equals(const struct sockaddr* left, const struct sockaddr* right) {
+    const struct sockaddr_in6* l = (const struct sockaddr_in6*)left;
+    const struct sockaddr_in6* r = (const struct sockaddr_in6*)right;
+    return l->sin6_port == r->sin6_port && memcmp(&l->sin6_addr, &r->sin6_addr, sizeof(l->sin6_addr)) == 0;
+}
+
+static int get_option_int(const struct coap_packet* packet, u16_t code) {
+    struct coap_option option;
+    if (coap_find_options(packet, code, &option, 1) <= 0) {
+        return -ENOENT;
+    }
+    return coap_option_value_to_int(&option);
+}
+
+static void release(struct outer_block_buffer* buffer) {
+    sys_dlist_remove(&buffer->node);
+    sys_dlist_append(&free_list, &buffer->node);
+}
+
+/**
+ * Finds the buffer of a transfer, dropping all transfers which timed out.
+ * @return buffer or NULL
+ */
+static struct outer_block_buffer* find(const struct sockaddr* addr, const struct coap_option* oscore, bool response) {
+    u32_t now = k_uptime_get_32();
+    struct outer_block_buffer* buffer;
+    struct outer_block_buffer* next;
+    SYS_DLIST_FOR_EACH_CONTAINER_SAFE(&used_list, buffer, next, node) {
+        if (now - buffer->last_used_ms >= OUTER_BLOCK_TIMEOUT_MS) {
+            release(buffer);
+            continue;
+        }
+        if (buffer->response == response && buffer->key_len == oscore->len &&
+            memcmp(buffer->key, oscore->value, oscore->len) == 0 &&
+            addr_equals((const struct sockaddr*)&buffer->addr, addr)) {
+            buffer->last_used_ms = now;
+            return buffer;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Takes a free buffer. Running transfers are never replaced, so a full pool rejects new transfers instead.
+ * @return buffer or NULL
+ */
+static struct outer_block_buffer* alloc(const struct sockaddr* addr, const struct coap_option* oscore, bool response) {
+    sys_dnode_t* node = sys_dlist_get(&free_list);
+    if (node == NULL) {
+        return NULL;
+    }
+    struct outer_block_buffer* buffer = CONTAINER_OF(node, struct outer_block_buffer, node);
+    buffer->addr = *(const struct sockaddr_in6*)addr;
+    memcpy(buffer->key, oscore->value, oscore->len);
+    buffer->key_len = oscore->len;
+    buffer->last_used_ms = k_uptime_get_32();
+    buffer->response = response;
+    buffer->opt_num = 0;
+    buffer->len = 0;
+    sys_dlist_append(&used_list, &buffer->node);
+    return buffer;
+}
+
+static u8_t response_type(struct coap_packet* request) {
+    return coap_header_get_type(request) == COAP_TYPE_CON ? COAP_TYPE_ACK : COAP_TYPE_NON_CON;
+}
+
+/**
+ * Sends an unprotected response without payload for a block of a request.
+ * @param option Option to include or 0
+ */
+static int send_block_status(struct coap_packet* request, const struct sockaddr* from, u8_t code, u16_t option,
+                             unsigned int value) {
+    struct coap_packet response;
+    u8_t token[8];
+    u8_t tkl = coap_header_get_token(request, token);
+
+    // the client retransmits or times out if the status is lost
+    struct net_pkt* pkt;
+    if (pkt_pool_get(false, K_NO_WAIT, &pkt) != OscoreNoError) {
+        return -ENOMEM;
+    }
+
+    int r = coap_packet_init(&response, pkt, 1, response_type(request), tkl, token, code,
+                             coap_header_get_id(request));
+    if (r == 0 && option != 0) {
+        r = coap_append_option_int(&response, option, value);
+    }
+    if (r == 0) {
+        r = net_context_sendto(pkt, from, sizeof(struct sockaddr_in6), NULL, 0, NULL, NULL);
+    }
+    if (r < 0) {
+        net_pkt_unref(pkt);
+    }
+    return r;
+}
+
+/**
+ * Rebuilds the complete OSCORE request from the last block and the collected payload, without the outer Block1 and
+ * Size1 Options.
+ */
+static int reassembled_packet(struct coap_packet* last_block, struct outer_block_buffer* buffer,
+                              struct coap_packet* out) {
+    struct coap_option options[MAX_RECEIVED_OPTIONS];
+    u8_t opt_num = MAX_RECEIVED_OPTIONS;
+    if (get_options(last_block, options, &opt_num) != OscoreNoError) {
+        return -EINVAL;
+    }
+    if (init_received_packet(last_block, coap_header_get_code(last_block), out) != OscoreNoError) {
+        return -ENOMEM;
+    }
+
+    u16_t number = 0;
+    for (int i = 0; i < opt_num; i++) {
+        number += options[i].delta;
+        if (number == COAP_OPTION_BLOCK1 || number == COAP_OPTION_SIZE1) {
+            continue;
+        }
+        if (coap_packet_append_option(out, number, options[i].value, options[i].len) < 0) {
+            net_pkt_unref(out->pkt);
+            return -ENOMEM;
+        }
+    }
+    if (coap_packet_append_payload_marker(out) < 0 ||
+        coap_packet_append_payload(out, buffer->payload, buffer->len) < 0) {
+        net_pkt_unref(out->pkt);
+        return -ENOMEM;
+    }
+    // parse again, so the packet looks like it was received in one piece
+    if (coap_packet_parse(out, out->pkt, NULL, 0) < 0) {
+        net_pkt_unref(out->pkt);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+void outer_block_init(void) {
+    sys_dlist_init(&used_list);
+    sys_dlist_init(&free_list);
+    for (int i = 0; i < NUM_OUTER_BLOCK_BUFFERS; i++) {
+        sys_dlist_append(&free_list, &buffers[i].node);
+    }
+}
+
+int outer_block_reassemble(struct coap_packet* request, const struct sockaddr* from) {
+    struct coap_option oscore;
+    int block1 = get_option_int(request, COAP_OPTION_BLOCK1);
+    if (block1 < 0 || coap_find_options(request, COAP_OPTION_OSCORE, &oscore, 1) != 1) {
+        return 0;
+    }
+    u32_t offset = GET_BLOCK_NUM(block1) * coap_block_size_to_bytes(GET_BLOCK_SIZE(block1));
+
+    struct outer_block_buffer* buffer = find(from, &oscore, false);
+    if (buffer == NULL && offset == 0) {
+        buffer = alloc(from, &oscore, false);
+        if (buffer == NULL) {
+            send_block_status(request, from, COAP_RESPONSE_CODE_SERVICE_UNAVAILABLE, 0, 0);
+            return -ENOMEM;
+        }
+    }
+
+    u16_t payload_offset;
+    u16_t len;
+    struct net_buf* frag = coap_packet_get_payload(request, &payload_offset, &len);
+    if (frag == NULL) {
+        len = 0;
+    }
+
+    if (buffer != NULL && GET_MORE(block1) && offset + len == buffer->len) {
+        // retransmission of the previous block, because our 2.31 got lost
+        send_block_status(request, from, COAP_RESPONSE_CODE_CONTINUE, COAP_OPTION_BLOCK1, block1);
+        return -EAGAIN;
+    }
+    if (buffer == NULL || offset != buffer->len) {
+        if (buffer != NULL) {
+            release(buffer);
+        }
+        send_block_status(request, from, COAP_RESPONSE_CODE_INCOMPLETE, 0, 0);
+        return -EINVAL;
+    }
+    if (buffer->len + len > OUTER_BLOCK_MAX_LEN) {
+        release(buffer);
+        send_block_status(request, from, COAP_RESPONSE_CODE_REQUEST_TOO_LARGE, COAP_OPTION_SIZE1, OUTER_BLOCK_MAX_LEN);
+        return -EMSGSIZE;
+    }
+
+    if (len > 0) {
+        u16_t pos;
+        frag = net_frag_read(frag, payload_offset, &pos, len, &buffer->payload[buffer->len]);
+        if (frag == NULL && pos == 0xffff) {
+            release(buffer);
+            return -EINVAL;
+        }
+        buffer->len += len;
+    }
+
+    if (GET_MORE(block1)) {
+        send_block_status(request, from, COAP_RESPONSE_CODE_CONTINUE, COAP_OPTION_BLOCK1, block1);
+        return -EAGAIN;
+    }
+
+    struct coap_packet reassembled;
+    int r = reassembled_packet(request, buffer, &reassembled);
+    release(buffer);
+    if (r < 0) {
+        send_block_status(request, from, COAP_RESPONSE_CODE_INTERNAL_ERROR, 0, 0);
+        return r;
+    }
+    net_pkt_unref(request->pkt);
+    *request = reassembled;
+    return 0;
+}
+
+/**
+ * Builds the block at @a offset of a fragmented response.
+ */
+static int block_packet(struct outer_block_buffer* buffer, u8_t type, const u8_t* token, u8_t tkl, u16_t id,
+                        enum coap_block_size block_size, u16_t offset, struct coap_packet* out) {
+    struct coap_block_context ctx = {
+        .block_size = block_size,
+        .total_size = buffer->len,
+        .current = offset,
+    };
+    u16_t len = min(coap_block_size_to_bytes(block_size), buffer->len - offset);
+
+    struct net_pkt* pkt;
+    if (pkt_pool_get(false, OSCORE_PKT_TIMEOUT_MS, &pkt) != OscoreNoError) {
+        return -ENOMEM;
+    }
+
+    int r = coap_packet_init(out, pkt, 1, type, tkl, (u8_t*)token, buffer->code, id);
+    // all outer options of a response are below Block2, see `outer_block_split`
+    for (int i = 0; r == 0 && i < buffer->opt_num; i++) {
+        r = coap_packet_append_option(out, buffer->option_numbers[i], buffer->options[i].value,
+                                      buffer->options[i].len);
+    }
+    if (r == 0) {
+        r = coap_append_block2_option(out, &ctx);
+    }
+    if (r == 0 && offset == 0) {
+        r = coap_append_size2_option(out, &ctx);
+    }
+    if (r == 0) {
+        r = coap_packet_append_payload_marker(out);
+    }
+    if (r == 0) {
+        r = coap_packet_append_payload(out, &buffer->payload[offset], len);
+    }
+    if (r < 0) {
+        net_pkt_unref(pkt);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+bool outer_block_serve(struct coap_packet* request, const struct sockaddr* from) {
+    struct coap_option oscore;
+    int block2 = get_option_int(request, COAP_OPTION_BLOCK2);
+    if (block2 < 0 || coap_find_options(request, COAP_OPTION_OSCORE, &oscore, 1) != 1) {
+        return false;
+    }
+    struct outer_block_buffer* buffer = find(from, &oscore, true);
+    if (buffer == NULL) {
+        return false;
+    }
+
+    // a client may ask for larger blocks than we send, the offset stays the same
+    enum coap_block_size block_size = min(GET_BLOCK_SIZE(block2), OUTER_BLOCK_SZX);
+    u32_t offset = GET_BLOCK_NUM(block2) * coap_block_size_to_bytes(GET_BLOCK_SIZE(block2));
+    offset -= offset % coap_block_size_to_bytes(block_size);
+    if (offset >= buffer->len) {
+        send_block_status(request, from, COAP_RESPONSE_CODE_BAD_OPTION, 0, 0);
+        return true;
+    }
+
+    u8_t token[8];
+    u8_t tkl = coap_header_get_token(request, token);
+    struct coap_packet block;
+    if (block_packet(buffer, response_type(request), token, tkl, coap_header_get_id(request), block_size,
+                     (u16_t)offset, &block) < 0) {
+        return true;
+    }
+    if (offset + coap_block_size_to_bytes(block_size) >= buffer->len) {
+        // last block, a retransmission of it is answered from the dedup cache
+        release(buffer);
+    }
+    dedup_add(&block, from);
+    if (net_context_sendto(block.pkt, from, sizeof(struct sockaddr_in6), NULL, 0, NULL, NULL) < 0) {
+        net_pkt_unref(block.pkt);
+    }
+    return true;
+}
+
+int outer_block_split(struct coap_packet* protected, struct coap_packet* request, const struct sockaddr* from,
+                      struct coap_packet* out) {
+    *out = *protected;
+
+    struct coap_option oscore;
+    u16_t payload_offset;
+    u16_t len;
+    struct net_buf* frag = coap_packet_get_payload(protected, &payload_offset, &len);
+    if (frag == NULL || len == 0) {
+        return 0;
+    }
+    // the payload of a locally built packet starts with the payload marker
+    frag = net_frag_skip(frag, payload_offset, &payload_offset, 1);
+    len--;
+    if (frag == NULL || len <= coap_block_size_to_bytes(OUTER_BLOCK_SZX) || len > OUTER_BLOCK_MAX_LEN ||
+        coap_find_options(request, COAP_OPTION_OSCORE, &oscore, 1) != 1) {
+        return 0;
+    }
+
+    // `get_options` would parse @a protected like a received packet, which it isn't
+    struct coap_option options[OUTER_BLOCK_MAX_OPTIONS];
+    u16_t opt_num;
+    if (read_built_options(protected, options, OUTER_BLOCK_MAX_OPTIONS, &opt_num) != OscoreNoError) {
+        return 0;
+    }
+    struct outer_block_buffer* buffer = find(from, &oscore, true);
+    if (buffer == NULL) {
+        buffer = alloc(from, &oscore, true);
+    }
+    if (buffer == NULL) {
+        // send unfragmented
+        return 0;
+    }
+
+    u16_t number = 0;
+    for (int i = 0; i < opt_num; i++) {
+        number += options[i].delta;
+        if (number >= COAP_OPTION_BLOCK2) {
+            release(buffer);
+            return 0;
+        }
+        buffer->option_numbers[i] = number;
+        buffer->options[i] = options[i];
+    }
+    buffer->opt_num = (u8_t)opt_num;
+    buffer->code = coap_header_get_code(protected);
+    u16_t pos;
+    frag = net_frag_read(frag, payload_offset, &pos, len, buffer->payload);
+    if (frag == NULL && pos == 0xffff) {
+        release(buffer);
+        return -EINVAL;
+    }
+    buffer->len = len;
+
+    u8_t token[8];
+    u8_t tkl = coap_header_get_token(protected, token);
+    int r = block_packet(buffer, coap_header_get_type(protected), token, tkl, coap_header_get_id(protected),
+                         OUTER_BLOCK_SZX, 0, out);
+    if (r < 0) {
+        release(buffer);
+        *out = *protected;
+        return 0;
+    }
+    net_pkt_unref(protected->pkt);
+    return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_OUTER_BLOCK_H
+#define NONE_OUTER_BLOCK_H
+
+#include <stdbool.h>
+#include <net/coap.h>
+
+/// Block size of outer Block2 responses, chosen to fit into a single BLE link layer PDU together with the headers
+#ifndef OUTER_BLOCK_SZX
+#define OUTER_BLOCK_SZX COAP_BLOCK_64
+#endif
+/// Number of buffers for messages which are currently reassembled or fragmented
+#define NUM_OUTER_BLOCK_BUFFERS 2
+/// Maximum length of the OSCORE payload of a reassembled or fragmented message
+#define OUTER_BLOCK_MAX_LEN 1024
+/// Maximum number of outer options of a fragmented response
+#define OUTER_BLOCK_MAX_OPTIONS 4
+/// Time in milliseconds after which an unfinished transfer is dropped
+#define OUTER_BLOCK_TIMEOUT_MS 60000
+
+/**
+ * Initializes the buffer pool for outer block-wise transfers (RFC8613 4.1.3.4.2).
+ * The pool isn't thread-safe, it must only be used from the thread receiving requests.
+ */
+void outer_block_init(void);
+
+/**
+ * Collects the blocks of an OSCORE request with an outer Block1 Option.
+ *
+ * The blocks are identified by the endpoint and the value of their OSCORE Option, which is the same for all blocks of
+ * one protected message. Every block but the last is answered with 2.31 (Continue). After the last block,
+ * @a request is replaced by the reassembled OSCORE message without outer Block1 Option, which can then be passed
+ * to `from_oscore`, and the original packet is freed.
+ * @param request Received OSCORE request
+ * @param from Address the request was received from
+ * @return 0 if @a request can be processed, -EAGAIN if more blocks are expected, or another negative errno value if
+ *          the block was rejected. In the latter two cases an error response was sent already.
+ */
+int outer_block_reassemble(struct coap_packet* request, const struct sockaddr* from);
+
+/**
+ * Answers a request for a further block of a fragmented OSCORE response, without decrypting the request again.
+ * @param request Received OSCORE request with an outer Block2 Option
+ * @param from Address the request was received from
+ * @return true if the block was sent and the request must not be processed any further
+ */
+bool outer_block_serve(struct coap_packet* request, const struct sockaddr* from);
+
+/**
+ * Splits an OSCORE response into outer Block2 blocks if its payload is longer than one block.
+ *
+ * The ciphertext is kept until all blocks were fetched or the transfer times out. If it is too large or no buffer is
+ * free, the response is sent unfragmented.
+ * @param protected Protected response. If it is fragmented, it is freed.
+ * @param request Decrypted request, which still contains its OSCORE Option
+ * @param from Address of the requesting endpoint
+ * @param out out-pointer which will contain the first block, or @a protected itself
+ * @return 0 or a negative errno value
+ */
+int outer_block_split(struct coap_packet* protected, struct coap_packet* request, const struct sockaddr* from,
+                      struct coap_packet* out);
+
+#endif //NONE_OUTER_BLOCK_H
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <string.h>
+#include <kernel.h>
+#include "rate_limit.h"
+
+/// Number of hash buckets used to find an entry by its key, must be a power of two
+#define NUM_KEY_BUCKETS 8
+/// Tokens are counted in thousandths, so a rate of one token per second refills one unit per millisecond
+#define TOKEN 1000
+
+enum rate_limit_kind {
+    RATE_LIMIT_SOURCE,
+    RATE_LIMIT_KID,
+};
+
+struct rate_limit_entry {
+    /// node in the LRU list, unused entries are kept in the free list
+    sys_dnode_t lru_node;
+    /// node in the key bucket, unlinked while the entry is unused
+    sys_dnode_t key_node;
+    u8_t kind;
+    u8_t key_len;
+    /// IPv6 address or kid
+    u8_t key[16];
+    u32_t tokens;
+    u32_t last_ms;
+    /// number of halvings of the rate, only source addresses are penalized
+    u8_t penalty;
+};
+
+static struct rate_limit_entry entries[NUM_RATE_LIMIT_ENTRIES];
+/// unused entries
+static sys_dlist_t free_list;
+/// used entries, least recently used first
+static sys_dlist_t lru_list;
+static sys_dlist_t key_buckets[NUM_KEY_BUCKETS];
+static struct rate_limit_stats stats;
+
+/// FNV-1a over kind and key, folded to the bucket count
+static sys_dlist_t* key_bucket(u8_t kind, const u8_t* key, u8_t key_len) {
+    u32_t hash = (2166136261u ^ kind) * 16777619u;
+    for (int i = 0; i < key_len; i++) {
+        hash = (hash ^ key[i]) * 16777619u;
+    }
+    return &key_buckets[(hash ^ (hash >> 16)) & (NUM_KEY_BUCKETS - 1)];
+}
+
+static void release(struct rate_limit_entry* entry) {
+    sys_dlist_remove(&entry->key_node);
+    sys_dlist_remove(&entry->lru_node);
+    sys_dlist_append(&free_list, &entry->lru_node);
+}
+
+/// frees all entries which weren't used for RATE_LIMIT_IDLE_MS
+static void expire(u32_t now) {
+    sys_dnode_t* node;
+    while ((node = sys_dlist_peek_head(&lru_list)) != NULL) {
+        struct rate_limit_entry* entry = CONTAINER_OF(node, struct rate_limit_entry, lru_node);
+        if (now - entry->last_ms < RATE_LIMIT_IDLE_MS) {
+            break;
+        }
+        release(entry);
+    }
+}
+
+/**
+ * Finds the entry of a key.
+ * @return entry, it is refilled up to @a now and moved to the end of the LRU list, or NULL if there is none
+ */
+static struct rate_limit_entry* find_entry(u8_t kind, const u8_t* key, u8_t key_len, u32_t now) {
+    key_len = min(key_len, sizeof(((struct rate_limit_entry*)0)->key));
+    sys_dlist_t* bucket = key_bucket(kind, key, key_len);
+    struct rate_limit_entry* entry;
+    SYS_DLIST_FOR_EACH_CONTAINER(bucket, entry, key_node) {
+        if (entry->kind == kind && entry->key_len == key_len && memcmp(entry->key, key, key_len) == 0) {
+            u32_t elapsed = min(now - entry->last_ms, RATE_LIMIT_IDLE_MS);
+            entry->tokens = min(entry->tokens + ((elapsed * RATE_LIMIT_RATE) >> entry->penalty),
+                                RATE_LIMIT_BURST * TOKEN);
+            entry->last_ms = now;
+            sys_dlist_remove(&entry->lru_node);
+            sys_dlist_append(&lru_list, &entry->lru_node);
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Finds the entry of a key, creating one with a full bucket if there is none.
+ * @return entry, it is refilled up to @a now and moved to the end of the LRU list
+ */
+static struct rate_limit_entry* get_entry(u8_t kind, const u8_t* key, u8_t key_len, u32_t now) {
+    struct rate_limit_entry* entry = find_entry(kind, key, key_len, now);
+    if (entry != NULL) {
+        return entry;
+    }
+
+    key_len = min(key_len, sizeof(((struct rate_limit_entry*)0)->key));
+    sys_dnode_t* node = sys_dlist_get(&free_list);
+    if (node == NULL) {
+        // replace the least recently used entry
+        release(CONTAINER_OF(sys_dlist_peek_head(&lru_list), struct rate_limit_entry, lru_node));
+        node = sys_dlist_get(&free_list);
+    }
+    entry = CONTAINER_OF(node, struct rate_limit_entry, lru_node);
+    entry->kind = kind;
+    entry->key_len = key_len;
+    memcpy(entry->key, key, key_len);
+    entry->tokens = RATE_LIMIT_BURST * TOKEN;
+    entry->last_ms = now;
+    entry->penalty = 0;
+    sys_dlist_append(&lru_list, &entry->lru_node);
+    sys_dlist_append(key_bucket(kind, key, key_len), &entry->key_node);
+    return entry;
+}
+
+static const u8_t* source_key(const struct sockaddr* from) {
+    return ((const struct sockaddr_in6*)from)->sin6_addr.s6_addr;
+}
+
+void rate_limit_init(void) {
+    sys_dlist_init(&free_list);
+    sys_dlist_init(&lru_list);
+    for (int i = 0; i < NUM_KEY_BUCKETS; i++) {
+        sys_dlist_init(&key_buckets[i]);
+    }
+    for (int i = 0; i < NUM_RATE_LIMIT_ENTRIES; i++) {
+        sys_dlist_append(&free_list, &entries[i].lru_node);
+    }
+}
+
+bool rate_limit_allow(const struct sockaddr* from, const u8_t* kid, u8_t kid_len) {
+    u32_t now = k_uptime_get_32();
+    expire(now);
+    struct rate_limit_entry* source = get_entry(RATE_LIMIT_SOURCE, source_key(from), sizeof(struct in6_addr), now);
+    // the kid isn't authenticated yet, so only kids of verified requests have a bucket
+    struct rate_limit_entry* peer = find_entry(RATE_LIMIT_KID, kid, kid_len, now);
+    if (source->tokens < TOKEN) {
+        stats.throttled_source++;
+        return false;
+    }
+    if (peer != NULL && peer->tokens < TOKEN) {
+        stats.throttled_kid++;
+        return false;
+    }
+    source->tokens -= TOKEN;
+    return true;
+}
+
+void rate_limit_report(const struct sockaddr* from, const u8_t* kid, u8_t kid_len, OscoreError result) {
+    u32_t now = k_uptime_get_32();
+    struct rate_limit_entry* source = get_entry(RATE_LIMIT_SOURCE, source_key(from), sizeof(struct in6_addr), now);
+    if (result == OscoreTinyCryptError) {
+        // anyone can send a request with the kid of another peer, thus only the source address is penalized
+        stats.failures++;
+        source->penalty = min(source->penalty + 1, RATE_LIMIT_MAX_PENALTY);
+    } else if (result == OscoreNoError) {
+        if (source->penalty > 0) {
+            source->penalty--;
+        }
+        struct rate_limit_entry* peer = get_entry(RATE_LIMIT_KID, kid, kid_len, now);
+        peer->tokens = peer->tokens >= TOKEN ? peer->tokens - TOKEN : 0;
+    }
+}
+
+void rate_limit_get_stats(struct rate_limit_stats* out) {
+    *out = stats;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_RATE_LIMIT_H
+#define NONE_RATE_LIMIT_H
+
+#include <stdbool.h>
+#include <net/net_ip.h>
+#include "../util/error.h"
+
+/// Number of OSCORE requests per second a source address or kid may send
+#define RATE_LIMIT_RATE 20
+/// Number of requests a peer may send at once after being idle
+#define RATE_LIMIT_BURST 10
+/// Maximum number of halvings of the rate after failed decryptions
+#define RATE_LIMIT_MAX_PENALTY 6
+/// Number of tracked source addresses and kids together
+#define NUM_RATE_LIMIT_ENTRIES 16
+/// Time in milliseconds after which an idle entry is forgotten, including its penalty
+#define RATE_LIMIT_IDLE_MS 60000
+
+/// Counters of `rate_limit_allow` and `rate_limit_report`
+struct rate_limit_stats {
+    /// requests dropped because their source address ran out of tokens
+    u32_t throttled_source;
+    /// requests dropped because their kid ran out of tokens
+    u32_t throttled_kid;
+    /// decryptions which failed with OscoreTinyCryptError
+    u32_t failures;
+};
+
+/**
+ * Initializes the token buckets for OSCORE requests.
+ * Each source address and each kid gets its own token bucket in a fixed-size hash table. The least recently used
+ * entry is replaced if the table is full. Not thread-safe, must only be used from the thread receiving requests.
+ */
+void rate_limit_init(void);
+
+/**
+ * Takes a token from the bucket of the source address of a request, before it is decrypted.
+ * The request is also dropped if its kid ran out of tokens, which only verified requests take, see `rate_limit_report`.
+ * @param from Address the request was received from
+ * @param kid kid of the request's OSCORE Option
+ * @param kid_len Length of @a kid
+ * @return true if the request may be processed, false if it must be dropped
+ */
+bool rate_limit_allow(const struct sockaddr* from, const u8_t* kid, u8_t kid_len);
+
+/**
+ * Reports the result of decrypting a request which passed `rate_limit_allow`.
+ * Every OscoreTinyCryptError, i.e. a wrong authentication tag, halves the rate of the source address, every
+ * successful decryption doubles it again up to RATE_LIMIT_RATE and takes a token from the bucket of the kid.
+ * The kid of a request which failed to decrypt isn't authentic, so its bucket is left alone.
+ * @param from Address the request was received from
+ * @param kid kid of the request's OSCORE Option
+ * @param kid_len Length of @a kid
+ * @param result Result of `from_oscore`
+ */
+void rate_limit_report(const struct sockaddr* from, const u8_t* kid, u8_t kid_len, OscoreError result);
+
+/**
+ * Copies the counters of the rate limiter.
+ * @param out out-pointer to write the counters into
+ */
+void rate_limit_get_stats(struct rate_limit_stats* out);
+
+#endif //NONE_RATE_LIMIT_H
@@ -16,6 +16,7 @@
 
 #include "coap-server.h"
 #include "oscore_post.h"
+#include "oscore_stats.h"
 #include "../main.h"
 
 static const char * const test_path[] = {"test", NULL };
@@ -38,6 +39,12 @@ static const char * const obs_path[] = { "obs", NULL };
 
 static const char* const oscore_path[] = { "oscore", "hello", "1", NULL };
 
+static const char * const oscore_stats_path[] = { "oscore", "stats", NULL };
+
+#ifdef OSCORE_TRACE
+static const char * const trace_path[] = { "oscore", "trace", NULL };
+#endif
+
 static const char * const core_1_path[] = { "core1", NULL };
 static const char * const core_1_attributes[] = {
         "title=\"Core 1\"",
@@ -104,6 +111,14 @@ static struct coap_resource resources[] = {
         .get = oscore_post,
         .path = oscore_path,
     },
+    { .get = oscore_stats_get,
+        .path = oscore_stats_path,
+    },
+#ifdef OSCORE_TRACE
+    { .get = trace_get,
+        .path = trace_path,
+    },
+#endif
     { },
 };
 
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <errno.h>
+#include <kernel.h>
+#include <net/net_context.h>
+#include "retransmit.h"
+#include "coap-server.h"
+#include "../oscore/coap_helper.h"
+#include "../util/timer_wheel.h"
+
+/// Number of hash buckets used to match ACKs by their Message ID, must be a power of two
+#define NUM_ID_BUCKETS 16
+
+struct retransmission {
+    struct timer_wheel_entry timer;
+    /// node in either the free-list or the Message ID bucket
+    sys_dnode_t id_node;
+    struct sockaddr addr;
+    /// current timeout in ticks, doubled after every retransmission
+    u32_t timeout;
+    u8_t retries;
+    u16_t id;
+    u16_t len;
+    u8_t message[RETRANSMISSION_MAX_LEN];
+};
+
+static struct retransmission retransmissions[NUM_RETRANSMISSIONS];
+static sys_dlist_t free_list;
+static sys_dlist_t id_buckets[NUM_ID_BUCKETS];
+static struct timer_wheel wheel;
+static struct k_delayed_work tick_work;
+static u32_t last_tick_ms;
+static struct k_mutex lock;
+
+static sys_dlist_t* id_bucket(u16_t id) {
+    return &id_buckets[(id ^ (id >> 8)) & (NUM_ID_BUCKETS - 1)];
+}
+
+static bool addr_equals(const struct sockaddr* left, const struct sockaddr* right) {
+    const struct sockaddr_in6* l = (const struct sockaddr_in6*)left;
+    const struct sockaddr_in6* r = (const struct sockaddr_in6*)right;
+    return l->sin6_port == r->sin6_port && memcmp(&l->sin6_addr, &r->sin6_addr, sizeof(l->sin6_addr)) == 0;
+}
+
+static void release(struct retransmission* retransmission) {
+    timer_wheel_cancel(&wheel, &retransmission->timer);
+    sys_dlist_remove(&retransmission->id_node);
+    sys_dlist_append(&free_list, &retransmission->id_node);
+}
+
+static void send(struct retransmission* retransmission) {
+    struct net_pkt* pkt;
+    array message = {
+        .len = retransmission->len,
+        .ptr = retransmission->message,
+    };
+    if (coap_message_to_pkt(message, K_NO_WAIT, &pkt) != OscoreNoError) {
+        // out of buffers, try again on the next retransmission
+        return;
+    }
+    int r = net_context_sendto(pkt, &retransmission->addr, sizeof(struct sockaddr_in6), NULL, 0, NULL, NULL);
+    if (r < 0) {
+        net_pkt_unref(pkt);
+    }
+}
+
+static void tick(struct k_work* work) {
+    sys_dlist_t expired;
+    sys_dlist_init(&expired);
+
+    k_mutex_lock(&lock, K_FOREVER);
+    // catch up with all ticks that passed since the last run, as the work item might have been delayed
+    u32_t now = k_uptime_get_32();
+    u32_t ticks = (now - last_tick_ms) / RETRANSMIT_TICK_MS;
+    last_tick_ms += ticks * RETRANSMIT_TICK_MS;
+    while (ticks-- > 0) {
+        timer_wheel_tick(&wheel, &expired);
+    }
+
+    sys_dnode_t* node;
+    while ((node = sys_dlist_get(&expired)) != NULL) {
+        struct retransmission* retransmission = CONTAINER_OF(node, struct retransmission, timer.node);
+        if (retransmission->retries >= COAP_MAX_RETRANSMIT) {
+            // last retransmit timed out, give up
+            release(retransmission);
+            continue;
+        }
+        send(retransmission);
+        retransmission->retries++;
+        retransmission->timeout *= 2;
+        timer_wheel_insert(&wheel, &retransmission->timer, retransmission->timeout);
+    }
+
+    if (wheel.count > 0) {
+        k_delayed_work_submit(&tick_work, RETRANSMIT_TICK_MS);
+    }
+    k_mutex_unlock(&lock);
+}
+
+void retransmit_init(void) {
+    k_mutex_init(&lock);
+    timer_wheel_init(&wheel);
+    sys_dlist_init(&free_list);
+    for (int i = 0; i < NUM_ID_BUCKETS; i++) {
+        sys_dlist_init(&id_buckets[i]);
+    }
+    for (int i = 0; i < NUM_RETRANSMISSIONS; i++) {
+        retransmissions[i].timer.scheduled = false;
+        sys_dlist_append(&free_list, &retransmissions[i].id_node);
+    }
+    k_delayed_work_init(&tick_work, tick);
+}
+
+int retransmit_add(struct coap_packet* message, const struct sockaddr* addr) {
+    u16_t len = coap_message_len(message);
+    if (len > RETRANSMISSION_MAX_LEN) {
+        return -EMSGSIZE;
+    }
+
+    k_mutex_lock(&lock, K_FOREVER);
+    sys_dnode_t* node = sys_dlist_get(&free_list);
+    if (node == NULL) {
+        k_mutex_unlock(&lock);
+        return -ENOMEM;
+    }
+    struct retransmission* retransmission = CONTAINER_OF(node, struct retransmission, id_node);
+    array bytes = {
+        .len = len,
+        .ptr = retransmission->message,
+    };
+    if (read_coap_message(message, bytes) != OscoreNoError) {
+        sys_dlist_append(&free_list, node);
+        k_mutex_unlock(&lock);
+        return -EINVAL;
+    }
+    retransmission->len = len;
+    retransmission->id = coap_header_get_id(message);
+    retransmission->addr = *addr;
+    retransmission->retries = 0;
+    // "the initial timeout is set to a random duration [...] between ACK_TIMEOUT and
+    //  (ACK_TIMEOUT * ACK_RANDOM_FACTOR)" with ACK_RANDOM_FACTOR = 1.5
+    u32_t timeout_ms = COAP_ACK_TIMEOUT_MS + sys_rand32_get() % (COAP_ACK_TIMEOUT_MS / 2);
+    retransmission->timeout = timeout_ms / RETRANSMIT_TICK_MS;
+    sys_dlist_append(id_bucket(retransmission->id), &retransmission->id_node);
+
+    if (wheel.count == 0) {
+        last_tick_ms = k_uptime_get_32();
+        k_delayed_work_submit(&tick_work, RETRANSMIT_TICK_MS);
+    }
+    timer_wheel_insert(&wheel, &retransmission->timer, retransmission->timeout);
+    k_mutex_unlock(&lock);
+    return 0;
+}
+
+bool retransmit_received(struct coap_packet* received, const struct sockaddr* from) {
+    u8_t type = coap_header_get_type(received);
+    if (type != COAP_TYPE_ACK && type != COAP_TYPE_RESET) {
+        return false;
+    }
+    u16_t id = coap_header_get_id(received);
+
+    k_mutex_lock(&lock, K_FOREVER);
+    struct retransmission* retransmission;
+    SYS_DLIST_FOR_EACH_CONTAINER(id_bucket(id), retransmission, id_node) {
+        if (retransmission->id == id && addr_equals(&retransmission->addr, from)) {
+            release(retransmission);
+            k_mutex_unlock(&lock);
+            return true;
+        }
+    }
+    k_mutex_unlock(&lock);
+    return false;
+}
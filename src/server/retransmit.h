@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_RETRANSMIT_H
+#define NONE_RETRANSMIT_H
+
+#include <stdbool.h>
+#include <net/coap.h>
+
+/// CoAP ACK_TIMEOUT in milliseconds (RFC7252 4.8)
+#define COAP_ACK_TIMEOUT_MS 2000
+/// CoAP MAX_RETRANSMIT (RFC7252 4.8)
+#define COAP_MAX_RETRANSMIT 4
+
+/// Maximum number of outstanding confirmable messages
+#define NUM_RETRANSMISSIONS 16
+/// Maximum length of a serialized confirmable message
+#define RETRANSMISSION_MAX_LEN 128
+/// Resolution of the retransmission timer wheel in milliseconds
+#define RETRANSMIT_TICK_MS 100
+
+/**
+ * Initializes the retransmission scheduler.
+ * Must be called once before any other retransmit function.
+ */
+void retransmit_init(void);
+
+/**
+ * Schedules the retransmission of a confirmable message until it is acknowledged or MAX_RETRANSMIT is reached.
+ *
+ * The message is copied, thus the exact same bytes (e.g. the same OSCORE ciphertext) are sent again on every
+ * retransmission. The packet itself is not consumed and still needs to be sent by the caller.
+ * @param message Locally built confirmable message
+ * @param addr Address to retransmit the message to
+ * @return 0 on success, -ENOMEM if all retransmission slots are in use, -EMSGSIZE if the message is too long
+ */
+int retransmit_add(struct coap_packet* message, const struct sockaddr* addr);
+
+/**
+ * Stops the retransmission of the confirmable message acknowledged or reset by @a received.
+ * @param received Received packet
+ * @param from Address the packet was received from
+ * @return true if @a received is an ACK or RST for an outstanding confirmable message
+ */
+bool retransmit_received(struct coap_packet* received, const struct sockaddr* from);
+
+#endif //NONE_RETRANSMIT_H
@@ -9,11 +9,31 @@
  * except according to those terms.
  */
 
+#include <errno.h>
 #include "util/error.h"
 #include "util/array.h"
 #include "util/macros.h"
 #include "crypto/hkdf.h"
 #include "crypto/security_context.h"
+#include "crypto/aes.h"
+#include "crypto/replay.h"
+#include "util/timer_wheel.h"
+#include "codec/oscore_option.h"
+#include "oscore/oscore.h"
+#include "oscore/exchange.h"
+#include "oscore/echo.h"
+#include "oscore/snapshot.h"
+#include "oscore/pkt_pool.h"
+#include "oscore/coap_helper.h"
+#include "oscore/options.h"
+#include "oscore/response_cache.h"
+#include "server/block_session.h"
+#include "server/dedup.h"
+#include "server/outer_block.h"
+#include "server/rate_limit.h"
+#include "util/scratch.h"
+#include "util/trace.h"
+#include "util/profile.h"
 
 void test_hkdf_sha256_tc1() {
     u8_t ikm_bytes[22] = { 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b,
@@ -194,3 +214,1253 @@ void test_derive_common_iv() {
     SYS_LOG_INF("test_derive_common_iv successful");
 }
 
+
+void test_aes_ccm_stream() {
+    u8_t key[16] = { 0xf0, 0x91, 0x0e, 0xd7, 0x29, 0x5e, 0x6a, 0xd4,
+                     0xb5, 0x4f, 0xc7, 0x93, 0x15, 0x43, 0x02, 0xff };
+    u8_t nonce[13] = { 0x46, 0x22, 0xd4, 0xdd, 0x6d, 0x94, 0x41, 0x68,
+                       0xee, 0xfb, 0x54, 0x98, 0x68 };
+    u8_t enc_structure[20] = { 0x83, 0x68, 0x45, 0x6e, 0x63, 0x72, 0x79, 0x70, 0x74, 0x30,
+                               0x40, 0x48, 0x85, 0x01, 0x81, 0x0a, 0x40, 0x41, 0x14, 0x40 };
+    u8_t plaintext[5] = { 0x01, 0xb3, 0x74, 0x76, 0x31 };
+    u8_t expected[13] = { 0x61, 0x2f, 0x10, 0x92, 0xf1, 0x77, 0x6f, 0x1c,
+                          0x16, 0x68, 0xb3, 0x82, 0x5e };
+    array ad = {
+        .len = sizeof(enc_structure),
+        .ptr = enc_structure,
+    };
+
+    struct tc_aes_key_sched_struct sched;
+    assert_no_error(aes_expand_key(key, &sched));
+
+    // encrypt in chunks of 2 and 3 bytes
+    u8_t ciphertext[13];
+    struct aes_ccm_stream stream;
+    assert_no_error(aes_ccm_stream_init(&stream, &sched, nonce, ad, sizeof(plaintext)));
+    array first_in = { .len = 2, .ptr = &plaintext[0] };
+    array first_out = { .len = 2, .ptr = &ciphertext[0] };
+    assert_no_error(aes_ccm_stream_encrypt(&stream, first_in, first_out));
+    array second_in = { .len = 3, .ptr = &plaintext[2] };
+    array second_out = { .len = 3, .ptr = &ciphertext[2] };
+    assert_no_error(aes_ccm_stream_encrypt(&stream, second_in, second_out));
+    array tag = { .len = AES_CCM_TAG_LEN, .ptr = &ciphertext[5] };
+    assert_no_error(aes_ccm_stream_tag(&stream, tag));
+    if (memcmp(ciphertext, expected, sizeof(expected)) != 0) {
+        SYS_LOG_ERR("test_aes_ccm_stream failed with invalid output");
+        log_hex("ciphertext", ciphertext, sizeof(ciphertext));
+        log_hex("expected", expected, sizeof(expected));
+        panic("spinning...");
+    }
+
+    // decrypt in place
+    assert_no_error(aes_ccm_stream_init(&stream, &sched, nonce, ad, sizeof(plaintext)));
+    array decrypted = { .len = 5, .ptr = &ciphertext[0] };
+    assert_no_error(aes_ccm_stream_decrypt(&stream, decrypted, decrypted));
+    assert_no_error(aes_ccm_stream_verify(&stream, tag));
+    if (memcmp(decrypted.ptr, plaintext, sizeof(plaintext)) != 0) {
+        SYS_LOG_ERR("test_aes_ccm_stream failed with invalid decryption");
+        log_hex("decrypted", decrypted.ptr, decrypted.len);
+        panic("spinning...");
+    }
+
+    // a modified tag is rejected
+    assert_no_error(aes_ccm_stream_init(&stream, &sched, nonce, ad, sizeof(plaintext)));
+    array received = { .len = 5, .ptr = &expected[0] };
+    assert_no_error(aes_ccm_stream_decrypt(&stream, received, decrypted));
+    expected[12] ^= 1;
+    array invalid_tag = { .len = AES_CCM_TAG_LEN, .ptr = &expected[5] };
+    assert_eq(aes_ccm_stream_verify(&stream, invalid_tag), OscoreTinyCryptError);
+    SYS_LOG_INF("test_aes_ccm_stream successful");
+}
+
+/// advances the wheel by @a ticks and returns the number of expired timers, which must be @a expected_entry (if not NULL)
+static u32_t tick_timer_wheel(struct timer_wheel* wheel, u32_t ticks, struct timer_wheel_entry* expected_entry) {
+    u32_t num_expired = 0;
+    for (u32_t i = 0; i < ticks; i++) {
+        sys_dlist_t expired;
+        sys_dlist_init(&expired);
+        timer_wheel_tick(wheel, &expired);
+        sys_dnode_t* node;
+        while ((node = sys_dlist_get(&expired)) != NULL) {
+            if (expected_entry != NULL && node != &expected_entry->node) {
+                panic("test_timer_wheel failed: unexpected timer expired at tick %u", wheel->now);
+            }
+            num_expired++;
+        }
+    }
+    return num_expired;
+}
+
+void test_timer_wheel() {
+    static struct timer_wheel wheel;
+    struct timer_wheel_entry short_timer = { .scheduled = false };
+    struct timer_wheel_entry long_timer = { .scheduled = false };
+    struct timer_wheel_entry canceled_timer = { .scheduled = false };
+    timer_wheel_init(&wheel);
+
+    timer_wheel_insert(&wheel, &short_timer, 20);
+    // larger than one level, needs to be cascaded
+    timer_wheel_insert(&wheel, &long_timer, 150);
+    timer_wheel_insert(&wheel, &canceled_timer, 40);
+    assert_eq(wheel.count, 3);
+
+    timer_wheel_cancel(&wheel, &canceled_timer);
+    assert_eq(wheel.count, 2);
+
+    assert_eq(tick_timer_wheel(&wheel, 19, NULL), 0);
+    assert_eq(tick_timer_wheel(&wheel, 1, &short_timer), 1);
+    assert_eq(tick_timer_wheel(&wheel, 129, NULL), 0);
+    assert_eq(tick_timer_wheel(&wheel, 1, &long_timer), 1);
+    assert_eq(wheel.count, 0);
+
+    // rescheduling replaces the previous expiry
+    timer_wheel_insert(&wheel, &short_timer, 5);
+    timer_wheel_insert(&wheel, &short_timer, 70);
+    assert_eq(tick_timer_wheel(&wheel, 69, NULL), 0);
+    assert_eq(tick_timer_wheel(&wheel, 1, &short_timer), 1);
+    SYS_LOG_INF("test_timer_wheel successful");
+}
+
+void test_response_option_savings() {
+    // server sender ID of RFC8613 C.1.2
+    u8_t sender_id_bytes[1] = { 0x01 };
+    u8_t seq_num_bytes[5] = { 0x01, 0x02, 0x03, 0x04, 0x05 };
+    array sender_id = { .len = sizeof(sender_id_bytes), .ptr = sender_id_bytes };
+    struct unprotected reused = {
+        .partial_iv = EMPTY_ARRAY,
+        .kid = NULL_ARRAY,
+        .kid_context = NULL_ARRAY,
+    };
+    assert_eq(option_value_length(reused), 0);
+    u8_t value_bytes[16];
+    array value = { .len = 0, .ptr = value_bytes };
+    assert_no_error(to_oscore_option(reused, value));
+
+    // an empty option decodes to no Partial IV and no kid
+    u8_t piv_bytes[8];
+    u8_t kid_bytes[8];
+    u8_t kid_context_bytes[16];
+    struct unprotected decoded = {
+        .partial_iv = { .len = sizeof(piv_bytes), .ptr = piv_bytes },
+        .kid = { .len = sizeof(kid_bytes), .ptr = kid_bytes },
+        .kid_context = { .len = sizeof(kid_context_bytes), .ptr = kid_context_bytes },
+    };
+    assert_no_error(from_oscore_option(value, &decoded));
+    assert_eq(decoded.partial_iv.len, 0);
+    assert_eq(decoded.kid.len, 0);
+
+    // a fresh Partial IV costs the flag byte, the Partial IV and the kid, see the option_savings runs of oscore_bench
+    for (size_t piv_len = 1; piv_len <= sizeof(seq_num_bytes); piv_len++) {
+        struct unprotected fresh = {
+            .partial_iv = { .len = piv_len, .ptr = seq_num_bytes },
+            .kid = sender_id,
+            .kid_context = NULL_ARRAY,
+        };
+        assert_eq(option_value_length(fresh), 1 + piv_len + sender_id.len);
+    }
+    SYS_LOG_INF("test_response_option_savings successful");
+}
+
+void test_exchange_table() {
+    struct oscore_request request = { .kid = { 0x01 }, .kid_len = 1, .piv = { 0x14 }, .piv_len = 1 };
+    struct oscore_request found;
+    exchange_init();
+
+    // NSTART requests in flight, each with its own token
+    for (u8_t i = 0; i < NUM_OSCORE_EXCHANGES; i++) {
+        u8_t token[2] = { 0x4a, i };
+        request.piv[0] = i;
+        assert_no_error(exchange_add(token, sizeof(token), &request, i == 0));
+    }
+    u8_t extra_token[2] = { 0x4b, 0x00 };
+    assert_eq(exchange_add(extra_token, sizeof(extra_token), &request, false), OscoreTooManyExchanges);
+    u8_t used_token[2] = { 0x4a, 0x03 };
+    exchange_remove(used_token, sizeof(used_token));
+    assert_no_error(exchange_add(used_token, sizeof(used_token), &request, false));
+    assert_eq(exchange_add(used_token, sizeof(used_token), &request, false), OscoreTokenInUse);
+
+    // responses may arrive in any order
+    u8_t token[2] = { 0x4a, 0x05 };
+    assert_no_error(exchange_find(token, sizeof(token), &found));
+    assert_eq(found.piv[0], 0x05);
+    exchange_complete(token, sizeof(token));
+    assert_eq(exchange_find(token, sizeof(token), &found), OscoreUnknownExchange);
+
+    // an Observe registration is kept for all notifications
+    u8_t observe_token[2] = { 0x4a, 0x00 };
+    exchange_complete(observe_token, sizeof(observe_token));
+    assert_no_error(exchange_find(observe_token, sizeof(observe_token), &found));
+    exchange_remove(observe_token, sizeof(observe_token));
+    assert_eq(exchange_find(observe_token, sizeof(observe_token), &found), OscoreUnknownExchange);
+    SYS_LOG_INF("test_exchange_table successful");
+}
+
+void test_replay_window() {
+    struct replay_state state = { .initialized = false };
+    u8_t piv_bytes[2];
+    array piv = { .len = sizeof(piv_bytes), .ptr = piv_bytes };
+
+    // 0x0100, then out of order 0x00ff and 0x0120
+    piv_bytes[0] = 0x01; piv_bytes[1] = 0x00;
+    assert_actually(replay_check(&state, piv), "first Partial IV rejected");
+    replay_update(&state, piv);
+    assert_actually(!replay_check(&state, piv), "replay accepted");
+    piv_bytes[0] = 0x00; piv_bytes[1] = 0xff;
+    assert_actually(replay_check(&state, piv), "older Partial IV inside the window rejected");
+    replay_update(&state, piv);
+    assert_actually(!replay_check(&state, piv), "replay of an older Partial IV accepted");
+    piv_bytes[0] = 0x01; piv_bytes[1] = 0x20;
+    replay_update(&state, piv);
+
+    // the window moved by 32, 0x00ff is too old now, 0x0101 is still unused
+    piv_bytes[0] = 0x00; piv_bytes[1] = 0xff;
+    assert_actually(!replay_check(&state, piv), "Partial IV outside the window accepted");
+    piv_bytes[0] = 0x01; piv_bytes[1] = 0x01;
+    assert_actually(replay_check(&state, piv), "unused Partial IV inside the window rejected");
+    SYS_LOG_INF("test_replay_window successful");
+}
+
+void test_pkt_pool() {
+    struct pkt_pool_stats before;
+    struct pkt_pool_stats stats;
+    struct net_pkt* pkts[OSCORE_TX_PKT_COUNT];
+    struct net_pkt* pkt;
+    pkt_pool_get_stats(&before);
+    u32_t available = OSCORE_TX_PKT_COUNT - before.tx_used;
+
+    for (u32_t i = 0; i < available; i++) {
+        assert_no_error(pkt_pool_get(false, K_NO_WAIT, &pkts[i]));
+    }
+    pkt_pool_get_stats(&stats);
+    assert_eq(stats.tx_used, OSCORE_TX_PKT_COUNT);
+    assert_eq(stats.tx_high_water, OSCORE_TX_PKT_COUNT);
+    assert_eq(stats.failures, before.failures);
+
+    // every allocation which runs into the exhausted pool counts, whether it waited or not
+    assert_eq(pkt_pool_get(false, K_NO_WAIT, &pkt), OscorePktError);
+    assert_eq(pkt_pool_get(false, OSCORE_PKT_TIMEOUT_MS, &pkt), OscorePktError);
+    pkt_pool_get_stats(&stats);
+    assert_eq(stats.failures, before.failures + 2);
+    // decrypted requests don't take TX packets
+    assert_no_error(pkt_pool_get(true, K_NO_WAIT, &pkt));
+    net_pkt_unref(pkt);
+
+    for (u32_t i = 0; i < available; i++) {
+        net_pkt_unref(pkts[i]);
+    }
+    assert_no_error(pkt_pool_get(false, K_NO_WAIT, &pkt));
+    net_pkt_unref(pkt);
+    pkt_pool_get_stats(&stats);
+    assert_eq(stats.tx_used, before.tx_used);
+    assert_eq(stats.tx_high_water, OSCORE_TX_PKT_COUNT);
+    assert_eq(stats.failures, before.failures + 2);
+    SYS_LOG_INF("test_pkt_pool successful");
+}
+
+void test_scratch_arena() {
+    size_t outer = scratch_mark();
+    u8_t* a = scratch_alloc(3);
+    assert_actually(a != NULL, "small allocation failed");
+    size_t inner = scratch_mark();
+    assert_eq(inner, outer + 8);
+    u8_t* b = scratch_alloc(0);
+    assert_actually(b != NULL, "empty allocation failed");
+    uintptr_t misalignment = ((uintptr_t) b) % 8;
+    assert_eq(misalignment, 0);
+
+    // releasing frees everything allocated after the mark, so the next allocation reuses the memory
+    scratch_release(inner);
+    u8_t* c = scratch_alloc(16);
+    assert_actually(c == b, "released memory not reused");
+
+    struct scratch_stats before;
+    scratch_get_stats(&before);
+    assert_actually(scratch_alloc(SCRATCH_SIZE) == NULL, "oversized allocation succeeded");
+    struct scratch_stats after;
+    scratch_get_stats(&after);
+    assert_eq(after.failures, before.failures + 1);
+    assert_actually(after.high_water >= inner - outer + 16, "high water mark too low");
+
+    scratch_release(outer);
+    assert_eq(scratch_mark(), outer);
+    SYS_LOG_INF("test_scratch_arena successful");
+}
+
+void test_coap_message_layout() {
+    u8_t token[1] = { 0xab };
+    struct net_pkt* pkt;
+    struct coap_packet message;
+    assert_no_error(pkt_pool_get(false, K_NO_WAIT, &pkt));
+    assert_eq(coap_packet_init(&message, pkt, 1, 0, sizeof(token), token, COAP_METHOD_GET, 0x1234), 0);
+    assert_eq(coap_packet_append_option(&message, COAP_OPTION_URI_PATH, (u8_t*) "oscore", 6), 0);
+    assert_eq(coap_packet_append_option(&message, COAP_OPTION_URI_PATH, (u8_t*) "hello", 5), 0);
+    // options must be appended in ascending order
+    assert_actually(coap_packet_append_option(&message, COAP_OPTION_OBSERVE, NULL, 0) != 0, "unordered option accepted");
+    assert_eq(coap_packet_append_payload_marker(&message), 0);
+    assert_eq(coap_packet_append_payload(&message, (u8_t*) "hi", 2), 0);
+
+    u8_t expected[] = {
+        0x41, 0x01, 0x12, 0x34, 0xab,
+        0xb6, 'o', 's', 'c', 'o', 'r', 'e',
+        0x05, 'h', 'e', 'l', 'l', 'o',
+        0xff, 'h', 'i',
+    };
+    assert_eq(coap_message_len(&message), sizeof(expected));
+    assert_eq(message.hdr_len, 5);
+    assert_eq(message.opt_len, 13);
+    u8_t bytes[sizeof(expected)];
+    array out = { .len = sizeof(bytes), .ptr = bytes };
+    assert_no_error(read_coap_message(&message, out));
+    assert_actually(memcmp(bytes, expected, sizeof(expected)) == 0, "unexpected encoding");
+    assert_eq(coap_header_get_id(&message), 0x1234);
+    assert_eq(coap_header_get_code(&message), COAP_METHOD_GET);
+
+    // the payload of a locally built message starts with the payload marker
+    struct payload_info info;
+    assert_no_error(get_payload_info(&message, &info));
+    assert_eq(info.len, 3);
+    net_pkt_unref(pkt);
+    SYS_LOG_INF("test_coap_message_layout successful");
+}
+
+void test_class_e_option_encoding() {
+    // Uri-Host (Class U), Uri-Path, Max-Age, Proxy-Scheme (Class U), Size1
+    struct coap_option options[5] = {
+        { .delta = COAP_OPTION_URI_HOST, .len = 1, .value = { 'h' } },
+        { .delta = COAP_OPTION_URI_PATH - COAP_OPTION_URI_HOST, .len = 1, .value = { 'a' } },
+        // 3 after Uri-Path, which would be Uri-Host if the class was checked against the delta
+        { .delta = COAP_OPTION_MAX_AGE - COAP_OPTION_URI_PATH, .len = 1, .value = { 0x3c } },
+        { .delta = COAP_OPTION_PROXY_SCHEME - COAP_OPTION_MAX_AGE, .len = 1, .value = { 'c' } },
+        { .delta = COAP_OPTION_SIZE1 - COAP_OPTION_PROXY_SCHEME, .len = 1, .value = { 0x40 } },
+    };
+    // deltas are relative to the previous Class E option, Size1 needs an extended delta after Max-Age
+    u8_t expected[] = { 0xb1, 'a', 0x31, 0x3c, 0xd1, COAP_OPTION_SIZE1 - COAP_OPTION_MAX_AGE - 13, 0x40 };
+    u8_t encoded[sizeof(expected)];
+    assert_eq(encoded_option_len(options, 5, CLASS_E), sizeof(expected));
+    assert_eq(encode_options(options, 5, CLASS_E, encoded), sizeof(expected));
+    assert_actually(memcmp(encoded, expected, sizeof(expected)) == 0, "wrong Class E options");
+    SYS_LOG_INF("test_class_e_option_encoding successful");
+}
+
+void test_security_contexts() {
+    static u8_t recipient_ids[OSCORE_MAX_CONTEXTS][2];
+    assert_no_error(oscore_init(PRE_ESTABLISHED));
+    // requests are assigned to their context by kid, so Recipient IDs have to be unique
+    assert_eq(oscore_add_context(PRE_ESTABLISHED), OscoreInvalidKid);
+    // IDs are stored inline, the nonce limits them to OSCORE_MAX_ID_LEN bytes
+    u8_t long_id[OSCORE_MAX_ID_LEN + 1] = { 0 };
+    struct pre_established long_peer = {
+        .master_secret = PRE_ESTABLISHED.master_secret,
+        .sender_id = PRE_ESTABLISHED.sender_id,
+        .recipient_id = { .len = sizeof(long_id), .ptr = long_id },
+        .common_id_context = PRE_ESTABLISHED.common_id_context,
+        .opt = PRE_ESTABLISHED.opt,
+    };
+    assert_eq(oscore_add_context(long_peer), OscoreInvalidKidLength);
+    for (size_t i = 1; i < OSCORE_MAX_CONTEXTS; i++) {
+        recipient_ids[i][0] = (u8_t) (i >> 8);
+        recipient_ids[i][1] = (u8_t) i;
+        struct pre_established peer = {
+            .master_secret = PRE_ESTABLISHED.master_secret,
+            .sender_id = PRE_ESTABLISHED.sender_id,
+            .recipient_id = { .len = sizeof(recipient_ids[i]), .ptr = recipient_ids[i] },
+            .common_id_context = PRE_ESTABLISHED.common_id_context,
+            .opt = PRE_ESTABLISHED.opt,
+        };
+        assert_no_error(oscore_add_context(peer));
+    }
+    assert_eq(oscore_add_context(PRE_ESTABLISHED), OscoreTooManyContexts);
+    // dropped again
+    assert_no_error(oscore_init(PRE_ESTABLISHED));
+    SYS_LOG_INF("test_security_contexts successful");
+}
+
+/// Receives the RFC8613 Test Vector 4 request, or one from @a kid whose payload doesn't decrypt if @a garbage is set
+static void test_vector_request(array kid, bool garbage, struct coap_packet* out) {
+    u8_t message[] = {
+        0x44, 0x02, 0x5d, 0x1f, 0x00, 0x00, 0x39, 0x74,
+        0x39, 'l', 'o', 'c', 'a', 'l', 'h', 'o', 's', 't',
+        0x62, 0x09, 0x14,
+        0xff, 0x61, 0x2f, 0x10, 0x92, 0xf1, 0x77, 0x6f, 0x1c, 0x16, 0x68, 0xb3, 0x82, 0x5e,
+    };
+    // Partial IV 1 and the kid, and a shorter payload
+    u8_t garbage_option[] = { (u8_t) (0x60 + 2 + kid.len), 0x09, 0x01 };
+    u8_t headers[NET_IPV6H_LEN + NET_UDPH_LEN] = { 0 };
+    struct net_pkt* pkt;
+    assert_no_error(pkt_pool_get(true, K_NO_WAIT, &pkt));
+    // received packets start with the IPv6 and UDP header
+    net_pkt_set_ip_hdr_len(pkt, NET_IPV6H_LEN);
+    assert_actually(net_pkt_append_all(pkt, sizeof(headers), headers, K_NO_WAIT), "append failed");
+    if (garbage) {
+        assert_actually(net_pkt_append_all(pkt, 18, message, K_NO_WAIT), "append failed");
+        assert_actually(net_pkt_append_all(pkt, sizeof(garbage_option), garbage_option, K_NO_WAIT), "append failed");
+        assert_actually(net_pkt_append_all(pkt, (u16_t) kid.len, kid.ptr, K_NO_WAIT), "append failed");
+        assert_actually(net_pkt_append_all(pkt, 10, &message[21], K_NO_WAIT), "append failed");
+    } else {
+        assert_actually(net_pkt_append_all(pkt, sizeof(message), message, K_NO_WAIT), "append failed");
+    }
+    assert_eq(coap_packet_parse(out, pkt, NULL, 0), 0);
+}
+
+void test_context_snapshot() {
+    static u8_t snapshot_bytes[SNAPSHOT_HEADER_LEN + SNAPSHOT_ENTRY_LEN + SNAPSHOT_TAG_LEN];
+    u8_t key_bytes[16] = { 0x5e, 0xc2, 0x37 };
+    array key = { .len = sizeof(key_bytes), .ptr = key_bytes };
+    array snapshot = { .len = sizeof(snapshot_bytes), .ptr = snapshot_bytes };
+    struct oscore_context_stats stats;
+    struct coap_packet request;
+    struct coap_packet decrypted;
+
+    assert_no_error(oscore_init(PRE_ESTABLISHED));
+    assert_actually(!oscore_snapshot_due(), "snapshot due without any");
+    assert_eq(oscore_snapshot_len(), sizeof(snapshot_bytes));
+    test_vector_request(PRE_ESTABLISHED.recipient_id, false, &request);
+    assert_no_error(from_oscore(request, &decrypted));
+    net_pkt_unref(decrypted.pkt);
+    assert_no_error(oscore_snapshot_save(key, snapshot));
+    assert_actually(!oscore_snapshot_due(), "snapshot due right after saving it");
+
+    // restored without derivation, with the replay window
+    assert_no_error(oscore_restore(&PRE_ESTABLISHED, 1, key, snapshot));
+    oscore_get_context_stats(&stats);
+    assert_eq(stats.derivations, 0);
+    assert_eq(stats.restored, 1);
+    // the restored contexts continue at the reserved sequence numbers, which another reset would restore again
+    assert_actually(oscore_snapshot_due(), "no snapshot due after restoring one");
+    test_vector_request(PRE_ESTABLISHED.recipient_id, false, &request);
+    assert_eq(from_oscore(request, &decrypted), OscoreReplayedPartialIv);
+    net_pkt_unref(request.pkt);
+
+    // derived if the pre-established material changed
+    u8_t other_secret[16] = { 0 };
+    struct pre_established other = {
+        .master_secret = { .len = sizeof(other_secret), .ptr = other_secret },
+        .sender_id = PRE_ESTABLISHED.sender_id,
+        .recipient_id = PRE_ESTABLISHED.recipient_id,
+        .common_id_context = PRE_ESTABLISHED.common_id_context,
+        .opt = PRE_ESTABLISHED.opt,
+    };
+    assert_no_error(oscore_restore(&other, 1, key, snapshot));
+    oscore_get_context_stats(&stats);
+    assert_eq(stats.restored, 0);
+
+    // rejected with another key or if modified
+    key_bytes[0] ^= 1;
+    assert_eq(oscore_restore(&PRE_ESTABLISHED, 1, key, snapshot), OscoreInvalidSnapshot);
+    key_bytes[0] ^= 1;
+    snapshot_bytes[SNAPSHOT_HEADER_LEN + SNAPSHOT_ENTRY_LEN / 2] ^= 1;
+    assert_eq(oscore_restore(&PRE_ESTABLISHED, 1, key, snapshot), OscoreInvalidSnapshot);
+    snapshot_bytes[4] = SNAPSHOT_VERSION + 1;
+    assert_eq(oscore_restore(&PRE_ESTABLISHED, 1, key, snapshot), OscoreInvalidSnapshot);
+
+    assert_no_error(oscore_init(PRE_ESTABLISHED));
+    SYS_LOG_INF("test_context_snapshot successful");
+}
+
+/// Protects a GET request with the first security context and cancels it again
+static OscoreError test_protect_and_cancel(u8_t token) {
+    struct net_pkt* pkt;
+    struct coap_packet request;
+    struct coap_packet protected;
+    assert_no_error(pkt_pool_get(false, K_NO_WAIT, &pkt));
+    assert_eq(coap_packet_init(&request, pkt, 1, COAP_TYPE_CON, 1, &token, COAP_METHOD_GET, token), 0);
+    OscoreError res = oscore_protect_request(request, &protected);
+    if (res != OscoreNoError) {
+        net_pkt_unref(request.pkt);
+        return res;
+    }
+    net_pkt_unref(protected.pkt);
+    oscore_cancel_request(&token, 1);
+    return OscoreNoError;
+}
+
+void test_sequence_reservation() {
+    static u8_t snapshot_bytes[SNAPSHOT_HEADER_LEN + SNAPSHOT_ENTRY_LEN + SNAPSHOT_TAG_LEN];
+    u8_t key_bytes[16] = { 0x5e, 0xc2, 0x37 };
+    array key = { .len = sizeof(key_bytes), .ptr = key_bytes };
+    array snapshot = { .len = sizeof(snapshot_bytes), .ptr = snapshot_bytes };
+
+    // unlimited until the first snapshot
+    assert_no_error(oscore_init(PRE_ESTABLISHED));
+    assert_no_error(test_protect_and_cancel(1));
+    assert_no_error(oscore_snapshot_save(key, snapshot));
+    for (u32_t i = 0; i < OSCORE_SEQ_RESERVATION; i++) {
+        assert_no_error(test_protect_and_cancel((u8_t) i));
+    }
+    assert_actually(oscore_snapshot_due(), "no snapshot due with the reservation used up");
+    assert_eq(test_protect_and_cancel(1), OscoreSequenceExhausted);
+
+    // a restored context sends nothing until it is saved again
+    assert_no_error(oscore_restore(&PRE_ESTABLISHED, 1, key, snapshot));
+    assert_eq(test_protect_and_cancel(1), OscoreSequenceExhausted);
+    assert_no_error(oscore_snapshot_save(key, snapshot));
+    assert_no_error(test_protect_and_cancel(1));
+
+    assert_no_error(oscore_init(PRE_ESTABLISHED));
+    SYS_LOG_INF("test_sequence_reservation successful");
+}
+
+/// Puts a serialized CoAP message behind IP and UDP headers and parses it like a received one
+static void test_receive_message(array message, struct coap_packet* out) {
+    u8_t headers[NET_IPV6H_LEN + NET_UDPH_LEN] = { 0 };
+    struct net_pkt* pkt;
+    assert_no_error(pkt_pool_get(true, K_NO_WAIT, &pkt));
+    net_pkt_set_ip_hdr_len(pkt, NET_IPV6H_LEN);
+    assert_actually(net_pkt_append_all(pkt, sizeof(headers), headers, K_NO_WAIT), "append failed");
+    assert_actually(net_pkt_append_all(pkt, (u16_t) message.len, message.ptr, K_NO_WAIT), "append failed");
+    assert_eq(coap_packet_parse(out, pkt, NULL, 0), 0);
+}
+
+/// Serializes a locally built packet and parses the copy like a received one, @a sent is released
+static void test_receive(struct coap_packet* sent, struct coap_packet* out) {
+    u8_t message_bytes[256];
+    array message = { .len = coap_message_len(sent), .ptr = message_bytes };
+    assert_actually(message.len <= sizeof(message_bytes), "message too long");
+    assert_no_error(read_coap_message(sent, message));
+    net_pkt_unref(sent->pkt);
+    test_receive_message(message, out);
+}
+
+/**
+ * Builds a received POST request with an OSCORE Option and a payload of zeros.
+ * @param piv_len Length of the Partial IV, which is 1 with leading zeros. 0xff for a request without OSCORE Option.
+ */
+static void test_prefilter_request(u8_t piv_len, array kid, u16_t payload_len, struct coap_packet* out) {
+    u8_t token = 1;
+    u8_t option[12] = { (u8_t) (0x08 | piv_len) };
+    u8_t payload[16] = { 0 };
+    struct net_pkt* pkt;
+    struct coap_packet request;
+    assert_no_error(pkt_pool_get(false, K_NO_WAIT, &pkt));
+    assert_eq(coap_packet_init(&request, pkt, 1, COAP_TYPE_CON, 1, &token, COAP_METHOD_POST, 1), 0);
+    if (piv_len != 0xff) {
+        if (piv_len > 0) {
+            option[piv_len] = 1;
+        }
+        assert_actually(1 + piv_len + kid.len <= sizeof(option), "OSCORE Option too long");
+        memcpy(&option[1 + piv_len], kid.ptr, kid.len);
+        assert_eq(coap_packet_append_option(&request, COAP_OPTION_OSCORE, option, (u16_t) (1 + piv_len + kid.len)), 0);
+    }
+    if (payload_len > 0) {
+        assert_eq(coap_packet_append_payload_marker(&request), 0);
+        assert_eq(coap_packet_append_payload(&request, payload, payload_len), 0);
+    }
+    test_receive(&request, out);
+}
+
+/// Runs `oscore_prefilter` on @a request, releases it and returns the result
+static OscoreError test_prefilter(struct coap_packet* request) {
+    OscoreError res = oscore_prefilter(request);
+    net_pkt_unref(request->pkt);
+    return res;
+}
+
+void test_prefilter_drops() {
+    u8_t unknown_kid_bytes[] = { 0xee };
+    array unknown_kid = { .len = sizeof(unknown_kid_bytes), .ptr = unknown_kid_bytes };
+    array kid = PRE_ESTABLISHED.recipient_id;
+    struct oscore_drop_stats before;
+    struct oscore_drop_stats after;
+    struct coap_packet request;
+    struct coap_packet decrypted;
+    assert_no_error(oscore_init(PRE_ESTABLISHED));
+    // the counters are never reset
+    oscore_get_drop_stats(&before);
+
+    test_prefilter_request(0xff, kid, 1 + AES_CCM_TAG_LEN, &request);
+    assert_eq(test_prefilter(&request), OscoreNoOscoreOption);
+    test_prefilter_request(1, unknown_kid, 1 + AES_CCM_TAG_LEN, &request);
+    assert_eq(test_prefilter(&request), OscoreInvalidKid);
+    test_prefilter_request(6, kid, 1 + AES_CCM_TAG_LEN, &request);
+    assert_eq(test_prefilter(&request), OscoreInvalidPartialIvLength);
+    test_prefilter_request(0, kid, 1 + AES_CCM_TAG_LEN, &request);
+    assert_eq(test_prefilter(&request), OscoreInvalidPartialIvLength);
+    test_prefilter_request(1, kid, 0, &request);
+    assert_eq(test_prefilter(&request), OscoreCoapPacketNoPayload);
+    test_prefilter_request(1, kid, AES_CCM_TAG_LEN, &request);
+    assert_eq(test_prefilter(&request), OscoreCoapPacketNoPayload);
+    // passing the filter doesn't mean that the request decrypts
+    test_prefilter_request(5, kid, 1 + AES_CCM_TAG_LEN, &request);
+    assert_no_error(test_prefilter(&request));
+
+    test_vector_request(kid, false, &request);
+    assert_no_error(oscore_prefilter(&request));
+    assert_no_error(from_oscore(request, &decrypted));
+    net_pkt_unref(decrypted.pkt);
+    test_vector_request(kid, false, &request);
+    assert_eq(test_prefilter(&request), OscoreReplayedPartialIv);
+
+    oscore_get_drop_stats(&after);
+    assert_eq(after.invalid_option - before.invalid_option, 1);
+    assert_eq(after.unknown_kid - before.unknown_kid, 1);
+    assert_eq(after.invalid_partial_iv - before.invalid_partial_iv, 2);
+    assert_eq(after.invalid_payload - before.invalid_payload, 2);
+    assert_eq(after.replayed - before.replayed, 1);
+    SYS_LOG_INF("test_prefilter_drops successful");
+}
+
+/// Builds a GET request for /test of the client with the given kid, as it looks after `from_oscore`
+static void test_cache_request(u8_t kid, struct coap_packet* out) {
+    // Partial IV 1 and the kid
+    u8_t oscore_option[] = { 0x09, 0x01, kid };
+    struct net_pkt* pkt;
+    struct coap_packet request;
+    assert_no_error(pkt_pool_get(false, K_NO_WAIT, &pkt));
+    assert_eq(coap_packet_init(&request, pkt, 1, COAP_TYPE_CON, 1, &kid, COAP_METHOD_GET, kid), 0);
+    assert_eq(coap_packet_append_option(&request, COAP_OPTION_OSCORE, oscore_option, sizeof(oscore_option)), 0);
+    assert_eq(coap_packet_append_option(&request, COAP_OPTION_URI_PATH, (u8_t*) "test", 4), 0);
+    test_receive(&request, out);
+}
+
+/// Caches a 2.05 response to @a request with the given Max-Age, or none if it is negative
+static void test_cache_response(struct coap_packet* request, int max_age) {
+    u8_t format = 0;
+    u8_t payload[] = { 'h', 'i' };
+    u8_t plaintext_bytes[32];
+    array plaintext = { .len = sizeof(plaintext_bytes), .ptr = plaintext_bytes };
+    struct oscore_inner inner;
+    struct coap_packet response;
+    struct net_pkt* pkt;
+    assert_no_error(pkt_pool_get(false, K_NO_WAIT, &pkt));
+    assert_eq(coap_packet_init(&response, pkt, 1, COAP_TYPE_ACK, 0, NULL, COAP_RESPONSE_CODE_CONTENT, 0), 0);
+    assert_eq(coap_packet_append_option(&response, COAP_OPTION_CONTENT_FORMAT, &format, 1), 0);
+    if (max_age >= 0) {
+        assert_eq(coap_append_option_int(&response, COAP_OPTION_MAX_AGE, (unsigned int) max_age), 0);
+    }
+    assert_eq(coap_packet_append_payload_marker(&response), 0);
+    assert_eq(coap_packet_append_payload(&response, payload, sizeof(payload)), 0);
+    assert_no_error(oscore_inner_encode(&response, plaintext, &inner));
+    assert_no_error(response_cache_add(request, &response, &inner));
+    net_pkt_unref(pkt);
+}
+
+void test_response_cache() {
+    struct coap_packet first;
+    struct coap_packet second;
+    struct coap_packet third;
+    struct response_cache_entry* entry;
+    response_cache_init();
+    test_cache_request(1, &first);
+    test_cache_request(2, &second);
+    test_cache_request(3, &third);
+
+    // without a Max-Age Option, the default one is added to the cached plaintext
+    assert_no_error(response_cache_lookup(&first, &entry));
+    assert_actually(entry == NULL, "hit before caching");
+    test_cache_response(&first, -1);
+    assert_no_error(response_cache_lookup(&first, &entry));
+    assert_actually(entry != NULL, "response not cached");
+    u8_t expected_default[] = { COAP_RESPONSE_CODE_CONTENT, 0xc1, 0x00, 0x21, COAP_DEFAULT_MAX_AGE, 0xff, 'h', 'i' };
+    assert_eq(entry->inner.plaintext.len, sizeof(expected_default));
+    assert_eq(memcmp(entry->inner.plaintext.ptr, expected_default, sizeof(expected_default)), 0);
+
+    // another client doesn't get the response of the first one
+    assert_no_error(response_cache_lookup(&second, &entry));
+    assert_actually(entry == NULL, "response of another client");
+
+    // the Max-Age of the response replaces the default one and counts down from there
+    test_cache_response(&second, 300);
+    assert_no_error(response_cache_lookup(&second, &entry));
+    assert_actually(entry != NULL, "response not cached");
+    u8_t expected_max_age[] = { COAP_RESPONSE_CODE_CONTENT, 0xc1, 0x00, 0x22, 0x01, 0x2c, 0xff, 'h', 'i' };
+    assert_eq(entry->inner.plaintext.len, sizeof(expected_max_age));
+    assert_eq(memcmp(entry->inner.plaintext.ptr, expected_max_age, sizeof(expected_max_age)), 0);
+    entry->expiry_ms -= 200 * MSEC_PER_SEC;
+    assert_no_error(response_cache_lookup(&second, &entry));
+    assert_eq(entry->inner.plaintext.ptr[4], 0x00);
+    assert_eq(entry->inner.plaintext.ptr[5], 100);
+
+    // a Max-Age of 0 isn't cached, and an expired response isn't served anymore
+    test_cache_response(&third, 0);
+    assert_no_error(response_cache_lookup(&third, &entry));
+    assert_actually(entry == NULL, "response with Max-Age 0 cached");
+    assert_no_error(response_cache_lookup(&second, &entry));
+    entry->expiry_ms = k_uptime_get_32();
+    assert_no_error(response_cache_lookup(&second, &entry));
+    assert_actually(entry == NULL, "expired response served");
+
+    struct response_cache_stats stats = response_cache_get_stats();
+    assert_eq(stats.hits, 4);
+    assert_eq(stats.misses, 4);
+    response_cache_clear();
+    net_pkt_unref(first.pkt);
+    net_pkt_unref(second.pkt);
+    net_pkt_unref(third.pkt);
+    SYS_LOG_INF("test_response_cache successful");
+}
+
+/// Protects a GET request with the first security context, with an Echo Option unless @a echo is NULL_ARRAY
+static void test_echo_request(u8_t token, array echo, struct coap_packet* out) {
+    struct net_pkt* pkt;
+    struct coap_packet request;
+    struct coap_packet protected;
+    assert_no_error(pkt_pool_get(false, K_NO_WAIT, &pkt));
+    assert_eq(coap_packet_init(&request, pkt, 1, COAP_TYPE_CON, 1, &token, COAP_METHOD_GET, token), 0);
+    assert_eq(coap_packet_append_option(&request, COAP_OPTION_URI_PATH, (u8_t*) "time", 4), 0);
+    if (echo.ptr != NULL) {
+        assert_eq(coap_packet_append_option(&request, COAP_OPTION_ECHO, echo.ptr, (u16_t) echo.len), 0);
+    }
+    assert_no_error(oscore_protect_request(request, &protected));
+    test_receive(&protected, out);
+}
+
+void test_echo_recovery() {
+    // Both sides share the table: requests are protected with the first context and verified with the second one,
+    // which protects the responses for the first one.
+    struct pre_established client = {
+        .master_secret = PRE_ESTABLISHED.master_secret,
+        .sender_id = PRE_ESTABLISHED.recipient_id,
+        .recipient_id = PRE_ESTABLISHED.sender_id,
+        .common_id_context = PRE_ESTABLISHED.common_id_context,
+        .opt = PRE_ESTABLISHED.opt,
+    };
+    assert_no_error(oscore_init(client));
+    assert_no_error(oscore_add_context(PRE_ESTABLISHED));
+    oscore_require_echo();
+    struct coap_packet first;
+    struct coap_packet request;
+    struct coap_packet decrypted;
+    struct coap_packet challenge;
+    struct coap_packet response;
+
+    // an authentic request isn't processed, but answered with a challenge
+    test_echo_request(1, NULL_ARRAY, &first);
+    assert_eq(from_oscore(first, &decrypted), OscoreEchoRequired);
+    assert_no_error(oscore_echo_challenge(&first, COAP_TYPE_ACK, 1, &challenge));
+    test_receive(&challenge, &response);
+    assert_no_error(oscore_unprotect_response(response, &decrypted));
+    assert_eq(coap_packet_parse(&decrypted, decrypted.pkt, NULL, 0), 0);
+    assert_eq(coap_header_get_code(&decrypted), COAP_RESPONSE_CODE_UNAUTHORIZED);
+    struct coap_option echo_option;
+    assert_eq(coap_find_options(&decrypted, COAP_OPTION_ECHO, &echo_option, 1), 1);
+    assert_eq(echo_option.len, OSCORE_ECHO_LEN);
+    u8_t echo_bytes[OSCORE_ECHO_LEN];
+    memcpy(echo_bytes, echo_option.value, sizeof(echo_bytes));
+    array echo = { .len = sizeof(echo_bytes), .ptr = echo_bytes };
+    net_pkt_unref(decrypted.pkt);
+
+    // only the Echo value of the challenge is accepted
+    echo_bytes[0] ^= 1;
+    test_echo_request(2, echo, &request);
+    assert_eq(from_oscore(request, &decrypted), OscoreEchoRequired);
+    net_pkt_unref(request.pkt);
+    echo_bytes[0] ^= 1;
+    test_echo_request(3, echo, &request);
+    assert_no_error(from_oscore(request, &decrypted));
+    net_pkt_unref(decrypted.pkt);
+
+    // the window starts at the echoing request, requests sent before it are rejected, later ones need no Echo
+    assert_eq(from_oscore(first, &decrypted), OscoreReplayedPartialIv);
+    net_pkt_unref(first.pkt);
+    test_echo_request(4, NULL_ARRAY, &request);
+    assert_no_error(from_oscore(request, &decrypted));
+    net_pkt_unref(decrypted.pkt);
+
+    for (u8_t token = 1; token <= 4; token++) {
+        oscore_cancel_request(&token, 1);
+    }
+    assert_no_error(oscore_init(PRE_ESTABLISHED));
+    SYS_LOG_INF("test_echo_recovery successful");
+}
+
+#ifdef OSCORE_LAZY_CONTEXTS
+void test_lazy_contexts() {
+    static u8_t recipient_ids[OSCORE_MAX_CONTEXTS][2];
+    struct oscore_context_stats stats;
+    // the material is copied, so the caller's buffers may be reused before the context is derived
+    u8_t secret[OSCORE_MAX_SECRET_LEN];
+    u8_t salt[OSCORE_MAX_SECRET_LEN];
+    u8_t sender_id[OSCORE_MAX_ID_LEN];
+    memcpy(secret, PRE_ESTABLISHED.master_secret.ptr, PRE_ESTABLISHED.master_secret.len);
+    memcpy(salt, PRE_ESTABLISHED.opt->master_salt.ptr, PRE_ESTABLISHED.opt->master_salt.len);
+    memcpy(sender_id, PRE_ESTABLISHED.sender_id.ptr, PRE_ESTABLISHED.sender_id.len);
+    struct pre_established_opt opt = {
+        .aead_alg = PRE_ESTABLISHED.opt->aead_alg,
+        .master_salt = { .len = PRE_ESTABLISHED.opt->master_salt.len, .ptr = salt },
+    };
+    struct pre_established first = {
+        .master_secret = { .len = PRE_ESTABLISHED.master_secret.len, .ptr = secret },
+        .sender_id = { .len = PRE_ESTABLISHED.sender_id.len, .ptr = sender_id },
+        .recipient_id = PRE_ESTABLISHED.recipient_id,
+        .common_id_context = PRE_ESTABLISHED.common_id_context,
+        .opt = &opt,
+    };
+    assert_no_error(oscore_init(first));
+    memset(secret, 0, sizeof(secret));
+    memset(salt, 0, sizeof(salt));
+    memset(sender_id, 0, sizeof(sender_id));
+    for (size_t i = 1; i < OSCORE_MAX_CONTEXTS; i++) {
+        recipient_ids[i][0] = (u8_t) (i >> 8);
+        recipient_ids[i][1] = (u8_t) i;
+        struct pre_established peer = {
+            .master_secret = PRE_ESTABLISHED.master_secret,
+            .sender_id = PRE_ESTABLISHED.sender_id,
+            .recipient_id = { .len = sizeof(recipient_ids[i]), .ptr = recipient_ids[i] },
+            .common_id_context = PRE_ESTABLISHED.common_id_context,
+            .opt = PRE_ESTABLISHED.opt,
+        };
+        assert_no_error(oscore_add_context(peer));
+    }
+    // nothing is derived up front
+    oscore_get_context_stats(&stats);
+    assert_eq(stats.peers, OSCORE_MAX_CONTEXTS);
+    assert_eq(stats.derivations, 0);
+
+    struct coap_packet request;
+    struct coap_packet decrypted;
+    test_vector_request(PRE_ESTABLISHED.recipient_id, false, &request);
+    assert_no_error(from_oscore(request, &decrypted));
+    net_pkt_unref(decrypted.pkt);
+
+    // every other peer is derived once, which evicts the first one
+    for (size_t i = 1; i < OSCORE_MAX_CONTEXTS; i++) {
+        test_vector_request((array) { .len = sizeof(recipient_ids[i]), .ptr = recipient_ids[i] }, true, &request);
+        assert_actually(from_oscore(request, &decrypted) != OscoreNoError, "garbage decrypted");
+        net_pkt_unref(request.pkt);
+    }
+    oscore_get_context_stats(&stats);
+    assert_eq(stats.derivations, OSCORE_MAX_CONTEXTS);
+    assert_eq(stats.evictions, OSCORE_MAX_CONTEXTS - OSCORE_DERIVED_CONTEXTS);
+    assert_eq(stats.derived, OSCORE_DERIVED_CONTEXTS);
+
+    // derived again, with the replay window it had when it was evicted
+    test_vector_request(PRE_ESTABLISHED.recipient_id, false, &request);
+    assert_eq(from_oscore(request, &decrypted), OscoreReplayedPartialIv);
+    net_pkt_unref(request.pkt);
+    oscore_get_context_stats(&stats);
+    assert_eq(stats.derivations, OSCORE_MAX_CONTEXTS + 1);
+
+    assert_no_error(oscore_init(PRE_ESTABLISHED));
+    SYS_LOG_INF("test_lazy_contexts successful");
+}
+#endif
+
+#ifdef OSCORE_HOST
+/// Builds a locally sent message without options, like a response of the server
+static void test_build_message(u8_t type, u8_t code, u16_t id, struct coap_packet* out) {
+    u8_t token = (u8_t) id;
+    struct net_pkt* pkt;
+    assert_no_error(pkt_pool_get(false, K_NO_WAIT, &pkt));
+    assert_eq(coap_packet_init(out, pkt, 1, type, 1, &token, code, id), 0);
+}
+
+/// Builds a message like `test_build_message` and parses it like a received one
+static void test_received_message(u8_t type, u8_t code, u16_t id, struct coap_packet* out) {
+    struct coap_packet sent;
+    test_build_message(type, code, id, &sent);
+    test_receive(&sent, out);
+}
+
+/// Takes the next packet sent by a server module and returns its serialized length, or 0 if nothing was sent
+static u16_t test_take_sent(u8_t* out, size_t len) {
+    struct net_pkt* pkt = net_context_sent_get();
+    if (pkt == NULL) {
+        return 0;
+    }
+    // packets allocated for sending only contain the CoAP message
+    u16_t pos;
+    size_t message_len = net_pkt_get_len(pkt);
+    assert_actually(message_len <= len, "sent message too long");
+    net_frag_read(pkt->frags, 0, &pos, (u16_t) message_len, out);
+    assert_actually(pos != 0xffff, "read failed");
+    net_pkt_unref(pkt);
+    return (u16_t) message_len;
+}
+
+/// Builds the loopback address with the given port
+static struct sockaddr_in6 test_endpoint(u16_t port) {
+    struct sockaddr_in6 addr = { .sin6_family = AF_INET6, .sin6_addr = IN6ADDR_LOOPBACK_INIT, .sin6_port = port };
+    return addr;
+}
+
+void test_dedup() {
+    struct sockaddr_in6 client = test_endpoint(5683);
+    struct sockaddr_in6 other = test_endpoint(5684);
+    const struct sockaddr* from = (const struct sockaddr*) &client;
+    struct coap_packet request;
+    struct coap_packet response;
+    u8_t expected[16];
+    u8_t sent[16];
+    dedup_init();
+
+    // only piggybacked responses are kept, a duplicate is answered with the same bytes
+    test_build_message(COAP_TYPE_NON_CON, COAP_RESPONSE_CODE_CONTENT, 0x1233, &response);
+    assert_eq(dedup_add(&response, from), 0);
+    net_pkt_unref(response.pkt);
+    test_build_message(COAP_TYPE_ACK, COAP_RESPONSE_CODE_CONTENT, 0x1234, &response);
+    array message = { .len = coap_message_len(&response), .ptr = expected };
+    assert_no_error(read_coap_message(&response, message));
+    assert_eq(dedup_add(&response, from), 0);
+    net_pkt_unref(response.pkt);
+
+    test_received_message(COAP_TYPE_CON, COAP_METHOD_GET, 0x1234, &request);
+    assert_actually(dedup_replay(&request, from), "duplicate not detected");
+    assert_eq(test_take_sent(sent, sizeof(sent)), message.len);
+    assert_eq(memcmp(sent, expected, message.len), 0);
+    // the Message ID only identifies a request together with its endpoint
+    assert_actually(!dedup_replay(&request, (const struct sockaddr*) &other), "duplicate of another endpoint");
+    net_pkt_unref(request.pkt);
+    test_received_message(COAP_TYPE_CON, COAP_METHOD_GET, 0x1233, &request);
+    assert_actually(!dedup_replay(&request, from), "NON response replayed");
+    net_pkt_unref(request.pkt);
+    assert_eq(test_take_sent(sent, sizeof(sent)), 0);
+
+    // forgotten after EXCHANGE_LIFETIME
+    test_received_message(COAP_TYPE_CON, COAP_METHOD_GET, 0x1234, &request);
+    k_uptime_skip(COAP_EXCHANGE_LIFETIME_MS - 1000);
+    assert_actually(dedup_replay(&request, from), "forgotten before EXCHANGE_LIFETIME");
+    assert_eq(test_take_sent(sent, sizeof(sent)), message.len);
+    k_uptime_skip(1000);
+    assert_actually(!dedup_replay(&request, from), "replayed after EXCHANGE_LIFETIME");
+    assert_eq(test_take_sent(sent, sizeof(sent)), 0);
+    net_pkt_unref(request.pkt);
+    SYS_LOG_INF("test_dedup successful");
+}
+
+void test_block_sessions() {
+    struct coap_resource large = { 0 };
+    struct coap_resource other = { 0 };
+    struct sockaddr_in6 addrs[NUM_BLOCK_SESSIONS + 1];
+    for (u16_t i = 0; i < NUM_BLOCK_SESSIONS + 1; i++) {
+        addrs[i] = test_endpoint((u16_t) (5683 + i));
+    }
+    const struct sockaddr* a = (const struct sockaddr*) &addrs[0];
+    const struct sockaddr* b = (const struct sockaddr*) &addrs[1];
+    block_session_init();
+
+    // two clients fetching the same resource at the same time don't disturb each other
+    struct coap_block_context* ctx_a = block_session_get(a, &large);
+    assert_eq(ctx_a->current, 0);
+    ctx_a->block_size = COAP_BLOCK_64;
+    ctx_a->current = 64;
+    struct coap_block_context* ctx_b = block_session_get(b, &large);
+    assert_actually(ctx_b != ctx_a, "clients share a session");
+    assert_eq(ctx_b->current, 0);
+    ctx_b->current = 128;
+    assert_actually(block_session_get(a, &large) == ctx_a, "session not found");
+    assert_eq(ctx_a->current, 64);
+    assert_eq(block_session_get(b, &large)->current, 128);
+    assert_eq(block_session_get(a, &other)->current, 0);
+    block_session_end(ctx_a);
+    assert_eq(block_session_get(a, &large)->current, 0);
+
+    // a full table replaces the least recently used session
+    block_session_init();
+    for (int i = 0; i < NUM_BLOCK_SESSIONS; i++) {
+        block_session_get((const struct sockaddr*) &addrs[i], &large)->current = (size_t) i + 1;
+    }
+    assert_eq(block_session_get(a, &large)->current, 1);
+    assert_eq(block_session_get((const struct sockaddr*) &addrs[NUM_BLOCK_SESSIONS], &large)->current, 0);
+    assert_eq(block_session_get(a, &large)->current, 1);
+    for (int i = 2; i < NUM_BLOCK_SESSIONS; i++) {
+        assert_eq(block_session_get((const struct sockaddr*) &addrs[i], &large)->current, (size_t) i + 1);
+    }
+    assert_eq(block_session_get(b, &large)->current, 0);
+
+    // unfinished transfers are dropped after BLOCK_SESSION_TIMEOUT_MS
+    block_session_init();
+    block_session_get(a, &large)->current = 64;
+    k_uptime_skip(BLOCK_SESSION_TIMEOUT_MS - 1);
+    assert_eq(block_session_get(a, &large)->current, 64);
+    k_uptime_skip(BLOCK_SESSION_TIMEOUT_MS);
+    assert_eq(block_session_get(a, &large)->current, 0);
+    SYS_LOG_INF("test_block_sessions successful");
+}
+
+/// OSCORE Option of the requests of `test_outer_block`: Partial IV 1, kid 0x42
+static const u8_t test_outer_oscore[] = { 0x09, 0x01, 0x42 };
+
+/**
+ * Builds a received OSCORE request with an outer Block1 or Block2 Option.
+ * @param payload Payload or NULL
+ */
+static void test_outer_block_request(u16_t id, u16_t block_option, unsigned int block_value, const u8_t* payload,
+                                     u16_t len, struct coap_packet* out) {
+    u8_t token = (u8_t) id;
+    struct net_pkt* pkt;
+    struct coap_packet request;
+    assert_no_error(pkt_pool_get(false, K_NO_WAIT, &pkt));
+    assert_eq(coap_packet_init(&request, pkt, 1, COAP_TYPE_CON, 1, &token, COAP_METHOD_POST, id), 0);
+    assert_eq(coap_packet_append_option(&request, COAP_OPTION_OSCORE, test_outer_oscore, sizeof(test_outer_oscore)),
+              0);
+    assert_eq(coap_append_option_int(&request, block_option, block_value), 0);
+    if (payload != NULL) {
+        assert_eq(coap_packet_append_payload_marker(&request), 0);
+        assert_eq(coap_packet_append_payload(&request, (u8_t*) payload, len), 0);
+    }
+    test_receive(&request, out);
+}
+
+/// Takes the next sent packet and parses it like a received one
+static void test_take_sent_packet(struct coap_packet* out) {
+    u8_t bytes[256];
+    array message = { .len = test_take_sent(bytes, sizeof(bytes)), .ptr = bytes };
+    assert_actually(message.len > 0, "nothing sent");
+    test_receive_message(message, out);
+}
+
+/// Takes the next sent packet and returns its CoAP Code
+static u8_t test_take_sent_code() {
+    struct coap_packet sent;
+    test_take_sent_packet(&sent);
+    u8_t code = coap_header_get_code(&sent);
+    net_pkt_unref(sent.pkt);
+    return code;
+}
+
+/// Returns the value of an integer option of @a packet, or -1 if it has none
+static int test_option_int(struct coap_packet* packet, u16_t code) {
+    struct coap_option option;
+    if (coap_find_options(packet, code, &option, 1) != 1) {
+        return -1;
+    }
+    return (int) coap_option_value_to_int(&option);
+}
+
+/// Checks that the payload of @a packet equals @a expected
+static void test_expect_payload(struct coap_packet* packet, const u8_t* expected, u16_t len) {
+    u8_t bytes[OUTER_BLOCK_MAX_LEN];
+    struct payload_info info;
+    assert_no_error(get_payload_info(packet, &info));
+    assert_eq(info.len, len);
+    array payload = { .len = info.len, .ptr = bytes };
+    assert_no_error(read_payload(info, payload));
+    assert_eq(memcmp(bytes, expected, len), 0);
+}
+
+/// Sends the block with the given number and size of @a message, @return the result of `outer_block_reassemble`
+static int test_outer_block1(u16_t id, const u8_t* message, u16_t len, u32_t num, enum coap_block_size szx,
+                             const struct sockaddr* from, struct coap_packet* request) {
+    u16_t bytes = coap_block_size_to_bytes(szx);
+    u32_t offset = num * bytes;
+    bool more = offset + bytes < len;
+    test_outer_block_request(id, COAP_OPTION_BLOCK1, num << 4 | (more ? 0x08 : 0) | szx, &message[offset],
+                             more ? bytes : (u16_t) (len - offset), request);
+    return outer_block_reassemble(request, from);
+}
+
+/// Checks the next block sent for a fragmented response of @a message
+static void test_expect_block2(const u8_t* message, u16_t len, u32_t num, struct coap_packet* block) {
+    u16_t bytes = coap_block_size_to_bytes(OUTER_BLOCK_SZX);
+    u32_t offset = num * bytes;
+    bool more = offset + bytes < len;
+    assert_eq(coap_header_get_code(block), COAP_RESPONSE_CODE_CONTENT);
+    assert_eq(test_option_int(block, COAP_OPTION_BLOCK2), (int) (num << 4 | (more ? 0x08 : 0) | OUTER_BLOCK_SZX));
+    assert_eq(test_option_int(block, COAP_OPTION_SIZE2), num == 0 ? len : -1);
+    test_expect_payload(block, &message[offset], more ? bytes : (u16_t) (len - offset));
+}
+
+/// Protects nothing, but builds a response which looks like a protected one with a payload of @a len bytes
+static void test_outer_block_response(const u8_t* payload, u16_t len, struct coap_packet* out) {
+    u8_t token = 1;
+    struct net_pkt* pkt;
+    assert_no_error(pkt_pool_get(false, K_NO_WAIT, &pkt));
+    assert_eq(coap_packet_init(out, pkt, 1, COAP_TYPE_ACK, 1, &token, COAP_RESPONSE_CODE_CONTENT, 1), 0);
+    assert_eq(coap_packet_append_option(out, COAP_OPTION_OSCORE, NULL, 0), 0);
+    assert_eq(coap_packet_append_payload_marker(out), 0);
+    assert_eq(coap_packet_append_payload(out, (u8_t*) payload, len), 0);
+}
+
+void test_outer_block() {
+    struct sockaddr_in6 addrs[NUM_OUTER_BLOCK_BUFFERS + 1];
+    for (u16_t i = 0; i < NUM_OUTER_BLOCK_BUFFERS + 1; i++) {
+        addrs[i] = test_endpoint((u16_t) (5683 + i));
+    }
+    const struct sockaddr* from = (const struct sockaddr*) &addrs[0];
+    u8_t message[150];
+    for (u16_t i = 0; i < sizeof(message); i++) {
+        message[i] = (u8_t) i;
+    }
+    struct coap_packet request;
+    struct coap_packet response;
+    struct coap_packet block;
+    dedup_init();
+    outer_block_init();
+
+    // reassembly, every block but the last is answered with 2.31, also when it is retransmitted
+    assert_eq(test_outer_block1(1, message, sizeof(message), 0, COAP_BLOCK_64, from, &request), -EAGAIN);
+    net_pkt_unref(request.pkt);
+    assert_eq(test_take_sent_code(), COAP_RESPONSE_CODE_CONTINUE);
+    assert_eq(test_outer_block1(2, message, sizeof(message), 0, COAP_BLOCK_64, from, &request), -EAGAIN);
+    net_pkt_unref(request.pkt);
+    assert_eq(test_take_sent_code(), COAP_RESPONSE_CODE_CONTINUE);
+    assert_eq(test_outer_block1(3, message, sizeof(message), 1, COAP_BLOCK_64, from, &request), -EAGAIN);
+    net_pkt_unref(request.pkt);
+    assert_eq(test_take_sent_code(), COAP_RESPONSE_CODE_CONTINUE);
+    assert_eq(test_outer_block1(4, message, sizeof(message), 2, COAP_BLOCK_64, from, &request), 0);
+    assert_eq(test_option_int(&request, COAP_OPTION_BLOCK1), -1);
+    struct coap_option oscore;
+    assert_eq(coap_find_options(&request, COAP_OPTION_OSCORE, &oscore, 1), 1);
+    test_expect_payload(&request, message, sizeof(message));
+    net_pkt_unref(request.pkt);
+    assert_eq(test_take_sent(NULL, 0), 0);
+
+    // a block out of order ends the transfer with 4.08
+    assert_eq(test_outer_block1(5, message, sizeof(message), 0, COAP_BLOCK_64, from, &request), -EAGAIN);
+    net_pkt_unref(request.pkt);
+    assert_eq(test_take_sent_code(), COAP_RESPONSE_CODE_CONTINUE);
+    assert_eq(test_outer_block1(6, message, sizeof(message), 2, COAP_BLOCK_64, from, &request), -EINVAL);
+    net_pkt_unref(request.pkt);
+    assert_eq(test_take_sent_code(), COAP_RESPONSE_CODE_INCOMPLETE);
+    assert_eq(test_outer_block1(7, message, sizeof(message), 1, COAP_BLOCK_64, from, &request), -EINVAL);
+    net_pkt_unref(request.pkt);
+    assert_eq(test_take_sent_code(), COAP_RESPONSE_CODE_INCOMPLETE);
+
+    // a fragmented response is served block by block, without decrypting the requests for further blocks
+    test_outer_block_request(8, COAP_OPTION_BLOCK2, 0, NULL, 0, &request);
+    test_outer_block_response(message, sizeof(message), &response);
+    assert_eq(outer_block_split(&response, &request, from, &block), 0);
+    assert_actually(block.pkt != response.pkt, "response not fragmented");
+    net_pkt_unref(request.pkt);
+    test_receive(&block, &response);
+    test_expect_block2(message, sizeof(message), 0, &response);
+    net_pkt_unref(response.pkt);
+    for (u32_t num = 1; num < 3; num++) {
+        test_outer_block_request((u16_t) (8 + num), COAP_OPTION_BLOCK2, num << 4 | OUTER_BLOCK_SZX, NULL, 0,
+                                 &request);
+        assert_actually(outer_block_serve(&request, from), "block not served");
+        net_pkt_unref(request.pkt);
+        test_take_sent_packet(&block);
+        test_expect_block2(message, sizeof(message), num, &block);
+        net_pkt_unref(block.pkt);
+    }
+    // the buffer is released after the last block, its retransmission is answered from the dedup cache
+    test_outer_block_request(10, COAP_OPTION_BLOCK2, 2 << 4 | OUTER_BLOCK_SZX, NULL, 0, &request);
+    assert_actually(!outer_block_serve(&request, from), "released buffer served");
+    assert_actually(dedup_replay(&request, from), "last block not cached");
+    net_pkt_unref(request.pkt);
+    test_take_sent_packet(&block);
+    test_expect_block2(message, sizeof(message), 2, &block);
+    net_pkt_unref(block.pkt);
+
+    // larger blocks than OUTER_BLOCK_SZX are asked for by their offset
+    test_outer_block_request(11, COAP_OPTION_BLOCK2, 0, NULL, 0, &request);
+    test_outer_block_response(message, sizeof(message), &response);
+    assert_eq(outer_block_split(&response, &request, from, &block), 0);
+    net_pkt_unref(request.pkt);
+    net_pkt_unref(block.pkt);
+    test_outer_block_request(12, COAP_OPTION_BLOCK2, 1 << 4 | (OUTER_BLOCK_SZX + 1), NULL, 0, &request);
+    assert_actually(outer_block_serve(&request, from), "block not served");
+    net_pkt_unref(request.pkt);
+    test_take_sent_packet(&block);
+    test_expect_block2(message, sizeof(message), 2, &block);
+    net_pkt_unref(block.pkt);
+
+    // running transfers are never replaced, a full pool rejects new ones until the old ones time out
+    for (int i = 0; i < NUM_OUTER_BLOCK_BUFFERS; i++) {
+        assert_eq(test_outer_block1((u16_t) (13 + i), message, sizeof(message), 0, COAP_BLOCK_64,
+                                    (const struct sockaddr*) &addrs[i], &request), -EAGAIN);
+        net_pkt_unref(request.pkt);
+        assert_eq(test_take_sent_code(), COAP_RESPONSE_CODE_CONTINUE);
+    }
+    const struct sockaddr* last = (const struct sockaddr*) &addrs[NUM_OUTER_BLOCK_BUFFERS];
+    assert_eq(test_outer_block1(20, message, sizeof(message), 0, COAP_BLOCK_64, last, &request), -ENOMEM);
+    net_pkt_unref(request.pkt);
+    assert_eq(test_take_sent_code(), COAP_RESPONSE_CODE_SERVICE_UNAVAILABLE);
+    test_outer_block_request(21, COAP_OPTION_BLOCK2, 0, NULL, 0, &request);
+    test_outer_block_response(message, sizeof(message), &response);
+    assert_eq(outer_block_split(&response, &request, last, &block), 0);
+    assert_actually(block.pkt == response.pkt, "response fragmented without a buffer");
+    net_pkt_unref(request.pkt);
+    net_pkt_unref(response.pkt);
+    k_uptime_skip(OUTER_BLOCK_TIMEOUT_MS);
+    assert_eq(test_outer_block1(22, message, sizeof(message), 0, COAP_BLOCK_64, last, &request), -EAGAIN);
+    net_pkt_unref(request.pkt);
+    assert_eq(test_take_sent_code(), COAP_RESPONSE_CODE_CONTINUE);
+    SYS_LOG_INF("test_outer_block successful");
+}
+
+void test_rate_limit() {
+    u8_t kid[] = { 0x42 };
+    struct sockaddr_in6 addrs[3] = { test_endpoint(5683), test_endpoint(5683), test_endpoint(5683) };
+    addrs[1].sin6_addr.s6_addr[0] = 0xfe;
+    addrs[2].sin6_addr.s6_addr[0] = 0xfd;
+    const struct sockaddr* source = (const struct sockaddr*) &addrs[0];
+    const struct sockaddr* peer = (const struct sockaddr*) &addrs[1];
+    const struct sockaddr* other = (const struct sockaddr*) &addrs[2];
+    // time for one token at the full rate
+    s32_t token_ms = 1000 / RATE_LIMIT_RATE;
+    struct rate_limit_stats before;
+    struct rate_limit_stats after;
+    rate_limit_init();
+    // the counters are never reset
+    rate_limit_get_stats(&before);
+
+    // a burst, then one request per token
+    for (int i = 0; i < RATE_LIMIT_BURST; i++) {
+        assert_actually(rate_limit_allow(source, kid, sizeof(kid)), "burst throttled");
+    }
+    assert_actually(!rate_limit_allow(source, kid, sizeof(kid)), "burst too long");
+    k_uptime_skip(token_ms);
+    assert_actually(rate_limit_allow(source, kid, sizeof(kid)), "not refilled");
+    assert_actually(!rate_limit_allow(source, kid, sizeof(kid)), "refilled too much");
+
+    // a failed decryption halves the rate of the source address, a successful one restores it
+    rate_limit_report(source, kid, sizeof(kid), OscoreTinyCryptError);
+    k_uptime_skip(token_ms);
+    assert_actually(!rate_limit_allow(source, kid, sizeof(kid)), "rate not halved");
+    k_uptime_skip(token_ms);
+    assert_actually(rate_limit_allow(source, kid, sizeof(kid)), "halved rate not refilled");
+    rate_limit_report(source, kid, sizeof(kid), OscoreNoError);
+    k_uptime_skip(token_ms);
+    assert_actually(rate_limit_allow(source, kid, sizeof(kid)), "rate not restored");
+
+    // only verified requests take tokens from the kid, which then throttles every source address
+    for (int i = 0; i < RATE_LIMIT_BURST; i++) {
+        rate_limit_report(peer, kid, sizeof(kid), OscoreTinyCryptError);
+    }
+    assert_actually(rate_limit_allow(other, kid, sizeof(kid)), "kid throttled by failed decryptions");
+    for (int i = 0; i < RATE_LIMIT_BURST; i++) {
+        rate_limit_report(other, kid, sizeof(kid), OscoreNoError);
+    }
+    assert_actually(!rate_limit_allow(other, kid, sizeof(kid)), "kid not throttled");
+
+    rate_limit_get_stats(&after);
+    assert_eq(after.throttled_source - before.throttled_source, 3);
+    assert_eq(after.throttled_kid - before.throttled_kid, 1);
+    assert_eq(after.failures - before.failures, 1 + RATE_LIMIT_BURST);
+    SYS_LOG_INF("test_rate_limit successful");
+}
+#endif
+
+#ifdef OSCORE_TRACE
+void test_trace_ring() {
+    static struct trace_event events[TRACE_RING_SIZE + 1];
+    for (size_t i = 0; i < TRACE_RING_SIZE + 6; i++) {
+        trace(TraceReceived, -(int) i, i);
+    }
+
+    // the oldest records were overwritten, the newest come last
+    assert_eq(trace_dump(events, 4), 4);
+    assert_eq(events[3].len, TRACE_RING_SIZE + 5);
+    assert_eq(events[3].error, -(TRACE_RING_SIZE + 5));
+    assert_eq(events[0].len, TRACE_RING_SIZE + 2);
+    assert_eq(trace_dump(events, TRACE_RING_SIZE + 1), TRACE_RING_SIZE);
+    assert_eq(events[0].len, 6);
+    assert_eq(events[0].stage, TraceReceived);
+    assert_eq((u8_t) (events[1].seq - events[0].seq), 1);
+    SYS_LOG_INF("test_trace_ring successful");
+}
+#endif
+
+#ifdef OSCORE_PROFILE
+void test_profile_histogram() {
+    struct profile_stats stats;
+    profile_get(ProfileProtectCcm, &stats);
+    assert_eq(stats.count, 0);
+
+    // 99 fast measurements and one outlier, which is above the 99th percentile
+    for (u32_t i = 0; i < 99; i++) {
+        profile_record(ProfileProtectCcm, 1000 + i);
+    }
+    profile_record(ProfileProtectCcm, 100000);
+    profile_get(ProfileProtectCcm, &stats);
+    assert_eq(stats.count, 100);
+    assert_eq(stats.min, 1000);
+    assert_eq(stats.max, 100000);
+    assert_eq(stats.avg, (99 * 1000 + 98 * 99 / 2 + 100000) / 100);
+    // 1000..1098 are in the bucket [1024, 2048) or below
+    assert_eq(stats.p99, 2047);
+    SYS_LOG_INF("test_profile_histogram successful");
+}
+#endif
@@ -22,5 +22,57 @@ void test_derive_sender_key();
 void test_derive_recipient_key();
 /// draft-ietf-core-object-security-14: Test Vector 1: Key Derivation with Master Salt: Server
 void test_derive_common_iv();
+/// RFC8613 Test Vector 4: OSCORE Request, Client: encrypted and decrypted in chunks
+void test_aes_ccm_stream();
+/// Expiry order, cascading and canceling of the retransmission timer wheel
+void test_timer_wheel();
+/// Encoding of the empty OSCORE Option of a response reusing the request's nonce, and length of a fresh one
+void test_response_option_savings();
+/// Matching of responses to pipelined client requests by their token
+void test_exchange_table();
+/// Sliding replay window with out of order Partial IVs
+void test_replay_window();
+/// Allocation, release and exhaustion of the per-thread scratch arena
+void test_scratch_arena();
+/// Exhausting the OSCORE TX pool, which counts failed allocations and keeps the high-water mark
+void test_pkt_pool();
+/// Encoding of the Class E options of a message interleaved with Class U options
+void test_class_e_option_encoding();
+/// Caching of response plaintexts per client, with the remaining lifetime as Max-Age
+void test_response_cache();
+/// Dropping requests with a bad kid, Partial IV or payload, or a replayed Partial IV, counted per reason
+void test_prefilter_drops();
+/// Adding security contexts of further peers, up to OSCORE_MAX_CONTEXTS and with IDs of up to OSCORE_MAX_ID_LEN bytes
+void test_security_contexts();
+/// Restoring security contexts from a snapshot, falling back to derivation, and rejection of modified snapshots
+void test_context_snapshot();
+/// Recovery of an unknown replay window with an Echo challenge (RFC8613 B.1.2), which rejects older requests
+void test_echo_recovery();
+/// Refusal to send beyond the sequence numbers reserved by the last snapshot, and after restoring it
+void test_sequence_reservation();
+#ifdef OSCORE_LAZY_CONTEXTS
+/// Derivation on first use and eviction of security contexts, which keeps their replay window
+void test_lazy_contexts();
+#endif
+/// Encoding of a locally built CoAP message, identical for Zephyr's CoAP library and the host port
+void test_coap_message_layout();
+#ifdef OSCORE_HOST
+/// Answering duplicate confirmable requests from the dedup cache until EXCHANGE_LIFETIME has passed
+void test_dedup();
+/// Keeping block-wise transfers of several clients apart, replacing the least recently used and dropping old ones
+void test_block_sessions();
+/// Reassembling requests and fragmenting responses with outer Block Options, and the limits of the buffer pool
+void test_outer_block();
+/// Token buckets per source address and kid, with the rate of a source halved after each failed decryption
+void test_rate_limit();
+#endif
+#ifdef OSCORE_TRACE
+/// Overwriting and dumping of the trace ring buffer
+void test_trace_ring();
+#endif
+#ifdef OSCORE_PROFILE
+/// Minimum, average, maximum and 99th percentile of a cycle count histogram
+void test_profile_histogram();
+#endif
 
 #endif //NONE_TESTS_H
@@ -23,10 +23,10 @@ typedef struct array {
 } array;
 
 /// Empty Array with len=0 but with a non-null pointer.
-array EMPTY_ARRAY;
+extern array EMPTY_ARRAY;
 
 /// Null Array with len=0 and a null pointer.
-array NULL_ARRAY;
+extern array NULL_ARRAY;
 
 /**
  * Compares if the given two arrays have an equal content.
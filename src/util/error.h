@@ -39,6 +39,7 @@ typedef enum OscoreError {
     OscoreKidContextError = 265,
     OscoreInvalidOutLength = 266,
     OscorePayloadNoPayloadMarker = 267,
+    OscoreReplayedPartialIv = 268,
 
     OscoreUriHttpParserError = 512,
     OscoreUriInvalidProtocol = 513,
@@ -54,8 +55,18 @@ typedef enum OscoreError {
     OscoreInvalidVersion = 771,
     OscoreInvalidType = 772,
     OscoreInvalidTokenLength = 773,
+    OscoreTooManyOptions = 774,
 
     OscorePktError = 1024,
+    OscoreTooManyExchanges = 1025,
+    OscoreTokenInUse = 1026,
+    OscoreUnknownExchange = 1027,
+    OscoreScratchExhausted = 1028,
+    OscoreTooManyContexts = 1029,
+    OscoreInvalidSnapshot = 1030,
+    OscoreEchoRequired = 1031,
+    OscoreSequenceExhausted = 1032,
+    OscoreStorageError = 1033,
 } OscoreError;
 
 /// Logs a message prepended with the filename and line at warn level
@@ -65,18 +76,18 @@ typedef enum OscoreError {
 
 /// Try a TinyCrypt operation, returning from the function with OscoreTinyCryptError if it errored.
 #define try_tc(e) do {\
-    int res = (e);\
-    if (res != TC_CRYPTO_SUCCESS) {\
-        warn("Error during TinyCrypt execution: %d", res);\
+    int try_res = (e);\
+    if (try_res != TC_CRYPTO_SUCCESS) {\
+        warn("Error during TinyCrypt execution: %d", try_res);\
         return OscoreTinyCryptError;\
     }\
 } while (0)
 
 /// Try a TinyCbor operation, returning from the function with OscoreCborError if it errored.
 #define try_cbor(e) do {\
-    int res = (e);\
-    if (res != CborNoError) {\
-        warn("Error during TinyCbor execution: %d", res);\
+    int try_res = (e);\
+    if (try_res != CborNoError) {\
+        warn("Error during TinyCbor execution: %d", try_res);\
         return OscoreCborError;\
     }\
 } while (0)
@@ -87,9 +98,9 @@ typedef enum OscoreError {
  * This is useful for getting an encoded buffer's length before allocating it and encoding into it.
  */
 #define try_cbor_oom(e) do {\
-    int res = (e);\
-    if (res != CborErrorOutOfMemory) {\
-        warn("Error during TinyCbor execution, expected CborErrorOurOfMemory, got %d", res);\
+    int try_res = (e);\
+    if (try_res != CborErrorOutOfMemory) {\
+        warn("Error during TinyCbor execution, expected CborErrorOurOfMemory, got %d", try_res);\
         return OscoreCborError;\
     }\
 } while (0)
@@ -99,9 +110,9 @@ typedef enum OscoreError {
  * returned a nonzero value.
  */
 #define try_http_parser(e) do {\
-    int res = (e);\
-    if (res != 0) {\
-        warn("Error during http_parser: %d", res);\
+    int try_res = (e);\
+    if (try_res != 0) {\
+        warn("Error during http_parser: %d", try_res);\
         return OscoreUriHttpParserError;\
     }\
 } while (0)
@@ -109,13 +120,14 @@ typedef enum OscoreError {
 /**
  * Try an operation returning an `OscoreError`.
  *
- * Propagates error case up to the callee.
+ * Propagates error case up to the callee. The local is named `try_res`, so `try(res)` doesn't initialize it with
+ * itself.
  */
 #define try(e) do {\
-    int res = (e);\
-    if (res != OscoreNoError) {\
-        warn("Error during execution: %d", res);\
-        return res;\
+    int try_res = (e);\
+    if (try_res != OscoreNoError) {\
+        warn("Error during execution: %d", try_res);\
+        return try_res;\
     }\
 } while (0)
 
@@ -137,10 +149,17 @@ typedef enum OscoreError {
     ensure_internal((left == right), "(%d == %d)", error, left, right);\
 } while (0)
 
+// the host build aborts, so tests and harnesses terminate
+#ifdef OSCORE_PANIC_ABORT
+#define panic_halt() abort()
+#else
+#define panic_halt() while (1) {}
+#endif
+
 /// Log an error message and start spinning afterwards.
 #define panic(msg, ...) do {\
     err(msg ", spinning...", ##__VA_ARGS__);\
-    while (1) {}\
+    panic_halt();\
 } while (0)
 
 // the provided assert is a noop
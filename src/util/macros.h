@@ -39,7 +39,12 @@
 /// Try an oscore operation, logging a message, unrefing `pkt` and returning in case of error.
 #define try_oscore_void(e) try_oscore(e, )
 
-/// Logs the bytes of an array with given message, data-pointer and length in hex.
+#ifdef OSCORE_LOG_HEX
+/**
+ * Logs the bytes of an array with given message, data-pointer and length in hex.
+ *
+ * This formats every message on the hot path, so it's only compiled in if `OSCORE_LOG_HEX` is defined.
+ */
 #define log_hex(msg, data, len) do {\
     char buf[len * 3 + 1];\
     int i = 0;\
@@ -49,5 +54,8 @@
     buf[i*3] = 0;\
     SYS_LOG_INF(msg " (%d bytes): %s", len, buf);\
 } while (0)
+#else
+#define log_hex(msg, data, len) do {} while (0)
+#endif
 
 #endif //NONE_MACROS_H
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <string.h>
+#include <kernel.h>
+#include <misc/util.h>
+#include "profile.h"
+
+/// One bucket per power of two of cycles
+#define PROFILE_BUCKETS 32
+
+static const char* const stage_names[NUM_PROFILE_STAGES] = {
+    [ProfileUnprotect] = "unprotect",
+    [ProfileUnprotectOptions] = "unprotect.options",
+    [ProfileUnprotectNonce] = "unprotect.nonce",
+    [ProfileUnprotectAad] = "unprotect.aad",
+    [ProfileUnprotectCcm] = "unprotect.ccm",
+    [ProfileUnprotectRebuild] = "unprotect.rebuild",
+    [ProfileProtect] = "protect",
+    [ProfileProtectEncode] = "protect.encode",
+    [ProfileProtectNonce] = "protect.nonce",
+    [ProfileProtectAad] = "protect.aad",
+    [ProfileProtectRebuild] = "protect.rebuild",
+    [ProfileProtectCcm] = "protect.ccm",
+};
+
+const char* profile_stage_name(u8_t stage) {
+    return stage < NUM_PROFILE_STAGES ? stage_names[stage] : "unknown";
+}
+
+#ifdef OSCORE_PROFILE
+
+struct histogram {
+    u32_t count;
+    u32_t min;
+    u32_t max;
+    u64_t sum;
+    /// bucket i counts measurements in [2^i, 2^(i+1)), bucket 0 also contains 0
+    u32_t buckets[PROFILE_BUCKETS];
+};
+
+static struct histogram histograms[NUM_PROFILE_STAGES];
+
+void profile_record(u8_t stage, u32_t cycles) {
+    if (stage >= NUM_PROFILE_STAGES) {
+        return;
+    }
+    struct histogram* h = &histograms[stage];
+    if (h->count == 0 || cycles < h->min) {
+        h->min = cycles;
+    }
+    if (cycles > h->max) {
+        h->max = cycles;
+    }
+    h->count++;
+    h->sum += cycles;
+    u8_t bucket = cycles == 0 ? 0 : (u8_t) (31 - __builtin_clz(cycles));
+    h->buckets[bucket]++;
+}
+
+void profile_get(u8_t stage, struct profile_stats* out) {
+    memset(out, 0, sizeof(*out));
+    if (stage >= NUM_PROFILE_STAGES || histograms[stage].count == 0) {
+        return;
+    }
+    struct histogram* h = &histograms[stage];
+    out->count = h->count;
+    out->min = h->min;
+    out->max = h->max;
+    out->avg = (u32_t) (h->sum / h->count);
+
+    // the bucket in which the cumulative count reaches 99%
+    u64_t threshold = ((u64_t) h->count * 99 + 99) / 100;
+    u64_t seen = 0;
+    for (u8_t i = 0; i < PROFILE_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= threshold) {
+            out->p99 = i == PROFILE_BUCKETS - 1 ? 0xffffffff : (u32_t) ((2ull << i) - 1);
+            break;
+        }
+    }
+    // the bucket bound can't be larger than the largest measurement
+    out->p99 = min(out->p99, out->max);
+}
+
+#else
+
+void profile_get(u8_t stage, struct profile_stats* out) {
+    memset(out, 0, sizeof(*out));
+}
+
+#endif //OSCORE_PROFILE
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_PROFILE_H
+#define NONE_PROFILE_H
+
+#include <kernel.h>
+#include <zephyr/types.h>
+
+// Cycle count histograms of the stages of protecting and unprotecting a message, read with GET /oscore/stats.
+// Only compiled in if `OSCORE_PROFILE` is defined, otherwise `profile_begin` and `profile_end` expand to nothing.
+
+/// Measured stages, every stage has its own histogram
+enum profile_stage {
+    /// whole `from_oscore`
+    ProfileUnprotect = 0,
+    /// reading the outer options
+    ProfileUnprotectOptions,
+    /// decoding the OSCORE Option and creating the nonce
+    ProfileUnprotectNonce,
+    /// reading the ciphertext and encoding the AAD
+    ProfileUnprotectAad,
+    /// Enc_structure and AES-CCM decryption
+    ProfileUnprotectCcm,
+    /// decoding the Class E options and building the decrypted packet
+    ProfileUnprotectRebuild,
+    /// protecting an encoded plaintext, without `ProfileProtectEncode`
+    ProfileProtect,
+    /// encoding the plaintext with `oscore_inner_encode`
+    ProfileProtectEncode,
+    /// creating the nonce
+    ProfileProtectNonce,
+    /// encoding the AAD and Enc_structure and starting the AES-CCM MAC
+    ProfileProtectAad,
+    /// building the outer header and options of the OSCORE packet
+    ProfileProtectRebuild,
+    /// AES-CCM encryption of the plaintext and appending the tag
+    ProfileProtectCcm,
+    NUM_PROFILE_STAGES,
+};
+
+/// Summary of the histogram of a stage, all values in cycles of `k_cycle_get_32`
+struct profile_stats {
+    u32_t count;
+    u32_t min;
+    u32_t avg;
+    u32_t max;
+    /// upper bound of the power of two bucket containing the 99th percentile
+    u32_t p99;
+};
+
+#ifdef OSCORE_PROFILE
+/// Declares @a var and starts measuring with it
+#define profile_begin(var) u32_t var = k_cycle_get_32()
+/// Adds the cycles since the last measurement with @a var to the histogram of @a stage and restarts it
+#define profile_end(stage, var) do {\
+    u32_t now = k_cycle_get_32();\
+    profile_record((stage), now - (var));\
+    (var) = now;\
+} while (0)
+#else
+#define profile_begin(var)
+#define profile_end(stage, var) do {} while (0)
+#endif
+
+/**
+ * Adds a measurement to the histogram of @a stage. Use `profile_end` instead, which is removed if profiling is
+ * disabled. Not locked, concurrent measurements of the same stage might get lost.
+ * @param stage `enum profile_stage`
+ * @param cycles Cycles spent in the stage
+ */
+void profile_record(u8_t stage, u32_t cycles);
+
+/**
+ * Summarizes the histogram of a stage.
+ * @param stage `enum profile_stage`
+ * @param out out-pointer to write the summary into, all zero if nothing was measured
+ */
+void profile_get(u8_t stage, struct profile_stats* out);
+
+/**
+ * Returns a short name of a stage, e.g. "unprotect.aad".
+ * @param stage `enum profile_stage`
+ * @return name
+ */
+const char* profile_stage_name(u8_t stage);
+
+#endif //NONE_PROFILE_H
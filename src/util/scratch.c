@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <kernel.h>
+#include <misc/util.h>
+#include "scratch.h"
+
+struct scratch_arena {
+    /// thread which claimed the arena, NULL if unused
+    k_tid_t owner;
+    size_t used;
+    u8_t buffer[SCRATCH_SIZE] __aligned(8);
+};
+
+static struct scratch_arena arenas[NUM_SCRATCH_ARENAS];
+static u32_t high_water;
+static u32_t failures;
+
+/// Finds the arena of the calling thread, claiming a free one on its first call
+static struct scratch_arena* current_arena(void) {
+    k_tid_t self = k_current_get();
+    for (int i = 0; i < NUM_SCRATCH_ARENAS; i++) {
+        if (arenas[i].owner == self) {
+            return &arenas[i];
+        }
+    }
+    struct scratch_arena* arena = NULL;
+    unsigned int key = irq_lock();
+    for (int i = 0; i < NUM_SCRATCH_ARENAS; i++) {
+        if (arenas[i].owner == NULL) {
+            arena = &arenas[i];
+            arena->owner = self;
+            arena->used = 0;
+            break;
+        }
+    }
+    irq_unlock(key);
+    return arena;
+}
+
+void* scratch_alloc(size_t len) {
+    struct scratch_arena* arena = current_arena();
+    size_t aligned = ROUND_UP(len, 8);
+    if (arena == NULL || aligned > SCRATCH_SIZE - arena->used) {
+        failures++;
+        return NULL;
+    }
+    void* ptr = &arena->buffer[arena->used];
+    arena->used += aligned;
+    // only a hint, concurrent threads might skip a maximum
+    high_water = max(high_water, arena->used);
+    return ptr;
+}
+
+size_t scratch_mark(void) {
+    struct scratch_arena* arena = current_arena();
+    return arena != NULL ? arena->used : 0;
+}
+
+void scratch_release(size_t mark) {
+    struct scratch_arena* arena = current_arena();
+    if (arena != NULL && mark <= arena->used) {
+        arena->used = mark;
+    }
+}
+
+void scratch_detach(void) {
+    k_tid_t self = k_current_get();
+    unsigned int key = irq_lock();
+    for (int i = 0; i < NUM_SCRATCH_ARENAS; i++) {
+        if (arenas[i].owner == self) {
+            arenas[i].owner = NULL;
+        }
+    }
+    irq_unlock(key);
+}
+
+void scratch_get_stats(struct scratch_stats* out) {
+    out->high_water = high_water;
+    out->failures = failures;
+}
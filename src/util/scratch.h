@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_SCRATCH_H
+#define NONE_SCRATCH_H
+
+#include <stddef.h>
+#include <zephyr/types.h>
+
+// Buffers whose size depends on the message (ciphertext, plaintext, AAD, Enc_structure, ...) are taken from a fixed
+// arena of the calling thread instead of the stack, so the stack usage of the OSCORE path doesn't grow with the
+// message size. Allocations are released in bulk with `scratch_release`, usually when an OSCORE function returns.
+
+/// Size of the arena of each thread, enough for ciphertext and plaintext of a reassembled 1024 byte message
+#ifndef SCRATCH_SIZE
+#define SCRATCH_SIZE 2304
+#endif
+/// Number of threads which may use the OSCORE functions: RX thread, system work queue and one client thread
+#ifndef NUM_SCRATCH_ARENAS
+#define NUM_SCRATCH_ARENAS 3
+#endif
+
+/// Usage of the arenas
+struct scratch_stats {
+    /// maximum number of bytes used by any thread at the same time
+    u32_t high_water;
+    /// allocations which didn't fit into the arena or found no free arena
+    u32_t failures;
+};
+
+/**
+ * Allocates @a len bytes from the arena of the calling thread. The first call of a thread claims a free arena.
+ * @param len Number of bytes, can be 0
+ * @return 8-byte aligned memory or NULL if the arena is exhausted
+ */
+void* scratch_alloc(size_t len);
+
+/**
+ * Returns the current position in the arena of the calling thread.
+ * @return mark to pass to `scratch_release`
+ */
+size_t scratch_mark(void);
+
+/**
+ * Frees everything allocated after @a mark was taken by the calling thread.
+ * @param mark Value returned by `scratch_mark`
+ */
+void scratch_release(size_t mark);
+
+/**
+ * Gives the arena of the calling thread back, e.g. before a worker thread exits, so another thread can claim it.
+ * Nothing allocated by the thread may be used afterwards.
+ */
+void scratch_detach(void);
+
+/**
+ * Copies the usage of the arenas.
+ * @param out out-pointer to write the statistics into
+ */
+void scratch_get_stats(struct scratch_stats* out);
+
+#endif //NONE_SCRATCH_H
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include "timer_wheel.h"
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+void timer_wheel_init(struct timer_wheel* wheel) {
+    wheel->now = 0;
+    wheel->count = 0;
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+            sys_dlist_init(&wheel->slots[level][slot]);
+        }
+    }
+}
+
+/**
+ * Puts the timer into the slot corresponding to its expiry relative to the current tick.
+ * @param wheel Timer wheel
+ * @param entry Timer with its expiry set, which is not part of any slot.
+ */
+static void place(struct timer_wheel* wheel, struct timer_wheel_entry* entry) {
+    u32_t delta = entry->expiry - wheel->now;
+    int level = 0;
+    // find the lowest level which still covers the delta
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1u << (TIMER_WHEEL_SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+    u32_t slot = (entry->expiry >> (TIMER_WHEEL_SLOT_BITS * level)) & SLOT_MASK;
+    sys_dlist_append(&wheel->slots[level][slot], &entry->node);
+}
+
+void timer_wheel_insert(struct timer_wheel* wheel, struct timer_wheel_entry* entry, u32_t ticks) {
+    timer_wheel_cancel(wheel, entry);
+    if (ticks == 0) {
+        ticks = 1;
+    } else if (ticks > TIMER_WHEEL_MAX_TICKS) {
+        ticks = TIMER_WHEEL_MAX_TICKS;
+    }
+    entry->expiry = wheel->now + ticks;
+    entry->scheduled = true;
+    place(wheel, entry);
+    wheel->count++;
+}
+
+void timer_wheel_cancel(struct timer_wheel* wheel, struct timer_wheel_entry* entry) {
+    if (!entry->scheduled) {
+        return;
+    }
+    sys_dlist_remove(&entry->node);
+    entry->scheduled = false;
+    wheel->count--;
+}
+
+/**
+ * Moves all timers of a slot of a higher level down to the lower levels.
+ * @param wheel Timer wheel
+ * @param level Level of the slot to cascade
+ */
+static void cascade(struct timer_wheel* wheel, int level) {
+    u32_t slot = (wheel->now >> (TIMER_WHEEL_SLOT_BITS * level)) & SLOT_MASK;
+    sys_dlist_t* list = &wheel->slots[level][slot];
+    sys_dnode_t* node;
+    while ((node = sys_dlist_get(list)) != NULL) {
+        place(wheel, CONTAINER_OF(node, struct timer_wheel_entry, node));
+    }
+}
+
+void timer_wheel_tick(struct timer_wheel* wheel, sys_dlist_t* expired) {
+    wheel->now++;
+    // cascade from the highest level which wrapped around, so the timers end up in level 0 eventually
+    for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+        if ((wheel->now & ((1u << (TIMER_WHEEL_SLOT_BITS * level)) - 1)) == 0) {
+            cascade(wheel, level);
+        }
+    }
+    sys_dlist_t* list = &wheel->slots[0][wheel->now & SLOT_MASK];
+    sys_dnode_t* node;
+    while ((node = sys_dlist_get(list)) != NULL) {
+        struct timer_wheel_entry* entry = CONTAINER_OF(node, struct timer_wheel_entry, node);
+        entry->scheduled = false;
+        wheel->count--;
+        sys_dlist_append(expired, node);
+    }
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_TIMER_WHEEL_H
+#define NONE_TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include <misc/dlist.h>
+
+/// log2 of the number of slots per level
+#define TIMER_WHEEL_SLOT_BITS 6
+/// Number of slots per level
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+/// Number of levels. Timeouts of up to TIMER_WHEEL_SLOTS^TIMER_WHEEL_LEVELS - 1 ticks can be scheduled.
+#define TIMER_WHEEL_LEVELS 2
+/// Longest timeout in ticks which can be scheduled
+#define TIMER_WHEEL_MAX_TICKS ((1 << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS)) - 1)
+
+/// Timer which is embedded into the struct that should be scheduled.
+struct timer_wheel_entry {
+    sys_dnode_t node;
+    /// absolute tick at which the timer expires
+    u32_t expiry;
+    bool scheduled;
+};
+
+/**
+ * Hierarchical timer wheel.
+ *
+ * Level 0 has one slot per tick, every slot of level 1 covers TIMER_WHEEL_SLOTS ticks.
+ * Whenever level 0 wraps around, the next slot of level 1 is cascaded down into level 0.
+ * Scheduling, canceling and expiring a timer are O(1).
+ */
+struct timer_wheel {
+    /// current tick
+    u32_t now;
+    /// number of scheduled timers
+    u32_t count;
+    sys_dlist_t slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+};
+
+/**
+ * Initializes an empty timer wheel.
+ * @param wheel Timer wheel to initialize
+ */
+void timer_wheel_init(struct timer_wheel* wheel);
+
+/**
+ * Schedules a timer. If the timer is already scheduled, it is rescheduled.
+ * @param wheel Timer wheel
+ * @param entry Timer to schedule
+ * @param ticks Number of ticks from now after which the timer expires. Is clamped to [1, TIMER_WHEEL_MAX_TICKS].
+ */
+void timer_wheel_insert(struct timer_wheel* wheel, struct timer_wheel_entry* entry, u32_t ticks);
+
+/**
+ * Cancels a scheduled timer. Does nothing if the timer isn't scheduled.
+ * @param wheel Timer wheel
+ * @param entry Timer to cancel
+ */
+void timer_wheel_cancel(struct timer_wheel* wheel, struct timer_wheel_entry* entry);
+
+/**
+ * Advances the timer wheel by one tick and moves all timers expiring at the new tick into @a expired.
+ * @param wheel Timer wheel
+ * @param expired Initialized list to append the expired timers to. They are no longer scheduled.
+ */
+void timer_wheel_tick(struct timer_wheel* wheel, sys_dlist_t* expired);
+
+#endif //NONE_TIMER_WHEEL_H
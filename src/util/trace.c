@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#include <kernel.h>
+#include <misc/util.h>
+#include "trace.h"
+
+#ifdef OSCORE_TRACE
+
+struct trace_slot {
+    /// sequence number + 1 of the record in this slot, 0 while it is written
+    volatile u32_t seq;
+    struct trace_event event;
+};
+
+static struct trace_slot ring[TRACE_RING_SIZE];
+/// sequence number of the next record
+static atomic_t next_seq;
+
+void trace_record(u8_t stage, int error, size_t len) {
+    u32_t seq = (u32_t) atomic_inc(&next_seq);
+    struct trace_slot* slot = &ring[seq & (TRACE_RING_SIZE - 1)];
+    slot->seq = 0;
+    __sync_synchronize();
+    slot->event.cycles = k_cycle_get_32();
+    slot->event.error = (s16_t) error;
+    slot->event.len = (u16_t) min(len, 0xffff);
+    slot->event.stage = stage;
+    slot->event.seq = (u8_t) seq;
+    __sync_synchronize();
+    slot->seq = seq + 1;
+}
+
+size_t trace_dump(struct trace_event* out, size_t max_events) {
+    u32_t end = (u32_t) atomic_get(&next_seq);
+    u32_t count = min(min(end, TRACE_RING_SIZE), max_events);
+    size_t written = 0;
+    for (u32_t seq = end - count; seq != end; seq++) {
+        struct trace_slot* slot = &ring[seq & (TRACE_RING_SIZE - 1)];
+        // a writer might overwrite the slot while it is copied, so check that the sequence number didn't change
+        if (slot->seq != seq + 1) {
+            continue;
+        }
+        __sync_synchronize();
+        out[written] = slot->event;
+        __sync_synchronize();
+        if (slot->seq == seq + 1) {
+            written++;
+        }
+    }
+    return written;
+}
+
+#endif //OSCORE_TRACE
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2019 Fraunhofer AISEC. See the COPYRIGHT
+ * file at the top-level directory of this distribution.
+ *
+ * Licensed under the Apache License, Version 2.0 <LICENSE-APACHE or
+ * http://www.apache.org/licenses/LICENSE-2.0> or the MIT license
+ * <LICENSE-MIT or http://opensource.org/licenses/MIT>, at your
+ * option. This file may not be copied, modified, or distributed
+ * except according to those terms.
+ */
+
+#ifndef NONE_TRACE_H
+#define NONE_TRACE_H
+
+#include <stddef.h>
+#include <zephyr/types.h>
+
+// Tracing of the message path. Instead of formatting log strings for every message, `trace` writes a fixed-size
+// binary record into a ring buffer, which is read out with `trace_dump` (GET /oscore/trace).
+// Tracing is only compiled in if `OSCORE_TRACE` is defined, e.g. with
+// `target_compile_definitions(app PRIVATE OSCORE_TRACE)` in CMakeLists.txt. Otherwise `trace` expands to nothing.
+
+/// Number of records kept, must be a power of two
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE 64
+#endif
+
+/// Point of the message path a record was written at
+enum trace_stage {
+    /// a datagram was received, len is its length
+    TraceReceived = 1,
+    /// the request was dropped by `oscore_prefilter`, error is the reason
+    TracePrefiltered = 2,
+    /// the request was dropped by the rate limiter
+    TraceRateLimited = 3,
+    /// a request was decrypted, len is the length of the received datagram
+    TraceUnprotected = 4,
+    /// a response was encrypted, len is the plaintext length
+    TraceProtected = 5,
+    /// a response is handed to the network stack, len is its length
+    TraceSent = 6,
+};
+
+/**
+ * A trace record as returned by `trace_dump`, 12 bytes in the byte order of the device.
+ */
+struct trace_event {
+    /// `k_cycle_get_32` when the record was written
+    u32_t cycles;
+    /// OscoreError or negative errno, depending on the stage
+    s16_t error;
+    u16_t len;
+    /// `enum trace_stage`
+    u8_t stage;
+    /// lowest byte of the record's sequence number, gaps show overwritten records
+    u8_t seq;
+    u8_t reserved[2];
+};
+
+#ifdef OSCORE_TRACE
+/// Records an event of @a stage with an error code and a length
+#define trace(stage, error, len) trace_record((stage), (error), (len))
+#else
+#define trace(stage, error, len) do {} while (0)
+#endif
+
+/**
+ * Writes a record into the ring buffer, overwriting the oldest one. It doesn't lock and can be called from any thread.
+ * Use the `trace` macro instead, which is removed if tracing is disabled.
+ * @param stage `enum trace_stage`
+ * @param error Error code
+ * @param len Length
+ */
+void trace_record(u8_t stage, int error, size_t len);
+
+/**
+ * Copies the newest complete records, oldest first. Records which are overwritten during the copy are skipped.
+ * @param out Buffer for the records
+ * @param max_events Number of records @a out has room for
+ * @return number of records written into @a out
+ */
+size_t trace_dump(struct trace_event* out, size_t max_events);
+
+#endif //NONE_TRACE_H